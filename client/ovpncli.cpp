@@ -59,9 +59,6 @@
 // force null tun device (useful for testing)
 //#define OPENVPN_FORCE_TUN_NULL
 
-// log cleartext tunnel packets to file for debugging/analysis
-//#define OPENVPN_PACKET_LOG "pkt.log"
-
 #ifndef OPENVPN_LOG
 // log thread settings
 #define OPENVPN_LOG_CLASS openvpn::ClientAPI::LogReceiver
@@ -89,6 +86,7 @@
 #include <openvpn/error/excode.hpp>
 #include <openvpn/crypto/selftest.hpp>
 #include <openvpn/client/clievent.hpp>
+#include <openvpn/client/clieventqueue.hpp>
 
 // copyright
 #include <openvpn/legal/copyright.hpp>
@@ -198,7 +196,10 @@ namespace openvpn {
                 ClientEvent::AppCustomControlMessage *accm = static_cast<ClientEvent::AppCustomControlMessage *>(event.get());
                 ev.protocol = accm->protocol;
                 ev.payload = accm->custommessage;
-                parent->acc_event(ev);
+                if (async_queue)
+                    push(ClientEvent::CUSTOM_CONTROL, std::move(ev.protocol), std::move(ev.payload), false, false);
+                else
+                    parent->acc_event(ev);
             }
             else
             {
@@ -209,16 +210,25 @@ namespace openvpn {
                 ev.fatal = event->is_fatal();
 
                 // save connected event
-                if (event->id() == ClientEvent::CONNECTED)
+                const ClientEvent::Type id = event->id();
+                if (id == ClientEvent::CONNECTED)
                     last_connected = std::move(event);
-                else if (event->id() == ClientEvent::DISCONNECTED)
+                else if (id == ClientEvent::DISCONNECTED)
                     parent->on_disconnect();
 
-                parent->event(ev);
+                if (async_queue)
+                    push(id, std::move(ev.name), std::move(ev.info), ev.error, ev.fatal);
+                else
+                    parent->event(ev);
             }
         }
     }
 
+    void set_async_queue(ClientEvent::AsyncQueue::Ptr queue)
+    {
+        async_queue = std::move(queue);
+    }
+
       void get_connection_info(ConnectionInfo& ci)
       {
 	ClientEvent::Base::Ptr connected = last_connected;
@@ -256,8 +266,21 @@ namespace openvpn {
       }
 
     private:
+      void push(const ClientEvent::Type id, std::string name, std::string info, const bool error, const bool fatal)
+      {
+        ClientEvent::AsyncQueue::Item item;
+        item.id = id;
+        item.name = std::move(name);
+        item.info = std::move(info);
+        item.error = error;
+        item.fatal = fatal;
+        if (!async_queue->push(std::move(item)))
+          OPENVPN_LOG("event queue full, dropped " << ClientEvent::event_name(id));
+      }
+
       OpenVPNClient* parent;
       ClientEvent::Base::Ptr last_connected;
+      ClientEvent::AsyncQueue::Ptr async_queue;
     };
 
 class MySocketProtect : public SocketProtect
@@ -294,6 +317,41 @@ class MySocketProtect : public SocketProtect
 	  return true;
       }
 
+    void socket_protect_batch(RequestList &requests) override
+    {
+#if defined(OPENVPN_COMMAND_AGENT) && (defined(OPENVPN_PLATFORM_WIN) || defined(OPENVPN_PLATFORM_MAC))
+        SocketProtect::socket_protect_batch(requests);
+#else
+        OpenVPNClient *p = parent;
+        if (!p)
+        {
+            for (auto &r : requests)
+                r.result = true;
+            return;
+        }
+
+        std::vector<SocketProtectRequest> api_requests;
+        api_requests.reserve(requests.size());
+        for (const auto &r : requests)
+        {
+            SocketProtectRequest req;
+            req.socket = r.socket;
+            req.remote = r.endpoint.to_string();
+            req.ipv6 = r.endpoint.is_ipv6();
+            api_requests.push_back(std::move(req));
+        }
+        p->socket_protect_batch(api_requests);
+        for (size_t i = 0; i < requests.size(); ++i)
+            requests[i].result = api_requests[i].result;
+#endif
+    }
+
+    bool socket_protect_async() const override
+    {
+        OpenVPNClient *p = parent;
+        return p && p->socket_protect_async();
+    }
+
       void detach_from_parent()
       {
 	parent = nullptr;
@@ -443,6 +501,7 @@ class MySocketProtect : public SocketProtect
 	ClientCreds::Ptr creds;
 	MySessionStats::Ptr stats;
 	MyClientEvents::Ptr events;
+	ClientEvent::AsyncQueue::Ptr event_queue;
 	ClientConnect::Ptr session;
 	std::unique_ptr<MyClockTick> clock_tick;
 
@@ -491,6 +550,8 @@ class MySocketProtect : public SocketProtect
 
 	  // client events
 	  events.reset(new CLIENT_EVENTS(parent));
+	  if (event_queue)
+	    events->set_async_queue(event_queue);
 
 	  // socket protect
 	  socket_protect.set_parent(parent);
@@ -778,6 +839,14 @@ class MySocketProtect : public SocketProtect
             if(config.tcpQueueLimit > 0)
                 state->tcp_queue_limit = config.tcpQueueLimit;
 
+            if (config.cpuAccounting)
+                state->stats->cpu_accounting_enable();
+
+            // created here rather than in connect() so that the
+            // application's delivery thread may start before connect()
+            if (config.asyncEvents && !state->event_queue)
+                state->event_queue.reset(new ClientEvent::AsyncQueue(config.asyncEventQueueSize));
+
             state->ncp_disable = config.disableNCP;
 
             if (!config.compressionMode.empty())
@@ -917,6 +986,17 @@ class MySocketProtect : public SocketProtect
         return true;
     }
 
+    OPENVPN_CLIENT_EXPORT void OpenVPNClient::socket_protect_batch(std::vector<SocketProtectRequest> &requests)
+    {
+        for (auto &r : requests)
+            r.result = socket_protect(r.socket, r.remote, r.ipv6);
+    }
+
+    OPENVPN_CLIENT_EXPORT bool OpenVPNClient::socket_protect_async()
+    {
+        return false;
+    }
+
     OPENVPN_CLIENT_EXPORT bool OpenVPNClientHelper::parse_dynamic_challenge(const std::string &cookie, DynamicChallenge &dc)
     {
     try
@@ -1354,6 +1434,12 @@ OPENVPN_CLIENT_EXPORT bool OpenVPNClient::sign(const std::string &alias,
     {
       TransportStats ret;
       ret.lastPacketReceived = -1; // undefined
+      ret.cpuCryptoUsec = 0;
+      ret.cpuCompressUsec = 0;
+      ret.cpuIoUsec = 0;
+      ret.cpuControlUsec = 0;
+      ret.cpuPerGB = -1.0;
+      ret.cpuPerHandshake = -1.0;
 
       if (state->is_foreign_thread_access())
 	{
@@ -1377,6 +1463,17 @@ OPENVPN_CLIENT_EXPORT bool OpenVPNClient::sign(const std::string &alias,
 		      ret.lastPacketReceived = delta;
 		  }
 	      }
+
+	      // CPU accounting
+	      if (const CPUAccounting *acct = stats->cpu_accounting())
+		{
+		  ret.cpuCryptoUsec = acct->stage_ns(CPUAccounting::CRYPTO) / 1000;
+		  ret.cpuCompressUsec = acct->stage_ns(CPUAccounting::COMPRESS) / 1000;
+		  ret.cpuIoUsec = acct->stage_ns(CPUAccounting::IO) / 1000;
+		  ret.cpuControlUsec = acct->stage_ns(CPUAccounting::CONTROL) / 1000;
+		  ret.cpuPerGB = stats->cpu_per_gb();
+		  ret.cpuPerHandshake = stats->cpu_per_handshake();
+		}
 	      return ret;
 	    }
 	}
@@ -1444,6 +1541,80 @@ OPENVPN_CLIENT_EXPORT bool OpenVPNClient::sign(const std::string &alias,
         }
     }
 
+    OPENVPN_CLIENT_EXPORT bool OpenVPNClient::start_packet_capture(const std::string &path, int snaplen)
+    {
+        if (state->is_foreign_thread_access())
+        {
+            ClientConnect *session = state->session.get();
+            if (session)
+            {
+                PcapRing::Config config;
+                config.path = path;
+                if (snaplen > 0)
+                    config.snaplen = snaplen;
+                session->thread_safe_start_packet_capture(std::move(config));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    OPENVPN_CLIENT_EXPORT void OpenVPNClient::stop_packet_capture()
+    {
+        if (state->is_foreign_thread_access())
+        {
+            ClientConnect *session = state->session.get();
+            if (session)
+                session->thread_safe_stop_packet_capture();
+        }
+    }
+
+    OPENVPN_CLIENT_EXPORT int OpenVPNClient::deliver_events(int timeout_ms)
+    {
+        ClientEvent::AsyncQueue *queue = state->event_queue.get();
+        if (!queue)
+            return -1;
+        auto deliver = [this](ClientEvent::AsyncQueue::Item &item)
+        {
+            if (item.id == ClientEvent::CUSTOM_CONTROL)
+            {
+                AppCustomControlMessageEvent ev;
+                ev.protocol = std::move(item.name);
+                ev.payload = std::move(item.info);
+                acc_event(ev);
+            }
+            else
+            {
+                Event ev;
+                ev.name = std::move(item.name);
+                ev.info = std::move(item.info);
+                ev.error = item.error;
+                ev.fatal = item.fatal;
+                event(ev);
+            }
+        };
+        const size_t n = queue->drain(deliver, std::chrono::milliseconds(std::max(timeout_ms, 0)));
+        return static_cast<int>(n);
+    }
+
+    OPENVPN_CLIENT_EXPORT EventQueueStats OpenVPNClient::event_queue_stats() const
+    {
+        EventQueueStats ret = {};
+        const ClientEvent::AsyncQueue *queue = state->event_queue.get();
+        if (queue)
+        {
+            const ClientEvent::AsyncQueue::Stats s = queue->stats();
+            ret.queued = s.queued;
+            ret.delivered = s.delivered;
+            ret.coalesced = s.coalesced;
+            ret.dropped = s.dropped;
+            ret.lastLagUsec = s.last_lag;
+            ret.maxLagUsec = s.max_lag;
+            ret.meanLagUsec = s.mean_lag;
+        }
+        return ret;
+    }
+
     static SSLLib::SSLAPI::Config::Ptr setup_certcheck_ssl_config(const std::string &client_cert,
                                                                   const std::string &extra_certs,
                                                                   const std::optional<const std::string> &ca)
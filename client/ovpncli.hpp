@@ -350,6 +350,19 @@ struct ConfigCommon
       // Set to 0 to disable.
       unsigned int clockTickMS = 0;
 
+      // Queue events and custom control messages instead of calling
+      // event() and acc_event() from the thread executing connect().
+      // The application then delivers them from its own thread with
+      // deliver_events(), so that a slow handler cannot stall the
+      // session.  Redundant transitional events such as repeated
+      // RECONNECTING are collapsed into the newest one.
+      bool asyncEvents = false;
+
+      // Capacity of the asyncEvents queue, rounded up to a power of two.
+      // While the queue is full, events are dropped and counted, except
+      // DISCONNECTED and fatal errors, which are always delivered.
+      unsigned int asyncEventQueueSize = 256;
+
       // Gremlin configuration (requires that the core is built with OPENVPN_GREMLIN)
       std::string gremlinConfig;
 
@@ -375,6 +388,56 @@ struct ConfigCommon
     // with all tun builder properties pushed by server.
     // Currently only implemented on Linux.
     bool generateTunBuilderCaptureEvent = false;
+
+    // Use io_uring for UDP transport and tun I/O, if supported
+    // by the kernel.  Falls back to the default I/O otherwise.
+    // Currently only implemented on Linux.
+    bool ioUring = false;
+
+    // With a TCP transport, schedule tunnel packets with FQ-CoDel
+    // instead of dropping them once tcpQueueLimit packets are queued,
+    // to keep interactive flows responsive during bulk transfers.
+    bool tcpQueueAqm = false;
+
+    // With a UDP transport, count the datagrams the kernel drops for
+    // lack of receive buffer space in the UDP_RECV_DROPS statistic,
+    // where the platform reports them (Linux).  This receives with
+    // recvmsg() to read the drop counter.
+    bool udpDropMonitor = false;
+
+    // With a UDP transport, grow the socket buffers up to this many
+    // bytes when the kernel drops datagrams for lack of buffer space,
+    // or 0 to leave them at the system default.  Implies udpDropMonitor.
+    int udpSockBufMax = 0;
+
+    // Once connected, keep a second session to the next remote entry
+    // handshaked and idle, and fail over to it when the active session
+    // is lost.  Only used with more than one remote entry over direct
+    // UDP or TCP transports.  The standby connection is routed like any
+    // other traffic, so with redirect-gateway it needs socket protection.
+    bool warmStandby = false;
+
+    // While a UDP remote entry is being tried, open a spare connection
+    // to the next TCP remote entry, so that a fallback to TCP starts on
+    // an already-connected socket.  The spare connection is closed once
+    // a session connects.  Only used with direct UDP or TCP transports.
+    bool tcpPrewarm = false;
+
+    // Answer repeated queries to the pushed DNS servers from a local
+    // cache of their responses, instead of sending them through the
+    // tunnel.  Only used with servers reached over plain UDP port 53.
+    // Hits and misses are counted in the DNS_CACHE_HITS and
+    // DNS_CACHE_MISSES statistics.
+    bool dnsCache = false;
+
+    // Capture the headers of tun and transport packets into this pcapng
+    // file from the start of the session.  The capture can also be
+    // started and stopped at runtime with start_packet_capture() and
+    // stop_packet_capture().
+    std::string packetCapture;
+
+    // Bytes captured per packet, or 0 for the default of 128
+    int packetCaptureSnaplen = 0;
 };
 
 // OpenVPN config-file/profile. Includes a few settings that we do not just
@@ -410,6 +473,10 @@ struct Config : public ConfigCommon
     // TCP queue limit in packets, or 0 for default 64 packets
     unsigned int tcpQueueLimit = 64;
 
+    // Sample thread CPU time spent in crypto, compression, i/o and
+    // control handling, reported by transport_stats()
+    bool cpuAccounting = false;
+
     // If true, disable negotiable crypto parameters
     bool disableNCP = false;
 
@@ -503,6 +570,15 @@ struct LogReceiver
     virtual ~LogReceiver() = default;
 };
 
+// used to request protection of several sockets in one call
+struct SocketProtectRequest
+{
+    openvpn_io::detail::socket_type socket; // (client reads)
+    std::string remote;                     // remote host the socket will connect to (client reads)
+    bool ipv6 = false;                      // (client reads)
+    bool result = false;                    // true if socket was protected (client writes)
+};
+
 // used to pass stats for an interface
 struct InterfaceStats
 {
@@ -525,6 +601,33 @@ struct TransportStats
     // number of binary milliseconds (1/1024th of a second) since
     // last packet was received, or -1 if undefined
     int lastPacketReceived;
+
+    // estimated CPU time in microseconds per data-path stage,
+    // only defined if Config::cpuAccounting is enabled
+    long long cpuCryptoUsec;
+    long long cpuCompressUsec;
+    long long cpuIoUsec;
+    long long cpuControlUsec;
+
+    // CPU seconds per GB of transport traffic and per TLS
+    // handshake, or -1 if undefined
+    double cpuPerGB;
+    double cpuPerHandshake;
+};
+
+// used to pass stats of the asyncEvents queue
+struct EventQueueStats
+{
+    long long queued;    // events added to the queue
+    long long delivered; // events passed to event() or acc_event()
+    long long coalesced; // events replaced by a newer one of the same type
+    long long dropped;   // events lost because the queue was full
+
+    // time from queueing to delivery in microseconds, for the
+    // last delivered event, the maximum and the mean
+    long long lastLagUsec;
+    long long maxLagUsec;
+    long long meanLagUsec;
 };
 
 // return value of merge_config methods
@@ -677,6 +780,17 @@ class OpenVPNClientHelper
     // The remote and ipv6 are the remote host this socket will connect to
     virtual bool socket_protect(openvpn_io::detail::socket_type socket, std::string remote, bool ipv6);
 
+    // Callback to "protect" several sockets at once.  The default
+    // implementation calls socket_protect() for each request.
+    // Override to avoid one expensive up-call per socket.
+    virtual void socket_protect_batch(std::vector<SocketProtectRequest> &requests);
+
+    // Return true to have socket_protect() and socket_protect_batch()
+    // called from a worker thread instead of the thread executing
+    // connect().  The connection attempt then proceeds once the call
+    // returns, without blocking the network thread.
+    virtual bool socket_protect_async();
+
       // Primary VPN client connect method, doesn't return until disconnect.
       // Should be called by a worker thread.  This method will make callbacks
       // to event() and log() functions.  Make sure to call eval_config()
@@ -743,6 +857,29 @@ class OpenVPNClientHelper
     // send custom app control channel message
     void send_app_control_channel_msg(const std::string &protocol, const std::string &msg);
 
+    // Start capturing the headers of tun and transport packets into a
+    // pcapng file, rotated at 64 MB, replacing any capture in progress.
+    // snaplen is the number of bytes kept per packet, or 0 for the
+    // default.  Returns false if there is no session.  The capture is
+    // started asynchronously, and a file that cannot be opened is
+    // logged.
+    bool start_packet_capture(const std::string &path, int snaplen);
+
+    // Stop a capture started by start_packet_capture() or the
+    // packetCapture config setting
+    void stop_packet_capture();
+
+    // With Config::asyncEvents, deliver queued events by calling event()
+    // and acc_event() from the calling thread, waiting up to timeout_ms
+    // for the first one.  Must be called by one thread at a time, and may
+    // keep being called after connect() returns to collect the final
+    // events.  Returns the number of events delivered, or -1 if
+    // asyncEvents is not enabled.
+    int deliver_events(int timeout_ms);
+
+    // return stats of the asyncEvents queue
+    EventQueueStats event_queue_stats() const;
+
     /**
       @brief Start up the cert check handshake using the given certs and key
       @param client_cert String containing the properly encoded client certificate
@@ -769,7 +906,8 @@ class OpenVPNClientHelper
     void start_cert_check_epki(const std::string &alias, const std::optional<const std::string> &ca);
 
     // Callback for delivering events during connect() call.
-    // Will be called from the thread executing connect().
+    // Will be called from the thread executing connect(), or
+    // from deliver_events() if Config::asyncEvents is enabled.
     // Will also deliver custom message from the server like AUTH_PENDING AUTH
     // events and custom control message events
     virtual void event(const Event &) = 0;
@@ -43,6 +43,7 @@
 %rename(ClientAPI_LogInfo) LogInfo;
 %rename(ClientAPI_InterfaceStats) InterfaceStats;
 %rename(ClientAPI_TransportStats) TransportStats;
+%rename(ClientAPI_SocketProtectRequest) SocketProtectRequest;
 %rename(ClientAPI_MergeConfig) MergeConfig;
 %rename(ClientAPI_ExternalPKIRequestBase) ExternalPKIRequestBase;
 %rename(ClientAPI_ExternalPKICertRequest) ExternalPKICertRequest;
@@ -54,6 +55,7 @@ namespace std {
   %template(ClientAPI_ServerEntryVector) vector<openvpn::ClientAPI::ServerEntry>;
   %template(ClientAPI_LLVector) vector<long long>;
   %template(ClientAPI_StringVec) vector<string>;
+  %template(ClientAPI_SocketProtectRequestVector) vector<openvpn::ClientAPI::SocketProtectRequest>;
 };
 %template(DnsOptions_AddressList) std::vector<openvpn::DnsAddress>;
 %template(DnsOptions_DomainsList) std::vector<openvpn::DnsDomain>;
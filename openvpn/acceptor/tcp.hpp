@@ -48,10 +48,15 @@ struct TCP : public Base
         // start at (1<<24) to avoid conflicting with SSLConst flags
         DISABLE_REUSE_ADDR = (1 << 24),
         REUSE_PORT = (1 << 25),
+        DEFER_ACCEPT = (1 << 26), // Linux only, ignored elsewhere
+        FASTOPEN = (1 << 27),     // ignored where TCP_FASTOPEN is unavailable
 
         FIRST = DISABLE_REUSE_ADDR
     };
-    void set_socket_options(unsigned int flags)
+    // must be called before listen()
+    void set_socket_options(unsigned int flags,
+                            const int defer_accept_seconds = 10,
+                            const int fastopen_qlen = 256)
     {
         static_assert(int(FIRST) > int(SSLConst::LAST), "TCP flags in conflict with SSL flags");
 
@@ -67,6 +72,14 @@ struct TCP : public Base
                 SockOpt::reuseport(fd);
             if (!(flags & DISABLE_REUSE_ADDR))
                 SockOpt::reuseaddr(fd);
+#ifdef TCP_DEFER_ACCEPT
+            if (flags & DEFER_ACCEPT)
+                SockOpt::tcp_defer_accept(fd, defer_accept_seconds);
+#endif
+#ifdef TCP_FASTOPEN
+            if (flags & FASTOPEN)
+                SockOpt::tcp_fastopen(fd, fastopen_qlen);
+#endif
             SockOpt::set_cloexec(fd);
         }
 #endif
@@ -75,7 +88,7 @@ struct TCP : public Base
     // filter all but socket option flags
     static unsigned int sockopt_flags(const unsigned int flags)
     {
-        return flags & (DISABLE_REUSE_ADDR | REUSE_PORT);
+        return flags & (DISABLE_REUSE_ADDR | REUSE_PORT | DEFER_ACCEPT | FASTOPEN);
     }
 
     openvpn_io::ip::tcp::endpoint local_endpoint;
@@ -50,7 +50,8 @@ class CipherContext
     enum
     {
         MAX_IV_LENGTH = 16,
-        CIPH_CBC_MODE = 0
+        CIPH_CBC_MODE = 0,
+        SUPPORTS_IN_PLACE = 0 // out must not alias in
     };
 
     CipherContext()
@@ -0,0 +1,186 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Recycling memory for the state asio allocates for each async operation.
+//
+// Handlers passed through AsioArena::bind() carry an associated allocator
+// that takes the operation state from a per-object free list of
+// fixed-size blocks instead of the heap.  Blocks are allocated on first
+// use and kept until the arena is destroyed, so once an object has as
+// many blocks as it has operations in flight, steady-state packet I/O
+// performs no heap allocations for handler memory.
+//
+// An arena is not thread-safe: all operations bound to it must run on
+// the same single-threaded io_context, as the I/O objects owning an
+// arena do.  The arena must outlive the operations bound to it, which
+// holds when the handler keeps a reference to the owning object.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace openvpn {
+
+class AsioArena
+{
+  public:
+    enum
+    {
+        BLOCK_BYTES = 256, // larger requests fall back to the heap
+    };
+
+    // Counters for tests and profiling
+    struct Stats
+    {
+        size_t allocs = 0;      // requests served
+        size_t heap_allocs = 0; // requests that allocated from the heap
+    };
+
+    template <typename T>
+    class Allocator
+    {
+      public:
+        typedef T value_type;
+
+        explicit Allocator(AsioArena &arena_arg) noexcept
+            : arena(&arena_arg)
+        {
+        }
+
+        template <typename U>
+        Allocator(const Allocator<U> &other) noexcept
+            : arena(other.arena)
+        {
+        }
+
+        T *allocate(const size_t n)
+        {
+            return static_cast<T *>(arena->allocate(sizeof(T) * n));
+        }
+
+        void deallocate(T *p, const size_t n) noexcept
+        {
+            arena->deallocate(p, sizeof(T) * n);
+        }
+
+        template <typename U>
+        bool operator==(const Allocator<U> &other) const noexcept
+        {
+            return arena == other.arena;
+        }
+
+        template <typename U>
+        bool operator!=(const Allocator<U> &other) const noexcept
+        {
+            return arena != other.arena;
+        }
+
+      private:
+        template <typename U>
+        friend class Allocator;
+
+        AsioArena *arena;
+    };
+
+    // Completion handler wrapper that associates the arena
+    template <typename Handler>
+    class Bound
+    {
+      public:
+        typedef Allocator<void> allocator_type;
+
+        Bound(AsioArena &arena_arg, Handler handler_arg)
+            : arena(&arena_arg),
+              handler(std::move(handler_arg))
+        {
+        }
+
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_type(*arena);
+        }
+
+        template <typename... Args>
+        void operator()(Args &&...args)
+        {
+            handler(std::forward<Args>(args)...);
+        }
+
+      private:
+        AsioArena *arena;
+        Handler handler;
+    };
+
+    AsioArena() = default;
+    AsioArena(const AsioArena &) = delete;
+    AsioArena &operator=(const AsioArena &) = delete;
+
+    ~AsioArena()
+    {
+        while (free_list)
+        {
+            Block *b = free_list;
+            free_list = b->next;
+            ::operator delete(b);
+        }
+    }
+
+    template <typename Handler>
+    Bound<typename std::decay<Handler>::type> bind(Handler &&handler)
+    {
+        return Bound<typename std::decay<Handler>::type>(*this, std::forward<Handler>(handler));
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    void *allocate(const size_t size)
+    {
+        ++stats_.allocs;
+        if (size <= BLOCK_BYTES && free_list)
+        {
+            Block *b = free_list;
+            free_list = b->next;
+            return b;
+        }
+        ++stats_.heap_allocs;
+        return ::operator new(size <= BLOCK_BYTES ? size_t(BLOCK_BYTES) : size);
+    }
+
+    void deallocate(void *p, const size_t size) noexcept
+    {
+        if (size <= BLOCK_BYTES)
+        {
+            Block *b = static_cast<Block *>(p);
+            b->next = free_list;
+            free_list = b;
+        }
+        else
+            ::operator delete(p);
+    }
+
+  private:
+    union Block
+    {
+        Block *next;
+        alignas(std::max_align_t) unsigned char data[BLOCK_BYTES];
+    };
+
+    Block *free_list = nullptr;
+    Stats stats_;
+};
+
+} // namespace openvpn
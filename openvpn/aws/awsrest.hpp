@@ -16,13 +16,19 @@
 #include <string>
 #include <vector>
 #include <cstdint> // for std::uint8_t
+#include <cstring> // for std::memset, std::memcmp
 #include <algorithm>
 #include <utility>
+#include <mutex>
 #include <time.h>
 
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/hexstr.hpp>
+#include <openvpn/common/count.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/bufstr.hpp>
 #include <openvpn/http/urlencode.hpp>
+#include <openvpn/http/parseutil.hpp>
 #include <openvpn/crypto/digestapi.hpp>
 #include <openvpn/aws/awscreds.hpp>
 
@@ -52,6 +58,16 @@ class REST
             return render_hex(hash, sizeof(hash));
         }
 
+        // append the lower case hex rendering to buf
+        void append_hex(Buffer &buf) const
+        {
+            for (const std::uint8_t b : hash)
+            {
+                const RenderHexByte h(b);
+                buf.write(h.str2(), 2);
+            }
+        }
+
         std::uint8_t hash[32];
     };
 
@@ -73,6 +89,15 @@ class REST
         return ret;
     }
 
+    static SHA256 hmac_sha256(DigestFactory &digest_factory, const Buffer &data, const SHA256 &key)
+    {
+        SHA256 ret;
+        HMACInstance::Ptr hi(digest_factory.new_hmac(CryptoAlgs::SHA256, key.hash, sizeof(key.hash)));
+        hi->update(data.c_data(), data.size());
+        hi->final(ret.hash);
+        return ret;
+    }
+
     static SHA256 sha256(DigestFactory &digest_factory, const std::string &data)
     {
         SHA256 ret;
@@ -82,6 +107,15 @@ class REST
         return ret;
     }
 
+    static SHA256 sha256(DigestFactory &digest_factory, const Buffer &data)
+    {
+        SHA256 ret;
+        DigestInstance::Ptr di(digest_factory.new_digest(CryptoAlgs::SHA256));
+        di->update(data.c_data(), data.size());
+        di->final(ret.hash);
+        return ret;
+    }
+
     static SHA256 signing_key(DigestFactory &df,
                               const std::string &key,
                               const std::string &date_stamp,
@@ -95,6 +129,139 @@ class REST
         return h4;
     }
 
+    // The derived signing key only depends on the secret key, the day,
+    // the region and the service, so it is computed once per day rather
+    // than with four HMACs on every request.  The secret key itself is
+    // not kept: entries are looked up by its SHA256.  Keys for other
+    // days, or for another secret key after the credentials changed,
+    // are evicted when a new one is added, and evicted entries are
+    // zeroed.
+    class SigningKeyCache
+    {
+      public:
+        struct Stats
+        {
+            count_t hits = 0;
+            count_t misses = 0;
+        };
+
+        static SigningKeyCache &global()
+        {
+            static SigningKeyCache cache;
+            return cache;
+        }
+
+        SHA256 get(DigestFactory &df,
+                   const std::string &key,
+                   const std::string &date_stamp,
+                   const std::string &region_name,
+                   const std::string &service_name)
+        {
+            Entry entry;
+            entry.key_hash = sha256(df, key);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const auto &e : entries)
+                {
+                    if (e.date_stamp == date_stamp
+                        && e.region_name == region_name
+                        && e.service_name == service_name
+                        && e.same_key(entry))
+                    {
+                        ++stats_.hits;
+                        return e.signing_key;
+                    }
+                }
+                ++stats_.misses;
+            }
+
+            entry.date_stamp = date_stamp;
+            entry.region_name = region_name;
+            entry.service_name = service_name;
+            entry.signing_key = signing_key(df, key, date_stamp, region_name, service_name);
+            const SHA256 ret = entry.signing_key;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.erase(std::remove_if(entries.begin(),
+                                         entries.end(),
+                                         [&entry](const Entry &e)
+                                         { return e.date_stamp != entry.date_stamp || !e.same_key(entry); }),
+                          entries.end());
+            if (entries.size() >= max_entries)
+                entries.erase(entries.begin());
+            entries.push_back(std::move(entry));
+            return ret;
+        }
+
+        Stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats_;
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries.size();
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            stats_ = Stats();
+        }
+
+      private:
+        static constexpr size_t max_entries = 16;
+
+        struct Entry
+        {
+            Entry() = default;
+            Entry(const Entry &) = default;
+            Entry(Entry &&) = default;
+            Entry &operator=(const Entry &) = default;
+            Entry &operator=(Entry &&) = default;
+
+            ~Entry()
+            {
+                std::memset(key_hash.hash, 0, sizeof(key_hash.hash));
+                std::memset(signing_key.hash, 0, sizeof(signing_key.hash));
+            }
+
+            bool same_key(const Entry &other) const
+            {
+                return std::memcmp(key_hash.hash, other.key_hash.hash, sizeof(key_hash.hash)) == 0;
+            }
+
+            SHA256 key_hash;
+            std::string date_stamp;
+            std::string region_name;
+            std::string service_name;
+            SHA256 signing_key;
+        };
+
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;
+        Stats stats_;
+    };
+
+    // append the same encoding as URL::encode() to buf
+    static void append_uri_encoded(Buffer &buf, const std::string &str)
+    {
+        for (const char c : str)
+        {
+            if (HTTP::Util::is_escaped(c))
+            {
+                const RenderHexByte h((unsigned char)c, true);
+                buf.push_back('%');
+                buf.write(h.str2(), 2);
+            }
+            else
+                buf.push_back(c);
+        }
+    }
+
     struct KeyValue
     {
         KeyValue(std::string key_arg, std::string value_arg)
@@ -113,6 +280,13 @@ class REST
             return URL::encode(key) + '=' + URL::encode(value);
         }
 
+        void uri_encode(Buffer &buf) const
+        {
+            append_uri_encoded(buf, key);
+            buf.push_back('=');
+            append_uri_encoded(buf, value);
+        }
+
         std::string key;
         std::string value;
     };
@@ -133,6 +307,18 @@ class REST
             return ret;
         }
 
+        void canonical_query_string(Buffer &buf) const
+        {
+            bool first = true;
+            for (auto &p : *this)
+            {
+                if (!first)
+                    buf.push_back('&');
+                p.uri_encode(buf);
+                first = false;
+            }
+        }
+
         void sort()
         {
             std::sort(begin(), end());
@@ -184,12 +370,14 @@ class REST
 
         std::string signature(DigestFactory &digest_factory, const Creds &creds) const
         {
-            const SHA256 sk = signing_key(digest_factory,
-                                          creds.secret_key,
-                                          date.substr(0, 8),
-                                          region,
-                                          service);
-            return hmac_sha256(digest_factory, string_to_sign(digest_factory), sk).to_hex();
+            const SHA256 sk = SigningKeyCache::global().get(digest_factory,
+                                                            creds.secret_key,
+                                                            date.substr(0, 8),
+                                                            region,
+                                                            service);
+            BufferAllocated buf(512, BufAllocFlags::GROW);
+            string_to_sign(buf, digest_factory);
+            return hmac_sha256(digest_factory, buf, sk).to_hex();
         }
 
         virtual std::string content_hash() const
@@ -200,17 +388,28 @@ class REST
 
         std::string canonical_request() const
         {
-            std::string ret = method + '\n'
-                              + uri + '\n'
-                              + parms.canonical_query_string() + '\n'
-                              + "host:" + host + '\n'
-                              + '\n'
-                              + amz_signed_headers() + '\n';
+            BufferAllocated buf(512, BufAllocFlags::GROW);
+            canonical_request(buf);
+            return buf_to_string(buf);
+        }
+
+        // append the canonical request to buf
+        void canonical_request(Buffer &buf) const
+        {
+            buf_append_string(buf, method);
+            buf.push_back('\n');
+            buf_append_string(buf, uri);
+            buf.push_back('\n');
+            parms.canonical_query_string(buf);
+            buf_append_string(buf, "\nhost:");
+            buf_append_string(buf, host);
+            buf_append_string(buf, "\n\n");
+            buf_append_string(buf, amz_signed_headers());
+            buf.push_back('\n');
             if (service == "s3")
-                ret += "UNSIGNED-PAYLOAD";
+                buf_append_string(buf, "UNSIGNED-PAYLOAD");
             else
-                ret += content_hash();
-            return ret;
+                buf_append_string(buf, content_hash());
         }
 
         std::string amz_signed_headers() const
@@ -221,10 +420,26 @@ class REST
 
         std::string string_to_sign(DigestFactory &digest_factory) const
         {
-            return "AWS4-HMAC-SHA256\n"
-                   + date + '\n'
-                   + amz_credential() + "\n"
-                   + sha256(digest_factory, canonical_request()).to_hex();
+            BufferAllocated buf(512, BufAllocFlags::GROW);
+            string_to_sign(buf, digest_factory);
+            return buf_to_string(buf);
+        }
+
+        // Replace the content of buf with the string to sign.  buf is
+        // first used to hold the canonical request while it is hashed.
+        void string_to_sign(Buffer &buf, DigestFactory &digest_factory) const
+        {
+            buf.reset_content();
+            canonical_request(buf);
+            const SHA256 request_hash = sha256(digest_factory, buf);
+
+            buf.reset_content();
+            buf_append_string(buf, "AWS4-HMAC-SHA256\n");
+            buf_append_string(buf, date);
+            buf.push_back('\n');
+            amz_credential(buf);
+            buf.push_back('\n');
+            request_hash.append_hex(buf);
         }
 
         std::string amz_credential() const
@@ -232,6 +447,16 @@ class REST
             return date.substr(0, 8) + '/' + region + '/' + service + "/aws4_request";
         }
 
+        void amz_credential(Buffer &buf) const
+        {
+            buf.write(date.c_str(), std::min(date.length(), size_t(8)));
+            buf.push_back('/');
+            buf_append_string(buf, region);
+            buf.push_back('/');
+            buf_append_string(buf, service);
+            buf_append_string(buf, "/aws4_request");
+        }
+
         virtual ~QueryBuilder() = default;
     };
 };
@@ -41,7 +41,17 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include <openvpn/common/xmlhelper.hpp>
+#include <openvpn/asio/asiostop.hpp>
+#include <openvpn/time/asiotimer.hpp>
 #include <openvpn/aws/awshttp.hpp>
 #include <openvpn/aws/awspc.hpp>
 #include <openvpn/aws/awsrest.hpp>
@@ -67,13 +77,27 @@ class Route
                 Stop *async_stop_arg,
                 const int debug_level)
             : instance_info(std::move(instance_info_arg)),
+              host(ec2_host(instance_info)),
               http_context(std::move(rng), debug_level),
-              ts(http_context.transaction_set(ec2_host(instance_info))),
+              ts(http_context.transaction_set(host)),
               creds(std::move(creds_arg)),
               async_stop(async_stop_arg)
         {
         }
 
+        // Send queries to host:port instead of the regional EC2 endpoint,
+        // such as a VPC interface endpoint.  An http_config without an
+        // SSL factory speaks plain HTTP, e.g. to a local mock endpoint.
+        void set_endpoint(std::string host_arg,
+                          std::string port_arg,
+                          WS::Client::Config::Ptr http_config_arg = WS::Client::Config::Ptr())
+        {
+            host = std::move(host_arg);
+            port = std::move(port_arg);
+            http_config = std::move(http_config_arg);
+            ts = transaction_set();
+        }
+
         void reset()
         {
             if (ts)
@@ -87,8 +111,21 @@ class Route
 
       private:
         friend class Route;
+
+        WS::ClientSet::TransactionSet::Ptr transaction_set() const
+        {
+            WS::ClientSet::TransactionSet::Ptr t = http_context.transaction_set(host);
+            t->host.port = port;
+            if (http_config)
+                t->http_config = http_config;
+            return t;
+        }
+
         PCQuery::Info instance_info;
+        std::string host;
+        std::string port = "443";
         HTTPContext http_context;
+        WS::Client::Config::Ptr http_config;
         WS::ClientSet::TransactionSet::Ptr ts;
         Creds creds;
         Stop *async_stop;
@@ -407,23 +444,7 @@ class Route
                                      const std::string &target_value,
                                      bool ipv6)
     {
-        std::string target_type_str;
-
-        switch (target_type)
-        {
-        case RouteTargetType::INSTANCE_ID:
-            target_type_str = "InstanceId";
-            break;
-
-        case RouteTargetType::INTERFACE_ID:
-            target_type_str = "NetworkInterfaceId";
-            break;
-
-        default:
-            OPENVPN_THROW(aws_route_error,
-                          "replace_create_route: unknown RouteTargetType " << (int)target_type);
-        }
-
+        const std::string target_type_str = target_type_name(target_type);
         const std::string dest_cidr_block_name = ipv6 ? "DestinationCidrIpv6Block" : "DestinationCidrBlock";
 
         // create API query
@@ -551,7 +572,480 @@ class Route
         return route_table_id;
     }
 
+    // Route changes issued concurrently, for a failover that has to move
+    // many routes across several route tables.  Up to max_in_flight
+    // queries are outstanding at once, each over its own keepalive
+    // connection.  Queries that cannot reach EC2, fail with a 5xx status
+    // or are throttled are retried after a random delay of up to
+    // backoff * 2^(attempt-1), capped at max_backoff.  Other errors fail
+    // the operation at once.
+    class Batch
+    {
+      public:
+        struct Config
+        {
+            unsigned int max_in_flight = 8;                             // concurrent queries and connections
+            unsigned int max_attempts = 5;                              // tries per query
+            Time::Duration backoff = Time::Duration::milliseconds(200); // retry delay ceiling, doubled per attempt
+            Time::Duration max_backoff = Time::Duration::seconds(5);    // limit of the retry delay ceiling
+        };
+
+        // Create/replace a VPC route, like Route::replace_create_route()
+        void replace_create_route(const std::string &route_table_id,
+                                  const std::string &route,
+                                  RouteTargetType target_type,
+                                  const std::string &target_value,
+                                  bool ipv6)
+        {
+            Op op(REPLACE_ROUTE, route_table_id);
+            op.cidr = route;
+            op.cidr_name = ipv6 ? "DestinationCidrIpv6Block" : "DestinationCidrBlock";
+            op.target_name = target_type_name(target_type);
+            op.target_value = target_value;
+            ops.push_back(std::move(op));
+        }
+
+        // Delete a VPC route, like Route::delete_route()
+        void delete_route(const std::string &route_table_id,
+                          const std::string &cidr,
+                          bool ipv6)
+        {
+            Op op(DELETE_ROUTE, route_table_id);
+            op.cidr = cidr;
+            op.cidr_name = ipv6 ? "DestinationIpv6CidrBlock" : "DestinationCidrBlock";
+            ops.push_back(std::move(op));
+        }
+
+        // Set sourceDestCheck, like Route::set_source_dest_check()
+        void set_source_dest_check(const std::string &network_interface_id,
+                                   const bool source_dest_check)
+        {
+            Op op(DESCRIBE_SOURCE_DEST_CHECK, network_interface_id);
+            op.sdc = source_dest_check ? "true" : "false";
+            ops.push_back(std::move(op));
+        }
+
+        size_t size() const
+        {
+            return ops.size();
+        }
+
+        // Apply every operation.  Once all of them have finished, throws
+        // aws_route_error listing the ones that failed, if any.
+        void execute(Context &ctx)
+        {
+            execute(ctx, Config());
+        }
+
+        void execute(Context &ctx, const Config &config)
+        {
+            if (ops.empty())
+                return;
+            for (auto &op : ops)
+                op.reset();
+            Executor ex(ctx, config, ops);
+            ex.run();
+
+            std::ostringstream os;
+            size_t failed = 0;
+            for (const auto &op : ops)
+            {
+                if (!op.error.empty())
+                {
+                    ++failed;
+                    os << '\n'
+                       << op.error;
+                }
+            }
+            if (failed)
+                OPENVPN_THROW(aws_route_error, failed << " of " << ops.size() << " route operations failed:" << os.str());
+        }
+
+      private:
+        enum Action
+        {
+            REPLACE_ROUTE,
+            CREATE_ROUTE,
+            DELETE_ROUTE,
+            DESCRIBE_SOURCE_DEST_CHECK,
+            MODIFY_SOURCE_DEST_CHECK,
+        };
+
+        static const char *action_name(const Action action)
+        {
+            switch (action)
+            {
+            case REPLACE_ROUTE:
+                return "ReplaceRoute";
+            case CREATE_ROUTE:
+                return "CreateRoute";
+            case DELETE_ROUTE:
+                return "DeleteRoute";
+            case DESCRIBE_SOURCE_DEST_CHECK:
+                return "DescribeNetworkInterfaceAttribute";
+            case MODIFY_SOURCE_DEST_CHECK:
+                return "ModifyNetworkInterfaceAttribute";
+            }
+            return "?";
+        }
+
+        struct Op
+        {
+            Op(const Action first_arg, std::string resource_arg)
+                : first(first_arg),
+                  action(first_arg),
+                  resource(std::move(resource_arg))
+            {
+            }
+
+            void reset()
+            {
+                action = first;
+                attempts = 0;
+                error.clear();
+            }
+
+            REST::Query query() const
+            {
+                REST::Query q;
+                q.emplace_back("Action", action_name(action));
+                switch (action)
+                {
+                case REPLACE_ROUTE:
+                case CREATE_ROUTE:
+                    q.emplace_back(cidr_name, cidr);
+                    q.emplace_back(target_name, target_value);
+                    q.emplace_back("RouteTableId", resource);
+                    break;
+                case DELETE_ROUTE:
+                    q.emplace_back(cidr_name, cidr);
+                    q.emplace_back("RouteTableId", resource);
+                    break;
+                case DESCRIBE_SOURCE_DEST_CHECK:
+                    q.emplace_back("NetworkInterfaceId", resource);
+                    q.emplace_back("Attribute", "sourceDestCheck");
+                    break;
+                case MODIFY_SOURCE_DEST_CHECK:
+                    q.emplace_back("NetworkInterfaceId", resource);
+                    q.emplace_back("SourceDestCheck.Value", sdc);
+                    break;
+                }
+                return q;
+            }
+
+            std::string title() const
+            {
+                std::string ret = action_name(action);
+                ret += ' ';
+                if (!cidr.empty())
+                {
+                    ret += cidr;
+                    ret += " -> table ";
+                }
+                ret += resource;
+                return ret;
+            }
+
+            Action first;
+            Action action;
+            std::string resource; // route table or network interface ID
+            std::string cidr;
+            std::string cidr_name;
+            std::string target_name;
+            std::string target_value;
+            std::string sdc;
+            unsigned int attempts = 0;
+            std::string error; // set if the operation failed
+        };
+
+        // Runs a batch on a private io_context, dispatching ready
+        // operations to idle connections
+        class Executor
+        {
+          public:
+            Executor(Context &ctx_arg, const Config &config_arg, std::vector<Op> &ops_arg)
+                : ctx(ctx_arg),
+                  config(config_arg),
+                  ops(ops_arg),
+                  io_context(1),
+                  timers(ops_arg.size()),
+                  remaining(ops_arg.size())
+            {
+            }
+
+            void run()
+            {
+                for (size_t i = 0; i < ops.size(); ++i)
+                    ready.push_back(i);
+                const size_t n = std::min(ops.size(), size_t(std::max(config.max_in_flight, 1u)));
+                for (size_t i = 0; i < n; ++i)
+                {
+                    WS::ClientSet::TransactionSet::Ptr ts = ctx.transaction_set();
+                    ts->max_retries = 1; // retries are ours, with backoff
+                    ts->retry_on_http_4xx = false;
+                    ts->preserve_http_state = true;
+                    ts->hsc.create_container();
+                    workers.push_back(ts);
+                    idle.push_back(std::move(ts));
+                }
+
+                try
+                {
+                    AsioStopScope scope(io_context, ctx.async_stop, [this]()
+                                        { stop("stop message received"); });
+                    cs.reset(new WS::ClientSet(io_context));
+                    cs->set_random(RandomAPI::Ptr(ctx.http_context.rng()));
+                    dispatch();
+                    io_context.run();
+                }
+                catch (...)
+                {
+                    if (cs)
+                        cs->stop();
+                    close();
+                    io_context.poll(); // execute completion handlers
+                    throw;
+                }
+            }
+
+          private:
+            enum Result
+            {
+                DONE,
+                NEXT,
+                RETRY,
+                FAIL,
+            };
+
+            void dispatch()
+            {
+                while (!halt && !idle.empty() && !ready.empty())
+                {
+                    WS::ClientSet::TransactionSet::Ptr ts = std::move(idle.back());
+                    idle.pop_back();
+                    const size_t i = ready.front();
+                    ready.pop_front();
+
+                    Op &op = ops[i];
+                    ++op.attempts;
+                    std::unique_ptr<WS::ClientSet::Transaction> t(new WS::ClientSet::Transaction);
+                    t->req.uri = ec2_uri(ctx, op.query());
+                    t->req.method = "GET";
+                    t->ci.keepalive = true;
+                    ts->transactions.clear();
+                    ts->transactions.push_back(std::move(t));
+
+                    // complete under a fresh stack, as the connection is
+                    // reused by the next query
+                    ts->completion = [this, i](WS::ClientSet::TransactionSet &set)
+                    {
+                        openvpn_io::post(io_context, [this, i, ts = WS::ClientSet::TransactionSet::Ptr(&set)]()
+                                         { complete(ts, i); });
+                    };
+                    cs->new_request(std::move(ts));
+                }
+            }
+
+            void complete(WS::ClientSet::TransactionSet::Ptr ts, const size_t i)
+            {
+                Op &op = ops[i];
+                Result result;
+                try
+                {
+                    result = process(op, *ts);
+                }
+                catch (const std::exception &e)
+                {
+                    op.error = op.title() + ": " + e.what();
+                    result = FAIL;
+                }
+                if (halt && (result == NEXT || result == RETRY))
+                {
+                    op.error = op.title() + ": stopped";
+                    result = FAIL;
+                }
+                ts->reset_callbacks();
+                idle.push_back(std::move(ts));
+
+                switch (result)
+                {
+                case DONE:
+                case FAIL:
+                    finish();
+                    break;
+                case NEXT:
+                    op.attempts = 0;
+                    ready.push_front(i);
+                    break;
+                case RETRY:
+                    retry(i);
+                    break;
+                }
+                dispatch();
+            }
+
+            Result process(Op &op, WS::ClientSet::TransactionSet &ts)
+            {
+                const WS::ClientSet::Transaction &t = ts.first_transaction();
+                const std::string reply = t.content_in_string();
+
+                if (retryable(t, reply))
+                {
+                    if (op.attempts < config.max_attempts)
+                        return RETRY;
+                    op.error = op.title() + ": " + t.format_status(ts) + " after " + std::to_string(op.attempts) + " attempts\n" + reply;
+                    return FAIL;
+                }
+
+                switch (op.action)
+                {
+                case REPLACE_ROUTE:
+                    // fails legitimately if the route doesn't exist yet
+                    if (t.request_status_success() && return_true(reply, "ReplaceRoute"))
+                        return done(op);
+                    op.action = CREATE_ROUTE;
+                    return NEXT;
+
+                case DESCRIBE_SOURCE_DEST_CHECK:
+                    {
+                        if (!t.http_status_success())
+                            break;
+                        const Xml::Document doc(reply, "DescribeNetworkInterfaceAttribute");
+                        const std::string retval = Xml::find_text(&doc,
+                                                                  "DescribeNetworkInterfaceAttributeResponse",
+                                                                  "sourceDestCheck",
+                                                                  "value");
+                        // already set to desired value?
+                        if (retval == op.sdc)
+                            return DONE;
+                        op.action = MODIFY_SOURCE_DEST_CHECK;
+                        return NEXT;
+                    }
+
+                default:
+                    if (t.http_status_success() && return_true(reply, action_name(op.action)))
+                        return done(op);
+                    break;
+                }
+                op.error = op.title() + ": " + t.format_status(ts) + '\n' + reply;
+                return FAIL;
+            }
+
+            static bool retryable(const WS::ClientSet::Transaction &t, const std::string &reply)
+            {
+                return !t.comm_status_success()
+                       || t.reply.status_code >= 500
+                       || t.reply.status_code == 429
+                       || reply.find("<Code>RequestLimitExceeded</Code>") != std::string::npos;
+            }
+
+            static bool return_true(const std::string &reply, const std::string &action)
+            {
+                const Xml::Document doc(reply, action);
+                return Xml::find_text(&doc, action + "Response", "return") == "true";
+            }
+
+            Result done(const Op &op)
+            {
+                if (op.action == MODIFY_SOURCE_DEST_CHECK)
+                    OPENVPN_LOG("AWS EC2 ModifyNetworkInterfaceAttribute " << op.resource << " SourceDestCheck.Value=" << op.sdc);
+                else
+                    OPENVPN_LOG("AWS EC2 " << op.title());
+                return DONE;
+            }
+
+            // wait for a random part of the backoff ceiling, so that
+            // operations throttled together spread out when retried
+            void retry(const size_t i)
+            {
+                const Op &op = ops[i];
+                const unsigned int shift = std::min(op.attempts - 1, 16u);
+                const Time::Duration ceiling = std::min(config.backoff * (1u << shift), config.max_backoff);
+                const std::uint32_t ms = static_cast<std::uint32_t>(ceiling.to_milliseconds());
+                const Time::Duration delay = Time::Duration::milliseconds(ctx.http_context.rng()->randrange32(0, ms));
+
+                std::unique_ptr<AsioTimer> &timer = timers[i];
+                if (!timer)
+                    timer.reset(new AsioTimer(io_context));
+                timer->expires_after(delay);
+                timer->async_wait([this, i](const openvpn_io::error_code &error)
+                                  {
+                    if (error || halt)
+                    {
+                        ops[i].error = ops[i].title() + ": stopped";
+                        finish();
+                    }
+                    else
+                    {
+                        ready.push_back(i);
+                        dispatch();
+                    } });
+            }
+
+            void finish()
+            {
+                if (--remaining == 0)
+                    close();
+            }
+
+            void stop(const std::string &message)
+            {
+                if (halt)
+                    return;
+                halt = true;
+                for (const size_t i : ready)
+                {
+                    ops[i].error = ops[i].title() + ": stopped";
+                    finish();
+                }
+                ready.clear();
+                for (auto &timer : timers)
+                    if (timer)
+                        timer->cancel();
+                if (cs)
+                    cs->abort(message);
+            }
+
+            // close the pooled connections so that io_context.run() returns
+            void close()
+            {
+                for (auto &ts : workers)
+                    ts->stop(true);
+            }
+
+            Context &ctx;
+            const Config &config;
+            std::vector<Op> &ops;
+            openvpn_io::io_context io_context;
+            WS::ClientSet::Ptr cs;
+            std::vector<WS::ClientSet::TransactionSet::Ptr> workers;
+            std::vector<WS::ClientSet::TransactionSet::Ptr> idle;
+            std::deque<size_t> ready;
+            std::vector<std::unique_ptr<AsioTimer>> timers;
+            size_t remaining;
+            bool halt = false;
+        };
+
+        std::vector<Op> ops;
+    };
+
   private:
+    static std::string target_type_name(const RouteTargetType target_type)
+    {
+        switch (target_type)
+        {
+        case RouteTargetType::INSTANCE_ID:
+            return "InstanceId";
+
+        case RouteTargetType::INTERFACE_ID:
+            return "NetworkInterfaceId";
+
+        default:
+            OPENVPN_THROW(aws_route_error,
+                          "replace_create_route: unknown RouteTargetType " << (int)target_type);
+        }
+    }
+
     static void execute_transaction(Context &ctx)
     {
         WS::ClientSet::new_request_synchronous(ctx.ts, ctx.async_stop, ctx.http_context.rng(), true);
@@ -575,7 +1069,7 @@ class Route
         qb.region = ctx.instance_info.region;
         qb.service = "ec2";
         qb.method = "GET";
-        qb.host = ec2_host(ctx.instance_info);
+        qb.host = ctx.host;
         qb.uri = "/";
         qb.parms = std::move(q);
         qb.parms.emplace_back("Version", "2015-10-01");
@@ -192,6 +192,15 @@ class BufferException : public std::exception
     std::string msg_;
 };
 
+/**
+    @brief number of times a BufferAllocated on this thread moved its data to a larger allocation
+    @details Counts BufferAllocated::realloc() and realign() when they need more capacity, and
+    reset() replacing an existing allocation with a larger one.  The data channel compares
+    it before and after each packet to detect Frame contexts that are too small for the
+    negotiated pipeline.
+*/
+inline thread_local std::size_t buffer_realloc_count = 0;
+
 //  ===============================================================================================
 //  ===============================================================================================
 
@@ -1741,7 +1750,11 @@ template <typename T>
 void BufferAllocatedType<T>::reset(const size_t min_capacity, const unsigned int flags)
 {
     if (min_capacity > capacity())
+    {
+        if (capacity())
+            ++buffer_realloc_count;
         init(min_capacity, flags);
+    }
 }
 
 template <typename T>
@@ -1834,6 +1847,7 @@ void BufferAllocatedType<T>::resize(const size_t new_capacity)
 template <typename T>
 void BufferAllocatedType<T>::realloc_(const size_t newcap, size_t new_offset)
 {
+    ++buffer_realloc_count;
     auto tempBuffer = BufferAllocatedType(new_offset, size(), newcap, flags_);
     if (size())
         std::memcpy(tempBuffer.data(), c_data(), size() * sizeof(T));
@@ -0,0 +1,40 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#pragma once
+
+#include <openvpn/buffer/buffer.hpp>
+
+namespace openvpn {
+
+/**
+ * @class ScratchBuffer
+ * @brief Per-thread work buffer for packet transforms
+ *
+ * Transforms such as data channel encryption write their output to a
+ * work buffer and then swap it with the packet buffer.  Using one
+ * buffer per thread instead of one per transform instance saves a
+ * full-size buffer per key in every session.
+ *
+ * The buffer may only be used within a single call: after the swap it
+ * holds the previous packet buffer, which the next user prepares again.
+ */
+class ScratchBuffer
+{
+  public:
+    static BufferAllocated &get()
+    {
+        thread_local BufferAllocated buf;
+        return buf;
+    }
+};
+
+} // namespace openvpn
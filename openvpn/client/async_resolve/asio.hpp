@@ -12,15 +12,92 @@
 #ifndef OPENVPN_CLIENT_ASYNC_RESOLVE_ASIO_H
 #define OPENVPN_CLIENT_ASYNC_RESOLVE_ASIO_H
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 #include <openvpn/io/io.hpp>
 #include <openvpn/asio/asiowork.hpp>
 
 #include <openvpn/common/bigmutex.hpp>
 #include <openvpn/common/rc.hpp>
 #include <openvpn/common/hostport.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/client/async_resolve/dnsstub.hpp>
 
+// Resolve with the DnsStub resolver on the io_context where it reads
+// the system configuration, and with getaddrinfo() on a small thread
+// pool otherwise
+#if defined(__linux__) && !defined(__ANDROID__) && !defined(OPENVPN_ASYNC_RESOLVE_NO_STUB)
+#define OPENVPN_ASYNC_RESOLVE_STUB
+#endif
 
 namespace openvpn {
+
+// Threads for the blocking getaddrinfo() calls, shared by all
+// resolvers.  The threads are detached and the pool is never
+// destroyed, so that exiting does not wait for a stuck lookup.
+class ResolveThreadPool
+{
+  public:
+    enum
+    {
+        MAX_THREADS = 4,
+    };
+
+    static void post(std::function<void()> job)
+    {
+        instance().add(std::move(job));
+    }
+
+  private:
+    static ResolveThreadPool &instance()
+    {
+        static ResolveThreadPool *pool = new ResolveThreadPool();
+        return *pool;
+    }
+
+    void add(std::function<void()> job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        if (idle == 0 && threads < MAX_THREADS)
+        {
+            ++threads;
+            std::thread([this]()
+                        { worker(); })
+                .detach();
+        }
+        else
+            cv.notify_one();
+    }
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            ++idle;
+            cv.wait(lock, [this]()
+                    { return !jobs.empty(); });
+            --idle;
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    unsigned int threads = 0;
+    unsigned int idle = 0;
+};
+
 template <typename RESOLVER_TYPE>
 class AsyncResolvable
 {
@@ -45,8 +122,11 @@ class AsyncResolvable
             : io_context(io_context_arg),
               parent(parent_arg)
         {
-            std::thread t([self = Ptr(this), host, port]()
-                          {
+            ResolveThreadPool::post([self = Ptr(this), host, port]()
+                                    {
+	  // skip lookups that were cancelled while queued
+	  if (self->is_detached())
+	    return;
 	  openvpn_io::io_context io_context(1);
 	  openvpn_io::error_code error;
 	  RESOLVER_TYPE resolver(io_context);
@@ -57,9 +137,6 @@ class AsyncResolvable
 	  {
 	    self->post_callback(results, error);
 	  } });
-            // detach the thread so that the client won't need to wait for
-            // it to join.
-            t.detach();
         }
 
         void detach()
@@ -91,6 +168,7 @@ class AsyncResolvable
     openvpn_io::io_context &io_context;
     std::unique_ptr<AsioWork> asio_work;
     typename ResolveThread::Ptr resolve_thread;
+    DnsStub::Lookup::Ptr lookup;
 
   public:
     using resolver_type = RESOLVER_TYPE;
@@ -109,22 +187,45 @@ class AsyncResolvable
     virtual void resolve_callback(const openvpn_io::error_code &error,
                                   results_type results) = 0;
 
-    // mimic the asynchronous DNS resolution by performing a
-    // synchronous one in a detached thread.
-    //
-    // This strategy has the advantage of allowing the core to
-    // stop/exit without waiting for the getaddrinfo() (used
-    // internally) to terminate.
-    // Note: getaddrinfo() is non-interruptible by design.
-    //
-    // In other words, we are re-creating exactly what ASIO would
-    // normally do in case of async_resolve(), with the difference
-    // that here we have control over the resolving thread and we
-    // can easily detach it. Deatching the internal thread created
-    // by ASIO would not be feasible as it is not exposed.
+    // Resolve with DnsStub::Lookup on our io_context when the system
+    // resolver configuration can be read, and fall back to getaddrinfo()
+    // for everything else: other platforms, service names as port, and
+    // names the stub resolver could not resolve (e.g. mDNS or NSS
+    // sources other than DNS and /etc/hosts).
     virtual void async_resolve_name(const std::string &host, const std::string &port)
     {
-        resolve_thread.reset(new ResolveThread(io_context, this, host, port));
+        cancel_lookups();
+#ifdef OPENVPN_ASYNC_RESOLVE_STUB
+        unsigned short port_num;
+        DnsStub::Config::Ptr config;
+        if (parse_number(port, port_num) && (config = DnsStub::SystemConfig::get()))
+        {
+            bool want_v4, want_v6;
+            DnsStub::configured_families(want_v4, want_v6);
+            lookup.reset(new DnsStub::Lookup(io_context,
+                                             std::move(config),
+                                             host,
+                                             want_v4,
+                                             want_v6,
+                                             [this, host, port, port_num](const openvpn_io::error_code &error, std::vector<IP::Addr> addrs)
+                                             {
+                                                 lookup.reset();
+                                                 if (error)
+                                                 {
+                                                     resolve_getaddrinfo(host, port);
+                                                     return;
+                                                 }
+                                                 std::vector<typename RESOLVER_TYPE::endpoint_type> eps;
+                                                 for (const IP::Addr &a : addrs)
+                                                     eps.emplace_back(a.to_asio(), port_num);
+                                                 OPENVPN_ASYNC_HANDLER;
+                                                 resolve_callback(error, results_type::create(eps.begin(), eps.end(), host, port));
+                                             }));
+            lookup->start();
+            return;
+        }
+#endif
+        resolve_getaddrinfo(host, port);
     }
 
     // there might be nothing else in the main io_context queue
@@ -140,14 +241,42 @@ class AsyncResolvable
     // and we don't need to wait for the detached thread any longer.
     // It simulates a resolve abort
     void async_resolve_cancel()
+    {
+        cancel_lookups();
+        asio_work.reset();
+    }
+
+  private:
+    // mimic the asynchronous DNS resolution by performing a
+    // synchronous one on a detached pool thread.
+    //
+    // This strategy has the advantage of allowing the core to
+    // stop/exit without waiting for the getaddrinfo() (used
+    // internally) to terminate.
+    // Note: getaddrinfo() is non-interruptible by design.
+    //
+    // In other words, we are re-creating exactly what ASIO would
+    // normally do in case of async_resolve(), with the difference
+    // that here we have control over the resolving thread and we
+    // can easily detach it. Deatching the internal thread created
+    // by ASIO would not be feasible as it is not exposed.
+    void resolve_getaddrinfo(const std::string &host, const std::string &port)
+    {
+        resolve_thread.reset(new ResolveThread(io_context, this, host, port));
+    }
+
+    void cancel_lookups()
     {
         if (resolve_thread)
         {
             resolve_thread->detach();
             resolve_thread.reset();
         }
-
-        asio_work.reset();
+        if (lookup)
+        {
+            lookup->cancel();
+            lookup.reset();
+        }
     }
 };
 } // namespace openvpn
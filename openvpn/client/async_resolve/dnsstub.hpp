@@ -0,0 +1,895 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Non-blocking stub resolver for A and AAAA lookups on an io_context.
+// It reads its name servers and search domains from /etc/resolv.conf
+// and static names from /etc/hosts, queries A and AAAA in parallel
+// over UDP with a TCP retry for truncated answers, and keeps a cache
+// of the answers for their TTL.
+
+#ifndef OPENVPN_CLIENT_ASYNC_RESOLVE_DNSSTUB_H
+#define OPENVPN_CLIENT_ASYNC_RESOLVE_DNSSTUB_H
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <ifaddrs.h>
+#endif
+
+#include <openvpn/io/io.hpp>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/number.hpp>
+#include <openvpn/common/string.hpp>
+#include <openvpn/common/file.hpp>
+#include <openvpn/common/split.hpp>
+#include <openvpn/common/lex.hpp>
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/time/asiotimer.hpp>
+
+namespace openvpn::DnsStub {
+
+enum
+{
+    TYPE_A = 1,
+    TYPE_CNAME = 5,
+    TYPE_AAAA = 28,
+    TYPE_OPT = 41,
+    CLASS_IN = 1,
+
+    RCODE_NOERROR = 0,
+    RCODE_NXDOMAIN = 3,
+
+    DNS_PORT = 53,
+    EDNS_UDP_SIZE = 1232,
+    MAX_NAMESERVERS = 3, // like the libc resolver
+};
+
+struct Config : public RC<thread_safe_refcount>
+{
+    typedef RCPtr<Config> Ptr;
+
+    struct Server
+    {
+        IP::Addr addr;
+        unsigned short port = DNS_PORT;
+    };
+
+    std::vector<Server> servers;
+    std::vector<std::string> search;
+    unsigned int ndots = 1;
+    unsigned int attempts = 2;
+    Time::Duration timeout = Time::Duration::seconds(5); // per query, before trying the next server
+    std::multimap<std::string, IP::Addr> hosts;          // static names, in lowercase
+
+    // Parse resolv.conf and hosts file contents, the way the libc
+    // resolver does for the directives used here
+    static Ptr parse(const std::string &resolv_conf, const std::string &hosts_file)
+    {
+        typedef std::vector<std::string> strvec;
+        Ptr conf(new Config);
+        std::istringstream rc(resolv_conf);
+        std::string line;
+        while (std::getline(rc, line))
+        {
+            const strvec v = Split::by_space<strvec, StandardLex, SpaceMatch, Split::NullLimit>(line);
+            if (v.empty() || v[0][0] == '#' || v[0][0] == ';')
+                continue;
+            if (v[0] == "nameserver" && v.size() >= 2 && conf->servers.size() < MAX_NAMESERVERS)
+            {
+                // scoped IPv6 addresses are left to getaddrinfo
+                if (IP::Addr::is_valid(v[1]))
+                    conf->servers.push_back({IP::Addr(v[1]), DNS_PORT});
+            }
+            else if ((v[0] == "search" || v[0] == "domain") && v.size() >= 2)
+            {
+                conf->search.clear();
+                for (size_t i = 1; i < v.size() && v[i][0] != '#'; ++i)
+                    conf->search.push_back(v[i]);
+            }
+            else if (v[0] == "options")
+            {
+                for (size_t i = 1; i < v.size(); ++i)
+                {
+                    const std::string &o = v[i];
+                    const size_t colon = o.find(':');
+                    if (colon == std::string::npos)
+                        continue;
+                    unsigned int n;
+                    if (!parse_number(o.substr(colon + 1), n))
+                        continue;
+                    const std::string name = o.substr(0, colon);
+                    if (name == "ndots")
+                        conf->ndots = std::min(n, 15u);
+                    else if (name == "attempts")
+                        conf->attempts = std::max(std::min(n, 5u), 1u);
+                    else if (name == "timeout")
+                        conf->timeout = Time::Duration::seconds(std::max(std::min(n, 30u), 1u));
+                }
+            }
+        }
+
+        std::istringstream hf(hosts_file);
+        while (std::getline(hf, line))
+        {
+            const size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.resize(comment);
+            const strvec v = Split::by_space<strvec, StandardLex, SpaceMatch, Split::NullLimit>(line);
+            if (v.size() < 2 || !IP::Addr::is_valid(v[0]))
+                continue;
+            const IP::Addr addr(v[0]);
+            for (size_t i = 1; i < v.size(); ++i)
+                conf->hosts.emplace(string::to_lower_copy(v[i]), addr);
+        }
+        return conf;
+    }
+};
+
+// The resolver configuration of the system, read again when
+// /etc/resolv.conf or /etc/hosts change.  Null where there is no
+// resolv.conf with a usable name server, so that lookups go to
+// getaddrinfo().
+class SystemConfig
+{
+  public:
+    static Config::Ptr get()
+    {
+        SystemConfig &sc = instance();
+        std::lock_guard<std::mutex> lock(sc.mutex);
+        if (sc.overridden)
+            return sc.config;
+#if defined(__linux__) && !defined(__ANDROID__)
+        const Stamp rc_stamp = stamp(RESOLV_CONF);
+        const Stamp hosts_stamp = stamp(HOSTS);
+        if (rc_stamp != sc.rc_stamp || hosts_stamp != sc.hosts_stamp)
+        {
+            sc.rc_stamp = rc_stamp;
+            sc.hosts_stamp = hosts_stamp;
+            sc.config.reset();
+            try
+            {
+                Config::Ptr conf = Config::parse(read_text(RESOLV_CONF), rc_stamp.defined() ? read_text(HOSTS) : "");
+                if (!conf->servers.empty())
+                    sc.config = std::move(conf);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        return sc.config;
+#else
+        return Config::Ptr();
+#endif
+    }
+
+    // Use the given configuration instead of the system one, or go
+    // back to the system configuration with a null pointer
+    static void set_override(Config::Ptr config)
+    {
+        SystemConfig &sc = instance();
+        std::lock_guard<std::mutex> lock(sc.mutex);
+        sc.overridden = bool(config);
+        sc.config = std::move(config);
+        sc.rc_stamp = Stamp();
+        sc.hosts_stamp = Stamp();
+    }
+
+  private:
+    static constexpr const char *RESOLV_CONF = "/etc/resolv.conf";
+    static constexpr const char *HOSTS = "/etc/hosts";
+
+    struct Stamp
+    {
+        std::int64_t mtime = -1;
+        std::int64_t mtime_nsec = 0;
+        std::int64_t size = 0;
+
+        bool defined() const
+        {
+            return mtime >= 0;
+        }
+
+        bool operator!=(const Stamp &other) const
+        {
+            return mtime != other.mtime || mtime_nsec != other.mtime_nsec || size != other.size;
+        }
+    };
+
+    static SystemConfig &instance()
+    {
+        static SystemConfig sc;
+        return sc;
+    }
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    static Stamp stamp(const char *path)
+    {
+        Stamp s;
+        struct stat st;
+        if (::stat(path, &st) == 0)
+        {
+            s.mtime = st.st_mtim.tv_sec;
+            s.mtime_nsec = st.st_mtim.tv_nsec;
+            s.size = st.st_size;
+        }
+        return s;
+    }
+#endif
+
+    std::mutex mutex;
+    Config::Ptr config;
+    bool overridden = false;
+    Stamp rc_stamp;
+    Stamp hosts_stamp;
+};
+
+// Answers shared by all lookups in the process, kept for their TTL
+class Cache
+{
+  public:
+    enum
+    {
+        MAX_ENTRIES = 256,
+        MAX_TTL = 3600,
+    };
+
+    static Cache &instance()
+    {
+        static Cache cache;
+        return cache;
+    }
+
+    bool get(const std::string &name, const unsigned int qtype, std::vector<IP::Addr> &addrs, const Time &now)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto e = entries.find(Key(name, qtype));
+        if (e == entries.end())
+            return false;
+        if (now >= e->second.expire)
+        {
+            entries.erase(e);
+            return false;
+        }
+        addrs = e->second.addrs;
+        return true;
+    }
+
+    void put(const std::string &name, const unsigned int qtype, const std::vector<IP::Addr> &addrs, std::uint32_t ttl, const Time &now)
+    {
+        ttl = std::min(ttl, std::uint32_t(MAX_TTL));
+        if (!ttl || addrs.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.size() >= MAX_ENTRIES)
+        {
+            // drop expired entries, or everything if none has expired
+            for (auto e = entries.begin(); e != entries.end();)
+                e = now >= e->second.expire ? entries.erase(e) : std::next(e);
+            if (entries.size() >= MAX_ENTRIES)
+                entries.clear();
+        }
+        Entry &e = entries[Key(name, qtype)];
+        e.addrs = addrs;
+        e.expire = now + Time::Duration::seconds(ttl);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+  private:
+    typedef std::pair<std::string, unsigned int> Key;
+
+    struct Entry
+    {
+        std::vector<IP::Addr> addrs;
+        Time expire;
+    };
+
+    std::mutex mutex;
+    std::map<Key, Entry> entries;
+};
+
+// Whether the host has non-loopback IPv4 and IPv6 addresses, like
+// AI_ADDRCONFIG.  Both are wanted if neither is found.
+inline void configured_families(bool &v4, bool &v6)
+{
+    v4 = v6 = false;
+#if defined(__linux__) && !defined(__ANDROID__)
+    struct ifaddrs *ifa = nullptr;
+    if (::getifaddrs(&ifa) == 0)
+    {
+        for (const struct ifaddrs *i = ifa; i; i = i->ifa_next)
+        {
+            if (!i->ifa_addr)
+                continue;
+            const IP::Addr a = IP::Addr::from_sockaddr(i->ifa_addr);
+            if (!a.defined() || a.is_loopback())
+                continue;
+            if (a.is_ipv6())
+            {
+                // link-local addresses cannot reach a server
+                unsigned char b[16];
+                a.to_ipv6_nocheck().to_byte_string(b);
+                v6 |= !(b[0] == 0xfe && (b[1] & 0xc0) == 0x80);
+            }
+            else
+                v4 = true;
+        }
+        ::freeifaddrs(ifa);
+    }
+#endif
+    if (!v4 && !v6)
+        v4 = v6 = true;
+}
+
+// DNS messages
+
+inline bool build_query(std::vector<unsigned char> &msg, const std::uint16_t id, const std::string &name, const unsigned int qtype)
+{
+    msg.clear();
+    const unsigned char header[12] = {
+        static_cast<unsigned char>(id >> 8), static_cast<unsigned char>(id), 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 1};
+    msg.insert(msg.end(), header, header + sizeof(header));
+    size_t start = 0;
+    while (start < name.size())
+    {
+        size_t end = name.find('.', start);
+        if (end == std::string::npos)
+            end = name.size();
+        if (end == start || end - start > 63)
+            return false;
+        msg.push_back(static_cast<unsigned char>(end - start));
+        msg.insert(msg.end(), name.begin() + start, name.begin() + end);
+        start = end + 1;
+    }
+    msg.push_back(0);
+    if (msg.size() - sizeof(header) > 255)
+        return false;
+    const unsigned char question_opt[] = {
+        0, static_cast<unsigned char>(qtype), 0, CLASS_IN,
+        // OPT record advertising EDNS_UDP_SIZE
+        0, 0, TYPE_OPT, EDNS_UDP_SIZE >> 8, EDNS_UDP_SIZE & 0xff, 0, 0, 0, 0, 0, 0};
+    msg.insert(msg.end(), question_opt, question_opt + sizeof(question_opt));
+    return true;
+}
+
+struct Answer
+{
+    enum Status
+    {
+        IGNORE,    // not a response to the query
+        OK,        // addrs holds the records, possibly none
+        NXDOMAIN,  // the name does not exist
+        TRUNCATED, // retry over TCP
+        FAILED,    // the server could not answer, try the next one
+    };
+
+    Status status = IGNORE;
+    std::vector<IP::Addr> addrs;
+    std::uint32_t ttl = 0;
+};
+
+inline std::uint16_t get16(const unsigned char *p)
+{
+    return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+// Reads the name at pos into name (if not null), in lowercase with dots,
+// and returns the offset past it, or 0 if malformed
+inline size_t read_name(const unsigned char *msg, const size_t size, size_t pos, std::string *name)
+{
+    size_t end = 0;
+    for (int hops = 0; pos < size; ++hops)
+    {
+        const unsigned char len = msg[pos];
+        if (len == 0)
+            return end ? end : pos + 1;
+        if ((len & 0xC0) == 0xC0)
+        {
+            if (pos + 1 >= size || hops > 32)
+                return 0;
+            if (!end)
+                end = pos + 2;
+            pos = ((len & 0x3F) << 8) | msg[pos + 1];
+            continue;
+        }
+        if (len > 63 || pos + 1 + len > size)
+            return 0;
+        if (name)
+        {
+            if (!name->empty())
+                *name += '.';
+            for (size_t i = 0; i < len; ++i)
+                *name += static_cast<char>(std::tolower(msg[pos + 1 + i]));
+        }
+        pos += 1 + len;
+    }
+    return 0;
+}
+
+inline Answer parse_response(const unsigned char *msg, const size_t size, const std::uint16_t id, const std::string &name, const unsigned int qtype)
+{
+    Answer ans;
+    if (size < 12 || get16(msg) != id || !(msg[2] & 0x80) || get16(msg + 4) != 1)
+        return ans;
+
+    std::string qname;
+    size_t pos = read_name(msg, size, 12, &qname);
+    if (!pos || pos + 4 > size || qname != string::to_lower_copy(name) || get16(msg + pos) != qtype)
+        return ans;
+    pos += 4;
+
+    if (msg[2] & 0x02)
+    {
+        ans.status = Answer::TRUNCATED;
+        return ans;
+    }
+    const unsigned int rcode = msg[3] & 0x0F;
+    if (rcode == RCODE_NXDOMAIN)
+    {
+        ans.status = Answer::NXDOMAIN;
+        return ans;
+    }
+    if (rcode != RCODE_NOERROR)
+    {
+        ans.status = Answer::FAILED;
+        return ans;
+    }
+
+    // A or AAAA records, for the name or at the end of its CNAME chain
+    bool ttl_set = false;
+    for (unsigned int n = get16(msg + 6); n > 0; --n)
+    {
+        pos = read_name(msg, size, pos, nullptr);
+        if (!pos || pos + 10 > size)
+        {
+            ans.status = Answer::FAILED;
+            return ans;
+        }
+        const unsigned int type = get16(msg + pos);
+        const unsigned int cls = get16(msg + pos + 2);
+        const std::uint32_t ttl = (std::uint32_t(get16(msg + pos + 4)) << 16) | get16(msg + pos + 6);
+        const size_t rdlen = get16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlen > size)
+        {
+            ans.status = Answer::FAILED;
+            return ans;
+        }
+        if (cls == CLASS_IN && type == qtype && (type == TYPE_A ? rdlen == 4 : rdlen == 16))
+        {
+            if (type == TYPE_A)
+            {
+                std::uint32_t a;
+                std::memcpy(&a, msg + pos, 4);
+                ans.addrs.push_back(IP::Addr::from_ipv4(IPv4::Addr::from_uint32_net(a)));
+            }
+            else
+                ans.addrs.push_back(IP::Addr::from_ipv6(IPv6::Addr::from_byte_string(msg + pos)));
+        }
+        if (cls == CLASS_IN && (type == qtype || type == TYPE_CNAME))
+        {
+            ans.ttl = ttl_set ? std::min(ans.ttl, ttl) : ttl;
+            ttl_set = true;
+        }
+        pos += rdlen;
+    }
+    ans.status = Answer::OK;
+    return ans;
+}
+
+// One lookup of the A and/or AAAA records of a host name.  The handler
+// is called once on the io_context thread, unless the lookup is
+// cancelled first.
+class Lookup : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<Lookup> Ptr;
+    typedef std::function<void(const openvpn_io::error_code &error, std::vector<IP::Addr> addrs)> Handler;
+
+    Lookup(openvpn_io::io_context &io_context_arg,
+           Config::Ptr config_arg,
+           const std::string &host_arg,
+           const bool want_v4,
+           const bool want_v6,
+           Handler handler_arg)
+        : io_context(io_context_arg),
+          config(std::move(config_arg)),
+          host(host_arg),
+          handler(std::move(handler_arg)),
+          udp(io_context_arg),
+          timer(io_context_arg)
+    {
+        if (want_v6)
+            queries.emplace_back(TYPE_AAAA, io_context_arg);
+        if (want_v4)
+            queries.emplace_back(TYPE_A, io_context_arg);
+    }
+
+    void start()
+    {
+        // literal addresses and static names need no query
+        if (IP::Addr::is_valid(host))
+        {
+            finish_post(openvpn_io::error_code(), {IP::Addr(host)});
+            return;
+        }
+        std::string name = string::to_lower_copy(host);
+        if (string::ends_with(name, '.'))
+            name.pop_back();
+        auto range = config->hosts.equal_range(name);
+        if (range.first != range.second)
+        {
+            std::vector<IP::Addr> addrs;
+            for (const Query &q : queries)
+                for (auto i = range.first; i != range.second; ++i)
+                    if (i->second.is_ipv6() == (q.qtype == TYPE_AAAA))
+                        addrs.push_back(i->second);
+            if (!addrs.empty())
+            {
+                finish_post(openvpn_io::error_code(), std::move(addrs));
+                return;
+            }
+        }
+
+        // names to try, with the search domains
+        const bool absolute = string::ends_with(host, '.');
+        const size_t dots = std::count(name.begin(), name.end(), '.');
+        if (absolute || dots >= config->ndots)
+            names.push_back(name);
+        if (!absolute)
+            for (const std::string &domain : config->search)
+                names.push_back(name + '.' + string::to_lower_copy(domain));
+        if (!absolute && dots < config->ndots)
+            names.push_back(name);
+
+        next_name();
+    }
+
+    void cancel()
+    {
+        if (!halt)
+        {
+            halt = true;
+            handler = nullptr;
+            close();
+        }
+    }
+
+  private:
+    struct Query
+    {
+        Query(const unsigned int qtype_arg, openvpn_io::io_context &io_context)
+            : qtype(qtype_arg),
+              tcp(io_context)
+        {
+        }
+
+        const unsigned int qtype;
+        std::uint16_t id = 0;
+        std::vector<unsigned char> msg;
+        bool done = false;
+        bool via_tcp = false;
+        Answer answer;
+
+        openvpn_io::ip::tcp::socket tcp;
+        unsigned char tcp_len[2];
+        std::vector<unsigned char> tcp_buf;
+    };
+
+    void next_name()
+    {
+        if (name_index >= names.size())
+        {
+            finish(openvpn_io::error::host_not_found);
+            return;
+        }
+        const std::string &name = names[name_index++];
+
+        // answers of all query types cached?
+        size_t cached = 0;
+        for (Query &q : queries)
+        {
+            q.done = false;
+            q.via_tcp = false;
+            q.answer = Answer();
+            if (Cache::instance().get(name, q.qtype, q.answer.addrs, Time::now()))
+            {
+                q.done = true;
+                q.answer.status = Answer::OK;
+                ++cached;
+            }
+            else if (!build_query(q.msg, 0, name, q.qtype))
+            {
+                next_name();
+                return;
+            }
+        }
+        if (cached == queries.size())
+        {
+            complete();
+            return;
+        }
+
+        server_index = 0;
+        attempt = 0;
+        send_udp();
+    }
+
+    const std::string &current_name() const
+    {
+        return names[name_index - 1];
+    }
+
+    // (Re)send the open queries to the current server
+    void send_udp()
+    {
+        close();
+        const Config::Server &server = config->servers[server_index];
+        const openvpn_io::ip::udp::endpoint ep(server.addr.to_asio(), server.port);
+        openvpn_io::error_code ec;
+        udp.open(ep.protocol(), ec);
+        if (!ec)
+            udp.connect(ep, ec);
+        if (ec)
+        {
+            next_server();
+            return;
+        }
+
+        for (Query &q : queries)
+        {
+            if (q.done || q.via_tcp)
+                continue;
+            q.id = static_cast<std::uint16_t>(rng());
+            q.msg[0] = static_cast<unsigned char>(q.id >> 8);
+            q.msg[1] = static_cast<unsigned char>(q.id);
+            udp.send(openvpn_io::buffer(q.msg), 0, ec);
+        }
+        udp_receive();
+
+        timer.expires_after(config->timeout);
+        timer.async_wait([self = Ptr(this), gen = generation](const openvpn_io::error_code &error)
+                         {
+                             if (!error && !self->halt && gen == self->generation)
+                                 self->next_server(); });
+    }
+
+    void udp_receive()
+    {
+        udp.async_receive(openvpn_io::buffer(udp_buf, sizeof(udp_buf)),
+                          [self = Ptr(this), gen = generation](const openvpn_io::error_code &error, const size_t bytes)
+                          {
+                              if (self->halt || gen != self->generation)
+                                  return;
+                              if (!error)
+                                  self->udp_recv(bytes);
+                              else if (error != openvpn_io::error::operation_aborted)
+                                  self->udp_receive(); // e.g. ICMP port unreachable, wait for the timeout
+                          });
+    }
+
+    void udp_recv(const size_t bytes)
+    {
+        const unsigned int gen = generation;
+        for (Query &q : queries)
+        {
+            if (q.done || q.via_tcp)
+                continue;
+            Answer ans = parse_response(udp_buf, bytes, q.id, current_name(), q.qtype);
+            if (ans.status == Answer::IGNORE)
+                continue;
+            if (ans.status == Answer::TRUNCATED)
+                send_tcp(q);
+            else
+                answered(q, std::move(ans));
+            break;
+        }
+
+        // keep receiving unless the lookup is over or moved on to
+        // another name or server, which has its own receive pending
+        if (!halt && gen == generation && !all_done())
+            udp_receive();
+    }
+
+    void answered(Query &q, Answer ans)
+    {
+        switch (ans.status)
+        {
+        case Answer::NXDOMAIN:
+            ++generation;
+            next_name();
+            break;
+        case Answer::FAILED:
+            next_server();
+            break;
+        default:
+            q.answer = std::move(ans);
+            q.done = true;
+            if (all_done())
+                complete();
+            break;
+        }
+    }
+
+    void send_tcp(Query &q)
+    {
+        q.via_tcp = true;
+        const Config::Server &server = config->servers[server_index];
+        const openvpn_io::ip::tcp::endpoint ep(server.addr.to_asio(), server.port);
+        q.tcp_buf.resize(2);
+        q.tcp_buf[0] = static_cast<unsigned char>(q.msg.size() >> 8);
+        q.tcp_buf[1] = static_cast<unsigned char>(q.msg.size());
+        q.tcp_buf.insert(q.tcp_buf.end(), q.msg.begin(), q.msg.end());
+        q.tcp.async_connect(ep, [self = Ptr(this), &q, gen = generation](const openvpn_io::error_code &error)
+                            {
+            if (self->halt || gen != self->generation)
+                return;
+            if (error)
+            {
+                self->next_server();
+                return;
+            }
+            openvpn_io::async_write(q.tcp, openvpn_io::buffer(q.tcp_buf),
+                                    [self, &q, gen](const openvpn_io::error_code &error, const size_t)
+                                    {
+                if (self->halt || gen != self->generation)
+                    return;
+                if (error)
+                {
+                    self->next_server();
+                    return;
+                }
+                self->tcp_read_len(q, gen);
+            }); });
+    }
+
+    void tcp_read_len(Query &q, const unsigned int gen)
+    {
+        openvpn_io::async_read(q.tcp, openvpn_io::buffer(q.tcp_len, sizeof(q.tcp_len)),
+                               [self = Ptr(this), &q, gen](const openvpn_io::error_code &error, const size_t)
+                               {
+            if (self->halt || gen != self->generation)
+                return;
+            if (error)
+            {
+                self->next_server();
+                return;
+            }
+            q.tcp_buf.resize(get16(q.tcp_len));
+            openvpn_io::async_read(q.tcp, openvpn_io::buffer(q.tcp_buf),
+                                   [self, &q, gen](const openvpn_io::error_code &error, const size_t bytes)
+                                   {
+                if (self->halt || gen != self->generation)
+                    return;
+                Answer ans;
+                if (!error)
+                    ans = parse_response(q.tcp_buf.data(), bytes, q.id, self->current_name(), q.qtype);
+                if (ans.status == Answer::IGNORE || ans.status == Answer::TRUNCATED)
+                    ans.status = Answer::FAILED;
+                self->answered(q, std::move(ans));
+            }); });
+    }
+
+    void next_server()
+    {
+        ++generation;
+        if (++server_index >= config->servers.size())
+        {
+            server_index = 0;
+            if (++attempt >= config->attempts)
+            {
+                finish(openvpn_io::error::timed_out);
+                return;
+            }
+        }
+        for (Query &q : queries)
+            q.via_tcp = false;
+        send_udp();
+    }
+
+    bool all_done() const
+    {
+        for (const Query &q : queries)
+            if (!q.done)
+                return false;
+        return true;
+    }
+
+    void complete()
+    {
+        std::vector<IP::Addr> addrs;
+        const Time now = Time::now();
+        for (const Query &q : queries)
+        {
+            Cache::instance().put(current_name(), q.qtype, q.answer.addrs, q.answer.ttl, now);
+            addrs.insert(addrs.end(), q.answer.addrs.begin(), q.answer.addrs.end());
+        }
+        if (addrs.empty())
+        {
+            // no records of the wanted types, try the next name
+            ++generation;
+            next_name();
+            return;
+        }
+        finish(openvpn_io::error_code(), std::move(addrs));
+    }
+
+    void finish(const openvpn_io::error_code &error, std::vector<IP::Addr> addrs = {})
+    {
+        if (halt)
+            return;
+        halt = true;
+        close();
+        Handler h = std::move(handler);
+        handler = nullptr;
+        if (h)
+            h(error, std::move(addrs));
+    }
+
+    // called from start(), so the handler never runs before it returns
+    void finish_post(const openvpn_io::error_code &error, std::vector<IP::Addr> addrs)
+    {
+        openvpn_io::post(io_context, [self = Ptr(this), error, addrs = std::move(addrs)]() mutable
+                         { self->finish(error, std::move(addrs)); });
+    }
+
+    void close()
+    {
+        openvpn_io::error_code ec;
+        timer.cancel();
+        udp.close(ec);
+        for (Query &q : queries)
+            q.tcp.close(ec);
+    }
+
+    openvpn_io::io_context &io_context;
+    Config::Ptr config;
+    std::string host;
+    Handler handler;
+
+    std::vector<std::string> names;
+    size_t name_index = 0;
+    size_t server_index = 0;
+    unsigned int attempt = 0;
+    unsigned int generation = 0; // invalidates the handlers of the previous name or server
+    bool halt = false;
+
+    std::vector<Query> queries;
+    openvpn_io::ip::udp::socket udp;
+    unsigned char udp_buf[EDNS_UDP_SIZE];
+    AsioTimer timer;
+    std::random_device rng;
+};
+
+} // namespace openvpn::DnsStub
+
+#endif
@@ -52,6 +52,8 @@ using namespace std::chrono_literals;
 #include <openvpn/client/cliopt.hpp>
 #include <openvpn/client/remotelist.hpp>
 #include <openvpn/client/clilife.hpp>
+#include <openvpn/client/standbystats.hpp>
+#include <openvpn/transport/client/prewarm.hpp>
 
 namespace openvpn {
 
@@ -83,7 +85,9 @@ namespace openvpn {
 	server_poll_timer(io_context_arg),
 	restart_wait_timer(io_context_arg),
 	conn_timer(io_context_arg),
-	conn_timer_pending(false)
+	conn_timer_pending(false),
+	standby_notify(*this),
+	standby_timer(io_context_arg)
     {
     }
 
@@ -94,6 +98,10 @@ namespace openvpn {
 	  if (!test_network())
 	    throw ErrorCode(Error::NETWORK_UNAVAILABLE, true, "Network Unavailable");
 
+	  const PcapRing::Config pcap = client_options->packet_capture_config();
+	  if (!pcap.path.empty())
+	    start_packet_capture(pcap);
+
 	  RemoteList::Ptr remote_list = client_options->remote_list_precache();
 	  RemoteList::BulkResolve::Ptr bulkres(new RemoteList::BulkResolve(io_context,
 									   remote_list,
@@ -135,6 +143,10 @@ namespace openvpn {
 	      client->tun_set_disconnect();
 	      client->stop(false);
 	    }
+	  detach_promoted_stats();
+	  stop_standby();
+	  stop_prewarm();
+	  stop_packet_capture();
 	  cancel_timers();
 	  asio_work.reset();
 
@@ -181,6 +193,9 @@ namespace openvpn {
 	      client->stop(false);
 	      interim_finalize();
 	    }
+	  detach_promoted_stats();
+	  stop_standby();
+	  stop_prewarm();
 	  cancel_timers();
 	  asio_work.reset(new AsioWork(io_context));
 	  ClientEvent::Base::Ptr ev = new ClientEvent::Pause(reason);
@@ -294,6 +309,64 @@ namespace openvpn {
         }
     }
 
+    // Copy packets of the current and later sessions into a new
+    // capture ring, replacing any capture in progress.  The ring is
+    // constructed here, on the session thread, so that its writer
+    // thread logs into the session's log context.
+    void start_packet_capture(const PcapRing::Config &config)
+    {
+      if (halt)
+	return;
+      stop_packet_capture();
+      packet_capture.reset(new PcapRing(config));
+      OPENVPN_LOG("Packet capture started: " << config.path << " snaplen=" << config.snaplen);
+      if (client)
+	client->set_packet_capture(packet_capture);
+    }
+
+    // The writer finishes on its own thread.  Keep the io_context
+    // running until it has, then log the totals back on this thread.
+    void stop_packet_capture()
+    {
+      if (!packet_capture)
+	return;
+      if (client)
+	client->set_packet_capture(PcapRing::Ptr());
+      packet_capture->stop([io = &io_context, capture = packet_capture, work = std::make_shared<AsioWork>(io_context)]() mutable
+			   {
+			     openvpn_io::post(*io, [capture = std::move(capture), work = std::move(work)]()
+					      {
+						const PcapRing::Stats stats = capture->stats();
+						OPENVPN_LOG("Packet capture stopped: packets=" << stats.written << " dropped=" << stats.dropped
+							    << " files=" << stats.files); }); });
+      packet_capture.reset();
+    }
+
+    void thread_safe_start_packet_capture(PcapRing::Config config)
+    {
+      if (!halt)
+	openvpn_io::post(io_context, [self=Ptr(this), config=std::move(config)]()
+		   {
+		     OPENVPN_ASYNC_HANDLER;
+		     try
+		       {
+			 self->start_packet_capture(config);
+		       }
+		     catch (const std::exception& e)
+		       {
+			 OPENVPN_LOG("Packet capture: " << e.what());
+		       } });
+    }
+
+    void thread_safe_stop_packet_capture()
+    {
+      if (!halt)
+	openvpn_io::post(io_context, [self=Ptr(this)]()
+		   {
+		     OPENVPN_ASYNC_HANDLER;
+		     self->stop_packet_capture(); });
+    }
+
     ~ClientConnect()
     {
       stop();
@@ -410,6 +483,9 @@ namespace openvpn {
 	      lifecycle_started = true;
 	    }
 	}
+
+      stop_prewarm();
+      start_standby();
     }
 
     void client_proto_renegotiated() override
@@ -507,6 +583,11 @@ namespace openvpn {
                 {
                 case Error::UNDEF: // means that there wasn't a fatal error
                     {
+                        if (standby && standby->standby_ready())
+                        {
+                            queue_failover();
+                            break;
+                        }
                         std::chrono::duration client_delay = client->reconnect_delay();
                         queue_restart(client_delay.count() > 0 ? client_delay : default_delay_);
                     }
@@ -679,6 +760,8 @@ namespace openvpn {
 	  client->stop(false);
 	  interim_finalize();
 	}
+      detach_promoted_stats();
+      stop_standby();
       if (generation > 1 && !transport_factory_relay)
 	{
 	  ClientEvent::Base::Ptr ev = new ClientEvent::Reconnecting();
@@ -693,6 +776,7 @@ namespace openvpn {
       // client_config in cliopt.hpp
       Client::Config::Ptr cli_config = client_options->client_config(!transport_factory_relay);
       client.reset(new Client(io_context, *cli_config, this)); // build ClientProto::Session from cliproto.hpp
+      client->set_packet_capture(packet_capture);
       client_finalized = false;
 
       // relay?
@@ -701,6 +785,8 @@ namespace openvpn {
 	  client->transport_factory_override(std::move(transport_factory_relay));
 	  transport_factory_relay.reset();
 	}
+      else
+	update_prewarm();
 
       restart_wait_timer.cancel();
       if (client_options->server_poll_timeout_enabled())
@@ -715,6 +801,214 @@ namespace openvpn {
       client->start();
     }
 
+    // Warm standby: while connected, a second session to the next remote
+    // entry completes its handshake and push reply, and then idles with
+    // keepalives.  When the active session is lost, the standby session
+    // brings up the tun and takes over, without a new handshake.
+
+    // Receives the notifications of the standby session
+    class StandbyNotify : public ClientProto::NotifyCallback
+    {
+      public:
+	explicit StandbyNotify(ClientConnect& parent_arg)
+	  : parent(parent_arg)
+	{
+	}
+
+	void client_proto_terminate() override
+	{
+	  parent.standby_terminate();
+	}
+
+      private:
+	ClientConnect& parent;
+    };
+
+    // Events of the standby session are not reported until it is promoted
+    class StandbyEvents : public ClientEvent::Queue
+    {
+      public:
+	void add_event(ClientEvent::Base::Ptr event) override
+	{
+	}
+    };
+
+    void start_standby()
+    {
+      stop_standby();
+      try
+	{
+	  StandbyStats::Ptr stats(new StandbyStats());
+	  Client::Config::Ptr cli_config = client_options->standby_client_config(stats);
+	  if (!cli_config)
+	    return;
+	  standby_stats = std::move(stats);
+	  cli_config->cli_events.reset(new StandbyEvents());
+	  OPENVPN_LOG("Starting standby session");
+	  standby.reset(new Client(io_context, *cli_config, &standby_notify));
+	  standby->start();
+	}
+      catch (const std::exception& e)
+	{
+	  OPENVPN_LOG("Standby session failed to start: " << e.what());
+	  stop_standby();
+	}
+    }
+
+    void stop_standby()
+    {
+      standby_timer.cancel();
+      if (standby)
+	{
+	  standby->send_explicit_exit_notify();
+	  standby->stop(false);
+	  standby.reset();
+	}
+      standby_stats.reset();
+    }
+
+    // The stats of a promoted standby session are merged into the
+    // client stats until the session is gone
+    void detach_promoted_stats()
+    {
+      if (promoted_stats)
+	{
+	  promoted_stats->detach();
+	  promoted_stats.reset();
+	}
+    }
+
+    // The standby session failed.  It is replaced after a delay, unless
+    // the error would also prevent the replacement from connecting.
+    void standby_terminate()
+    {
+      if (halt || !standby)
+	return;
+      if (standby->fatal() != Error::UNDEF)
+	{
+	  OPENVPN_LOG("Standby session terminated: " << Error::name(standby->fatal()) << ' ' << standby->fatal_reason());
+	  return;
+	}
+      OPENVPN_LOG("Standby session terminated, restarting in " << standby_retry_delay_.count() << " ms...");
+      standby_timer.expires_after(Time::Duration::milliseconds(standby_retry_delay_));
+      standby_timer.async_wait([self=Ptr(this), gen=generation](const openvpn_io::error_code& error)
+                               {
+                                 OPENVPN_ASYNC_HANDLER;
+                                 self->standby_timer_callback(gen, error); });
+    }
+
+    void standby_timer_callback(unsigned int gen, const openvpn_io::error_code& e)
+    {
+      if (!e && gen == generation && !halt && !paused && client && client->reached_connected_state())
+	start_standby();
+    }
+
+    // Called when the active session terminates without a fatal error.
+    // The failed session stops its tun after this returns, so the
+    // standby session takes over from a posted handler.
+    void queue_failover()
+    {
+      OPENVPN_LOG("Client terminated, failing over to standby session...");
+      server_poll_timer.cancel();
+      interim_finalize();
+      openvpn_io::post(io_context, [self=Ptr(this), gen=generation]()
+		       {
+			 OPENVPN_ASYNC_HANDLER;
+			 self->failover(gen); });
+    }
+
+    void failover(unsigned int gen)
+    {
+      if (gen != generation || halt || paused)
+	return;
+      if (!standby || !standby->standby_ready())
+	{
+	  queue_restart();
+	  return;
+	}
+
+      // Make sure generation is > 0 in case of overflow
+      if (++generation == 0)
+	++generation;
+
+      ClientEvent::Base::Ptr ev = new ClientEvent::Reconnecting();
+      client_options->events().add_event(std::move(ev));
+      client_options->stats().error(Error::N_RECONNECT);
+
+      // the standby session is connected to the next remote entry
+      client_options->next(RemoteList::Advance::Remote);
+
+      standby_timer.cancel();
+      client = std::move(standby);
+      client->set_packet_capture(packet_capture);
+      client_finalized = false;
+      detach_promoted_stats();
+      promoted_stats = std::move(standby_stats);
+      promoted_stats->promote(client_options->stats_ptr());
+      client->promote(this, client_options->events_ptr(), client_options->stats_ptr()); // calls back to client_proto_connected
+    }
+
+    // TCP prewarm: while a UDP remote entry is tried, a spare connection
+    // to the next TCP remote entry is opened.  If the client falls back
+    // to that entry, the new session takes over the connected socket
+    // instead of connecting (and going through a proxy, if any) again.
+    // The spare connection is closed once a session connects.
+
+    // Called for each new session, before it is started
+    void update_prewarm()
+    {
+      if (prewarm)
+	{
+	  if (client_options->is_current_remote(*prewarm_remote))
+	    {
+	      TransportClientFactory::Ptr factory = prewarm->release();
+	      if (factory)
+		{
+		  OPENVPN_LOG("Using prewarmed TCP connection");
+		  client->transport_factory_override(std::move(factory));
+		}
+	      stop_prewarm();
+	    }
+	  else if (prewarm->state_get() == TransportPrewarm::FAILED)
+	    {
+	      OPENVPN_LOG("TCP prewarm failed: " << prewarm->error());
+	      stop_prewarm();
+	    }
+	}
+      if (!prewarm)
+	start_prewarm();
+    }
+
+    void start_prewarm()
+    {
+      try
+	{
+	  RemoteList::Ptr rl;
+	  TransportClientFactory::Ptr factory = client_options->prewarm_transport_factory(rl);
+	  if (!factory)
+	    return;
+	  OPENVPN_LOG("Prewarming TCP connection to " << rl->current_server_host());
+	  prewarm.reset(new TransportPrewarm(io_context, std::move(factory)));
+	  prewarm_remote = std::move(rl);
+	  prewarm->start();
+	}
+      catch (const std::exception& e)
+	{
+	  OPENVPN_LOG("TCP prewarm failed to start: " << e.what());
+	  stop_prewarm();
+	}
+    }
+
+    void stop_prewarm()
+    {
+      if (prewarm)
+	{
+	  prewarm->stop();
+	  prewarm.reset();
+	}
+      prewarm_remote.reset();
+    }
+
     // ClientLifeCycle::NotifyCallback callbacks
 
     virtual void cln_stop() override
@@ -754,8 +1048,17 @@ namespace openvpn {
     bool conn_timer_pending;
     std::unique_ptr<AsioWork> asio_work;
     RemoteList::BulkResolve::Ptr bulk_resolve;
+    StandbyNotify standby_notify;
+    Client::Ptr standby;
+    StandbyStats::Ptr standby_stats;
+    StandbyStats::Ptr promoted_stats;
+    AsioTimer standby_timer;
+    TransportPrewarm::Ptr prewarm;
+    RemoteList::Ptr prewarm_remote;
+    PcapRing::Ptr packet_capture;
 
     static constexpr std::chrono::milliseconds default_delay_ = 2000ms;
+    static constexpr std::chrono::milliseconds standby_retry_delay_ = 10000ms;
 };
 
 } // namespace openvpn
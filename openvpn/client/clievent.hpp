@@ -20,6 +20,7 @@
 #include <utility>
 
 #include <openvpn/common/size.hpp>
+#include <openvpn/common/arraysize.hpp>
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/rc.hpp>
 #include <openvpn/transport/protocol.hpp>
@@ -0,0 +1,303 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Decoupled delivery of client events to the host application.  The
+// session thread renders each event into an Item and pushes it into a
+// bounded lock-free multi-producer ring, so that it never waits on the
+// host's event handler.  A single host-owned thread drains the ring
+// with drain(), which also collapses runs of redundant state events
+// such as repeated RECONNECTING into the newest one.
+//
+// Terminal events, DISCONNECTED and fatal errors, are never dropped:
+// if the ring is full they go to a locked overflow list, which drain()
+// delivers once the ring ahead of them is empty.
+
+#ifndef OPENVPN_CLIENT_CLIEVENTQUEUE_H
+#define OPENVPN_CLIENT_CLIEVENTQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/count.hpp>
+#include <openvpn/client/clievent.hpp>
+
+namespace openvpn::ClientEvent {
+
+class AsyncQueue : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<AsyncQueue> Ptr;
+
+    // An event rendered on the session thread.  For CUSTOM_CONTROL,
+    // name is the protocol and info the payload.
+    struct Item
+    {
+        Type id = DISCONNECTED;
+        bool error = false;
+        bool fatal = false;
+        std::string name;
+        std::string info;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct Stats
+    {
+        count_t queued = 0;         // events pushed into the ring
+        count_t delivered = 0;      // events passed to the host
+        count_t coalesced = 0;      // events superseded by a newer one of the same type
+        count_t dropped = 0;        // events lost because the ring was full
+        count_t overflowed = 0;     // terminal events queued on the overflow list
+        std::int64_t last_lag = 0;  // push to delivery of the last event, in microseconds
+        std::int64_t max_lag = 0;   // maximum push to delivery time, in microseconds
+        std::int64_t mean_lag = 0;  // mean push to delivery time, in microseconds
+    };
+
+    explicit AsyncQueue(const size_t capacity)
+        : mask(ring_size(capacity) - 1),
+          cells(mask + 1)
+    {
+        for (size_t i = 0; i < cells.size(); ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return cells.size();
+    }
+
+    // Transitional events that only report the latest state, so that
+    // a run of them can be replaced by the newest one
+    static bool coalescible(const Type id)
+    {
+        switch (id)
+        {
+        case RECONNECTING:
+        case RESOLVE:
+        case WAIT:
+        case WAIT_PROXY:
+        case CONNECTING:
+        case GET_CONFIG:
+        case ASSIGN_IP:
+        case ADD_ROUTES:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Events the host must see even if the ring is full
+    static bool terminal(const Item &item)
+    {
+        return item.fatal || item.id == DISCONNECTED;
+    }
+
+    // May be called from any thread.  Returns false if the ring is full,
+    // in which case the event is dropped rather than blocking the caller,
+    // unless it is terminal.  While terminal events wait on the overflow
+    // list, later terminal events join them and all others are dropped,
+    // so that nothing overtakes them.
+    bool push(Item item)
+    {
+        item.queued = std::chrono::steady_clock::now();
+        if (overflow_pending.load(std::memory_order_seq_cst))
+            return push_overflow(std::move(item));
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const std::intptr_t dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return push_overflow(std::move(item));
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+        cell->item = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_seq_cst);
+        queued.fetch_add(1, std::memory_order_relaxed);
+
+        // only take the lock if the consumer is asleep
+        if (waiting.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_one();
+        }
+        return true;
+    }
+
+    // Called by one thread only, the host's delivery thread.  Waits up
+    // to timeout for an event, then passes the events in the ring to
+    // fn(Item&), at most one ring's worth so that busy producers cannot
+    // keep it here forever.  Returns the number of events delivered.
+    template <typename FUNC>
+    size_t drain(FUNC fn, const std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+    {
+        if (!ready(dequeue_pos) && timeout.count() > 0)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.store(true, std::memory_order_seq_cst);
+            cond.wait_for(lock, timeout, [this]()
+                          { return ready(dequeue_pos) || overflow_pending.load(std::memory_order_relaxed); });
+            waiting.store(false, std::memory_order_relaxed);
+        }
+
+        size_t n = 0;
+        Item item;
+        for (size_t i = 0; i < cells.size() && pop(item); ++i)
+        {
+            if (coalescible(item.id) && ready(dequeue_pos) && cells[dequeue_pos & mask].item.id == item.id)
+            {
+                coalesced.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            deliver(fn, item);
+            ++n;
+        }
+
+        // the overflow list follows everything that was in the ring
+        // when it was started
+        if (overflow_pending.load(std::memory_order_seq_cst) && !ready(dequeue_pos))
+        {
+            std::vector<Item> items;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                items.swap(overflow);
+                overflow_pending.store(false, std::memory_order_seq_cst);
+            }
+            for (Item &it : items)
+            {
+                deliver(fn, it);
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.queued = queued.load(std::memory_order_relaxed);
+        s.delivered = delivered.load(std::memory_order_relaxed);
+        s.coalesced = coalesced.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        s.overflowed = overflowed.load(std::memory_order_relaxed);
+        s.last_lag = last_lag.load(std::memory_order_relaxed);
+        s.max_lag = max_lag.load(std::memory_order_relaxed);
+        s.mean_lag = mean_lag.load(std::memory_order_relaxed);
+        return s;
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        Item item;
+    };
+
+    static size_t ring_size(const size_t n)
+    {
+        size_t size = 2;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+
+    bool push_overflow(Item item)
+    {
+        if (!terminal(item))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            overflow.push_back(std::move(item));
+            overflow_pending.store(true, std::memory_order_seq_cst);
+            cond.notify_one();
+        }
+        queued.fetch_add(1, std::memory_order_relaxed);
+        overflowed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template <typename FUNC>
+    void deliver(FUNC &fn, Item &item)
+    {
+        const std::int64_t lag = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - item.queued)
+                                     .count();
+        lag_total += lag;
+        last_lag.store(lag, std::memory_order_relaxed);
+        if (lag > max_lag.load(std::memory_order_relaxed))
+            max_lag.store(lag, std::memory_order_relaxed);
+        delivered.fetch_add(1, std::memory_order_relaxed);
+        mean_lag.store(lag_total / static_cast<std::int64_t>(delivered.load(std::memory_order_relaxed)),
+                       std::memory_order_relaxed);
+
+        fn(item);
+    }
+
+    bool ready(const size_t pos) const
+    {
+        return cells[pos & mask].seq.load(std::memory_order_seq_cst) == pos + 1;
+    }
+
+    bool pop(Item &item)
+    {
+        const size_t pos = dequeue_pos;
+        if (!ready(pos))
+            return false;
+        Cell &cell = cells[pos & mask];
+        item = std::move(cell.item);
+        cell.seq.store(pos + mask + 1, std::memory_order_release);
+        dequeue_pos = pos + 1;
+        return true;
+    }
+
+    const size_t mask;
+    std::vector<Cell> cells;
+
+    alignas(64) std::atomic<size_t> enqueue_pos{0}; // shared by the producers
+    alignas(64) size_t dequeue_pos = 0;             // owned by the consumer
+    std::int64_t lag_total = 0;
+
+    std::atomic<bool> waiting{false};
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Item> overflow; // terminal events, protected by mutex
+    std::atomic<bool> overflow_pending{false};
+
+    std::atomic<count_t> queued{0};
+    std::atomic<count_t> delivered{0};
+    std::atomic<count_t> coalesced{0};
+    std::atomic<count_t> dropped{0};
+    std::atomic<count_t> overflowed{0};
+    std::atomic<std::int64_t> last_lag{0};
+    std::atomic<std::int64_t> max_lag{0};
+    std::atomic<std::int64_t> mean_lag{0};
+};
+
+} // namespace openvpn::ClientEvent
+
+#endif
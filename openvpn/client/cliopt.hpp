@@ -457,6 +457,7 @@ class ClientOptions : public RC<thread_unsafe_refcount>
                 tunconf->tun_prop.google_dns_fallback = config.clientconf.googleDnsFallback;
                 tunconf->tun_prop.dhcp_search_domains_as_split_domains = config.clientconf.dhcpSearchDomainsAsSplitDomains;
                 tunconf->generate_tun_builder_capture_event = config.clientconf.generateTunBuilderCaptureEvent;
+                tunconf->io_uring = config.clientconf.ioUring;
                 tunconf->tun_prop.remote_list = remote_list;
                 tunconf->frame = frame;
                 tunconf->stats = cli_stats;
@@ -1184,6 +1185,8 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         cli_config->creds = creds;
         cli_config->pushed_options_filter = pushed_options_filter;
         cli_config->tcp_queue_limit = tcp_queue_limit;
+        cli_config->tcp_queue_aqm = clientconf.tcpQueueAqm;
+        cli_config->dns_cache = clientconf.dnsCache;
         cli_config->ncp_disable = ncp_disable;
         cli_config->echo = clientconf.echo;
         cli_config->info = clientconf.info;
@@ -1198,6 +1201,74 @@ class ClientOptions : public RC<thread_unsafe_refcount>
         return cli_config;
     }
 
+    /**
+     * Return a client configuration for a warm standby session to the
+     * next remote entry, or an undefined pointer if warm standby is
+     * disabled or not possible with this profile.
+     *
+     * The standby session uses its own copy of the remote list and its
+     * own transport, which must be a direct UDP or TCP connection, and
+     * counts in the given stats instead of the client stats.
+     */
+    Client::Config::Ptr standby_client_config(const SessionStats::Ptr &stats)
+    {
+#ifdef OPENVPN_EXTERNAL_TRANSPORT_FACTORY
+        return Client::Config::Ptr();
+#else
+        if (!clientconf.warmStandby || dco || alt_proxy || http_proxy_options || cp_relay)
+            return Client::Config::Ptr();
+
+        RemoteList::Ptr rl = remote_list->clone_next_remote();
+        if (!rl)
+            return Client::Config::Ptr();
+
+        Client::Config::Ptr cli_config = client_config(false);
+        cli_config->transport_factory = new_link_transport_factory(rl, stats);
+        cli_config->cli_stats = stats;
+        cli_config->standby = true;
+        return cli_config;
+#endif
+    }
+
+    /**
+     * Return a transport factory for a spare connection to the next TCP
+     * remote entry, to be opened while the current UDP entry is tried,
+     * or an undefined pointer if TCP prewarm is disabled or not possible
+     * from the current entry.  rl is set to the copy of the remote list
+     * used by the factory, positioned at that TCP entry.
+     */
+    TransportClientFactory::Ptr prewarm_transport_factory(RemoteList::Ptr& rl)
+    {
+#ifdef OPENVPN_EXTERNAL_TRANSPORT_FACTORY
+        return TransportClientFactory::Ptr();
+#else
+        if (!clientconf.tcpPrewarm || dco || alt_proxy || http_proxy_options || cp_relay
+            || !remote_list->current_transport_protocol().is_udp())
+            return TransportClientFactory::Ptr();
+
+        rl = remote_list->clone_next_remote(Protocol(Protocol::TCP));
+        if (!rl)
+            return TransportClientFactory::Ptr();
+        return new_link_transport_factory(rl, cli_stats);
+#endif
+    }
+
+    // Return true if the current remote entry is the current entry of rl
+    bool is_current_remote(const RemoteList& rl) const
+    {
+        return remote_list->same_current_item(rl);
+    }
+
+    // Packet capture requested by the config, with an empty path if none
+    PcapRing::Config packet_capture_config() const
+    {
+        PcapRing::Config config;
+        config.path = clientconf.packetCapture;
+        if (clientconf.packetCaptureSnaplen > 0)
+            config.snaplen = clientconf.packetCaptureSnaplen;
+        return config;
+    }
+
     bool need_creds() const
     {
       return !autologin;
@@ -1250,6 +1321,10 @@ class ClientOptions : public RC<thread_unsafe_refcount>
     {
         return *cli_events;
     }
+    const ClientEvent::Queue::Ptr &events_ptr() const
+    {
+        return cli_events;
+    }
     ClientLifeCycle *lifecycle()
     {
         return client_lifecycle.get();
@@ -1430,49 +1505,60 @@ class ClientOptions : public RC<thread_unsafe_refcount>
 	  transport_factory = httpconf;
 	}
       else
+	transport_factory = new_link_transport_factory(remote_list, cli_stats);
+#endif // OPENVPN_EXTERNAL_TRANSPORT_FACTORY
+      return remote_list->current_server_host();
+    }
+
+#ifndef OPENVPN_EXTERNAL_TRANSPORT_FACTORY
+    // construct a direct UDP or TCP transport to the current entry of rl
+    TransportClientFactory::Ptr new_link_transport_factory(const RemoteList::Ptr& rl, const SessionStats::Ptr& stats)
+    {
+      const Protocol& transport_protocol = rl->current_transport_protocol();
+      if (transport_protocol.is_udp())
 	{
-	  if (transport_protocol.is_udp())
-	    {
-	      // UDP transport
-	      UDPTransport::ClientConfig::Ptr udpconf = UDPTransport::ClientConfig::new_obj();
-	      udpconf->remote_list = remote_list;
-	      udpconf->frame = frame;
-	      udpconf->stats = cli_stats;
-	      udpconf->socket_protect = socket_protect;
-	      udpconf->server_addr_float = server_addr_float;
+	  // UDP transport
+	  UDPTransport::ClientConfig::Ptr udpconf = UDPTransport::ClientConfig::new_obj();
+	  udpconf->remote_list = rl;
+	  udpconf->frame = frame;
+	  udpconf->stats = stats;
+	  udpconf->socket_protect = socket_protect;
+	  udpconf->server_addr_float = server_addr_float;
+	  udpconf->io_uring = clientconf.ioUring;
+	  udpconf->monitor_drops = clientconf.udpDropMonitor;
+	  udpconf->sockbuf_autotune_max = clientconf.udpSockBufMax;
 #ifdef OPENVPN_GREMLIN
-	      udpconf->gremlin_config = gremlin_config;
+	  udpconf->gremlin_config = gremlin_config;
 #endif
-	      transport_factory = udpconf;
-	    }
-	  else if (transport_protocol.is_tcp()
+	  return udpconf;
+	}
+      else if (transport_protocol.is_tcp()
 #ifdef OPENVPN_TLS_LINK
-		   || transport_protocol.is_tls()
+	  || transport_protocol.is_tls()
 #endif
-		  )
-	    {
-	      // TCP transport
-	      TCPTransport::ClientConfig::Ptr tcpconf = TCPTransport::ClientConfig::new_obj();
-	      tcpconf->remote_list = remote_list;
-	      tcpconf->frame = frame;
-	      tcpconf->stats = cli_stats;
-	      tcpconf->socket_protect = socket_protect;
+	  )
+	{
+	  // TCP transport
+	  TCPTransport::ClientConfig::Ptr tcpconf = TCPTransport::ClientConfig::new_obj();
+	  tcpconf->remote_list = rl;
+	  tcpconf->frame = frame;
+	  tcpconf->stats = stats;
+	  tcpconf->socket_protect = socket_protect;
 #ifdef OPENVPN_TLS_LINK
-	      if (transport_protocol.is_tls())
+	  if (transport_protocol.is_tls())
 		tcpconf->use_tls = true;
-	      tcpconf->tls_ca = tls_ca;
+	  tcpconf->tls_ca = tls_ca;
 #endif
 #ifdef OPENVPN_GREMLIN
-	      tcpconf->gremlin_config = gremlin_config;
+	  tcpconf->gremlin_config = gremlin_config;
 #endif
-                transport_factory = tcpconf;
-            }
-            else
-                throw option_error(ERR_INVALID_OPTION_VAL, "internal error: unknown transport protocol");
-        }
-#endif // OPENVPN_EXTERNAL_TRANSPORT_FACTORY
-      return remote_list->current_server_host();
+	  return tcpconf;
+	}
+      else
+	throw option_error(ERR_INVALID_OPTION_VAL, "internal error: unknown transport protocol");
     }
+#endif
+
     // General client options.
     ClientConfigParsed clientconf;
 
@@ -45,6 +45,7 @@ using namespace std::chrono_literals;
 #include <openvpn/tun/client/tunbase.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/client/relay.hpp>
+#include <openvpn/transport/fqcodel.hpp>
 #include <openvpn/options/continuation.hpp>
 #include <openvpn/options/sanitize.hpp>
 #include <openvpn/client/acc_certcheck.hpp>
@@ -52,6 +53,9 @@ using namespace std::chrono_literals;
 #include <openvpn/client/clicreds.hpp>
 #include <openvpn/client/cliconstants.hpp>
 #include <openvpn/client/clihalt.hpp>
+#include <openvpn/client/dns.hpp>
+#include <openvpn/client/dnscache.hpp>
+#include <openvpn/log/pcapring.hpp>
 #include <openvpn/client/optfilt.hpp>
 #include <openvpn/time/asiotimer.hpp>
 #include <openvpn/time/coarsetime.hpp>
@@ -86,6 +90,11 @@ struct NotifyCallback
     virtual void client_proto_renegotiated()
     {
     }
+    // a standby session has processed its push reply and is ready to
+    // be promoted
+    virtual void client_proto_standby_ready()
+    {
+    }
     };
 
 class Session : ProtoContextCallbackInterface,
@@ -137,6 +146,9 @@ class Session : ProtoContextCallbackInterface,
         OptionList::Limits pushed_options_limit;
         OptionList::FilterBase::Ptr pushed_options_filter;
         unsigned int tcp_queue_limit = 64;
+        bool tcp_queue_aqm = false; // schedule packets for a stream transport with FQ-CoDel
+        bool standby = false;       // hold the session after the push reply, without a tun, until promote()
+        bool dns_cache = false;     // answer repeated queries to the pushed DNS servers locally
         bool ncp_disable = false;
         bool echo = false;
         bool info = false;
@@ -151,6 +163,9 @@ class Session : ProtoContextCallbackInterface,
           transport_factory(config.transport_factory),
           tun_factory(config.tun_factory),
           tcp_queue_limit(config.tcp_queue_limit),
+          tcp_queue_aqm(config.tcp_queue_aqm),
+          standby(config.standby),
+          dns_cache_enabled(config.dns_cache),
           notify_callback(notify_callback_arg),
           housekeeping_timer(io_context_arg),
           push_request_timer(io_context_arg),
@@ -168,11 +183,6 @@ class Session : ProtoContextCallbackInterface,
           inactive_timer(io_context_arg),
           info_hold_timer(io_context_arg)
     {
-#ifdef OPENVPN_PACKET_LOG
-	packet_log.open(OPENVPN_PACKET_LOG, std::ios::binary);
-	if (!packet_log)
-	  OPENVPN_THROW(open_file_error, "cannot open packet log for output: " << OPENVPN_PACKET_LOG);
-#endif
         proto_context.update_now();
         proto_context.reset();
         // proto_context.enable_strict_openvpn_2x();
@@ -197,6 +207,8 @@ class Session : ProtoContextCallbackInterface,
 	    // initialize transport-layer packet handler
 	    transport = transport_factory->new_transport_client_obj(io_context, this);
 	    transport_has_send_queue = transport->transport_has_send_queue();
+	    if (transport_has_send_queue && tcp_queue_aqm)
+	      tcp_queue.reset(new FQCoDel(FQCoDel::Config()));
 	    if (transport_factory->is_relay())
 	      transport_connecting();
 	    else
@@ -285,6 +297,22 @@ class Session : ProtoContextCallbackInterface,
             inactive_timer.cancel();
 
             info_hold_timer.cancel();
+            if (tcp_queue && tcp_queue->stats().enqueued)
+            {
+                const FQCoDel::Stats &qs = tcp_queue->stats();
+                OPENVPN_LOG("TCP send queue: packets=" << qs.dequeued
+                                                       << " codel_drops=" << qs.codel_drops
+                                                       << " overlimit_drops=" << qs.overlimit_drops
+                                                       << " delay_avg_ms=" << qs.sojourn_avg().to_milliseconds()
+                                                       << " delay_max_ms=" << qs.sojourn_max.to_milliseconds());
+            }
+            if (dns_cache && (dns_cache->stats().hits || dns_cache->stats().misses))
+            {
+                const DnsCache::Stats &ds = dns_cache->stats();
+                OPENVPN_LOG("DNS cache: hits=" << ds.hits
+                                               << " misses=" << ds.misses
+                                               << " hit_rate=" << ds.hit_rate() << '%');
+            }
             if (notify_callback && call_terminate_callback)
                 notify_callback->client_proto_terminate();
             if (tun)
@@ -304,6 +332,54 @@ class Session : ProtoContextCallbackInterface,
         return bool(connected_);
     }
 
+    bool standby_ready() const
+    {
+        return standby_ready_;
+    }
+
+    // Start copying packets into the given capture ring, or stop with
+    // a null pointer
+    void set_packet_capture(PcapRing::Ptr capture)
+    {
+        packet_capture = std::move(capture);
+    }
+
+    // Turn a standby session that has processed its push reply into the
+    // active session.  Its data channel is already up, so this only has
+    // to bring up the tun.  Events and notifications go to the given
+    // callbacks, and the session's own stats (the tun, DNS cache and
+    // inactivity timer) to the given stats from here on.  The transport
+    // and protocol keep counting in the standby stats.
+    void promote(NotifyCallback *notify_callback_arg, ClientEvent::Queue::Ptr cli_events_arg, SessionStats::Ptr cli_stats_arg)
+    {
+        if (halt || !standby_ready_)
+            throw client_exception("standby session is not ready");
+        notify_callback = notify_callback_arg;
+        cli_events = std::move(cli_events_arg);
+        cli_stats = std::move(cli_stats_arg);
+        standby = false;
+        standby_ready_ = false;
+        try
+        {
+            proto_context.update_now();
+            connect_tun(true);
+            set_housekeeping_timer();
+        }
+        catch (const std::exception &e)
+        {
+            process_exception(e, "promote");
+        }
+    }
+
+    // Statistics of the FQ-CoDel scheduler in front of the transport
+    // send queue, or nullptr if it is not in use
+    const FQCoDel::Stats *tcp_queue_stats() const
+    {
+        if (tcp_queue)
+            return &tcp_queue->stats();
+        return nullptr;
+    }
+
       // If fatal() returns something other than Error::UNDEF, it
       // is intended to flag the higher levels (cliconnect.hpp)
       // that special handling is required.  This handling might include
@@ -360,6 +436,12 @@ class Session : ProtoContextCallbackInterface,
         {
             OPENVPN_LOG_CLIPROTO("Transport RECV " << server_endpoint_render() << ' ' << proto_context.dump_packet(buf));
 
+            // account CPU time not claimed by crypto/compression/control to i/o
+            CPUAccounting::Scope cpu(cli_stats->cpu_accounting(), CPUAccounting::IO);
+
+            if (packet_capture)
+                packet_capture->capture(PcapRing::LINK, false, buf);
+
             // update current time
             proto_context.update_now();
 
@@ -384,22 +466,31 @@ class Session : ProtoContextCallbackInterface,
                 proto_context.data_decrypt(pt, buf);
                 if (buf.size())
                 {
-#ifdef OPENVPN_PACKET_LOG
-		  log_packet(buf, false);
-#endif
+		  if (packet_capture)
+		    packet_capture->capture(PcapRing::TUN, false, buf);
 		  // make packet appear as incoming on tun interface
 		  if (tun)
 		    {
 		      OPENVPN_LOG_CLIPROTO("TUN send, size=" << buf.size());
+		      if (dns_cache)
+			dns_cache->learn(buf, proto_context.now());
 		      tun->tun_send(buf);
 		    }
 		}
 
-                // do a lightweight flush
-                proto_context.flush(false);
+                // do a lightweight flush -- if it found no control work,
+                // the data packet could only have moved the keepalive
+                // expiration later, so a pending housekeeping wakeup
+                // is still good
+                if (!proto_context.flush(false)
+                    && !proto_context.invalidated()
+                    && housekeeping_schedule.defined())
+                    return;
             }
             else if (pt.is_control())
             {
+                CPUAccounting::Scope cpu_control(cli_stats->cpu_accounting(), CPUAccounting::CONTROL);
+
                 // control packet
                 proto_context.control_net_recv(pt, std::move(buf));
 
@@ -432,6 +523,18 @@ class Session : ProtoContextCallbackInterface,
 
       void transport_needs_send() override
       {
+	if (tcp_queue && !tcp_queue->empty())
+	  {
+	    try
+	      {
+		proto_context.update_now();
+		tcp_queue_flush();
+	      }
+	    catch (const std::exception& e)
+	      {
+		process_exception(e, "transport_needs_send");
+	      }
+	  }
       }
 
       // tun i/o driver calls here with incoming packets
@@ -441,16 +544,20 @@ class Session : ProtoContextCallbackInterface,
         {
 	  OPENVPN_LOG_CLIPROTO("TUN recv, size=" << buf.size());
 
+            CPUAccounting::Scope cpu(cli_stats->cpu_accounting(), CPUAccounting::IO);
+
             // update current time
             proto_context.update_now();
 
-	  // log packet
-#ifdef OPENVPN_PACKET_LOG
-	  log_packet(buf, true);
-#endif
+	  if (packet_capture)
+	    packet_capture->capture(PcapRing::TUN, true, buf);
+
+            // answer repeated DNS queries locally, also while the transport
+            // queue is full
+            const bool dns_cached = dns_cache && dns_cache->answer(buf, proto_context.now());
 
 	  // if transport layer has an output queue, check if it's full
-	  if (transport_has_send_queue)
+	  if (!dns_cached && transport_has_send_queue && !tcp_queue)
 	    {
 	      if (transport->transport_send_queue_size() > tcp_queue_limit)
 		{
@@ -477,11 +584,27 @@ class Session : ProtoContextCallbackInterface,
                 constexpr size_t MinIpHeader = 20;
                 size_t mss_no_tcp_ip_encap = c.mss_fix + (MinTcpHeader + MinIpHeader);
 
-                if (df && c.mss_fix > 0 && buf.size() > mss_no_tcp_ip_encap)
+                if (dns_cached)
+                {
+                    // answered from the DNS cache
+                    if (packet_capture)
+                        packet_capture->capture(PcapRing::TUN, false, buf);
+                    tun->tun_send(buf);
+                }
+                else if (df && c.mss_fix > 0 && buf.size() > mss_no_tcp_ip_encap)
                 {
                     Ptb::generate_icmp_ptb(buf, clamp_to_typerange<unsigned short>(mss_no_tcp_ip_encap));
                     tun->tun_send(buf);
                 }
+                else if (tcp_queue)
+                {
+                    // packet is encrypted when the scheduler releases it
+                    if (!tcp_queue->enqueue(buf, proto_context.now()))
+                        cli_stats->error(Error::TCP_OVERFLOW);
+                    tcp_queue_flush();
+                    if (halt)
+                        return;
+                }
                 else
                 {
                     proto_context.data_encrypt(buf);
@@ -489,6 +612,8 @@ class Session : ProtoContextCallbackInterface,
                     {
                         // send packet via transport to destination
                         OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(buf));
+                        if (packet_capture)
+                            packet_capture->capture(PcapRing::LINK, true, buf);
                         if (transport->transport_send(buf))
                             proto_context.update_last_sent();
                         else if (halt)
@@ -554,6 +679,7 @@ class Session : ProtoContextCallbackInterface,
       {
         try
         {
+            CPUAccounting::Scope cpu(cli_stats->cpu_accounting(), CPUAccounting::CONTROL);
             proto_context.conf().build_connect_time_peer_info_string(transport);
             OPENVPN_LOG("Connecting to " << server_endpoint_render());
             proto_context.set_protocol(transport->transport_protocol());
@@ -564,6 +690,14 @@ class Session : ProtoContextCallbackInterface,
             proto_context.flush(true);
             set_housekeeping_timer();
         }
+        catch (const ExceptionCode &e)
+        {
+            // such as a CA bundle that fails to parse on first use
+            if (e.code_defined() && e.fatal())
+                transport_error((Error::Type)e.code(), e.what());
+            else
+                process_exception(e, "transport_connecting");
+        }
         catch (const std::exception &e)
         {
             process_exception(e, "transport_connecting");
@@ -608,7 +742,8 @@ class Session : ProtoContextCallbackInterface,
 
 	// auth-token-user
 	{
-	  const Option* o = opt.get_ptr("auth-token-user");
+	  static const OptionName auth_token_user_name("auth-token-user");
+	  const Option* o = opt.get_ptr(auth_token_user_name);
 	  if (o)
 	    username = base64->decode(o->get(1, 340)); // 255 chars after base64 decode
 	}
@@ -616,7 +751,8 @@ class Session : ProtoContextCallbackInterface,
 	// auth-token
 	{
 	  // if auth-token is present, use it as the password for future renegotiations
-	  const Option* o = opt.get_ptr("auth-token");
+	  static const OptionName auth_token_name("auth-token");
+	  const Option* o = opt.get_ptr(auth_token_name);
 	  if (o)
 	    {
 	      const std::string& sess_id = o->get(1, 256);
@@ -731,6 +867,8 @@ class Session : ProtoContextCallbackInterface,
     void control_net_send(const Buffer &net_buf) override
     {
         OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(net_buf));
+        if (packet_capture)
+            packet_capture->capture(PcapRing::LINK, true, net_buf);
         if (transport->transport_send_const(net_buf))
             proto_context.update_last_sent();
     }
@@ -1113,6 +1251,37 @@ class Session : ProtoContextCallbackInterface,
             creds->purge_user_pass();
         }
 
+        // a standby session keeps its data channel up for keepalives,
+        // and waits for promote() to bring up the tun
+        if (standby)
+        {
+            proto_context.init_data_channel();
+            standby_ready_ = true;
+            OPENVPN_LOG("Standby session ready");
+            if (notify_callback)
+                notify_callback->client_proto_standby_ready();
+            return;
+        }
+
+        connect_tun(false);
+            }
+            else
+                OPENVPN_LOG("Options continuation...");
+        }
+        else if (received_options.complete())
+        {
+            // We got a PUSH REPLY in the middle of a session. Ignore it apart from
+            // updating the auth-token if included in the push reply
+            auto opts = OptionList::parse_from_csv_static(msg.substr(11), nullptr);
+            extract_auth_token(opts);
+        }
+    }
+
+    // Bring up the tun with the pushed options and report the session
+    // as connected.  data_channel_ready is set for a promoted standby
+    // session, whose data channel was initialized with its push reply.
+    void connect_tun(const bool data_channel_ready)
+    {
         // initialize tun/routing
         tun = tun_factory->new_tun_client_obj(io_context, *this, transport.get());
         tun->tun_start(received_options, *transport, proto_context.dc_settings());
@@ -1125,7 +1294,8 @@ class Session : ProtoContextCallbackInterface,
         proto_context.conf().tun_mtu = tun->vpn_mtu();
 
         // initialize data channel after pushed options have been processed
-        proto_context.init_data_channel();
+        if (!data_channel_ready)
+            proto_context.init_data_channel();
 
         // we got pushed options and initializated crypto - now we can push mss to dco
         tun->adjust_mss(proto_context.conf().mss_fix);
@@ -1137,6 +1307,10 @@ class Session : ProtoContextCallbackInterface,
 		// process "inactive" directive
 		process_inactive(received_options);
 
+        // answer repeated DNS queries to the pushed servers locally
+        if (dns_cache_enabled)
+            start_dns_cache();
+
 		// tell parent that we are connected
 		if (notify_callback)
 		  notify_callback->client_proto_connected();
@@ -1152,16 +1326,20 @@ class Session : ProtoContextCallbackInterface,
 
                 // check for proto options
                 check_proto_warnings();
-            }
-            else
-                OPENVPN_LOG("Options continuation...");
+    }
+
+    void start_dns_cache()
+    {
+        try
+        {
+            DnsOptionsParser dns_options(received_options, false);
+            dns_cache.reset(new DnsCache(dns_options, cli_stats, DnsCache::Config()));
+            if (dns_cache->empty())
+                dns_cache.reset();
         }
-        else if (received_options.complete())
+        catch (const std::exception &e)
         {
-            // We got a PUSH REPLY in the middle of a session. Ignore it apart from
-            // updating the auth-token if included in the push reply
-            auto opts = OptionList::parse_from_csv_static(msg.substr(11), nullptr);
-            extract_auth_token(opts);
+            OPENVPN_LOG("DNS cache disabled: " << e.what());
         }
     }
 
@@ -1459,6 +1637,8 @@ class Session : ProtoContextCallbackInterface,
         {
             if (!e && !halt)
             {
+                CPUAccounting::Scope cpu(cli_stats->cpu_accounting(), CPUAccounting::CONTROL);
+
                 // update current time
                 proto_context.update_now();
 
@@ -1537,6 +1717,8 @@ class Session : ProtoContextCallbackInterface,
                     [self = Ptr(this)](const count_t value)
                     { self->reset_inactive_timer(value); });
 
+                // the stats may be shared with earlier sessions
+                inactive_last_sample = cli_stats->get_stat(SessionStats::TUN_BYTES_IN) + cli_stats->get_stat(SessionStats::TUN_BYTES_OUT);
                 schedule_inactive_timer();
             }
         }
@@ -1614,7 +1796,8 @@ class Session : ProtoContextCallbackInterface,
 
       void process_echo(const OptionList& opt)
       {
-	OptionList::IndexMap::const_iterator echo_opt = opt.map().find("echo");
+	static const OptionName echo_name("echo");
+	OptionList::IndexMap::const_iterator echo_opt = opt.map().find(echo_name);
 	if (echo_opt != opt.map().end())
 	  {
 	    for (OptionList::IndexList::const_iterator i = echo_opt->second.begin(); i != echo_opt->second.end(); ++i)
@@ -1689,19 +1872,31 @@ class Session : ProtoContextCallbackInterface,
         }
     }
 
-#ifdef OPENVPN_PACKET_LOG
-      void log_packet(const Buffer& buf, const bool out)
-      {
-	if (buf.size())
-	  {
-	    std::uint16_t len = buf.size() & 0x7FFF;
-	    if (out)
-	      len |= 0x8000;
-	    packet_log.write((const char *)&len, sizeof(len));
-	    packet_log.write((const char *)buf.c_data(), buf.size());
-	  }
-      }
-#endif
+    // Move packets from the FQ-CoDel scheduler to the transport while
+    // the transport send queue is shorter than TCP_QUEUE_LINK_DEPTH.
+    // Keeping that queue short leaves the scheduler in charge of the
+    // order and of the drop decisions.
+    void tcp_queue_flush()
+    {
+        const count_t codel_drops = tcp_queue->stats().codel_drops;
+        while (transport->transport_send_queue_size() < TCP_QUEUE_LINK_DEPTH
+               && tcp_queue->dequeue(tcp_queue_buf, proto_context.now()))
+        {
+            proto_context.data_encrypt(tcp_queue_buf);
+            if (tcp_queue_buf.size())
+            {
+                OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << proto_context.dump_packet(tcp_queue_buf));
+                if (packet_capture)
+                    packet_capture->capture(PcapRing::LINK, true, tcp_queue_buf);
+                if (transport->transport_send(tcp_queue_buf))
+                    proto_context.update_last_sent();
+                else if (halt)
+                    return;
+            }
+        }
+        for (count_t i = codel_drops; i < tcp_queue->stats().codel_drops; ++i)
+            cli_stats->error(Error::TCP_OVERFLOW);
+    }
 
     ProtoContext proto_context;
 
@@ -1713,8 +1908,20 @@ class Session : ProtoContextCallbackInterface,
     TunClientFactory::Ptr tun_factory;
     TunClient::Ptr tun;
 
+    enum
+    {
+        TCP_QUEUE_LINK_DEPTH = 8, // packets handed to the transport ahead of the scheduler
+    };
+
     unsigned int tcp_queue_limit;
+    bool tcp_queue_aqm;
+    bool standby;
+    bool standby_ready_ = false;
+    bool dns_cache_enabled;
+    std::unique_ptr<DnsCache> dns_cache;
     bool transport_has_send_queue = false;
+    std::unique_ptr<FQCoDel> tcp_queue;
+    BufferAllocated tcp_queue_buf;
 
     NotifyCallback* notify_callback;
 
@@ -1771,9 +1978,7 @@ class Session : ProtoContextCallbackInterface,
     // Client side certcheck
     AccHandshaker certcheck_hs;
 
-#ifdef OPENVPN_PACKET_LOG
-      std::ofstream packet_log;
-#endif
+    PcapRing::Ptr packet_capture; // null unless capturing
 };
 } // namespace openvpn::ClientProto
 
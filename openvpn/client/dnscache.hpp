@@ -0,0 +1,536 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Client-side cache of DNS responses from the pushed DNS servers.
+//
+// Queries read from the tun that go to one of the pushed servers over
+// plain UDP port 53 are answered from the cache when a response to the
+// same question was seen before and has not expired.  The response is
+// synthesized as an IP packet back to the tun, with the ID of the query
+// and the remaining TTLs filled in.  Everything else is sent through the
+// tunnel as before, and the cache learns from the responses that come
+// back.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <openvpn/addr/ip.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/client/dns_options.hpp>
+#include <openvpn/common/count.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/ip/csum.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ping6.hpp>
+#include <openvpn/ip/udp.hpp>
+#include <openvpn/log/sessionstats.hpp>
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+
+class DnsCache
+{
+  public:
+    struct Config
+    {
+        size_t max_entries = 1024;                              // questions cached at most
+        Time::Duration max_ttl = Time::Duration::seconds(3600); // upper bound for cached TTLs
+    };
+
+    struct Stats
+    {
+        count_t hits = 0;   // queries answered from the cache
+        count_t misses = 0; // queries forwarded through the tunnel
+
+        // percentage of queries answered from the cache
+        unsigned int hit_rate() const
+        {
+            const count_t queries = hits + misses;
+            return queries ? static_cast<unsigned int>(hits * 100 / queries) : 0;
+        }
+    };
+
+    enum
+    {
+        DNS_PORT = 53,
+    };
+
+    DnsCache(const DnsOptions &dns,
+             const SessionStats::Ptr &session_stats_arg,
+             const Config &config_arg)
+        : config(config_arg),
+          session_stats(session_stats_arg)
+    {
+        for (const auto &[priority, server] : dns.servers)
+        {
+            if (server.transport != DnsServer::Transport::Unset
+                && server.transport != DnsServer::Transport::Plain)
+                continue;
+            for (const DnsAddress &address : server.addresses)
+            {
+                if (address.port && address.port != DNS_PORT)
+                    continue;
+                const IP::Addr addr(address.address, "dns-cache");
+                unsigned char bytes[16];
+                addr.to_byte_string_variable(bytes);
+                servers.emplace_back(reinterpret_cast<const char *>(bytes), addr.size_bytes());
+            }
+        }
+    }
+
+    // true if there is no pushed server the cache can be used with
+    bool empty() const
+    {
+        return servers.empty();
+    }
+
+    size_t size() const
+    {
+        return cache.size();
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    // If buf is a packet from the tun with a query to one of the servers,
+    // and a response to it is cached, replace buf with the response and
+    // return true.  Otherwise leave buf unchanged and return false.
+    bool answer(BufferAllocated &buf, const Time &now)
+    {
+        Datagram dg;
+        if (!parse_datagram(buf, dg) || dg.dport != DNS_PORT || !is_server(dg.daddr, dg.addr_size))
+            return false;
+
+        Message query;
+        if (!parse_message(dg.payload, dg.payload_size, query)
+            || (query.flags & FLAG_QR)
+            || (query.flags & OPCODE_MASK)
+            || query.ancount || query.nscount || query.arcount > 1)
+            return false;
+
+        const auto it = cache.find(query.key);
+        if (it == cache.end() || now >= it->second.expires)
+        {
+            if (it != cache.end())
+                erase(it);
+            miss();
+            return false;
+        }
+
+        const Entry &entry = it->second;
+        const size_t ip_size = dg.version == IPCommon::IPv4 ? sizeof(IPv4Header) : sizeof(IPv6Header);
+        const size_t packet_size = ip_size + sizeof(UDPHeader) + entry.response.size();
+        if (buf.offset() + packet_size > buf.capacity())
+        {
+            miss();
+            return false;
+        }
+
+        // build the response: the cached message with the ID and question
+        // of the query (to keep the case of the name as asked) and the
+        // TTLs counted down to now
+        packet.resize(packet_size);
+        unsigned char *dns = packet.data() + ip_size + sizeof(UDPHeader);
+        std::memcpy(dns, entry.response.data(), entry.response.size());
+        std::memcpy(dns, dg.payload, 2);
+        std::memcpy(dns + HEADER_SIZE, dg.payload + HEADER_SIZE, query.question_end - HEADER_SIZE);
+        const std::uint32_t elapsed = static_cast<std::uint32_t>((now - entry.learned).to_seconds());
+        for (size_t i = 0; i < entry.ttl_offsets.size(); ++i)
+            write_u32(dns + entry.ttl_offsets[i], entry.ttls[i] > elapsed ? entry.ttls[i] - elapsed : 0);
+
+        UDPHeader *udp = reinterpret_cast<UDPHeader *>(packet.data() + ip_size);
+        udp->source = htons(dg.dport);
+        udp->dest = htons(dg.sport);
+        udp->len = htons(static_cast<std::uint16_t>(sizeof(UDPHeader) + entry.response.size()));
+        udp->check = 0;
+
+        if (dg.version == IPCommon::IPv4)
+        {
+            IPv4Header *ip = reinterpret_cast<IPv4Header *>(packet.data());
+            const IPv4Header *q = reinterpret_cast<const IPv4Header *>(buf.c_data());
+            ip->version_len = IPv4Header::ver_len(IPCommon::IPv4, sizeof(IPv4Header));
+            ip->tos = 0;
+            ip->tot_len = htons(static_cast<std::uint16_t>(packet_size));
+            ip->id = 0;
+            ip->frag_off = 0;
+            ip->ttl = 64;
+            ip->protocol = IPCommon::UDP;
+            ip->saddr = q->daddr;
+            ip->daddr = q->saddr;
+            ip->check = 0;
+            ip->check = IPChecksum::checksum(ip, sizeof(IPv4Header));
+            udp->check = htons(udp_checksum(packet.data() + ip_size,
+                                            static_cast<unsigned int>(packet_size - ip_size),
+                                            reinterpret_cast<const std::uint8_t *>(&ip->saddr),
+                                            reinterpret_cast<const std::uint8_t *>(&ip->daddr)));
+        }
+        else
+        {
+            IPv6Header *ip = reinterpret_cast<IPv6Header *>(packet.data());
+            const IPv6Header *q = reinterpret_cast<const IPv6Header *>(buf.c_data());
+            ip->version_prio = (6 << 4);
+            ip->flow_lbl[0] = 0;
+            ip->flow_lbl[1] = 0;
+            ip->flow_lbl[2] = 0;
+            ip->payload_len = udp->len;
+            ip->nexthdr = IPCommon::UDP;
+            ip->hop_limit = 64;
+            ip->saddr = q->daddr;
+            ip->daddr = q->saddr;
+            udp->check = Ping6::csum_ipv6_pseudo(&ip->saddr,
+                                                 &ip->daddr,
+                                                 static_cast<std::uint32_t>(packet_size - ip_size),
+                                                 IPCommon::UDP,
+                                                 IPChecksum::compute(udp, packet_size - ip_size));
+        }
+        if (!udp->check)
+            udp->check = 0xffff;
+
+        buf.reset_size();
+        buf.write(packet.data(), packet.size());
+
+        ++stats_.hits;
+        if (session_stats)
+            session_stats->inc_stat(SessionStats::DNS_CACHE_HITS, 1);
+        return true;
+    }
+
+    // Learn from a packet about to be written to the tun, if it is a
+    // response from one of the servers.
+    void learn(const Buffer &buf, const Time &now)
+    {
+        Datagram dg;
+        if (!parse_datagram(buf, dg) || dg.sport != DNS_PORT || !is_server(dg.saddr, dg.addr_size))
+            return;
+
+        // only cache complete answers and name errors
+        Message msg;
+        if (!parse_message(dg.payload, dg.payload_size, msg)
+            || !(msg.flags & FLAG_QR)
+            || (msg.flags & (OPCODE_MASK | FLAG_TC))
+            || ((msg.flags & RCODE_MASK) != RCODE_NOERROR && (msg.flags & RCODE_MASK) != RCODE_NXDOMAIN))
+            return;
+
+        Entry entry;
+        std::uint32_t min_ttl = 0;
+        if (!parse_records(dg.payload, dg.payload_size, msg, entry, min_ttl))
+            return;
+        min_ttl = std::min(min_ttl, static_cast<std::uint32_t>(config.max_ttl.to_seconds()));
+        if (!min_ttl)
+            return;
+
+        if (cache.size() >= config.max_entries && !cache.count(msg.key))
+            make_room(now);
+
+        entry.response.assign(dg.payload, dg.payload + dg.payload_size);
+        entry.learned = now;
+        entry.expires = now + Time::Duration::seconds(min_ttl);
+        const auto [it, inserted] = cache.try_emplace(msg.key);
+        if (!inserted)
+            expiry.erase(it->second.by_expiry);
+        it->second = std::move(entry);
+        it->second.by_expiry = expiry.emplace(it->second.expires, &it->first);
+    }
+
+  private:
+    enum
+    {
+        HEADER_SIZE = 12,
+        FLAG_QR = 0x8000,
+        OPCODE_MASK = 0x7800,
+        FLAG_TC = 0x0200,
+        FLAG_RD = 0x0100,
+        FLAG_CD = 0x0010,
+        RCODE_MASK = 0x000f,
+        RCODE_NOERROR = 0,
+        RCODE_NXDOMAIN = 3,
+        TYPE_OPT = 41,
+        EDNS_DO = 0x8000,
+        IP4_MF = 0x2000, // more fragments
+    };
+
+    struct Datagram
+    {
+        unsigned int version = 0;
+        const unsigned char *saddr = nullptr;
+        const unsigned char *daddr = nullptr;
+        size_t addr_size = 0;
+        std::uint16_t sport = 0;
+        std::uint16_t dport = 0;
+        const unsigned char *payload = nullptr;
+        size_t payload_size = 0;
+    };
+
+    // Header and question of a DNS message
+    struct Message
+    {
+        std::uint16_t flags = 0;
+        std::uint16_t ancount = 0;
+        std::uint16_t nscount = 0;
+        std::uint16_t arcount = 0;
+        size_t question_end = 0;
+
+        // lower-cased question, plus the flags that change the answer
+        std::string key;
+    };
+
+    // Cache keys ordered by expiry time, so that make_room() finds the
+    // expired entries and the one closest to expiry without a scan
+    typedef std::multimap<Time, const std::string *> ExpiryIndex;
+
+    struct Entry
+    {
+        std::vector<unsigned char> response;
+        std::vector<std::uint16_t> ttl_offsets;
+        std::vector<std::uint32_t> ttls;
+        Time learned;
+        Time expires;
+        ExpiryIndex::iterator by_expiry;
+    };
+
+    typedef std::unordered_map<std::string, Entry> Cache;
+
+    // Find the UDP payload of an unfragmented IPv4 or IPv6 packet
+    static bool parse_datagram(const Buffer &buf, Datagram &dg)
+    {
+        const unsigned char *data = buf.c_data();
+        const size_t size = buf.size();
+        if (!size)
+            return false;
+
+        size_t l4_offset;
+        size_t ip_size;
+        dg.version = IPCommon::version(data[0]);
+        if (dg.version == IPCommon::IPv4)
+        {
+            if (size < sizeof(IPv4Header))
+                return false;
+            const IPv4Header *ip = reinterpret_cast<const IPv4Header *>(data);
+            if (ip->protocol != IPCommon::UDP
+                || (ntohs(ip->frag_off) & (IPv4Header::OFFMASK | IP4_MF)))
+                return false;
+            l4_offset = IPv4Header::length(ip->version_len);
+            ip_size = ntohs(ip->tot_len);
+            dg.saddr = reinterpret_cast<const unsigned char *>(&ip->saddr);
+            dg.daddr = reinterpret_cast<const unsigned char *>(&ip->daddr);
+            dg.addr_size = 4;
+        }
+        else if (dg.version == IPCommon::IPv6)
+        {
+            if (size < sizeof(IPv6Header))
+                return false;
+            const IPv6Header *ip = reinterpret_cast<const IPv6Header *>(data);
+            if (ip->nexthdr != IPCommon::UDP)
+                return false;
+            l4_offset = sizeof(IPv6Header);
+            ip_size = sizeof(IPv6Header) + ntohs(ip->payload_len);
+            dg.saddr = ip->saddr.s6_addr;
+            dg.daddr = ip->daddr.s6_addr;
+            dg.addr_size = 16;
+        }
+        else
+            return false;
+
+        if (ip_size > size || l4_offset + sizeof(UDPHeader) > ip_size)
+            return false;
+        const UDPHeader *udp = reinterpret_cast<const UDPHeader *>(data + l4_offset);
+        const size_t udp_size = ntohs(udp->len);
+        if (udp_size < sizeof(UDPHeader) || l4_offset + udp_size > ip_size)
+            return false;
+        dg.sport = ntohs(udp->source);
+        dg.dport = ntohs(udp->dest);
+        dg.payload = data + l4_offset + sizeof(UDPHeader);
+        dg.payload_size = udp_size - sizeof(UDPHeader);
+        return true;
+    }
+
+    // Parse the header and the single question of a message, and build
+    // the cache key.  The RD and CD bits and the EDNS DO bit are part of
+    // the key, as they change what the server answers.
+    static bool parse_message(const unsigned char *msg, const size_t size, Message &m)
+    {
+        if (size < HEADER_SIZE || read_u16(msg + 4) != 1)
+            return false;
+        m.flags = read_u16(msg + 2);
+        m.ancount = read_u16(msg + 6);
+        m.nscount = read_u16(msg + 8);
+        m.arcount = read_u16(msg + 10);
+
+        // the question name, without compression
+        size_t pos = HEADER_SIZE;
+        while (true)
+        {
+            if (pos >= size)
+                return false;
+            const unsigned int len = msg[pos];
+            if (len > 63)
+                return false;
+            ++pos;
+            if (!len)
+                break;
+            pos += len;
+        }
+        pos += 4; // QTYPE, QCLASS
+        if (pos > size)
+            return false;
+        m.question_end = pos;
+
+        m.key.assign(reinterpret_cast<const char *>(msg + HEADER_SIZE), pos - HEADER_SIZE);
+        for (char &c : m.key)
+            if (c >= 'A' && c <= 'Z')
+                c = static_cast<char>(c - 'A' + 'a');
+        m.key.push_back(static_cast<char>((m.flags & FLAG_RD ? 1 : 0) | (m.flags & FLAG_CD ? 2 : 0)
+                                          | (edns_do(msg, size, m) ? 4 : 0)));
+        return true;
+    }
+
+    // Return true if the message has an OPT record with the DO bit set.
+    // For queries, the OPT record is the only record after the question.
+    static bool edns_do(const unsigned char *msg, const size_t size, const Message &m)
+    {
+        if (!m.arcount)
+            return false;
+        size_t pos = m.question_end;
+        const unsigned int n_records = m.ancount + m.nscount + m.arcount;
+        for (unsigned int i = 0; i < n_records; ++i)
+        {
+            if (!skip_name(msg, size, pos) || pos + 10 > size)
+                return false;
+            if (i >= unsigned(m.ancount + m.nscount) && read_u16(msg + pos) == TYPE_OPT)
+                return read_u16(msg + pos + 6) & EDNS_DO;
+            pos += 10 + read_u16(msg + pos + 8);
+        }
+        return false;
+    }
+
+    // Walk the resource records of a response, noting the position of
+    // each TTL other than that of the OPT record.
+    static bool parse_records(const unsigned char *msg,
+                              const size_t size,
+                              const Message &m,
+                              Entry &entry,
+                              std::uint32_t &min_ttl)
+    {
+        size_t pos = m.question_end;
+        const unsigned int n_records = m.ancount + m.nscount + m.arcount;
+        bool first = true;
+        for (unsigned int i = 0; i < n_records; ++i)
+        {
+            if (!skip_name(msg, size, pos) || pos + 10 > size)
+                return false;
+            const std::uint16_t type = read_u16(msg + pos);
+            const size_t rdlength = read_u16(msg + pos + 8);
+            if (pos + 10 + rdlength > size)
+                return false;
+            if (type != TYPE_OPT)
+            {
+                const std::uint32_t ttl = read_u32(msg + pos + 4);
+                entry.ttl_offsets.push_back(static_cast<std::uint16_t>(pos + 4));
+                entry.ttls.push_back(ttl);
+                min_ttl = first ? ttl : std::min(min_ttl, ttl);
+                first = false;
+            }
+            pos += 10 + rdlength;
+        }
+
+        // nothing to take a TTL from
+        return !first;
+    }
+
+    static bool skip_name(const unsigned char *msg, const size_t size, size_t &pos)
+    {
+        while (pos < size)
+        {
+            const unsigned int len = msg[pos];
+            if ((len & 0xc0) == 0xc0) // compression pointer ends the name
+            {
+                pos += 2;
+                return pos <= size;
+            }
+            if (len > 63)
+                return false;
+            ++pos;
+            if (!len)
+                return true;
+            pos += len;
+        }
+        return false;
+    }
+
+    bool is_server(const unsigned char *addr, const size_t addr_size) const
+    {
+        for (const std::string &server : servers)
+            if (server.size() == addr_size && !std::memcmp(server.data(), addr, addr_size))
+                return true;
+        return false;
+    }
+
+    void miss()
+    {
+        ++stats_.misses;
+        if (session_stats)
+            session_stats->inc_stat(SessionStats::DNS_CACHE_MISSES, 1);
+    }
+
+    // Drop expired entries, or the entry closest to expiry if none are
+    void make_room(const Time &now)
+    {
+        while (!expiry.empty() && now >= expiry.begin()->first)
+            erase(cache.find(*expiry.begin()->second));
+        if (cache.size() >= config.max_entries && !expiry.empty())
+            erase(cache.find(*expiry.begin()->second));
+    }
+
+    void erase(const Cache::iterator it)
+    {
+        expiry.erase(it->second.by_expiry);
+        cache.erase(it);
+    }
+
+    static std::uint16_t read_u16(const unsigned char *p)
+    {
+        return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    static std::uint32_t read_u32(const unsigned char *p)
+    {
+        return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+    }
+
+    static void write_u32(unsigned char *p, const std::uint32_t v)
+    {
+        p[0] = static_cast<unsigned char>(v >> 24);
+        p[1] = static_cast<unsigned char>(v >> 16);
+        p[2] = static_cast<unsigned char>(v >> 8);
+        p[3] = static_cast<unsigned char>(v);
+    }
+
+    const Config config;
+    SessionStats::Ptr session_stats;
+    std::vector<std::string> servers; // addresses in network byte order
+    Cache cache;
+    ExpiryIndex expiry; // points to the keys of cache
+    std::vector<unsigned char> packet; // response being built
+    Stats stats_;
+};
+
+} // namespace openvpn
@@ -810,7 +810,47 @@ namespace openvpn {
 	reset_item(index.item());
     }
 
+    // Return a copy of the list positioned at the next remote entry, for
+    // a second connection to another server alongside the current one.
+    // If proto is defined, the copy is positioned at the next entry
+    // with a matching transport protocol instead.
+    // Items are shared, so resolved addresses are cached for both lists.
+    // Returns an undefined pointer if there is no other entry to use.
+    Ptr clone_next_remote(const Protocol& proto = Protocol()) const
+    {
+      if (remote_override || list.size() < 2)
+	return Ptr();
+
+      Ptr rl(new RemoteList(directives));
+      rl->cache_lifetime = cache_lifetime;
+      rl->random_hostname = random_hostname;
+      rl->random = random;
+      rl->enable_cache = enable_cache;
+      rl->index = index;
+      rl->list = list;
+      rl->rng = rng;
+      for (size_t i = 1; i < list.size(); ++i)
+	{
+	  rl->next(Advance::Remote);
+	  if (!proto.defined() || proto.transport_match(rl->current_transport_protocol()))
+	    return rl;
+	}
+      return Ptr();
+    }
+
+    // Return true if the current entry of other is the same entry
+    // (not just an equal one) as our current entry
+    bool same_current_item(const RemoteList& other) const
+    {
+      return list[item_index()] == other.list[other.item_index()];
+    }
+
   private:
+    explicit RemoteList(const Directives& directives_arg)
+      : directives(directives_arg)
+    {
+    }
+
     // Process --remote-cache-lifetime option
     void process_cache_lifetime(const OptionList& opt)
     {
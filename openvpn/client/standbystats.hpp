@@ -0,0 +1,111 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#ifndef OPENVPN_CLIENT_STANDBYSTATS_H
+#define OPENVPN_CLIENT_STANDBYSTATS_H
+
+#include <string>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/error/error.hpp>
+#include <openvpn/log/sessionstats.hpp>
+
+namespace openvpn {
+
+// Statistics of a warm standby session.  The standby session counts
+// on its own, so that its handshake, keepalives and errors don't show
+// up in the stats of the active session.  Once it is promoted, its
+// counts are merged into the client stats: errors counted so far are
+// replayed there and later ones forwarded, and the transport counters
+// are pulled in by dco_update(), the way the kernel counters are with
+// DCO (which is never used with a standby session).
+class StandbyStats : public SessionStats
+{
+  public:
+    typedef RCPtr<StandbyStats> Ptr;
+
+    void error(const size_t err, const std::string *text = nullptr) override
+    {
+        if (parent)
+            parent->error(err, text);
+        else if (err < Error::N_ERRORS)
+            ++errors[err];
+    }
+
+    count_t error_count(const size_t err) const
+    {
+        return err < Error::N_ERRORS ? errors[err] : 0;
+    }
+
+    // Merge into the stats of the client from here on
+    void promote(const SessionStats::Ptr &parent_arg)
+    {
+        detach();
+        parent = parent_arg;
+        for (size_t i = 0; i < Error::N_ERRORS; ++i)
+        {
+            for (; errors[i]; --errors[i])
+                parent->error(i);
+        }
+        parent->update_last_packet_received(last_packet_received());
+        parent->dco_configure(new Source(this));
+    }
+
+    // Stop merging, after pulling in the last transport counters.  Must
+    // be called once the promoted session is gone, since the client
+    // stats and these stats refer to each other until then.
+    void detach()
+    {
+        if (parent)
+        {
+            parent->dco_update();
+            parent->dco_configure(nullptr);
+            parent.reset();
+        }
+    }
+
+  private:
+    // Hands the growth of the transport counters to the client stats
+    class Source : public SessionStats::DCOTransportSource
+    {
+      public:
+        explicit Source(StandbyStats *stats_arg)
+            : stats(stats_arg)
+        {
+        }
+
+        Data dco_transport_stats_delta() override
+        {
+            const Data data(stats->get_stat_fast(BYTES_IN),
+                            stats->get_stat_fast(BYTES_OUT),
+                            0,
+                            0,
+                            stats->get_stat_fast(PACKETS_IN),
+                            stats->get_stat_fast(PACKETS_OUT),
+                            0,
+                            0);
+            const Data delta = data - last;
+            last = data;
+            return delta;
+        }
+
+      private:
+        StandbyStats::Ptr stats;
+        Data last;
+    };
+
+    SessionStats::Ptr parent;
+    count_t errors[Error::N_ERRORS] = {};
+};
+
+} // namespace openvpn
+
+#endif
@@ -13,6 +13,7 @@
 #define OPENVPN_COMMON_MSGWIN_H
 
 #include <deque>
+#include <memory>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
@@ -26,6 +27,8 @@ namespace openvpn {
 //   On sending side: used to buffer unacknowledged packets
 //   M : message class, must define default constructor, defined(), and erase() methods
 //   id_t : sequence number object, usually unsigned int
+// The queue is only allocated while it holds messages, so an idle
+// window costs no heap memory.
 template <typename M, typename id_t>
 class MessageWindow
 {
@@ -47,7 +50,7 @@ class MessageWindow
     {
         head_id_ = starting_head_id;
         span_ = span;
-        q_.clear();
+        q_.reset();
     }
 
     // Return true if id is within current window
@@ -69,12 +72,27 @@ class MessageWindow
         if (in_window(id))
         {
             grow(id);
-            return q_[id - head_id_];
+            return (*q_)[id - head_id_];
         }
         else
             throw message_window_ref_by_id();
     }
 
+    // Return a pointer to the M object at id, or nullptr if id is not
+    // in the window or no object has been created for it yet.  Unlike
+    // ref_by_id(), never grows the queue.
+    M *find(const id_t id)
+    {
+        if (in_window(id) && q_ && id - head_id_ < q_->size())
+            return &(*q_)[id - head_id_];
+        return nullptr;
+    }
+
+    const M *find(const id_t id) const
+    {
+        return const_cast<MessageWindow *>(this)->find(id);
+    }
+
     // Remove the M object at id, is a no-op if
     // id not in window.  Do a purge() as a last
     // step to advance the head_id_ if it's now
@@ -84,7 +102,7 @@ class MessageWindow
         if (in_window(id))
         {
             grow(id);
-            M &m = q_[id - head_id_];
+            M &m = (*q_)[id - head_id_];
             m.erase();
         }
         purge();
@@ -93,7 +111,7 @@ class MessageWindow
     // Return true if an object at head of queue is defined
     bool head_defined() const
     {
-        return (!q_.empty() && q_.front().defined());
+        return (q_ && !q_->empty() && q_->front().defined());
     }
 
     // Return the id that the object at the head of the queue
@@ -118,7 +136,7 @@ class MessageWindow
     // Return a reference to the object at the front of the queue
     M &ref_head()
     {
-        return q_.front();
+        return q_->front();
     }
 
     // Remove the object at head of queue, throw an exception if undefined
@@ -135,9 +153,10 @@ class MessageWindow
     // head_defined() returns true.
     void rm_head_nocheck()
     {
-        q_.front().erase();
-        q_.pop_front();
+        q_->front().erase();
+        q_->pop_front();
         ++head_id_;
+        release_if_empty();
     }
 
   private:
@@ -146,24 +165,35 @@ class MessageWindow
     void grow(const id_t id)
     {
         const size_t needed_index = id - head_id_;
-        while (q_.size() <= needed_index)
-            q_.push_back(M());
+        if (!q_)
+            q_.reset(new std::deque<M>());
+        while (q_->size() <= needed_index)
+            q_->push_back(M());
     }
 
     // Purge all undefined objects at the head of
     // the queue, advancing the head_id_
     void purge()
     {
-        while (!q_.empty() && q_.front().erased())
+        if (!q_)
+            return;
+        while (!q_->empty() && q_->front().erased())
         {
-            q_.pop_front();
+            q_->pop_front();
             ++head_id_;
         }
+        release_if_empty();
+    }
+
+    void release_if_empty()
+    {
+        if (q_->empty())
+            q_.reset();
     }
 
     id_t head_id_; // id of msgs[0]
     id_t span_;
-    std::deque<M> q_;
+    std::unique_ptr<std::deque<M>> q_;
 };
 
 } // namespace openvpn
@@ -55,6 +55,7 @@
 #include <openvpn/common/splitlines.hpp>
 #include <openvpn/common/unicode.hpp>
 #include <openvpn/common/option_error.hpp>
+#include <openvpn/common/optnames.hpp>
 
 namespace openvpn {
 
@@ -518,9 +519,145 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
   public:
     typedef RCPtr<OptionList> Ptr;
     typedef std::vector<unsigned int> IndexList;
-    typedef std::unordered_map<std::string, IndexList> IndexMap;
     typedef std::pair<std::string, IndexList> IndexPair;
 
+    // Map locating options by directive name.  It is keyed by the ID of
+    // the name in the process-wide OptionNameTable, so that lists share
+    // one copy of each name, and kept as a vector sorted by ID since a
+    // list rarely has more than a few dozen distinct directives.  Names
+    // that don't fit in the table get IDs above OptionNameTable::max_names
+    // private to this map.
+    class IndexMap
+    {
+      public:
+        typedef OptionNameTable::ID ID;
+        typedef std::vector<std::pair<ID, IndexList>> Map;
+        typedef Map::const_iterator const_iterator;
+
+        const_iterator find(const std::string &name) const
+        {
+            // for a handful of names, comparing them is cheaper than hashing
+            if (map.size() <= small_size)
+            {
+                for (const_iterator e = map.begin(); e != map.end(); ++e)
+                    if (this->name(e->first) == name)
+                        return e;
+                return map.end();
+            }
+            return find(lookup(name));
+        }
+
+        const_iterator find(const OptionName &name) const
+        {
+            if (name.id == OptionNameTable::UNDEF)
+                return find(name.name);
+            return find(name.id);
+        }
+
+        const_iterator find(const ID id) const
+        {
+            const_iterator e = lower_bound(id);
+            return e != map.end() && e->first == id ? e : map.end();
+        }
+
+        const_iterator begin() const
+        {
+            return map.begin();
+        }
+
+        const_iterator end() const
+        {
+            return map.end();
+        }
+
+        size_t size() const
+        {
+            return map.size();
+        }
+
+        bool empty() const
+        {
+            return map.empty();
+        }
+
+        IndexList &operator[](const std::string &name)
+        {
+            return (*this)[intern(name)];
+        }
+
+        // Note that adding an ID invalidates references to other lists
+        IndexList &operator[](const ID id)
+        {
+            const auto i = map.begin() + (lower_bound(id) - map.cbegin());
+            if (i != map.end() && i->first == id)
+                return i->second;
+            return map.emplace(i, id, IndexList())->second;
+        }
+
+        // Return the name of an ID used as a key in this map
+        const std::string &name(const ID id) const
+        {
+            if (id < OptionNameTable::max_names)
+                return OptionNameTable::global().name(id);
+            return local_names[id - OptionNameTable::max_names];
+        }
+
+        ID intern(const std::string &name)
+        {
+            ID id = OptionNameTable::global().intern(name);
+            if (id == OptionNameTable::UNDEF)
+            {
+                auto e = local_ids.find(name);
+                if (e != local_ids.end())
+                    return e->second;
+                id = ID(OptionNameTable::max_names + local_names.size());
+                local_names.push_back(name);
+                local_ids.emplace(name, id);
+            }
+            return id;
+        }
+
+        void reserve(const size_t n)
+        {
+            map.reserve(n);
+        }
+
+        void clear()
+        {
+            map.clear();
+            local_ids.clear();
+            local_names.clear();
+        }
+
+      private:
+        static constexpr size_t small_size = 16;
+
+        const_iterator lower_bound(const ID id) const
+        {
+            return std::lower_bound(map.begin(),
+                                    map.end(),
+                                    id,
+                                    [](const Map::value_type &e, const ID id)
+                                    { return e.first < id; });
+        }
+
+        ID lookup(const std::string &name) const
+        {
+            const ID id = OptionNameTable::global().lookup(name);
+            if (id == OptionNameTable::UNDEF && !local_ids.empty())
+            {
+                auto e = local_ids.find(name);
+                if (e != local_ids.end())
+                    return e->second;
+            }
+            return id;
+        }
+
+        Map map;
+        std::unordered_map<std::string, ID> local_ids;
+        std::vector<std::string> local_names;
+    };
+
     static bool is_comment(const char c)
     {
         return c == '#' || c == ';';
@@ -1185,22 +1322,13 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
     // doesn't exist.
     const Option *get_ptr(const std::string &name) const
     {
-        IndexMap::const_iterator e = map_.find(name);
-        if (e != map_.end())
-        {
-            const size_t size = e->second.size();
-            if (size)
-            {
-                for (const auto &optidx : e->second)
-                {
-                    (*this)[optidx].touch(true);
-                }
-                const Option *ret = &((*this)[e->second[size - 1]]);
-                ret->touch();
-                return ret;
-            }
-        }
-        return nullptr;
+        return get_last_ptr(map_.find(name));
+    }
+
+    // Same as above, for a directive interned ahead of time.
+    const Option *get_ptr(const OptionName &name) const
+    {
+        return get_last_ptr(map_.find(name));
     }
 
     // Get an option, return nullptr if option doesn't exist, or
@@ -1499,7 +1627,7 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
         std::ostringstream out;
         for (IndexMap::const_iterator i = map_.begin(); i != map_.end(); ++i)
         {
-            out << i->first << " [";
+            out << map_.name(i->first) << " [";
             for (IndexList::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
                 out << ' ' << *j;
             out << " ]" << std::endl;
@@ -1568,12 +1696,48 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
     // has been modified.
     void update_map()
     {
+        typedef IndexMap::ID ID;
         map_.clear();
+
+        // Resolve each name to its ID once, reusing the previous ID for
+        // runs of the same directive, and count the instances so that each
+        // index list is allocated once at its final size.
+        std::vector<ID> ids(size(), OptionNameTable::UNDEF);
+        std::vector<unsigned int> counts;
+        const std::string *prev_name = nullptr;
+        ID prev_id = OptionNameTable::UNDEF;
         for (size_t i = 0; i < size(); ++i)
         {
             const Option &opt = (*this)[i];
-            if (!opt.empty())
-                map_[opt.ref(0)].push_back((unsigned int)i);
+            if (opt.empty())
+                continue;
+            const std::string &name = opt.ref(0);
+            if (!prev_name || name != *prev_name)
+            {
+                prev_id = map_.intern(name);
+                prev_name = &name;
+            }
+            ids[i] = prev_id;
+            if (prev_id >= counts.size())
+                counts.resize(prev_id + 1);
+            ++counts[prev_id];
+        }
+
+        // IDs are visited in order, so each list is appended at the end
+        map_.reserve(counts.size() - std::count(counts.begin(), counts.end(), 0u));
+        std::vector<IndexList *> lists(counts.size());
+        for (ID id = 0; id < counts.size(); ++id)
+        {
+            if (counts[id])
+            {
+                lists[id] = &map_[id];
+                lists[id]->reserve(counts[id]);
+            }
+        }
+        for (size_t i = 0; i < size(); ++i)
+        {
+            if (ids[i] != OptionNameTable::UNDEF)
+                lists[ids[i]]->push_back((unsigned int)i);
         }
     }
 
@@ -1646,6 +1810,26 @@ class OptionList : public std::vector<Option>, public RCCopyable<thread_unsafe_r
     }
 
   private:
+    // Last instance of the options at e, or nullptr
+    const Option *get_last_ptr(const IndexMap::const_iterator e) const
+    {
+        if (e != map_.end())
+        {
+            const size_t size = e->second.size();
+            if (size)
+            {
+                for (const auto &optidx : e->second)
+                {
+                    (*this)[optidx].touch(true);
+                }
+                const Option *ret = &((*this)[e->second[size - 1]]);
+                ret->touch();
+                return ret;
+            }
+        }
+        return nullptr;
+    }
+
     // multiline tagging (meta)
 
     // return true if string is a meta tag, e.g. WEB_CA_BUNDLE_START
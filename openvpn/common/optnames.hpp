@@ -0,0 +1,157 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Process-wide table of interned option directive names.  Each name is
+// assigned a small integer ID on first use, shared by every OptionList
+// in the process, so that option indices can be keyed by ID instead of
+// by a copy of the name.
+//
+// Names are never removed.  Since option lists are also parsed from
+// data supplied by peers, the table is bounded both in number of names
+// and in bytes, and intern() returns UNDEF once it is full.  Lookups
+// are lock-free; only the insertion of a new name takes a lock.
+
+#ifndef OPENVPN_COMMON_OPTNAMES_H
+#define OPENVPN_COMMON_OPTNAMES_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <utility>
+
+namespace openvpn {
+
+class OptionNameTable
+{
+  public:
+    typedef unsigned int ID;
+
+    static constexpr ID UNDEF = ~ID(0);
+    static constexpr size_t max_names = 4096;
+    static constexpr size_t max_bytes = 256 * 1024;
+
+    static OptionNameTable &global()
+    {
+        static OptionNameTable table;
+        return table;
+    }
+
+    OptionNameTable() = default;
+
+    OptionNameTable(const OptionNameTable &) = delete;
+    OptionNameTable &operator=(const OptionNameTable &) = delete;
+
+    ~OptionNameTable()
+    {
+        for (auto &e : by_id)
+            delete e.load(std::memory_order_relaxed);
+    }
+
+    // Return the ID of name, or UNDEF if it has not been interned.
+    ID lookup(const std::string &name) const
+    {
+        const size_t hash = std::hash<std::string>()(name);
+        for (size_t i = 0; i < n_slots; ++i)
+        {
+            const Entry *e = slots[(hash + i) & (n_slots - 1)].load(std::memory_order_acquire);
+            if (!e)
+                break;
+            if (e->hash == hash && e->name == name)
+                return e->id;
+        }
+        return UNDEF;
+    }
+
+    // Return the ID of name, adding it to the table if necessary.
+    // Returns UNDEF if the table is full.
+    ID intern(const std::string &name)
+    {
+        ID id = lookup(name);
+        if (id != UNDEF)
+            return id;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        id = lookup(name); // may have been added while we waited for the lock
+        if (id != UNDEF)
+            return id;
+        const size_t n = n_names.load(std::memory_order_relaxed);
+        if (n >= max_names || n_bytes + name.length() > max_bytes)
+            return UNDEF;
+
+        Entry *e = new Entry{name, std::hash<std::string>()(name), ID(n)};
+        by_id[n].store(e, std::memory_order_release);
+        for (size_t i = 0;; ++i)
+        {
+            std::atomic<const Entry *> &slot = slots[(e->hash + i) & (n_slots - 1)];
+            if (!slot.load(std::memory_order_relaxed))
+            {
+                slot.store(e, std::memory_order_release);
+                break;
+            }
+        }
+        n_bytes += name.length();
+        n_names.store(n + 1, std::memory_order_release);
+        return e->id;
+    }
+
+    // Return the name of an ID returned by intern()
+    const std::string &name(const ID id) const
+    {
+        return by_id[id].load(std::memory_order_acquire)->name;
+    }
+
+    size_t size() const
+    {
+        return n_names.load(std::memory_order_acquire);
+    }
+
+  private:
+    struct Entry
+    {
+        std::string name;
+        size_t hash;
+        ID id;
+    };
+
+    // open addressing, kept at most half full
+    static constexpr size_t n_slots = max_names * 2;
+
+    std::atomic<const Entry *> slots[n_slots] = {};
+    std::atomic<const Entry *> by_id[max_names] = {};
+    std::atomic<size_t> n_names{0};
+    size_t n_bytes = 0;
+    std::mutex mutex;
+};
+
+// A directive name interned ahead of time, for code that looks up the
+// same directive on every call.  Keep it in a function-local static:
+//
+//   static const OptionName route("route");
+//   opt.map().find(route);
+//
+// id is UNDEF if the table was already full, in which case lookups fall
+// back to the name.
+struct OptionName
+{
+    explicit OptionName(std::string name_arg)
+        : name(std::move(name_arg)),
+          id(OptionNameTable::global().intern(name))
+    {
+    }
+
+    const std::string name;
+    const OptionNameTable::ID id;
+};
+
+} // namespace openvpn
+
+#endif // OPENVPN_COMMON_OPTNAMES_H
@@ -53,6 +53,59 @@ inline void tcp_nodelay(const int fd)
         throw Exception("error setting TCP_NODELAY on socket");
 }
 
+#ifdef TCP_DEFER_ACCEPT
+// set TCP_DEFER_ACCEPT on a listening socket, so that accept
+// only completes once the client has sent data (or seconds elapse)
+inline void tcp_defer_accept(const int fd, const int seconds)
+{
+    if (::setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, (void *)&seconds, sizeof(seconds)) != 0)
+        throw Exception("error setting TCP_DEFER_ACCEPT on socket");
+}
+#endif
+
+#ifdef TCP_FASTOPEN
+// enable TCP Fast Open on a listening socket with the given
+// queue length of pending TFO requests
+inline void tcp_fastopen(const int fd, const int qlen)
+{
+    if (::setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, (void *)&qlen, sizeof(qlen)) != 0)
+        throw Exception("error setting TCP_FASTOPEN on socket");
+}
+#endif
+
+// get SO_RCVBUF or SO_SNDBUF (optname) as reported by the kernel
+inline int sockbuf(const int fd, const int optname)
+{
+    int size = 0;
+    socklen_t len = sizeof(size);
+    if (::getsockopt(fd, SOL_SOCKET, optname, (void *)&size, &len) < 0)
+        throw Exception("error getting socket buffer size");
+    return size;
+}
+
+// set SO_RCVBUF or SO_SNDBUF (optname) so that sockbuf() reports size,
+// subject to the system limit (net.core.rmem_max/wmem_max on Linux)
+inline void set_sockbuf(const int fd, const int optname, int size)
+{
+#ifdef OPENVPN_PLATFORM_LINUX
+    // the kernel doubles the value to allow for bookkeeping overhead
+    size /= 2;
+#endif
+    if (::setsockopt(fd, SOL_SOCKET, optname, (void *)&size, sizeof(size)) < 0)
+        throw Exception("error setting socket buffer size");
+}
+
+#ifdef SO_RXQ_OVFL
+// set SO_RXQ_OVFL, so that received datagrams carry the number of
+// datagrams the kernel has dropped on the socket in a control message
+inline void rxq_ovfl(const int fd)
+{
+    int on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, (void *)&on, sizeof(on)) < 0)
+        throw Exception("error setting SO_RXQ_OVFL on socket");
+}
+#endif
+
 // set FD_CLOEXEC to prevent fd from being passed across execs
 inline void set_cloexec(const int fd)
 {
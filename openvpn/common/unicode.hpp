@@ -22,11 +22,130 @@
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
+#include <openvpn/common/ffs.hpp>
 #include <openvpn/common/unicode-impl.hpp>
 #include <openvpn/buffer/buffer.hpp>
 
+// Vector instructions used for the ASCII fast path, unless
+// OPENVPN_UNICODE_NO_SIMD is defined
+#if !defined(OPENVPN_UNICODE_NO_SIMD)
+#if defined(__AVX2__)
+#define OPENVPN_UNICODE_AVX2
+#define OPENVPN_UNICODE_SSE2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OPENVPN_UNICODE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define OPENVPN_UNICODE_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace openvpn::Unicode {
 
+// ASCII fast path: the length of the leading run of ASCII chars that
+// need no further checks, 16 or 32 bytes at a time where vector
+// instructions are available.  Besides bytes with the high bit set,
+// the run ends at the chars selected by the stop flags.
+enum
+{
+    ASCII_STOP_NUL = (1 << 0),
+    ASCII_STOP_CTRL = (1 << 1),  // 0x00-0x1F and 0x7F
+    ASCII_STOP_SPACE = (1 << 2), // ' ' and '\t' '\n' '\v' '\f' '\r'
+};
+
+inline bool ascii_stop(const unsigned char c, const unsigned int stop)
+{
+    return c >= 0x80
+           || ((stop & ASCII_STOP_NUL) && c == 0)
+           || ((stop & ASCII_STOP_CTRL) && (c < 0x20 || c == 0x7F))
+           || ((stop & ASCII_STOP_SPACE) && (c == ' ' || (c >= '\t' && c <= '\r')));
+}
+
+#if defined(OPENVPN_UNICODE_AVX2)
+inline unsigned int ascii_stop_mask(const __m256i v, const unsigned int stop)
+{
+    // signed compares, bytes with the high bit set are negative
+    __m256i m = v;
+    if (stop & ASCII_STOP_NUL)
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    if (stop & ASCII_STOP_CTRL)
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v),
+                                               _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F))));
+    if (stop & ASCII_STOP_SPACE)
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                               _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                                                _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v))));
+    return static_cast<unsigned int>(_mm256_movemask_epi8(m));
+}
+#endif
+
+#if defined(OPENVPN_UNICODE_SSE2)
+inline unsigned int ascii_stop_mask(const __m128i v, const unsigned int stop)
+{
+    __m128i m = v;
+    if (stop & ASCII_STOP_NUL)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    if (stop & ASCII_STOP_CTRL)
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                                         _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F))));
+    if (stop & ASCII_STOP_SPACE)
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                         _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                                       _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)))));
+    return static_cast<unsigned int>(_mm_movemask_epi8(m));
+}
+#endif
+
+#if defined(OPENVPN_UNICODE_NEON)
+inline bool ascii_stop_any(const uint8x16_t v, const unsigned int stop)
+{
+    uint8x16_t m = vcgeq_u8(v, vdupq_n_u8(0x80));
+    if (stop & ASCII_STOP_NUL)
+        m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8(0)));
+    if (stop & ASCII_STOP_CTRL)
+        m = vorrq_u8(m, vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)), vceqq_u8(v, vdupq_n_u8(0x7F))));
+    if (stop & ASCII_STOP_SPACE)
+        m = vorrq_u8(m, vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                                 vandq_u8(vcgeq_u8(v, vdupq_n_u8('\t')), vcleq_u8(v, vdupq_n_u8('\r')))));
+    return vmaxvq_u8(m) != 0;
+}
+#endif
+
+inline size_t ascii_run(const unsigned char *source, const size_t size, const unsigned int stop)
+{
+    // in text that is mostly multi-byte chars, most runs are empty
+    if (!size || ascii_stop(source[0], stop))
+        return 0;
+    size_t i = 1;
+#if defined(OPENVPN_UNICODE_AVX2)
+    for (; i + 32 <= size; i += 32)
+    {
+        const unsigned int m = ascii_stop_mask(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i)), stop);
+        if (m)
+            return i + find_first_set(m) - 1;
+    }
+#endif
+#if defined(OPENVPN_UNICODE_SSE2)
+    for (; i + 16 <= size; i += 16)
+    {
+        const unsigned int m = ascii_stop_mask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i)), stop);
+        if (m)
+            return i + find_first_set(m) - 1;
+    }
+#elif defined(OPENVPN_UNICODE_NEON)
+    for (; i + 16 <= size; i += 16)
+    {
+        if (ascii_stop_any(vld1q_u8(source + i), stop))
+            break;
+    }
+#endif
+    while (i < size && !ascii_stop(source[i], stop))
+        ++i;
+    return i;
+}
+
 OPENVPN_SIMPLE_EXCEPTION(unicode_src_overflow);
 OPENVPN_SIMPLE_EXCEPTION(unicode_dest_overflow);
 OPENVPN_SIMPLE_EXCEPTION(unicode_malformed);
@@ -43,9 +162,23 @@ inline bool is_valid_utf8_uchar_buf(const unsigned char *source,
                                     const size_t max_len_flags = 0) // OR max length (or 0 to disable) with UTF8_x flags above
 {
     const size_t max_len = max_len_flags & ((size_t)UTF8_NO_CTRL - 1); // NOTE -- use smallest flag value here
+    const unsigned int stop = ASCII_STOP_NUL
+                              | ((max_len_flags & UTF8_NO_CTRL) ? ASCII_STOP_CTRL : 0)
+                              | ((max_len_flags & UTF8_NO_SPACE) ? ASCII_STOP_SPACE : 0);
     size_t unicode_len = 0;
     while (size)
     {
+        // ASCII chars that pass all checks, without scanning
+        // past max_len
+        const size_t run = ascii_run(source, max_len ? std::min(size, max_len - unicode_len + 1) : size, stop);
+        source += run;
+        size -= run;
+        unicode_len += run;
+        if (max_len && unicode_len > max_len)
+            return false;
+        if (!size)
+            break;
+
         const unsigned char c = *source;
         if (c == '\0')
             return false;
@@ -138,6 +271,18 @@ inline STRING utf8_printable(const STRING &str, size_t max_len_flags)
     {
         if (!max_len || upos < max_len)
         {
+            // printable ASCII chars are copied as they are
+            const size_t run = ascii_run((const unsigned char *)&str[pos],
+                                         max_len ? std::min(size - pos, max_len - upos) : size - pos,
+                                         ASCII_STOP_CTRL);
+            if (run)
+            {
+                ret.append(str, pos, run);
+                pos += run;
+                upos += run;
+                continue;
+            }
+
             unsigned char c = str[pos];
             int len = trailingBytesForUTF8[c] + 1;
             if (pos + len <= size
@@ -20,6 +20,7 @@
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/clamp_typerange.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/scratchbuf.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/crypto/static_key.hpp>
 #include <openvpn/crypto/packet_id_data.hpp>
@@ -159,7 +160,6 @@ class Crypto : public CryptoDCInstance
         typename CRYPTO_API::CipherContextAEAD impl;
         Nonce nonce;
         PacketIDDataSend pid_send{};
-        BufferAllocated work;
     };
 
     struct Decrypt
@@ -167,7 +167,6 @@ class Crypto : public CryptoDCInstance
         typename CRYPTO_API::CipherContextAEAD impl;
         Nonce nonce;
         PacketIDDataReceive pid_recv{};
-        BufferAllocated work;
     };
 
   public:
@@ -196,21 +195,22 @@ class Crypto : public CryptoDCInstance
             Nonce nonce(e.nonce, e.pid_send, op32);
 
             // encrypt to work buf
-            frame->prepare(Frame::ENCRYPT_WORK, e.work);
-            if (e.work.max_size() < buf.size())
+            BufferAllocated &work = ScratchBuffer::get();
+            frame->prepare(Frame::ENCRYPT_WORK, work);
+            if (work.max_size() < buf.size())
                 throw aead_error("encrypt work buffer too small");
 
 
-            unsigned char *work_data = e.work.write_alloc(buf.size());
+            unsigned char *work_data = work.write_alloc(buf.size());
 
             unsigned char *auth_tag_tmp = nullptr;
             // alloc auth tag in buffer at the start of the packet
             // Create a temporary auth tag at the end if the implementation and mode require it
 
-            unsigned char *auth_tag = e.work.prepend_alloc(CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
+            unsigned char *auth_tag = work.prepend_alloc(CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
             if (e.impl.requires_authtag_at_end())
             {
-                auth_tag_tmp = e.work.write_alloc(CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
+                auth_tag_tmp = work.write_alloc(CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
             }
 
             // encrypt
@@ -221,10 +221,10 @@ class Crypto : public CryptoDCInstance
                 /* move the auth tag to the front */
                 std::memcpy(auth_tag, auth_tag_tmp, CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
                 /* Ignore the auth tag at the end */
-                e.work.inc_size(-CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
+                work.inc_size(-CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
             }
 
-            buf.swap(e.work);
+            buf.swap(work);
 
             // prepend additional data
             nonce.prepend_ad(buf, e.pid_send);
@@ -247,8 +247,9 @@ class Crypto : public CryptoDCInstance
             auth_tag = buf.read_alloc(CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
 
             // initialize work buffer.
-            frame->prepare(Frame::DECRYPT_WORK, d.work);
-            if (d.work.max_size() < buf.size())
+            BufferAllocated &work = ScratchBuffer::get();
+            frame->prepare(Frame::DECRYPT_WORK, work);
+            if (work.max_size() < buf.size())
                 throw aead_error("decrypt work buffer too small");
 
             if (auth_tag && e.impl.requires_authtag_at_end())
@@ -259,7 +260,7 @@ class Crypto : public CryptoDCInstance
             }
 
             // decrypt from buf -> work
-            if (!d.impl.decrypt(buf.c_data(), d.work.data(), buf.size(), nonce.iv(), auth_tag, nonce.ad(), nonce.ad_len(d.pid_recv)))
+            if (!d.impl.decrypt(buf.c_data(), work.data(), buf.size(), nonce.iv(), auth_tag, nonce.ad(), nonce.ad_len(d.pid_recv)))
             {
                 buf.reset_size();
                 return Error::DECRYPT_ERROR;
@@ -267,11 +268,11 @@ class Crypto : public CryptoDCInstance
 
             if (e.impl.requires_authtag_at_end())
             {
-                d.work.set_size(buf.size() - CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
+                work.set_size(buf.size() - CRYPTO_API::CipherContextAEAD::AUTH_TAG_LEN);
             }
             else
             {
-                d.work.set_size(buf.size());
+                work.set_size(buf.size());
             }
 
             // verify packet ID
@@ -282,7 +283,7 @@ class Crypto : public CryptoDCInstance
             }
 
             // return cleartext result in buf
-            buf.swap(d.work);
+            buf.swap(work);
         }
         return Error::SUCCESS;
     }
@@ -20,6 +20,7 @@
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/clamp_typerange.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/scratchbuf.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/crypto/static_key.hpp>
 #include <openvpn/crypto/packet_id_data.hpp>
@@ -34,10 +35,6 @@ OPENVPN_EXCEPTION(aead_epoch_error);
 template <typename CRYPTO_API>
 class Crypto : public CryptoDCInstance
 {
-
-    BufferAllocated work_encrypt;
-    BufferAllocated work_decrypt;
-
   public:
     Crypto(SSLLib::Ctx libctx_arg,
            CryptoDCSettingsData dc_settings_data,
@@ -75,6 +72,7 @@ class Crypto : public CryptoDCInstance
         encrypt_ctx.calculate_iv(pkt_header.data() + 4, calculated_iv);
 
         // encrypt to work buf
+        BufferAllocated &work_encrypt = ScratchBuffer::get();
         frame->prepare(Frame::ENCRYPT_WORK, work_encrypt);
         if (work_encrypt.max_size() < buf.size())
             throw aead_epoch_error("encrypt work buffer too small");
@@ -136,6 +134,7 @@ class Crypto : public CryptoDCInstance
         decrypt_ctx->calculate_iv(packet_id, calculated_iv);
 
         // initialize work buffer.
+        BufferAllocated &work_decrypt = ScratchBuffer::get();
         frame->prepare(Frame::DECRYPT_WORK, work_decrypt);
         if (work_decrypt.max_size() < buf.size())
             throw aead_epoch_error("decrypt work buffer too small");
@@ -20,6 +20,7 @@
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/memneq.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/scratchbuf.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/crypto/cipher.hpp>
 #include <openvpn/crypto/ovpnhmac.hpp>
@@ -64,23 +65,27 @@ class DecryptCHM
             // extract IV from head of packet
             buf.read(iv_buf, iv_length);
 
-            // initialize work buffer
-            frame->prepare(Frame::DECRYPT_WORK, work);
+            // decrypt in place if possible, otherwise from buf -> work
+            const bool in_place = CRYPTO_API::CipherContext::SUPPORTS_IN_PLACE
+                                  && buf.size() + buf.remaining() >= cipher.output_size(buf.size());
+            BufferAllocated &work = ScratchBuffer::get();
+            BufferAllocated &out = in_place ? buf : work;
+            if (!in_place)
+                frame->prepare(Frame::DECRYPT_WORK, work);
 
-            // decrypt from buf -> work
-            const size_t decrypt_bytes = cipher.decrypt(iv_buf, work.data(), work.max_size(), buf.c_data(), buf.size());
+            const size_t decrypt_bytes = cipher.decrypt(iv_buf, out.data(), out.size() + out.remaining(), buf.c_data(), buf.size());
             if (!decrypt_bytes)
             {
                 buf.reset_size();
                 return Error::DECRYPT_ERROR;
             }
-            work.set_size(decrypt_bytes);
+            out.set_size(decrypt_bytes);
 
             // handle different cipher modes
             const int cipher_mode = cipher.cipher_mode();
             if (cipher_mode == CRYPTO_API::CipherContext::CIPH_CBC_MODE)
             {
-                if (!verify_packet_id(work, now))
+                if (!verify_packet_id(out, now))
                 {
                     buf.reset_size();
                     return Error::REPLAY_ERROR;
@@ -92,7 +97,8 @@ class DecryptCHM
             }
 
             // return cleartext result in buf
-            buf.swap(work);
+            if (!in_place)
+                buf.swap(work);
         }
         else // no encryption
         {
@@ -117,8 +123,6 @@ class DecryptCHM
         const PacketIDData pid = pid_recv.read_next(buf);
         return pid_recv.test_add(pid, now, stats);
     }
-
-    BufferAllocated work;
 };
 
 } // namespace openvpn
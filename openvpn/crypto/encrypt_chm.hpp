@@ -20,7 +20,9 @@
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/buffer/scratchbuf.hpp>
 #include <openvpn/random/randapi.hpp>
+#include <openvpn/random/randbuf.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/crypto/cipher.hpp>
 #include <openvpn/crypto/ovpnhmac.hpp>
@@ -51,7 +53,7 @@ class EncryptCHM
             if (cipher_mode == CRYPTO_API::CipherContext::CIPH_CBC_MODE)
             {
                 // in CBC mode, use an explicit, random IV
-                rng->rand_bytes(iv_buf, iv_length);
+                StrongRandomBuffer::rand_bytes(*rng, iv_buf, iv_length);
 
                 // generate fresh outgoing packet ID and prepend to cleartext buffer
                 pid_send.prepend_next(buf);
@@ -61,26 +63,47 @@ class EncryptCHM
                 throw chm_unsupported_cipher_mode();
             }
 
-            // initialize work buffer
-            frame->prepare(Frame::ENCRYPT_WORK, work);
-
-            // encrypt from buf -> work
-            const size_t encrypt_bytes = cipher.encrypt(iv_buf, work.data(), work.max_size(), buf.c_data(), buf.size());
-            if (!encrypt_bytes)
+            if (in_place(buf))
             {
-                buf.reset_size();
-                return;
+                // encrypt buf in place
+                const size_t encrypt_bytes = cipher.encrypt(iv_buf, buf.data(), buf.size() + buf.remaining(), buf.c_data(), buf.size());
+                if (!encrypt_bytes)
+                {
+                    buf.reset_size();
+                    return;
+                }
+                buf.set_size(encrypt_bytes);
+
+                // prepend the IV to the ciphertext
+                buf.prepend(iv_buf, iv_length);
+
+                // HMAC the ciphertext
+                prepend_hmac(buf);
+            }
+            else
+            {
+                // initialize work buffer
+                BufferAllocated &work = ScratchBuffer::get();
+                frame->prepare(Frame::ENCRYPT_WORK, work);
+
+                // encrypt from buf -> work
+                const size_t encrypt_bytes = cipher.encrypt(iv_buf, work.data(), work.max_size(), buf.c_data(), buf.size());
+                if (!encrypt_bytes)
+                {
+                    buf.reset_size();
+                    return;
+                }
+                work.set_size(encrypt_bytes);
+
+                // prepend the IV to the ciphertext
+                work.prepend(iv_buf, iv_length);
+
+                // HMAC the ciphertext
+                prepend_hmac(work);
+
+                // return ciphertext result in buf
+                buf.swap(work);
             }
-            work.set_size(encrypt_bytes);
-
-            // prepend the IV to the ciphertext
-            work.prepend(iv_buf, iv_length);
-
-            // HMAC the ciphertext
-            prepend_hmac(work);
-
-            // return ciphertext result in buf
-            buf.swap(work);
         }
         else // no encryption
         {
@@ -103,6 +126,18 @@ class EncryptCHM
     PacketIDDataSend pid_send{};
 
   private:
+    // true if buf has tailroom for the CBC padding and as much headroom
+    // as the ENCRYPT_WORK buffer, so that it can be encrypted in place.
+    // Callers prepend the op and, on TCP, the packet length after IV and
+    // HMAC, so the headroom must be the same as with the copy.
+    bool in_place(const BufferAllocated &buf) const
+    {
+        if (!CRYPTO_API::CipherContext::SUPPORTS_IN_PLACE)
+            return false;
+        return buf.size() + buf.remaining() >= cipher.output_size(buf.size())
+               && buf.offset() >= (*frame)[Frame::ENCRYPT_WORK].headroom();
+    }
+
     // compute HMAC signature of data buffer,
     // then prepend the signature to the buffer.
     void prepend_hmac(BufferAllocated &buf)
@@ -117,7 +152,6 @@ class EncryptCHM
         }
     }
 
-    BufferAllocated work;
     StrongRandomAPI::Ptr rng;
 };
 
@@ -36,6 +36,7 @@
 #include <openvpn/kovpn/kovpn.hpp>
 #include <openvpn/kovpn/rps_xps.hpp>
 #elif defined(ENABLE_OVPNDCO)
+#include <openvpn/asio/asioarena.hpp>
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/common/uniqueptr.hpp>
 #include <openvpn/dco/key.hpp>
@@ -637,27 +637,27 @@ class OvpnDcoClient : public Client,
                        BufAllocFlags::GROW | BufAllocFlags::CONSTRUCT_ZERO | BufAllocFlags::DESTRUCT_ZERO);
         pipe->async_read_some(
             pkt->buf.mutable_buffer(),
-            [self = Ptr(this),
-             pkt = PacketFrom::SPtr(pkt)](const openvpn_io::error_code &error,
-                                          const size_t bytes_recvd) mutable
-            {
-                if (!error)
-                {
-                    pkt->buf.set_size(bytes_recvd);
-                    if (self->tun_read_handler(pkt->buf))
-                        self->queue_read_pipe(pkt.release());
-                }
-                else
-                {
-                    if (!self->halt)
-                    {
-                        OPENVPN_LOG("ovpn-dco pipe read error: " << error.message());
-                        self->stop_();
-                        self->transport_parent->transport_error(Error::TUN_HALT,
-                                                                error.message());
-                    }
-                }
-            });
+            arena.bind([self = Ptr(this),
+                        pkt = PacketFrom::SPtr(pkt)](const openvpn_io::error_code &error,
+                                                     const size_t bytes_recvd) mutable
+                       {
+                           if (!error)
+                           {
+                               pkt->buf.set_size(bytes_recvd);
+                               if (self->tun_read_handler(pkt->buf))
+                                   self->queue_read_pipe(pkt.release());
+                           }
+                           else
+                           {
+                               if (!self->halt)
+                               {
+                                   OPENVPN_LOG("ovpn-dco pipe read error: " << error.message());
+                                   self->stop_();
+                                   self->transport_parent->transport_error(Error::TUN_HALT,
+                                                                           error.message());
+                               }
+                           }
+                       }));
     }
 
     SessionStats::DCOTransportSource::Data dco_transport_stats_delta() override
@@ -676,6 +676,7 @@ class OvpnDcoClient : public Client,
 
     // used to communicate to kernel via privileged process
     std::unique_ptr<openvpn_io::posix::stream_descriptor> pipe;
+    AsioArena arena;
 
     GeNLImpl::Ptr genl;
     TransportClient::Ptr transport;
@@ -110,6 +110,8 @@ enum Type
     PKTID_REPLAY,
     PKTID_TIME_BACKTRACK,
 
+    BUFFER_REALLOC,                       // data channel buffer grew, its Frame context is too small
+
     N_ERRORS,
 
     // undefined error
@@ -204,6 +206,7 @@ inline const char *name(const size_t type)
         "PKTID_EXPIRE",
         "PKTID_REPLAY",
         "PKTID_TIME_BACKTRACK",
+        "BUFFER_REALLOC",
     };
 
     static_assert(N_ERRORS == array_size(names), "error names array inconsistency");
@@ -50,6 +50,15 @@ class Frame : public RC<thread_unsafe_refcount>
         N_ALIGN_CONTEXTS
     };
 
+    // Contexts of the buffers a data channel packet passes through
+    enum
+    {
+        DATA_PATH_CONTEXTS = (1 << ENCRYPT_WORK) | (1 << DECRYPT_WORK)
+                             | (1 << COMPRESS_WORK) | (1 << DECOMPRESS_WORK)
+                             | (1 << READ_LINK_UDP) | (1 << READ_LINK_TCP)
+                             | (1 << READ_TUN)
+    };
+
     OPENVPN_SIMPLE_EXCEPTION(frame_context_index);
 
     // We manage an array of Context objects, one for each
@@ -322,6 +331,19 @@ class Frame : public RC<thread_unsafe_refcount>
         }
     }
 
+    // True if all data path contexts leave at least headroom bytes in
+    // front of and tailroom bytes behind a packet
+    bool data_path_fits(const size_t headroom, const size_t tailroom) const
+    {
+        unsigned int mask = DATA_PATH_CONTEXTS;
+        for (size_t i = 0; i < N_ALIGN_CONTEXTS; ++i, mask >>= 1)
+        {
+            if ((mask & 1) && (contexts[i].headroom() < headroom || contexts[i].tailroom() < tailroom))
+                return false;
+        }
+        return true;
+    }
+
   private:
     Context contexts[N_ALIGN_CONTEXTS];
 };
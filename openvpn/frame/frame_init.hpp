@@ -20,6 +20,15 @@
 
 namespace openvpn {
 
+// The most any data channel pipeline adds in front of a tun packet:
+// TCP length prefix (2), op32 (4), compression header (2), long packet
+// ID (8), CBC IV (16) and HMAC (64, with SHA512), and behind it: CBC
+// padding (16).  The transport and tun objects copy their contexts when
+// they are created, before the data channel is negotiated, so the frame
+// must have room for any pipeline from the start.
+constexpr size_t frame_data_path_headroom = 96;
+constexpr size_t frame_data_path_tailroom = 16;
+
 inline Frame::Ptr frame_init(const bool align_adjust_3_1,
                              const size_t tun_mtu_max,
                              const size_t control_channel_payload,
@@ -27,9 +36,12 @@ inline Frame::Ptr frame_init(const bool align_adjust_3_1,
 {
     const size_t payload = std::max(tun_mtu_max + 512, size_t(2048));
     const size_t headroom = 512;
+    const size_t tun_prefix = 16;
     const size_t tailroom = 512;
     const size_t align_block = 16;
     const unsigned int buffer_flags = 0;
+    static_assert(headroom >= frame_data_path_headroom && tailroom >= frame_data_path_tailroom,
+                  "frame too small for the data channel");
 
     Frame::Ptr frame(new Frame(Frame::Context(headroom, payload, tailroom, 0, align_block, buffer_flags)));
     if (align_adjust_3_1)
@@ -37,6 +49,9 @@ inline Frame::Ptr frame_init(const bool align_adjust_3_1,
         (*frame)[Frame::READ_LINK_TCP] = Frame::Context(headroom, payload, tailroom, 3, align_block, buffer_flags);
         (*frame)[Frame::READ_LINK_UDP] = Frame::Context(headroom, payload, tailroom, 1, align_block, buffer_flags);
     }
+    // room for the compression header and packet ID in front of the
+    // ENCRYPT_WORK headroom, so that tun packets can be encrypted in place
+    (*frame)[Frame::READ_TUN] = Frame::Context(headroom + tun_prefix, payload, tailroom, 0, align_block, buffer_flags);
     (*frame)[Frame::READ_BIO_MEMQ_STREAM] = Frame::Context(headroom,
                                                            std::min(control_channel_payload, payload),
                                                            tailroom,
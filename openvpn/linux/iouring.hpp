@@ -0,0 +1,882 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Minimal io_uring ring used as an optional packet I/O backend for the
+// tun and UDP links on Linux.
+//
+// All links of an io_context share one ring.  Operations prepared while
+// a handler runs are submitted together with a single io_uring_enter()
+// once the handler returns, and the ring fd is watched by the io_context,
+// so completions are dispatched in batches like any other asio handler.
+//
+// Packets written through the ring are copied into a pool of fixed-size
+// slots, registered with the kernel as a fixed buffer when the memlock
+// limit permits, so callers may reuse their buffer on return exactly as
+// with a synchronous write.  Received datagrams can be placed by the
+// kernel into a provided buffer ring (BufferGroup), which lets a single
+// multishot recvmsg serve any number of packets.
+//
+// The ring is not thread safe and must only be used from the thread
+// running its io_context.  Define OPENVPN_NO_IO_URING to compile the
+// backend out.
+
+#pragma once
+
+#if !defined(OPENVPN_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+
+// multishot recvmsg and provided buffer rings need 6.0+ kernel headers
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_CQE_F_MORE) && defined(__NR_io_uring_setup)
+#define OPENVPN_IO_URING
+
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/strerror.hpp>
+
+namespace openvpn {
+
+class IOUring : public RC<thread_unsafe_refcount>
+{
+    struct Link
+    {
+        Link *prev = nullptr;
+        Link *next = nullptr;
+    };
+
+  public:
+    typedef RCPtr<IOUring> Ptr;
+
+    OPENVPN_EXCEPTION(io_uring_error);
+
+    enum
+    {
+        DEFAULT_ENTRIES = 256,
+        DEFAULT_SLOTS = 256,
+        DEFAULT_SLOT_SIZE = 2048,
+        MAX_SLOT_CHUNKS = 8, // the pool grows up to MAX_SLOT_CHUNKS * n_slots
+    };
+
+    // An operation submitted to the ring.  The ring holds a reference
+    // to the operation from submission until its last completion, so
+    // the operation (and whatever it references) stays alive while
+    // the kernel may still use its buffers.
+    class Op : public RC<thread_unsafe_refcount>, private Link
+    {
+      public:
+        typedef RCPtr<Op> Ptr;
+
+        bool pending() const
+        {
+            return next != nullptr;
+        }
+
+        // Called for each completion of the operation with the result
+        // (or -errno) and the CQE flags.  A multishot operation remains
+        // pending as long as IORING_CQE_F_MORE is set in flags.
+        virtual void complete(const int res, const unsigned int flags) = 0;
+
+      private:
+        friend class IOUring;
+    };
+
+    // A ring of buffers provided to the kernel for receive operations
+    // using IOSQE_BUFFER_SELECT.  Buffers are returned to the kernel
+    // by calling recycle() once their content has been consumed.
+    class BufferGroup : public RC<thread_unsafe_refcount>
+    {
+      public:
+        typedef RCPtr<BufferGroup> Ptr;
+
+        // n_bufs must be a power of 2
+        BufferGroup(IOUring::Ptr ring_arg, const unsigned int n_bufs, const size_t buf_size_arg)
+            : ring(std::move(ring_arg)),
+              mask(n_bufs - 1),
+              buf_size(buf_size_arg),
+              bgid(ring->next_bgid++)
+        {
+            if (!n_bufs || (n_bufs & mask) || n_bufs > 32768)
+                throw io_uring_error("buffer group size must be a power of 2");
+            ring_len = n_bufs * sizeof(io_uring_buf);
+            void *p = ::mmap(nullptr, ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw io_uring_error("cannot allocate buffer ring");
+            // io_uring_buf_ring overlays the tail with bufs[0].resv, but its
+            // flexible array member is not laid out as in C, so the ring is
+            // accessed as a plain array of io_uring_buf
+            bufs = static_cast<io_uring_buf *>(p);
+            slab.reset(new unsigned char[n_bufs * buf_size]);
+
+            io_uring_buf_reg reg = {};
+            reg.ring_addr = reinterpret_cast<std::uintptr_t>(bufs);
+            reg.ring_entries = n_bufs;
+            reg.bgid = bgid;
+            const int status = ring->do_register(IORING_REGISTER_PBUF_RING, &reg, 1);
+            if (status < 0)
+            {
+                ::munmap(bufs, ring_len);
+                throw io_uring_error("cannot register buffer ring: " + strerror_str(-status));
+            }
+            for (unsigned int bid = 0; bid < n_bufs; ++bid)
+                add(bid);
+            commit();
+        }
+
+        ~BufferGroup()
+        {
+            io_uring_buf_reg reg = {};
+            reg.bgid = bgid;
+            ring->do_register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            ::munmap(bufs, ring_len);
+        }
+
+        std::uint16_t id() const
+        {
+            return bgid;
+        }
+
+        size_t size() const
+        {
+            return buf_size;
+        }
+
+        unsigned char *buffer(const unsigned int bid)
+        {
+            return slab.get() + size_t(bid & mask) * buf_size;
+        }
+
+        void recycle(const unsigned int bid)
+        {
+            add(bid & mask);
+            commit();
+        }
+
+      private:
+        void add(const unsigned int bid)
+        {
+            io_uring_buf &b = bufs[tail & mask];
+            b.addr = reinterpret_cast<std::uintptr_t>(buffer(bid));
+            b.len = static_cast<std::uint32_t>(buf_size);
+            b.bid = static_cast<std::uint16_t>(bid);
+            ++tail;
+        }
+
+        void commit()
+        {
+            __atomic_store_n(&bufs[0].resv, tail, __ATOMIC_RELEASE);
+        }
+
+        IOUring::Ptr ring;
+        const unsigned int mask;
+        const size_t buf_size;
+        const std::uint16_t bgid;
+        io_uring_buf *bufs = nullptr;
+        size_t ring_len = 0;
+        std::unique_ptr<unsigned char[]> slab;
+        std::uint16_t tail = 0;
+    };
+
+    // Return the ring shared by all users of io_context, or a null
+    // pointer if io_uring is not available on this system (old kernel,
+    // disabled by sysctl or seccomp policy).
+    static Ptr get(openvpn_io::io_context &io_context)
+    {
+        return openvpn_io::use_service<Service>(io_context).ring();
+    }
+
+    // If io_context is null, completions are only processed by
+    // explicit calls to poll().
+    IOUring(openvpn_io::io_context *io_context_arg,
+            const unsigned int entries = DEFAULT_ENTRIES,
+            const unsigned int n_slots = DEFAULT_SLOTS,
+            const size_t slot_size_arg = DEFAULT_SLOT_SIZE)
+        : io_context(io_context_arg),
+          slot_size_(slot_size_arg)
+    {
+        setup(entries);
+        init_slots(n_slots);
+        if (io_context)
+            notify.reset(new openvpn_io::posix::stream_descriptor(*io_context, ring_fd));
+    }
+
+    ~IOUring()
+    {
+        shutdown();
+    }
+
+    // Prepare a read of up to len bytes into buf, or a write of len
+    // bytes from buf.  A write from a slot can use the registered
+    // slot pool.
+    //
+    // These return a null pointer, without taking a reference to op,
+    // if the submission queue is full and can't be submitted, or once
+    // the ring is shut down.  The caller should then fall back to asio.
+    io_uring_sqe *read(Op *op, const int fd, void *buf, const size_t len)
+    {
+        io_uring_sqe *sqe = get_sqe(op);
+        if (!sqe)
+            return nullptr;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(buf);
+        sqe->len = static_cast<std::uint32_t>(len);
+        sqe->off = std::uint64_t(-1); // current file position, as read(2)
+        return sqe;
+    }
+
+    io_uring_sqe *write(Op *op, const int fd, const void *buf, const size_t len)
+    {
+        io_uring_sqe *sqe = get_sqe(op);
+        if (!sqe)
+            return nullptr;
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(buf);
+        sqe->len = static_cast<std::uint32_t>(len);
+        sqe->off = std::uint64_t(-1);
+        if (slots_registered && in_slot_pool(buf, len))
+        {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->buf_index = 0;
+        }
+        return sqe;
+    }
+
+    io_uring_sqe *recvmsg(Op *op, const int fd, ::msghdr *msg)
+    {
+        io_uring_sqe *sqe = get_sqe(op);
+        if (!sqe)
+            return nullptr;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(msg);
+        sqe->len = 1;
+        return sqe;
+    }
+
+    // Receive any number of datagrams into buffers of group.  msg
+    // only describes the size of the name and control areas, and
+    // each buffer starts with an io_uring_recvmsg_out header.
+    io_uring_sqe *recvmsg_multishot(Op *op, const int fd, ::msghdr *msg, const BufferGroup &group)
+    {
+        io_uring_sqe *sqe = get_sqe(op);
+        if (!sqe)
+            return nullptr;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(msg);
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = group.id();
+        return sqe;
+    }
+
+    io_uring_sqe *sendmsg(Op *op, const int fd, const ::msghdr *msg)
+    {
+        io_uring_sqe *sqe = get_sqe(op);
+        if (!sqe)
+            return nullptr;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(msg);
+        sqe->len = 1;
+        return sqe;
+    }
+
+    // Cancel all operations on fd.  The cancellation is submitted
+    // immediately, so fd may be closed on return.  The cancelled
+    // operations complete with -ECANCELED.
+    void cancel_fd(const int fd)
+    {
+        if (halt)
+            return;
+        io_uring_sqe *sqe = get_sqe(nullptr);
+        if (!sqe)
+        {
+            // no room in the submission queue, cancel synchronously
+            io_uring_sync_cancel_reg reg = {};
+            reg.fd = fd;
+            reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            reg.timeout.tv_sec = -1;
+            reg.timeout.tv_nsec = -1;
+            do_register(IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+            return;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        submit();
+    }
+
+    // Sequence number of the most recently prepared entry
+    unsigned int prepared() const
+    {
+        return sqe_tail;
+    }
+
+    // If the entry numbered seq is still the most recently prepared one
+    // and has not been submitted, link it with IOSQE_IO_LINK to the next
+    // entry, which will then only be started once seq has completed.
+    bool link_last(const unsigned int seq)
+    {
+        if (halt || seq != sqe_tail || submitted == sqe_tail)
+            return false;
+        // the next entry would only be added after a submit, which ends the chain
+        if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+            return false;
+        sqes[(seq - 1) & sq_mask].flags |= IOSQE_IO_LINK;
+        return true;
+    }
+
+    // Pool of fixed-size slots for outgoing packets.  Only the initial
+    // chunk of the pool is registered, further chunks are added when
+    // writes pile up.  alloc_slot() returns -1 if the pool is exhausted.
+    int alloc_slot()
+    {
+        if (free_slots.empty() && !grow_slots())
+            return -1;
+        const int i = free_slots.back();
+        free_slots.pop_back();
+        return i;
+    }
+
+    void free_slot(const int i)
+    {
+        free_slots.push_back(i);
+    }
+
+    unsigned char *slot(const int i)
+    {
+        const size_t chunk = size_t(i) / n_slots;
+        const size_t offset = (size_t(i) % n_slots) * slot_size_;
+        return chunk ? slot_chunks[chunk - 1].get() + offset : slots + offset;
+    }
+
+    size_t slot_size() const
+    {
+        return slot_size_;
+    }
+
+    // Submit all prepared entries now.
+    void submit()
+    {
+        if (halt)
+            return;
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        while (submitted != sqe_tail)
+        {
+            const int n = enter(sqe_tail - submitted, 0, 0);
+            if (n > 0)
+                submitted += n;
+            else if (n == -EINTR)
+                continue;
+            else
+            {
+                // CQ backlog (EBUSY/EAGAIN), retried with the next submit
+                // after completions have been reaped
+                break;
+            }
+        }
+    }
+
+    // Process available completions and submit the entries prepared
+    // by their handlers.  Returns the number of completions processed.
+    size_t poll()
+    {
+        // entries prepared by completion handlers are submitted below
+        const bool scheduled = submit_scheduled;
+        submit_scheduled = true;
+        size_t count = 0;
+        for (int round = 0; round < 4 && !halt; ++round)
+        {
+            const size_t n = reap();
+            submit();
+            if (!n)
+                break;
+            count += n;
+        }
+        submit_scheduled = scheduled;
+        return count;
+    }
+
+    void shutdown()
+    {
+        if (halt)
+            return;
+        if (notify)
+        {
+            notify->release();
+            notify.reset();
+        }
+
+        // Closing the ring would cancel the outstanding requests too, but
+        // asynchronously, while their buffers and the mappings below are
+        // released right away
+        cancel_all();
+        halt = true;
+        teardown();
+
+        if (inflight.next != &inflight)
+        {
+            // still owned by the kernel, so their buffers must not be freed
+            OPENVPN_LOG("io_uring: requests not cancelled at shutdown, leaking them");
+            inflight.next = inflight.prev = &inflight;
+        }
+    }
+
+  private:
+    // Registers one ring per io_context
+    class Service : public openvpn_io::execution_context::service
+    {
+      public:
+        static inline openvpn_io::execution_context::id id;
+
+        explicit Service(openvpn_io::io_context &io_context_arg)
+            : openvpn_io::execution_context::service(io_context_arg),
+              io_context(io_context_arg)
+        {
+        }
+
+        IOUring::Ptr ring()
+        {
+            if (!initialized)
+            {
+                initialized = true;
+                try
+                {
+                    ring_.reset(new IOUring(&io_context));
+                }
+                catch (const std::exception &e)
+                {
+                    OPENVPN_LOG("io_uring not available: " << e.what());
+                }
+            }
+            return ring_;
+        }
+
+      private:
+        void shutdown() override
+        {
+            if (ring_)
+                ring_->shutdown();
+        }
+
+        openvpn_io::io_context &io_context;
+        IOUring::Ptr ring_;
+        bool initialized = false;
+    };
+
+    int enter(const unsigned int to_submit, const unsigned int min_complete, const unsigned int flags)
+    {
+        const long status = ::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+        return status < 0 ? -errno : static_cast<int>(status);
+    }
+
+    int do_register(const unsigned int opcode, void *arg, const unsigned int nr_args)
+    {
+        if (ring_fd < 0)
+            return -EBADF;
+        const long status = ::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+        return status < 0 ? -errno : static_cast<int>(status);
+    }
+
+    void setup(const unsigned int entries)
+    {
+        io_uring_params p = {};
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (ring_fd < 0)
+            throw io_uring_error("io_uring_setup: " + strerror_str(errno));
+
+        if (!(p.features & IORING_FEAT_NODROP))
+        {
+            teardown();
+            throw io_uring_error("kernel lacks IORING_FEAT_NODROP");
+        }
+
+        sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_len = cq_len = std::max(sq_len, cq_len);
+
+        sq_ptr = map(sq_len, IORING_OFF_SQ_RING);
+        cq_ptr = single_mmap ? sq_ptr : map(cq_len, IORING_OFF_CQ_RING);
+        sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map(sqes_len, IORING_OFF_SQES));
+
+        unsigned char *sq = static_cast<unsigned char *>(sq_ptr);
+        sq_tail = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+        sq_head = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+        sq_flags = reinterpret_cast<unsigned int *>(sq + p.sq_off.flags);
+        sq_mask = *reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+        sq_entries = p.sq_entries;
+
+        // SQEs are always submitted in order, so the indirection
+        // array is the identity mapping
+        unsigned int *sq_array = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+        for (unsigned int i = 0; i < sq_entries; ++i)
+            sq_array[i] = i;
+        sqe_tail = submitted = *sq_tail;
+
+        unsigned char *cq = static_cast<unsigned char *>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    }
+
+    void *map(const size_t len, const off_t offset)
+    {
+        void *p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (p == MAP_FAILED)
+        {
+            const int eno = errno;
+            teardown();
+            throw io_uring_error("io_uring mmap: " + strerror_str(eno));
+        }
+        return p;
+    }
+
+    void init_slots(const unsigned int n_slots_arg)
+    {
+        n_slots = n_slots_arg;
+        slots_len = n_slots * slot_size_;
+        void *p = ::mmap(nullptr, slots_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            teardown();
+            throw io_uring_error("cannot allocate slot pool");
+        }
+        slots = static_cast<unsigned char *>(p);
+        free_slots.reserve(n_slots);
+        for (int i = int(n_slots) - 1; i >= 0; --i)
+            free_slots.push_back(i);
+
+        // Registering pins the pool and counts against RLIMIT_MEMLOCK.
+        // If that fails, slots are written with plain writes.
+        ::iovec iov = {slots, slots_len};
+        slots_registered = do_register(IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    }
+
+    bool grow_slots()
+    {
+        if (!slots || slot_chunks.size() + 1 >= MAX_SLOT_CHUNKS)
+            return false;
+        slot_chunks.emplace_back(new unsigned char[slots_len]);
+        const int base = int(slot_chunks.size() * n_slots);
+        for (int i = int(n_slots) - 1; i >= 0; --i)
+            free_slots.push_back(base + i);
+        return true;
+    }
+
+    bool in_slot_pool(const void *buf, const size_t len) const
+    {
+        const unsigned char *b = static_cast<const unsigned char *>(buf);
+        return b >= slots && b + len <= slots + slots_len;
+    }
+
+    void teardown()
+    {
+        if (slots)
+            ::munmap(slots, slots_len);
+        if (sqes)
+            ::munmap(sqes, sqes_len);
+        if (cq_ptr && cq_ptr != sq_ptr)
+            ::munmap(cq_ptr, cq_len);
+        if (sq_ptr)
+            ::munmap(sq_ptr, sq_len);
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+        slots = nullptr;
+        sqes = nullptr;
+        sq_ptr = cq_ptr = nullptr;
+        ring_fd = -1;
+        free_slots.clear();
+        slot_chunks.clear();
+        slots_registered = false;
+    }
+
+    bool sq_full() const
+    {
+        return sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries;
+    }
+
+    io_uring_sqe *get_sqe(Op *op)
+    {
+        if (halt)
+            return nullptr;
+
+        // Flush a full submission queue before reusing its entries.  The
+        // kernel refuses new entries while completions that did not fit
+        // into the CQ are pending, and those are only reaped once the
+        // current handler has returned.
+        if (sq_full())
+        {
+            submit();
+            if (sq_full())
+                return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes[sqe_tail & sq_mask];
+        ++sqe_tail;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = reinterpret_cast<std::uintptr_t>(op);
+        if (op && !op->pending())
+        {
+            intrusive_ptr_add_ref(op);
+            push_back(inflight, *op);
+            if (notify && !waiting)
+                wait_for_completions();
+        }
+        schedule_submit();
+        return sqe;
+    }
+
+    // Submit once the current handler has returned, so that all
+    // entries prepared by it go to the kernel in one system call.
+    void schedule_submit()
+    {
+        if (submit_scheduled || !io_context)
+            return;
+        submit_scheduled = true;
+        openvpn_io::post(*io_context, [self = Ptr(this)]()
+                         {
+                             self->submit_scheduled = false;
+                             self->submit();
+                             self->completions_ready(); });
+    }
+
+    size_t reap()
+    {
+        size_t n = 0;
+        unsigned int head = *cq_head;
+        while (!halt)
+        {
+            if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            {
+                // completions that did not fit into the CQ are held by
+                // the kernel until the next io_uring_enter()
+                if (!(__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+                    break;
+                enter(0, 0, IORING_ENTER_GETEVENTS);
+                if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+                    break;
+            }
+            const io_uring_cqe cqe = cqes[head & cq_mask];
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            ++n;
+            dispatch(cqe);
+        }
+        return n;
+    }
+
+    // Cancel all operations and wait for their final completions, so
+    // that the kernel no longer uses their buffers when they are
+    // released.  Completion handlers are not called.
+    void cancel_all()
+    {
+        // submitted here rather than from the io_context, which may be
+        // going away
+        submit_scheduled = true;
+
+        bool can_wait = true;
+        for (int round = 0; round < 10 && can_wait && inflight.next != &inflight; ++round)
+        {
+            // one request per operation, as IORING_ASYNC_CANCEL_ANY
+            // needs Linux 5.19
+            for (Link *l = inflight.next; l != &inflight; l = l->next)
+            {
+                io_uring_sqe *sqe = get_sqe(nullptr);
+                if (!sqe)
+                    break;
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(static_cast<Op *>(l));
+            }
+            submit();
+
+            // wait up to 100 ms at a time for the operations to complete
+            while (inflight.next != &inflight)
+            {
+                if (reap_final())
+                    continue;
+                __kernel_timespec ts = {0, 100 * 1000 * 1000};
+                io_uring_getevents_arg arg = {};
+                arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+                const long status = ::syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+                if (status < 0 && errno != EINTR)
+                {
+                    can_wait = errno == ETIME;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Consume the available completions without dispatching them, and
+    // drop the references of the operations that are done.
+    size_t reap_final()
+    {
+        if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+            enter(0, 0, IORING_ENTER_GETEVENTS);
+        size_t n = 0;
+        unsigned int head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe cqe = cqes[head & cq_mask];
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            ++n;
+            Op *op = reinterpret_cast<Op *>(static_cast<std::uintptr_t>(cqe.user_data));
+            if (op && !(cqe.flags & IORING_CQE_F_MORE))
+            {
+                unlink(*op);
+                intrusive_ptr_release(op);
+            }
+        }
+        return n;
+    }
+
+    void dispatch(const io_uring_cqe &cqe)
+    {
+        Op *op = reinterpret_cast<Op *>(static_cast<std::uintptr_t>(cqe.user_data));
+        if (!op)
+            return;
+        Op::Ptr hold;
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+        {
+            // adopt the reference taken at submission
+            unlink(*op);
+            hold = Op::Ptr(op, false);
+        }
+        op->complete(cqe.res, cqe.flags);
+    }
+
+    // The ring fd is only watched while operations are pending, so an
+    // idle ring does not keep the io_context running.
+    bool cq_ready() const
+    {
+        return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)
+               || (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW);
+    }
+
+    void wait_for_completions()
+    {
+        waiting = true;
+        notify->async_wait(openvpn_io::posix::stream_descriptor::wait_read,
+                           [self = Ptr(this)](const openvpn_io::error_code &error)
+                           {
+                               self->waiting = false;
+                               if (!error)
+                                   self->completions_ready();
+                               else if (error == openvpn_io::error::operation_aborted
+                                        && !self->halt
+                                        && self->inflight.next != &self->inflight)
+                                   self->wait_for_completions(); // new ops since the cancel
+                           });
+    }
+
+    void completions_ready()
+    {
+        if (halt)
+            return;
+        poll();
+        if (halt)
+            return;
+        if (cq_ready())
+        {
+            // more completions than poll() processes in one go,
+            // give other handlers a turn before continuing
+            openvpn_io::post(*io_context, [self = Ptr(this)]()
+                             { self->completions_ready(); });
+        }
+        else if (inflight.next != &inflight)
+        {
+            if (!waiting)
+                wait_for_completions();
+        }
+        else if (waiting)
+            notify->cancel();
+    }
+
+    static void push_back(Link &head, Link &l)
+    {
+        l.prev = head.prev;
+        l.next = &head;
+        head.prev->next = &l;
+        head.prev = &l;
+    }
+
+    static void unlink(Link &l)
+    {
+        l.prev->next = l.next;
+        l.next->prev = l.prev;
+        l.prev = l.next = nullptr;
+    }
+
+    openvpn_io::io_context *io_context;
+    std::unique_ptr<openvpn_io::posix::stream_descriptor> notify;
+    bool halt = false;
+    bool submit_scheduled = false;
+    bool waiting = false;
+
+    int ring_fd = -1;
+    void *sq_ptr = nullptr;
+    void *cq_ptr = nullptr;
+    size_t sq_len = 0;
+    size_t cq_len = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_len = 0;
+
+    unsigned int *sq_head = nullptr;
+    unsigned int *sq_tail = nullptr;
+    unsigned int *sq_flags = nullptr;
+    unsigned int sq_mask = 0;
+    unsigned int sq_entries = 0;
+    unsigned int sqe_tail = 0;  // next entry to prepare
+    unsigned int submitted = 0; // entries handed to the kernel
+
+    unsigned int *cq_head = nullptr;
+    unsigned int *cq_tail = nullptr;
+    unsigned int cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    unsigned char *slots = nullptr;
+    size_t slots_len = 0;
+    unsigned int n_slots = 0;
+    const size_t slot_size_;
+    std::vector<std::unique_ptr<unsigned char[]>> slot_chunks;
+    std::vector<int> free_slots;
+    bool slots_registered = false;
+
+    std::uint16_t next_bgid = 0;
+
+    // operations the kernel may still complete
+    Link inflight{&inflight, &inflight};
+};
+
+} // namespace openvpn
+
+#endif
+#endif
@@ -0,0 +1,390 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Packet capture into pcapng files.  The session thread copies the
+// first snaplen bytes of each packet into a lock-free single-producer
+// ring, and a writer thread drains the ring into the capture file,
+// rotating it with log_rotate() when it reaches max_file_size.
+//
+// The writer thread is detached and holds a reference to the ring, so
+// the ring lives until the writer has closed the file after stop().
+// Construct it on the thread whose log context the writer should use.
+
+#ifndef OPENVPN_LOG_PCAPRING_H
+#define OPENVPN_LOG_PCAPRING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/logrotate.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/count.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/log/logthread.hpp>
+
+namespace openvpn {
+
+class PcapRing : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<PcapRing> Ptr;
+
+    OPENVPN_EXCEPTION(pcap_ring_error);
+
+    // Each interface is a pcapng Interface Description Block
+    enum Interface
+    {
+        TUN,  // IP packets on the tun side, as LINKTYPE_RAW
+        LINK, // OpenVPN protocol packets on the transport, as LINKTYPE_USER0
+        N_INTERFACES,
+    };
+
+    struct Config
+    {
+        std::string path;                           // capture file
+        size_t snaplen = 128;                       // bytes kept from each packet
+        size_t slots = 4096;                        // ring capacity, rounded up to a power of two
+        size_t max_file_size = 64 * 1024 * 1024;    // rotate before exceeding, 0 to disable
+        int max_versions = 4;                       // rotated files kept as path.1 ... path.N
+        std::chrono::milliseconds poll_interval{5}; // writer sleep when the ring is empty
+    };
+
+    struct Stats
+    {
+        count_t captured = 0; // packets copied into the ring
+        count_t dropped = 0;  // packets lost because the ring was full
+        count_t written = 0;  // packets written to a file
+        count_t files = 0;    // files opened, including rotations
+    };
+
+    explicit PcapRing(const Config &config_arg)
+        : config(config_arg),
+          mask(ring_size(config_arg.slots) - 1),
+          slots(mask + 1),
+          data(slots.size() * config_arg.snaplen)
+    {
+        if (config.path.empty())
+            throw pcap_ring_error("no capture file");
+        if (!config.snaplen || config.snaplen > 65535)
+            throw pcap_ring_error("snaplen must be between 1 and 65535");
+        open_file();
+        std::thread([self = Ptr(this)]()
+                    { self->writer(); })
+            .detach();
+    }
+
+    // Tell the writer to write out what is still in the ring and close
+    // the file, without waiting for it, so that it may be called on the
+    // session thread.  done, if given, is called once the writer has
+    // finished, on the writer thread or, if it already has, right away.
+    // Packets captured after stop() are dropped.
+    void stop(std::function<void()> done = nullptr)
+    {
+        halt.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!finished)
+            {
+                on_finished = std::move(done);
+                return;
+            }
+        }
+        if (done)
+            done();
+    }
+
+    // Wait until the writer has finished after stop().  Not to be
+    // called on the session thread.
+    void join()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]()
+                  { return finished; });
+    }
+
+    const Config &conf() const
+    {
+        return config;
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.captured = captured.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        s.written = written.load(std::memory_order_relaxed);
+        s.files = files.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Called by one thread only, the session thread
+    void capture(const Interface iface, const bool out, const Buffer &buf)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) > mask || halt.load(std::memory_order_relaxed))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const size_t i = h & mask;
+        Slot &slot = slots[i];
+        slot.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        slot.len = static_cast<std::uint32_t>(buf.size());
+        slot.caplen = static_cast<std::uint16_t>(std::min(buf.size(), config.snaplen));
+        slot.iface = static_cast<std::uint8_t>(iface);
+        slot.out = out;
+        std::memcpy(&data[i * config.snaplen], buf.c_data(), slot.caplen);
+
+        head.store(h + 1, std::memory_order_release);
+        captured.fetch_add(1, std::memory_order_relaxed);
+    }
+
+  private:
+    struct Slot
+    {
+        std::uint64_t timestamp; // microseconds since the epoch
+        std::uint32_t len;
+        std::uint16_t caplen;
+        std::uint8_t iface;
+        bool out;
+    };
+
+    // pcapng block types and constants
+    enum : std::uint32_t
+    {
+        SHB_TYPE = 0x0A0D0D0A,
+        IDB_TYPE = 0x00000001,
+        EPB_TYPE = 0x00000006,
+        BYTE_ORDER_MAGIC = 0x1A2B3C4D,
+        LINKTYPE_RAW = 101,
+        LINKTYPE_USER0 = 147,
+        OPT_ENDOFOPT = 0,
+        OPT_IF_NAME = 2,
+        OPT_EPB_FLAGS = 2,
+        EPB_FLAGS_INBOUND = 1,
+        EPB_FLAGS_OUTBOUND = 2,
+    };
+
+    static size_t ring_size(const size_t n)
+    {
+        size_t size = 2;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+
+    static size_t pad4(const size_t n)
+    {
+        return (n + 3) & ~size_t(3);
+    }
+
+    void put32(const std::uint32_t v)
+    {
+        block.insert(block.end(), reinterpret_cast<const unsigned char *>(&v), reinterpret_cast<const unsigned char *>(&v) + 4);
+    }
+
+    void put16(const std::uint16_t v)
+    {
+        block.insert(block.end(), reinterpret_cast<const unsigned char *>(&v), reinterpret_cast<const unsigned char *>(&v) + 2);
+    }
+
+    void put_padded(const void *p, const size_t size)
+    {
+        const unsigned char *b = static_cast<const unsigned char *>(p);
+        block.insert(block.end(), b, b + size);
+        block.resize(pad4(block.size()), 0);
+    }
+
+    void begin_block(const std::uint32_t type)
+    {
+        block.clear();
+        put32(type);
+        put32(0); // total length, set by end_block()
+    }
+
+    void end_block()
+    {
+        const std::uint32_t len = static_cast<std::uint32_t>(block.size() + 4);
+        std::memcpy(&block[4], &len, 4);
+        put32(len);
+        file.write(reinterpret_cast<const char *>(block.data()), block.size());
+        if (!file)
+            throw pcap_ring_error("cannot write capture file: " + config.path);
+        file_size += block.size();
+    }
+
+    // Section header and one interface description per Interface,
+    // in native byte order
+    void write_header()
+    {
+        begin_block(SHB_TYPE);
+        put32(BYTE_ORDER_MAGIC);
+        put16(1);          // major version
+        put16(0);          // minor version
+        put32(0xffffffff); // section length unknown
+        put32(0xffffffff);
+        end_block();
+
+        static const char *names[N_INTERFACES] = {"tun", "link"};
+        for (unsigned int i = 0; i < N_INTERFACES; ++i)
+        {
+            begin_block(IDB_TYPE);
+            put16(i == TUN ? LINKTYPE_RAW : LINKTYPE_USER0);
+            put16(0);
+            put32(static_cast<std::uint32_t>(config.snaplen));
+            put16(OPT_IF_NAME);
+            put16(static_cast<std::uint16_t>(std::strlen(names[i])));
+            put_padded(names[i], std::strlen(names[i]));
+            put32(OPT_ENDOFOPT);
+            end_block();
+        }
+    }
+
+    void write_packet(const Slot &slot, const unsigned char *packet)
+    {
+        begin_block(EPB_TYPE);
+        put32(slot.iface);
+        put32(static_cast<std::uint32_t>(slot.timestamp >> 32));
+        put32(static_cast<std::uint32_t>(slot.timestamp));
+        put32(slot.caplen);
+        put32(slot.len);
+        put_padded(packet, slot.caplen);
+        put16(OPT_EPB_FLAGS);
+        put16(4);
+        put32(slot.out ? EPB_FLAGS_OUTBOUND : EPB_FLAGS_INBOUND);
+        put32(OPT_ENDOFOPT);
+
+        // rotate before the block would take the file over its limit,
+        // but always write at least one packet per file
+        if (config.max_file_size && file_size + block.size() + 4 > config.max_file_size && file_packets)
+        {
+            // the block is built already, so keep it aside while the
+            // new file gets its header
+            std::vector<unsigned char> packet_block;
+            packet_block.swap(block);
+            file.close();
+            log_rotate(config.path, config.max_versions);
+            open_file();
+            block.swap(packet_block);
+        }
+        end_block();
+        ++file_packets;
+    }
+
+    void open_file()
+    {
+        file.open(config.path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw pcap_ring_error("cannot open capture file for output: " + config.path);
+        file_size = 0;
+        file_packets = 0;
+        write_header();
+        files.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns the number of packets written
+    size_t drain()
+    {
+        const size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_relaxed);
+        const size_t n = h - t;
+        for (; t != h; ++t)
+        {
+            const size_t i = t & mask;
+            write_packet(slots[i], &data[i * config.snaplen]);
+            tail.store(t + 1, std::memory_order_release);
+        }
+        written.fetch_add(n, std::memory_order_relaxed);
+        return n;
+    }
+
+    void writer()
+    {
+        Log::Context logctx(logwrap);
+        try
+        {
+            while (true)
+            {
+                const bool halting = halt.load(std::memory_order_acquire);
+                if (!drain())
+                {
+                    if (halting)
+                        break;
+                    file.flush();
+                    std::this_thread::sleep_for(config.poll_interval);
+                }
+            }
+            file.close();
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG("packet capture stopped: " << e.what());
+
+            // keep the producer from filling the ring for nothing
+            halt.store(true, std::memory_order_release);
+        }
+
+        std::function<void()> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            done = std::move(on_finished);
+        }
+        cond.notify_all();
+        if (done)
+            done();
+    }
+
+    const Config config;
+    const size_t mask;
+    std::vector<Slot> slots;
+    std::vector<unsigned char> data; // snaplen bytes per slot
+
+    alignas(64) std::atomic<size_t> head{0}; // written by the producer
+    alignas(64) std::atomic<size_t> tail{0}; // written by the writer thread
+    alignas(64) std::atomic<bool> halt{false};
+
+    std::atomic<count_t> captured{0};
+    std::atomic<count_t> dropped{0};
+    std::atomic<count_t> written{0};
+    std::atomic<count_t> files{0};
+
+    // writer thread state
+    std::ofstream file;
+    size_t file_size = 0;
+    size_t file_packets = 0;
+    std::vector<unsigned char> block;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool finished = false;             // protected by mutex
+    std::function<void()> on_finished; // protected by mutex
+
+    Log::Context::Wrapper logwrap; // carries the log context into the writer thread
+};
+
+} // namespace openvpn
+
+#endif
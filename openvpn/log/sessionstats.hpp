@@ -21,6 +21,7 @@
 #include <openvpn/common/rc.hpp>
 #include <openvpn/error/error.hpp>
 #include <openvpn/time/time.hpp>
+#include <openvpn/time/cpuacct.hpp>
 
 namespace openvpn {
 
@@ -33,14 +34,17 @@ class SessionStats : public RC<thread_safe_refcount>
     enum Stats
     {
         // operating stats
-        BYTES_IN = 0,    // network bytes in
-        BYTES_OUT,       // network bytes out
-        PACKETS_IN,      // network packets in
-        PACKETS_OUT,     // network packets out
-        TUN_BYTES_IN,    // tun/tap bytes in
-        TUN_BYTES_OUT,   // tun/tap bytes out
-        TUN_PACKETS_IN,  // tun/tap packets in
-        TUN_PACKETS_OUT, // tun/tap packets out
+        BYTES_IN = 0,     // network bytes in
+        BYTES_OUT,        // network bytes out
+        PACKETS_IN,       // network packets in
+        PACKETS_OUT,      // network packets out
+        TUN_BYTES_IN,     // tun/tap bytes in
+        TUN_BYTES_OUT,    // tun/tap bytes out
+        TUN_PACKETS_IN,   // tun/tap packets in
+        TUN_PACKETS_OUT,  // tun/tap packets out
+        UDP_RECV_DROPS,   // datagrams dropped by the kernel for lack of receive buffer space
+        DNS_CACHE_HITS,   // DNS queries answered from the client DNS cache
+        DNS_CACHE_MISSES, // DNS queries to pushed servers sent through the tunnel
         N_STATS,
     };
 
@@ -99,6 +103,9 @@ class SessionStats : public RC<thread_safe_refcount>
             "TUN_BYTES_OUT",
             "TUN_PACKETS_IN",
             "TUN_PACKETS_OUT",
+            "UDP_RECV_DROPS",
+            "DNS_CACHE_HITS",
+            "DNS_CACHE_MISSES",
         };
 
         if (type < N_STATS)
@@ -241,6 +248,49 @@ class SessionStats : public RC<thread_safe_refcount>
         return cb_ptr;
     }
 
+    /**
+     * @brief Enable per-session CPU accounting of data-path stages
+     *
+     * @param sample_interval Measure one out of every sample_interval batches
+     */
+    void cpu_accounting_enable(const unsigned int sample_interval = 16)
+    {
+        cpu_acct_.reset(new CPUAccounting(sample_interval));
+    }
+
+    /**
+     * @brief Returns the CPU accounting object, or nullptr if accounting is disabled
+     */
+    CPUAccounting *cpu_accounting() const
+    {
+        return cpu_acct_.get();
+    }
+
+    /**
+     * @brief Estimated data-path CPU seconds per GB of transport traffic
+     *
+     * @return CPU seconds per 10^9 bytes in and out, or -1.0 if undefined
+     */
+    double cpu_per_gb() const
+    {
+        const count_t bytes = stats_[BYTES_IN] + stats_[BYTES_OUT];
+        if (!cpu_acct_ || !bytes)
+            return -1.0;
+        return double(cpu_acct_->data_ns()) / double(bytes);
+    }
+
+    /**
+     * @brief Estimated control channel CPU seconds per completed TLS handshake
+     *
+     * @return CPU seconds per handshake, or -1.0 if undefined
+     */
+    double cpu_per_handshake() const
+    {
+        if (!cpu_acct_ || !cpu_acct_->handshakes())
+            return -1.0;
+        return double(cpu_acct_->stage_ns(CPUAccounting::CONTROL)) / 1e9 / double(cpu_acct_->handshakes());
+    }
+
   protected:
     void session_stats_set_verbose(const bool v)
     {
@@ -251,6 +301,7 @@ class SessionStats : public RC<thread_safe_refcount>
     bool verbose_;
     Time last_packet_received_;
     DCOTransportSource::Ptr dco_;
+    CPUAccounting::Ptr cpu_acct_;
     volatile count_t stats_[N_STATS];
     std::array<std::weak_ptr<inc_callback_t>, N_STATS> inc_callbacks_;
 };
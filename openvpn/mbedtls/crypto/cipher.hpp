@@ -125,7 +125,8 @@ class CipherContext
     enum
     {
         MAX_IV_LENGTH = MBEDTLS_MAX_IV_LENGTH,
-        CIPH_CBC_MODE = MBEDTLS_MODE_CBC
+        CIPH_CBC_MODE = MBEDTLS_MODE_CBC,
+        SUPPORTS_IN_PLACE = 0 // out must not alias in
     };
 
     CipherContext() = default;
@@ -0,0 +1,106 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Bytecount reports of the management interface.  The counters are
+// sampled on the connection thread, once per bytecount interval, and
+// a report is handed to the OMI thread only when they moved by at
+// least the threshold, so an idle tunnel costs no work on the OMI
+// thread.  A report not yet sent is replaced by a newer one.
+
+#ifndef OPENVPN_OMI_BYTECOUNT_H
+#define OPENVPN_OMI_BYTECOUNT_H
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+#include <openvpn/common/to_string.hpp>
+
+namespace openvpn {
+
+class OMIBytecount
+{
+  public:
+    // Transport counters, filled in from ClientAPI::TransportStats by
+    // the caller, so that this header does not depend on the client API
+    struct Stats
+    {
+        long long bytes_in = 0;
+        long long bytes_out = 0;
+        long long packets_in = 0;
+        long long packets_out = 0;
+    };
+
+    // Connection thread: called every second, returns true once per
+    // interval, when the counters should be sampled
+    bool tick(const unsigned int interval)
+    {
+        if (!interval || ++ticks < interval)
+            return false;
+        ticks = 0;
+        return true;
+    }
+
+    // Connection thread: returns true if a report must be posted to
+    // the OMI thread, which must then call take()
+    bool sample(const Stats &ts, const std::uint64_t threshold)
+    {
+        if (threshold
+            && std::uint64_t(ts.bytes_in - last.bytes_in) + std::uint64_t(ts.bytes_out - last.bytes_out) < threshold)
+            return false;
+        last = ts;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = ts;
+        }
+        return !post_pending.exchange(true);
+    }
+
+    // OMI thread: the latest report
+    Stats take()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        post_pending = false;
+        return pending;
+    }
+
+    // Start over for a new connection thread, once the previous one
+    // has exited
+    void reset()
+    {
+        ticks = 0;
+        last = Stats();
+    }
+
+    static std::string render(const Stats &ts, const bool json)
+    {
+        if (json)
+            return ">BYTECOUNT_JSON:{\"in\":" + openvpn::to_string(ts.bytes_in)
+                   + ",\"out\":" + openvpn::to_string(ts.bytes_out)
+                   + ",\"pkts_in\":" + openvpn::to_string(ts.packets_in)
+                   + ",\"pkts_out\":" + openvpn::to_string(ts.packets_out) + "}\r\n";
+        else
+            return ">BYTECOUNT:" + openvpn::to_string(ts.bytes_in) + ',' + openvpn::to_string(ts.bytes_out) + "\r\n";
+    }
+
+  private:
+    unsigned int ticks = 0; // connection thread only
+    Stats last;             // connection thread only
+    std::mutex mutex;
+    Stats pending; // protected by mutex
+    std::atomic<bool> post_pending{false};
+};
+
+} // namespace openvpn
+
+#endif
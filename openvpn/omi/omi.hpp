@@ -18,6 +18,9 @@
 #include <memory>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/platform.hpp>
@@ -401,9 +404,20 @@ class OMICore : public Acceptor::ListenerBase
         return stop_called;
     }
 
+    // The bytecount settings are read by the connection thread
     unsigned int get_bytecount() const
     {
-        return bytecount;
+        return bytecount.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t get_bytecount_threshold() const
+    {
+        return bytecount_threshold.load(std::memory_order_relaxed);
+    }
+
+    bool is_bytecount_json() const
+    {
+        return bytecount_json.load(std::memory_order_relaxed);
     }
 
     virtual bool omi_command_is_multiline(const std::string &arg0, const Option &option) = 0;
@@ -612,9 +626,20 @@ class OMICore : public Acceptor::ListenerBase
         }
     }
 
+    // bytecount n [min-bytes] [text|json]
     void process_bytecount_cmd(const Option &o)
     {
-        bytecount = o.get_num<decltype(bytecount)>(1, 0, 0, 86400);
+        const unsigned int interval = o.get_num<unsigned int>(1, 0, 0, 86400);
+        const std::uint64_t threshold = o.get_num<std::uint64_t>(2, 0, 0, std::numeric_limits<std::uint64_t>::max());
+        const std::string format = o.get_default(3, 16, "text");
+        if (format != "text" && format != "json")
+        {
+            send("ERROR: bytecount format must be text or json\r\n");
+            return;
+        }
+        bytecount_threshold.store(threshold, std::memory_order_relaxed);
+        bytecount_json.store(format == "json", std::memory_order_relaxed);
+        bytecount.store(interval, std::memory_order_relaxed);
         send("SUCCESS: bytecount interval changed\r\n");
     }
 
@@ -1049,7 +1074,9 @@ class OMICore : public Acceptor::ListenerBase
     bool hold_flag = false;
 
     // bandwidth stats
-    unsigned int bytecount = 0;
+    std::atomic<unsigned int> bytecount{0};           // report interval in seconds, 0 to disable
+    std::atomic<std::uint64_t> bytecount_threshold{0}; // bytes in + out since the last report, 0 to report every interval
+    std::atomic<bool> bytecount_json{false};
 
     // histories
     History hist_log{"log", 100};
@@ -24,6 +24,9 @@
 // don't export core symbols
 #define OPENVPN_CORE_API_VISIBILITY_HIDDEN
 
+// OMI is referenced from the connection thread by bytecount_tick()
+#define OPENVPN_ACCEPTOR_LISTENER_BASE_RC RC<thread_safe_refcount>
+
 // should be included before other openvpn includes,
 // with the exception of openvpn/log includes
 #include <client/ovpncli.cpp>
@@ -39,6 +42,7 @@
 #include <openvpn/common/stop.hpp>
 #include <openvpn/time/asiotimersafe.hpp>
 #include <openvpn/omi/omi.hpp>
+#include <openvpn/omi/bytecount.hpp>
 
 using namespace openvpn;
 
@@ -71,6 +75,7 @@ class Client : public ClientAPI::OpenVPNClient
 
     void event(const ClientAPI::Event &ev) override;
     void log(const ClientAPI::LogInfo &msg) override;
+    void clock_tick() override;
     void external_pki_cert_request(ClientAPI::ExternalPKICertRequest &certreq) override;
     void external_pki_sign_request(ClientAPI::ExternalPKISignRequest &signreq) override;
     void acc_event(const openvpn::ClientAPI::AppCustomControlMessageEvent &event) override;
@@ -87,7 +92,6 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
         : OMICore(io_context),
           opt(std::move(opt_arg)),
           reconnect_timer(io_context),
-          bytecount_timer(io_context),
           exit_event(io_context),
           log_context(this)
     {
@@ -155,6 +159,24 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
                          { event_msg(ev, &ci); });
     }
 
+    // Called every second on the connection thread, see OMIBytecount.
+    // The post holds a reference, since it may still be queued when
+    // the connection thread has been joined.
+    void bytecount_tick(Client &cli)
+    {
+        if (!bytecount_report.tick(get_bytecount()))
+            return;
+        const ClientAPI::TransportStats ts = cli.transport_stats();
+        OMIBytecount::Stats stats;
+        stats.bytes_in = ts.bytesIn;
+        stats.bytes_out = ts.bytesOut;
+        stats.packets_in = ts.packetsIn;
+        stats.packets_out = ts.packetsOut;
+        if (bytecount_report.sample(stats, get_bytecount_threshold()))
+            openvpn_io::post(io_context, [self = Ptr(this)]()
+                             { self->report_bytecount(); });
+    }
+
     void external_pki_cert_request(ClientAPI::ExternalPKICertRequest &certreq)
     {
         // not currently supported, <cert> must be in config
@@ -348,6 +370,7 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
                 config->proxyHost = http_proxy_host;
                 config->proxyPort = http_proxy_port;
                 config->echo = true;
+                config->clockTickMS = 1000; // drives bytecount_tick()
 
                 if (management_external_key)
                     config->externalPkiAlias = "EPKI"; // dummy alias
@@ -539,28 +562,12 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
         omi_start_connection();
     }
 
-    void schedule_bytecount_timer()
-    {
-        if (get_bytecount())
-        {
-            bytecount_timer.expires_after(Time::Duration::seconds(get_bytecount()));
-            bytecount_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
-                                       {
-				     if (!error)
-				       self->report_bytecount(); });
-        }
-        else
-            bytecount_timer.cancel();
-    }
-
     void report_bytecount()
     {
-        if (client && get_bytecount())
-        {
-            const ClientAPI::TransportStats ts = client->transport_stats();
-            send(">BYTECOUNT:" + openvpn::to_string(ts.bytesIn) + ',' + openvpn::to_string(ts.bytesOut) + "\r\n");
-        }
-        schedule_bytecount_timer();
+        const OMIBytecount::Stats stats = bytecount_report.take();
+        if (is_stopping() || !get_bytecount())
+            return;
+        send(OMIBytecount::render(stats, is_bytecount_json()));
     }
 
     void start_connection_thread()
@@ -583,8 +590,8 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
                     OPENVPN_THROW_EXCEPTION("creds error: " << creds_status.message);
             }
 
-            // bytecount
-            schedule_bytecount_timer();
+            // bytecount, the previous connection thread has exited
+            bytecount_report.reset();
 
             // start connection thread
             thread.reset(new std::thread([this]()
@@ -658,7 +665,6 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
 
         // stop timers
         reconnect_timer.cancel();
-        bytecount_timer.cancel();
 
         // stop the client
         if (client)
@@ -984,7 +990,7 @@ class OMI : public OMICore, public ClientAPI::LogReceiver
     AsioTimerSafe reconnect_timer;
 
     // bytecount
-    AsioTimerSafe bytecount_timer;
+    OMIBytecount bytecount_report;
 
     // external PKI
     bool management_external_key = false;
@@ -1024,6 +1030,11 @@ void Client::log(const ClientAPI::LogInfo &msg)
     parent->log(msg);
 }
 
+void Client::clock_tick()
+{
+    parent->bytecount_tick(*this);
+}
+
 void Client::external_pki_cert_request(ClientAPI::ExternalPKICertRequest &certreq)
 {
     parent->external_pki_cert_request(certreq);
@@ -61,7 +61,8 @@ class CipherContext
     enum
     {
         MAX_IV_LENGTH = EVP_MAX_IV_LENGTH,
-        CIPH_CBC_MODE = EVP_CIPH_CBC_MODE
+        CIPH_CBC_MODE = EVP_CIPH_CBC_MODE,
+        SUPPORTS_IN_PLACE = 1 // update() may be called with out == in
     };
 
     CipherContext() = default;
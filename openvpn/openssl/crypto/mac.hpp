@@ -93,7 +93,9 @@ class HMACContext
     void reset()
     {
         check_initialized();
-        if (!EVP_MAC_init(ctx, nullptr, 0, params))
+        // reinitialize with the key and digest already set by init(),
+        // passing params again would re-fetch the digest and rehash the key
+        if (!EVP_MAC_init(ctx, nullptr, 0, nullptr))
         {
             openssl_clear_error_stack();
             throw openssl_mac_error("EVP_HMAC_Init (reset)");
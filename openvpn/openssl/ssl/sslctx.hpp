@@ -47,6 +47,7 @@
 #include <openvpn/common/unicode.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/error/excode.hpp>
 #include <openvpn/pki/cclist.hpp>
 #include <openvpn/pki/epkibase.hpp>
 #include <openvpn/ssl/kuparse.hpp>
@@ -210,14 +211,19 @@ class OpenSSLContext : public SSLFactoryAPI
             pkey.set_private_key_password(pwd);
         }
 
+        // CAs, CRLs and extra certs can be large bundles and are not
+        // needed until the first TLS session.  Small ones are parsed here
+        // as usual.  Larger ones only have their PEM framing checked, and
+        // their text is kept and parsed on first use by ca_list() and
+        // extra_cert_list().
         void load_ca(const std::string &ca_txt, bool strict) override
         {
-            ca.parse_pem(ca_txt, "ca");
+            load_ca_crl(ca_txt, "ca");
         }
 
         void load_crl(const std::string &crl_txt) override
         {
-            ca.parse_pem(crl_txt, "crl");
+            load_ca_crl(crl_txt, "crl");
         }
 
         void load_cert(const std::string &cert_txt) override
@@ -228,8 +234,15 @@ class OpenSSLContext : public SSLFactoryAPI
         void load_cert(const std::string &cert_txt, const std::string &extra_certs_txt) override
         {
             load_cert(cert_txt);
-            if (!extra_certs_txt.empty())
+            if (extra_certs_txt.empty())
+                return;
+            if (extra_certs_txt.length() <= deferred_parse_min && extra_certs_pending.empty())
                 CertCRLList::from_string(extra_certs_txt, "extra-certs", &extra_certs, nullptr);
+            else
+            {
+                CertCRLList::check_pem(extra_certs_txt, "extra-certs", false);
+                extra_certs_pending.push_back(extra_certs_txt);
+            }
         }
 
         void load_private_key(const std::string &key_txt) override
@@ -244,12 +257,12 @@ class OpenSSLContext : public SSLFactoryAPI
 
         std::string extract_ca() const override
         {
-            return ca.certs.render_pem();
+            return ca_list().certs.render_pem();
         }
 
         std::string extract_crl() const override
         {
-            return ca.crls.render_pem();
+            return ca_list().crls.render_pem();
         }
 
         std::string extract_cert() const override
@@ -261,7 +274,7 @@ class OpenSSLContext : public SSLFactoryAPI
         {
             std::vector<std::string> ret;
 
-            for (auto const &cert : extra_certs)
+            for (auto const &cert : extra_cert_list())
                 ret.push_back(cert.render_pem());
 
             return ret;
@@ -556,6 +569,7 @@ class OpenSSLContext : public SSLFactoryAPI
                     {
                         ret->cert = cert;
                         ret->extra_certs = extra_certs;
+                        ret->extra_certs_pending = extra_certs_pending;
                     }
                 }
 
@@ -574,6 +588,7 @@ class OpenSSLContext : public SSLFactoryAPI
                 // inherit from self
                 ret->cert = cert;
                 ret->extra_certs = extra_certs;
+                ret->extra_certs_pending = extra_certs_pending;
                 ret->pkey = pkey;
             }
 
@@ -666,12 +681,81 @@ class OpenSSLContext : public SSLFactoryAPI
         using SSLCtxType = std::remove_pointer<SSLLib::Ctx>::type;
         mutable std::unique_ptr<SSLCtxType, decltype(&::OSSL_LIB_CTX_free)> lib_ctx{nullptr, &::OSSL_LIB_CTX_free};
 
+        // Bundles up to this size are parsed when loaded
+        static constexpr size_t deferred_parse_min = 64 * 1024;
+
+        void load_ca_crl(const std::string &txt, const std::string &title)
+        {
+            if (txt.length() <= deferred_parse_min && ca_pending.empty())
+                ca.parse_pem(txt, title);
+            else
+            {
+                CertCRLList::check_pem(txt, title, true);
+                ca_pending.emplace_back(title, txt);
+            }
+        }
+
+        // Parse the pending CA/CRL text, if any, and return the result.
+        // A parse error is thrown as a fatal CERT_VERIFY_FAIL so that the
+        // client doesn't keep retrying, and is thrown again on the next
+        // call.
+        const CertCRLList &ca_list() const
+        {
+            if (!ca_pending.empty())
+            {
+                CertCRLList parsed = ca;
+                try
+                {
+                    for (const auto &p : ca_pending)
+                        parsed.parse_pem(p.second, p.first);
+                }
+                catch (const std::exception &e)
+                {
+                    throw ErrorCode(Error::CERT_VERIFY_FAIL, true, std::string("error parsing ca/crl-verify: ") + e.what());
+                }
+                ca = std::move(parsed);
+                ca_pending.clear();
+            }
+            return ca;
+        }
+
+        const OpenSSLPKI::X509List &extra_cert_list() const
+        {
+            if (!extra_certs_pending.empty())
+            {
+                OpenSSLPKI::X509List parsed = extra_certs;
+                try
+                {
+                    for (const auto &txt : extra_certs_pending)
+                        CertCRLList::from_string(txt, "extra-certs", &parsed, nullptr);
+                }
+                catch (const std::exception &e)
+                {
+                    throw ErrorCode(Error::CERT_VERIFY_FAIL, true, std::string("error parsing extra-certs: ") + e.what());
+                }
+                extra_certs = std::move(parsed);
+                extra_certs_pending.clear();
+            }
+            return extra_certs;
+        }
+
+        // true if a CA was loaded, without parsing it
+        bool ca_defined() const
+        {
+            for (const auto &p : ca_pending)
+                if (p.first == "ca" && !p.second.empty())
+                    return true;
+            return ca.certs.defined();
+        }
+
         Mode mode;
-        CertCRLList ca;                   // from OpenVPN "ca" and "crl-verify" option
-        OpenSSLPKI::X509 cert;            // from OpenVPN "cert" option
-        OpenSSLPKI::X509List extra_certs; // from OpenVPN "extra-certs" option
-        OpenSSLPKI::PKey pkey;            // private key
-        OpenSSLPKI::DH dh;                // diffie-hellman parameters (only needed in server mode)
+        mutable CertCRLList ca;                                              // from OpenVPN "ca" and "crl-verify" option
+        mutable std::vector<std::pair<std::string, std::string>> ca_pending; // unparsed "ca" and "crl-verify" text, by title
+        OpenSSLPKI::X509 cert;                                               // from OpenVPN "cert" option
+        mutable OpenSSLPKI::X509List extra_certs;                            // from OpenVPN "extra-certs" option
+        mutable std::vector<std::string> extra_certs_pending;                // unparsed "extra-certs" text
+        OpenSSLPKI::PKey pkey;                                               // private key
+        OpenSSLPKI::DH dh;                                                   // diffie-hellman parameters (only needed in server mode)
         ExternalPKIBase *external_pki = nullptr;
         std::string external_pki_alias;
         TLSSessionTicketBase *session_ticket_handler = nullptr; // server side only
@@ -1227,7 +1311,7 @@ class OpenSSLContext : public SSLFactoryAPI
             // send a client CA list to the client
             if (config->flags & SSLConst::SEND_CLIENT_CA_LIST)
             {
-                for (const auto &e : config->ca.certs)
+                for (const auto &e : config->ca_list().certs)
                 {
                     if (SSL_CTX_add_client_CA(ctx.get(), e.obj()) != 1)
                         throw OpenSSLException("OpenSSLContext: SSL_CTX_add_client_CA failed");
@@ -1423,24 +1507,21 @@ class OpenSSLContext : public SSLFactoryAPI
                     throw OpenSSLException("OpenSSLContext: private key does not match the certificate");
             }
 
-            // Set extra certificates that are part of our own certificate
-            // chain but shouldn't be included in the verify chain.
-            if (config->extra_certs.defined())
-            {
-                for (const auto &e : config->extra_certs)
-                {
-                    if (SSL_CTX_add_extra_chain_cert(ctx.get(), e.obj_dup()) != 1)
-                        throw OpenSSLException("OpenSSLContext: SSL_CTX_add_extra_chain_cert failed");
-                }
-            }
+            // Extra certificates that are part of our own certificate
+            // chain but shouldn't be included in the verify chain are
+            // added by load_deferred().
+            deferred_extra_certs = true;
         }
 
-        // Set CAs/CRLs
-        if (config->ca.certs.defined())
-            update_trust(config->ca);
-        else if (!(config->flags & (SSLConst::NO_VERIFY_PEER | SSLConst::VERIFY_PEER_FINGERPRINT)))
+        // CAs/CRLs are set by load_deferred()
+        if (!config->ca_defined() && !(config->flags & (SSLConst::NO_VERIFY_PEER | SSLConst::VERIFY_PEER_FINGERPRINT)))
             OPENVPN_THROW(ssl_context_error, "OpenSSLContext: CA not defined");
 
+        // a server should report a bad CA bundle when it starts rather
+        // than when the first client connects
+        if (config->mode.is_server())
+            load_deferred();
+
         // Show handshake debugging info
         if (log_.log_level() >= logging::LOG_LEVEL_INFO)
             SSL_CTX_set_info_callback(ctx.get(), info_callback);
@@ -1450,12 +1531,14 @@ class OpenSSLContext : public SSLFactoryAPI
     // create a new SSL instance
     SSLAPI::Ptr ssl() override
     {
+        load_deferred();
         return SSL::Ptr(new SSL(*this, nullptr, nullptr));
     }
 
     // like ssl() above but verify hostname against cert CommonName and/or SubjectAltName
     SSLAPI::Ptr ssl(const std::string *hostname, const std::string *cache_key) override
     {
+        load_deferred();
         return SSL::Ptr(new SSL(*this, hostname, cache_key));
     }
 
@@ -1470,10 +1553,28 @@ class OpenSSLContext : public SSLFactoryAPI
     }
 
 
+    // Complete the SSL_CTX with the parts of the config that are parsed
+    // on first use, before the first SSL object is created from it
+    void load_deferred()
+    {
+        if (deferred_extra_certs)
+        {
+            for (const auto &e : config->extra_cert_list())
+            {
+                if (SSL_CTX_add_extra_chain_cert(ctx.get(), e.obj_dup()) != 1)
+                    throw OpenSSLException("OpenSSLContext: SSL_CTX_add_extra_chain_cert failed");
+            }
+            deferred_extra_certs = false;
+        }
+        if (!trust_set && config->ca_defined())
+            update_trust(config->ca_list());
+    }
+
     void update_trust(const CertCRLList &cc)
     {
         OpenSSLPKI::X509Store store(cc);
         SSL_CTX_set_cert_store(ctx.get(), store.release());
+        trust_set = true;
     }
 
     ~OpenSSLContext() = default;
@@ -2336,6 +2437,8 @@ class OpenSSLContext : public SSLFactoryAPI
 
     SSL_CTX_unique_ptr ctx{nullptr, &SSL_CTX_free};
     OpenSSLSessionCache::Ptr sess_cache; // client-side only
+    bool deferred_extra_certs = false;   // extra certs not yet added to ctx
+    bool trust_set = false;              // ctx has a cert store
 };
 
 inline const std::string get_ssl_library_version()
@@ -130,6 +130,59 @@ class CertCRLListTemplate
             OPENVPN_THROW(parse_cert_crl_error, title << " : CERT/CRL content ended unexpectedly without END marker");
     }
 
+    // Check the PEM framing of a list of certs and CRLs without parsing
+    // the items: every BEGIN marker must have its END marker and the text
+    // between them must be base64.  Throws the same parse_cert_crl_error
+    // as from_istream() for the errors it can detect.
+    static void check_pem(const std::string &content, const std::string &title, const bool crl_ok)
+    {
+        static const char cert_start[] = "-----BEGIN CERTIFICATE-----";
+        static const char cert_end[] = "-----END CERTIFICATE-----";
+        static const char crl_start[] = "-----BEGIN X509 CRL-----";
+        static const char crl_end[] = "-----END X509 CRL-----";
+
+        std::stringstream in(content);
+        std::string line;
+        const char *end = nullptr;
+        size_t b64_len = 0;
+        int line_num = 0;
+
+        while (std::getline(in, line))
+        {
+            line_num++;
+            string::trim(line);
+            if (!end)
+            {
+                if (line == cert_start)
+                    end = cert_end;
+                else if (line == crl_start)
+                {
+                    if (!crl_ok)
+                        OPENVPN_THROW(parse_cert_crl_error, title << ":" << line_num << " : not expecting a CRL");
+                    end = crl_end;
+                }
+                b64_len = 0;
+            }
+            else if (line == end)
+            {
+                if (!b64_len || b64_len % 4)
+                    OPENVPN_THROW(parse_cert_crl_error, title << ":" << line_num << " : error parsing " << (end == cert_end ? "CERT" : "CRL") << ": bad base64 length");
+                end = nullptr;
+            }
+            else
+            {
+                for (const char c : line)
+                {
+                    if (!(string::is_alphanumeric(c) || c == '+' || c == '/' || c == '='))
+                        OPENVPN_THROW(parse_cert_crl_error, title << ":" << line_num << " : error parsing " << (end == cert_end ? "CERT" : "CRL") << ": bad base64 character");
+                }
+                b64_len += line.length();
+            }
+        }
+        if (end)
+            OPENVPN_THROW(parse_cert_crl_error, title << " : CERT/CRL content ended unexpectedly without END marker");
+    }
+
     static void from_string(const std::string &content, const std::string &title, CertList *cert_list, CRLList *crl_list = nullptr)
     {
         std::stringstream in(content);
@@ -0,0 +1,72 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#pragma once
+
+#include <cstring>
+
+#include <openvpn/common/size.hpp>
+#include <openvpn/random/randapi.hpp>
+
+namespace openvpn {
+
+/**
+ * @class StrongRandomBuffer
+ * @brief Per-thread buffer of strong random bytes for small, frequent requests
+ *
+ * Requests such as per-packet CBC IVs are served from a buffer that is
+ * refilled from a StrongRandomAPI in bulk, amortizing the per-call
+ * overhead (locking, DRBG state handling) of the underlying generator.
+ *
+ * Each thread has its own buffer, which is refilled from whichever
+ * generator the caller passes in.  Buffered bytes should only be used
+ * for values that are made public, like IVs.  The buffer is not
+ * fork-safe: a child process must not continue drawing from it.
+ */
+class StrongRandomBuffer
+{
+  public:
+    static constexpr size_t SIZE = 1024;
+
+    /**
+     * @brief  Fill buf with size random bytes from the calling thread's buffer
+     * @param  rng   Generator used to refill the buffer
+     * @param  buf   Pointer to the output buffer
+     * @param  size  Number of bytes to generate
+     */
+    static void rand_bytes(StrongRandomAPI &rng, unsigned char *buf, const size_t size)
+    {
+        thread_local StrongRandomBuffer rb;
+        rb.get(rng, buf, size);
+    }
+
+  private:
+    void get(StrongRandomAPI &rng, unsigned char *buf, const size_t size)
+    {
+        if (size > SIZE / 4)
+        {
+            rng.rand_bytes(buf, size);
+            return;
+        }
+        if (SIZE - pos < size)
+        {
+            rng.rand_bytes(pool, SIZE);
+            pos = 0;
+        }
+        std::memcpy(buf, pool + pos, size);
+        pos += size;
+    }
+
+    unsigned char pool[SIZE];
+    size_t pos = SIZE;
+};
+
+} // namespace openvpn
@@ -97,16 +97,23 @@ class ReliableSendTemplate
         return window_.ref_by_id(id);
     }
 
+    // Return a pointer to the Message object at id, or nullptr
+    // if there is none
+    Message *find(const id_t id)
+    {
+        return window_.find(id);
+    }
+
     // Return the shortest duration for any pending retransmissions
     Time::Duration until_retransmit(const Time &now)
     {
         Time::Duration ret = Time::Duration::infinite();
         for (id_t i = head_id(); i < tail_id(); ++i)
         {
-            const Message &msg = ref_by_id(i);
-            if (msg.defined())
+            const Message *msg = find(i);
+            if (msg && msg->defined())
             {
-                Time::Duration ut = msg.until_retransmit(now);
+                Time::Duration ut = msg->until_retransmit(now);
                 if (ut < ret)
                     ret = ut;
             }
@@ -120,7 +127,8 @@ class ReliableSendTemplate
         unsigned int ret = 0;
         for (id_t i = head_id(); i < tail_id(); ++i)
         {
-            if (ref_by_id(i).defined())
+            const Message *msg = find(i);
+            if (msg && msg->defined())
                 ++ret;
         }
         return ret;
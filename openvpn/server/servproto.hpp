@@ -199,6 +199,9 @@ class ServerProto
             {
                 OPENVPN_LOG_SERVPROTO(instance_name() << " : Transport RECV[" << buf.size() << "] " << client_endpoint_render() << ' ' << proto_context.dump_packet(buf));
 
+                // account CPU time not claimed by crypto/compression/control to i/o
+                CPUAccounting::Scope cpu(proto_context.stat().cpu_accounting(), CPUAccounting::IO);
+
                 // update current time
                 proto_context.update_now();
 
@@ -212,9 +215,6 @@ class ServerProto
                     ret = proto_context.data_decrypt(pt, buf);
                     if (buf.size())
                     {
-#ifdef OPENVPN_PACKET_LOG
-                        log_packet(buf, false);
-#endif
                         // make packet appear as incoming on tun interface
                         if (true) // fixme: was tun
                         {
@@ -223,11 +223,17 @@ class ServerProto
                         }
                     }
 
-                    // do a lightweight flush
-                    proto_context.flush(false);
+                    // do a lightweight flush, rescheduling housekeeping
+                    // only if it found control work to do
+                    if (!proto_context.flush(false)
+                        && !proto_context.invalidated()
+                        && housekeeping_schedule.defined())
+                        return ret;
                 }
                 else if (pt.is_control())
                 {
+                    CPUAccounting::Scope cpu_control(proto_context.stat().cpu_accounting(), CPUAccounting::CONTROL);
+
                     // control packet
                     ret = proto_context.control_net_recv(pt, std::move(buf));
 
@@ -644,6 +650,8 @@ class ServerProto
             {
                 if (!e && !halt)
                 {
+                    CPUAccounting::Scope cpu(proto_context.stat().cpu_accounting(), CPUAccounting::CONTROL);
+
                     // update current time
                     proto_context.update_now();
 
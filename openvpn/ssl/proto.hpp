@@ -42,6 +42,7 @@
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/buffer/safestr.hpp>
 #include <openvpn/buffer/bufcomposed.hpp>
+#include <openvpn/buffer/scratchbuf.hpp>
 #include <openvpn/ip/ip4.hpp>
 #include <openvpn/ip/ip6.hpp>
 #include <openvpn/ip/udp.hpp>
@@ -127,9 +128,12 @@ namespace openvpn {
 	KEEPALIVE_FIRST_BYTE = 0x2a  // first byte of keepalive message
       };
 
+      // Keepalives are always exactly sizeof(keepalive_message) bytes,
+      // so the length test alone rejects practically every data packet
+      // (no IP packet is that short) before the contents are looked at.
       inline bool is_keepalive(const Buffer& buf)
       {
-	return buf.size() >= sizeof(keepalive_message)
+	return buf.size() == sizeof(keepalive_message)
 	  && buf[0] == KEEPALIVE_FIRST_BYTE
 	  && !std::memcmp(keepalive_message, buf.c_data(), sizeof(keepalive_message));
       }
@@ -2057,8 +2061,12 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	    && (crypto_flags & CryptoDCInstance::CRYPTO_DEFINED)
 	    && !invalidated())
 	  {
+	    const size_t reallocs = buffer_realloc_count;
+
 	    // compress and encrypt packet and prepend op header
 	    const bool pid_wrap = do_encrypt(buf, true);
+	    if (buffer_realloc_count != reallocs)
+	      proto.stats->error(Error::BUFFER_REALLOC);
 
 	    // Trigger a new SSL/TLS negotiation if packet ID (a 32-bit unsigned int)
 	    // is getting close to wrapping around.  If it wraps back to 0 without
@@ -2080,6 +2088,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	      && (crypto_flags & CryptoDCInstance::CRYPTO_DEFINED)
 	      && !invalidated())
 	    {
+	      const size_t reallocs = buffer_realloc_count;
+
 	      // Knock off leading op from buffer, but pass the 32-bit version to
 	      // decrypt so it can be used as Additional Data for packet authentication.
 	      const size_t head_size = op_head_size(buf[0]);
@@ -2087,7 +2097,11 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	      buf.advance(head_size);
 
 	      // decrypt packet
-	      const Error::Type err = crypto->decrypt(buf, now->seconds_since_epoch(), op32);
+	      Error::Type err;
+	      {
+		CPUAccounting::Scope cpu(proto.stats->cpu_accounting(), CPUAccounting::CRYPTO);
+		err = crypto->decrypt(buf, now->seconds_since_epoch(), op32);
+	      }
 	      if (err)
 		{
 		  proto.stats->error(err);
@@ -2102,11 +2116,17 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
 	      // decompress packet
 	      if (compress)
-		compress->decompress(buf);
+		{
+		  CPUAccounting::Scope cpu(proto.stats->cpu_accounting(), CPUAccounting::COMPRESS);
+		  compress->decompress(buf);
+		}
 
                     // set MSS for segments server can receive
                     if (proto.config->mss_fix > 0)
                         MSSFix::mssfix(buf, numeric_cast<uint16_t>(proto.config->mss_fix));
+
+                    if (buffer_realloc_count != reallocs)
+                        proto.stats->error(Error::BUFFER_REALLOC);
                 }
                 else
                     buf.reset_size(); // no crypto context available
@@ -2470,6 +2490,20 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	cache_op32();
 
 	calculate_mssfix(c);
+	validate_frame(c);
+      }
+
+      // The frame was laid out before the data channel was negotiated,
+      // and the transport and tun have their own copies of its contexts
+      // by now, so it can't be changed here.  frame_init() sizes it for
+      // any pipeline; warn if a custom frame is too small for this one,
+      // since its packets will be reallocated (BUFFER_REALLOC).
+      static void validate_frame(ProtoConfig &c)
+      {
+	const size_t headroom = c.link_mtu_adjust();             // transport prefix, op, compression, packet ID, crypto
+	const size_t tailroom = c.dc.context().encap_overhead(); // e.g. CBC padding
+	if (!c.frame->data_path_fits(headroom, tailroom))
+	  OVPN_LOG_INFO("Frame too small for data channel: headroom=" << headroom << " tailroom=" << tailroom);
       }
 
       void data_limit_notify(const DataLimit::Mode cdl_mode,
@@ -2552,9 +2586,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
             if (orig_size < data_offset)
                 return false;
 
-	// we need a buffer to perform the payload decryption and being this a static
-	// function we can't use the instance member like in decapsulate_tls_crypt()
-	BufferAllocated work;
+	// we need a buffer to perform the payload decryption
+	BufferAllocated &work = ScratchBuffer::get();
 	proto.config->frame->prepare(Frame::DECRYPT_WORK, work);
 
 	// decrypt payload from 'recv' into 'work'
@@ -2633,7 +2666,10 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
 	// compress packet
 	if (compress)
-	  compress->compress(buf, compress_hint);
+	  {
+	    CPUAccounting::Scope cpu(proto.stats->cpu_accounting(), CPUAccounting::COMPRESS);
+	    compress->compress(buf, compress_hint);
+	  }
 
             // trigger renegotiation if we hit encrypt data limit
             if (data_limit)
@@ -2642,6 +2678,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
             bool pid_wrap;
 
+	CPUAccounting::Scope cpu(proto.stats->cpu_accounting(), CPUAccounting::CRYPTO);
 	if (enable_op32)
 	  {
 	    const std::uint32_t op32 = htonl(op32_compose(DATA_V2, key_id_, remote_peer_id));
@@ -3072,6 +3109,8 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	  }
 	reached_active_time_ = *now;
 	proto.slowest_handshake_.max(reached_active_time_ - construct_time);
+	if (CPUAccounting *acct = proto.stats->cpu_accounting())
+	  acct->inc_handshake();
 	active_event();
       }
 
@@ -3150,6 +3189,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
       void gen_head_tls_crypt(const unsigned int opcode, BufferAllocated& buf)
       {
 	// in 'work' we store all the fields that are not supposed to be encrypted
+	BufferAllocated &work = ScratchBuffer::get();
 	proto.config->frame->prepare(Frame::ENCRYPT_WORK, work);
 	// make space for HMAC
 	work.prepend_alloc(proto.hmac_size);
@@ -3367,6 +3407,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	  return false;
 
 	// decrypt payload
+	BufferAllocated &work = ScratchBuffer::get();
 	proto.config->frame->prepare(Frame::DECRYPT_WORK, work);
 
 	const size_t decrypt_bytes = proto.tls_crypt_recv->decrypt(orig_data + TLSCryptContext::hmac_offset,
@@ -3703,7 +3744,6 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
       std::unique_ptr<DataChannelKey> data_channel_key;
       BufferComposed app_recv_buf;
       std::unique_ptr<DataLimit> data_limit;
-      BufferAllocated work;
 
       // static member used by validate_tls_crypt()
       static BufferAllocated static_work;
@@ -3908,6 +3948,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	    if (net_buf.size() < data_offset)
 	      return false;
 
+	    BufferAllocated &work = ScratchBuffer::get();
 	    frame->prepare(Frame::DECRYPT_WORK, work);
 
 	    // decrypt payload from 'net_buf' into 'work'
@@ -3939,7 +3980,6 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     private:
       TLSCryptInstance::Ptr tls_crypt_recv;
       Frame::Ptr frame;
-      BufferAllocated work;
     };
 
     class TLSCryptV2PreValidate : public TLSCryptPreValidate
@@ -4175,6 +4215,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
       // initialize keepalive timers
       keepalive_expire = Time::infinite();   // initially disabled
+      last_data_received.reset();
       update_last_sent();                    // set timer for initial keepalive send
     }
 
@@ -4257,7 +4298,9 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     // If control_channel is true, do a full flush.
     // If control_channel is false, optimize flush for data
     // channel only.
-    void flush(const bool control_channel)
+    // Returns false if there was nothing to do, in which case
+    // next_housekeeping() cannot have moved earlier.
+    bool flush(const bool control_channel)
     {
       if (control_channel || process_events())
 	{
@@ -4268,7 +4311,9 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 	    if (secondary)
 	      secondary->flush();
 	  } while (process_events());
+	  return true;
 	}
+      return false;
     }
 
     // Perform various time-based housekeeping tasks such as retransmiting
@@ -4370,17 +4415,15 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
 
       select_key_context(type, false).decrypt(in_out);
 
-      // update time of most recent packet received
       if (in_out.size())
 	{
-	  update_last_received();
+	  // update time of most recent packet received
+	  update_last_data_received();
 	  ret = true;
-	}
 
-      // discard keepalive packets
-      if (proto_context_private::is_keepalive(in_out))
-	{
-	  in_out.reset_size();
+	  // discard keepalive packets
+	  if (proto_context_private::is_keepalive(in_out))
+	    in_out.reset_size();
 	}
 
       return ret;
@@ -4644,6 +4687,22 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     void update_last_received()
     {
       keepalive_expire = *now_ + (data_channel_ready() ? config->keepalive_timeout : config->keepalive_timeout_early);
+      last_data_received.reset();
+    }
+
+    // Data channel variant of update_last_received().  Packets read
+    // from the transport in one batch are processed at the same time
+    // value, so only the first of them needs to move keepalive_expire.
+    // Any other update (control packet, keepalive parameter change)
+    // clears last_data_received, so the next data packet recomputes
+    // the expiration with the timeout currently in effect.
+    void update_last_data_received()
+    {
+      if (*now_ != last_data_received)
+	{
+	  update_last_received();
+	  last_data_received = *now_;
+	}
     }
 
     void net_send(const unsigned int key_id, const Packet& net_pkt)
@@ -4931,6 +4990,7 @@ class ProtoContext : public logging::LoggingMixin<OPENVPN_DEBUG_PROTO,
     TimePtr now_;                      // pointer to current time (a clone of config->now)
     Time keepalive_xmit;               // time in future when we will transmit a keepalive (subject to continuous change)
     Time keepalive_expire;             // time in future when we must have received a packet from peer or we will timeout session
+    Time last_data_received;           // time keepalive_expire was last moved by a data packet
 
     Time::Duration slowest_handshake_; // longest time to reach a successful handshake
 
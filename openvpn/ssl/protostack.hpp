@@ -184,16 +184,16 @@ class ProtoStackBase
         {
             for (id_t i = rel_send.head_id(); i < rel_send.tail_id(); ++i)
             {
-                typename ReliableSend::Message &m = rel_send.ref_by_id(i);
-                if (m.ready_retransmit(*now))
+                typename ReliableSend::Message *m = rel_send.find(i);
+                if (m && m->ready_retransmit(*now))
                 {
                     // preserve original packet non-encapsulated
-                    PACKET pkt = m.packet.clone();
+                    PACKET pkt = m->packet.clone();
 
                     // encapsulate packet
                     try
                     {
-                        parent().encapsulate(m.id(), pkt);
+                        parent().encapsulate(m->id(), pkt);
                     }
                     catch (...)
                     {
@@ -201,7 +201,7 @@ class ProtoStackBase
                         throw;
                     }
                     parent().net_send(pkt, NET_SEND_RETRANSMIT);
-                    m.reset_retransmit(*now, tls_timeout);
+                    m->reset_retransmit(*now, tls_timeout);
                 }
             }
             update_retransmit();
@@ -46,6 +46,11 @@ class CoarseTime
         time_.reset();
     }
 
+    bool defined() const
+    {
+        return time_.defined();
+    }
+
     bool similar(const Time &t) const
     {
         if (time_.defined())
@@ -0,0 +1,219 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Per-session CPU accounting, attributing thread CPU time to
+// data-path stages (crypto, compression, I/O and control handling).
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <openvpn/common/rc.hpp>
+
+namespace openvpn {
+
+/**
+ * Return the CPU time (user + system) consumed by the calling thread
+ * in nanoseconds, or 0 if the platform cannot provide it.
+ *
+ * Unlike cpu_time() in cputime.hpp, this has sub-microsecond
+ * resolution so it can be used to measure short batches of work.
+ */
+inline std::uint64_t thread_cpu_time_ns()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    const std::uint64_t k = (std::uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    const std::uint64_t u = (std::uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return (k + u) * 100; // FILETIME is in 100ns units
+#else
+    struct timespec ts;
+    if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return std::uint64_t(ts.tv_sec) * 1000000000ull + std::uint64_t(ts.tv_nsec);
+#endif
+}
+
+/**
+ * Accumulates thread CPU time per data-path stage.
+ *
+ * Work is bracketed with CPUAccounting::Scope objects.  Scopes may be
+ * nested, in which case time is attributed exclusively: while an inner
+ * scope is open, the enclosing stage is not charged.
+ *
+ * Reading the thread CPU clock is a system call on most platforms, so
+ * only one out of every sample_interval outermost scopes (a "batch",
+ * typically the handling of one packet or one timer event) is actually
+ * measured.  The totals returned by stage_ns() are extrapolated from
+ * the sampled batches.
+ *
+ * All mutation happens on the thread that drives the session, while
+ * the getters may be called from any thread.
+ */
+class CPUAccounting : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<CPUAccounting> Ptr;
+
+    enum Stage
+    {
+        CRYPTO = 0, // data channel encrypt/decrypt
+        COMPRESS,   // data channel compress/decompress
+        IO,         // packet handling around tun and transport i/o
+        CONTROL,    // control channel, TLS handshake and housekeeping
+        N_STAGES,
+    };
+
+    class Scope
+    {
+      public:
+        Scope(CPUAccounting *acct, const Stage stage)
+            : acct_(acct)
+        {
+            if (acct_)
+                prev_ = acct_->enter(stage);
+        }
+
+        ~Scope()
+        {
+            if (acct_)
+                acct_->leave(prev_);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        CPUAccounting *acct_;
+        int prev_ = N_STAGES;
+    };
+
+    explicit CPUAccounting(const unsigned int sample_interval = 16)
+        : sample_interval_(sample_interval ? sample_interval : 1)
+    {
+        for (auto &ns : stage_ns_)
+            ns.store(0, std::memory_order_relaxed);
+    }
+
+    static const char *stage_name(const int stage)
+    {
+        static const char *names[] = {
+            "CRYPTO",
+            "COMPRESS",
+            "IO",
+            "CONTROL",
+        };
+
+        if (stage >= 0 && stage < N_STAGES)
+            return names[stage];
+        else
+            return "UNKNOWN_CPU_STAGE";
+    }
+
+    // Estimated CPU time spent in the given stage, in nanoseconds
+    std::uint64_t stage_ns(const int stage) const
+    {
+        if (stage >= 0 && stage < N_STAGES)
+            return stage_ns_[stage].load(std::memory_order_relaxed) * sample_interval_;
+        else
+            return 0;
+    }
+
+    // Estimated CPU time spent in crypto, compression and i/o
+    std::uint64_t data_ns() const
+    {
+        return stage_ns(CRYPTO) + stage_ns(COMPRESS) + stage_ns(IO);
+    }
+
+    std::uint64_t total_ns() const
+    {
+        return data_ns() + stage_ns(CONTROL);
+    }
+
+    void inc_handshake()
+    {
+        handshakes_.store(handshakes_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t handshakes() const
+    {
+        return handshakes_.load(std::memory_order_relaxed);
+    }
+
+    unsigned int sample_interval() const
+    {
+        return sample_interval_;
+    }
+
+  private:
+    int enter(const Stage stage)
+    {
+        // the outermost scope of a batch decides whether it is sampled
+        if (depth_++ == 0)
+        {
+            sampling_ = (++batch_count_ >= sample_interval_);
+            if (sampling_)
+                batch_count_ = 0;
+        }
+        if (!sampling_)
+            return N_STAGES;
+
+        const std::uint64_t now = thread_cpu_time_ns();
+        const int prev = current_;
+        if (prev < N_STAGES)
+            charge(prev, now);
+        current_ = stage;
+        mark_ = now;
+        return prev;
+    }
+
+    void leave(const int prev)
+    {
+        if (sampling_)
+        {
+            const std::uint64_t now = thread_cpu_time_ns();
+            charge(current_, now);
+            current_ = prev;
+            mark_ = now;
+        }
+        --depth_;
+    }
+
+    void charge(const int stage, const std::uint64_t now)
+    {
+        if (now > mark_)
+        {
+            auto &ns = stage_ns_[stage];
+            ns.store(ns.load(std::memory_order_relaxed) + (now - mark_), std::memory_order_relaxed);
+        }
+    }
+
+    const unsigned int sample_interval_;
+    unsigned int batch_count_ = 0;
+    unsigned int depth_ = 0;
+    bool sampling_ = false;
+    int current_ = N_STAGES;
+    std::uint64_t mark_ = 0;
+
+    std::atomic<std::uint64_t> stage_ns_[N_STAGES];
+    std::atomic<std::uint64_t> handshakes_{0};
+};
+
+} // namespace openvpn
@@ -0,0 +1,379 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Hierarchical timer wheel for large numbers of coarse timeouts,
+// such as the idle/general timeouts of thousands of HTTP connections.
+//
+// All timers of an io_context share one wheel, which in turn uses a
+// single asio timer.  Arming and cancelling a timer are O(1) list
+// operations.  Pushing out the expiry of an armed timer (the common
+// case of a timeout re-armed on every bit of activity) only records
+// the new deadline: the timer is moved lazily, when the wheel reaches
+// the slot it was placed in and finds it is not due yet.
+//
+// Expiry resolution is one tick (256/1024 sec by default).  Timers
+// never fire early, and fire at most one tick late.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/time/time.hpp>
+#include <openvpn/time/asiotimersafe.hpp>
+
+namespace openvpn {
+
+class TimerWheel : public RC<thread_unsafe_refcount>
+{
+    struct Link
+    {
+        Link *prev = nullptr;
+        Link *next = nullptr;
+    };
+
+  public:
+    typedef RCPtr<TimerWheel> Ptr;
+    typedef std::uint64_t tick_t;
+
+    enum
+    {
+        SLOT_BITS = 6,
+        N_SLOTS = (1 << SLOT_BITS),
+        N_LEVELS = 4,
+        DEFAULT_TICK_SHIFT = 8, // tick is 2^8 / Time::prec sec
+    };
+
+    class Timer : private Link
+    {
+      public:
+        typedef std::function<void()> Callback;
+
+        Timer(TimerWheel::Ptr wheel_arg, Callback callback_arg)
+            : wheel(std::move(wheel_arg)),
+              callback(std::move(callback_arg))
+        {
+        }
+
+        ~Timer()
+        {
+            cancel();
+        }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        // Arm the timer, or change the expiry of an armed timer.
+        void expires_at(const Time &t)
+        {
+            if (t.is_infinite())
+                cancel();
+            else
+                wheel->arm(*this, wheel->tick_ceil(t));
+        }
+
+        void expires_after(const Time::Duration &d)
+        {
+            expires_at(Time::now() + d);
+        }
+
+        void cancel()
+        {
+            if (armed())
+                wheel->disarm(*this);
+        }
+
+        bool armed() const
+        {
+            return next != nullptr;
+        }
+
+      private:
+        friend class TimerWheel;
+
+        TimerWheel::Ptr wheel;
+        Callback callback;
+        tick_t deadline = 0; // tick at which the timer is due
+        tick_t placed = 0;   // tick the timer was filed under, placed <= deadline
+    };
+
+    // Return the wheel shared by all users of io_context.
+    static Ptr get(openvpn_io::io_context &io_context)
+    {
+        return openvpn_io::use_service<Service>(io_context).wheel;
+    }
+
+    // If io_context is null, the wheel does not schedule itself and
+    // must be driven by calling advance().
+    explicit TimerWheel(openvpn_io::io_context *io_context,
+                        const unsigned int tick_shift_arg = DEFAULT_TICK_SHIFT)
+        : tick_shift(tick_shift_arg)
+    {
+        if (io_context)
+            timer.reset(new AsioTimerSafe(*io_context));
+        for (auto &s : slots)
+            s.prev = s.next = &s;
+    }
+
+    // Number of armed timers
+    size_t size() const
+    {
+        return n_armed;
+    }
+
+    Time::Duration tick_duration() const
+    {
+        return Time::Duration::binary_ms(Time::type(1) << tick_shift);
+    }
+
+    // Fire all timers due at or before now.
+    void advance(const Time &now)
+    {
+        const tick_t target = tick_floor(now);
+        while (current < target)
+        {
+            if (!n_armed)
+            {
+                current = target;
+                break;
+            }
+            ++current;
+            cascade();
+            expire();
+        }
+    }
+
+  private:
+    // Registers one wheel per io_context
+    class Service : public openvpn_io::execution_context::service
+    {
+      public:
+        static inline openvpn_io::execution_context::id id;
+
+        explicit Service(openvpn_io::io_context &io_context)
+            : openvpn_io::execution_context::service(io_context),
+              wheel(new TimerWheel(&io_context))
+        {
+        }
+
+        TimerWheel::Ptr wheel;
+
+      private:
+        void shutdown() override
+        {
+            wheel->shutdown();
+        }
+    };
+
+    tick_t tick_floor(const Time &t) const
+    {
+        return tick_t(t.raw()) >> tick_shift;
+    }
+
+    tick_t tick_ceil(const Time &t) const
+    {
+        return (tick_t(t.raw()) + (tick_t(1) << tick_shift) - 1) >> tick_shift;
+    }
+
+    Time tick_time(const tick_t tick) const
+    {
+        return Time::zero() + Time::Duration::binary_ms(Time::type(tick << tick_shift));
+    }
+
+    void arm(Timer &t, const tick_t deadline)
+    {
+        if (t.armed())
+        {
+            // lazy re-arm: the wheel will look at the timer again
+            // no later than its current placement
+            if (deadline >= t.placed)
+            {
+                t.deadline = deadline;
+                return;
+            }
+            unlink(t);
+        }
+        else
+        {
+            // while idle the current tick is not maintained
+            if (!n_armed)
+                current = tick_floor(Time::now());
+            ++n_armed;
+        }
+        t.deadline = deadline;
+        insert(t);
+        schedule(t.placed);
+    }
+
+    void disarm(Timer &t)
+    {
+        unlink(t);
+        if (!--n_armed && scheduled && timer)
+        {
+            // don't keep a run-to-completion io_context alive
+            timer->cancel();
+            scheduled = 0;
+        }
+    }
+
+    void insert(Timer &t)
+    {
+        tick_t e = t.deadline;
+        if (e <= current)
+            e = current + 1;
+        const tick_t delta = e - current;
+
+        unsigned int level = 0;
+        while (level < N_LEVELS - 1 && delta >= (tick_t(1) << (SLOT_BITS * (level + 1))))
+            ++level;
+        if (level == N_LEVELS - 1)
+        {
+            const tick_t max_delta = (tick_t(1) << (SLOT_BITS * N_LEVELS)) - 1;
+            if (delta > max_delta)
+                e = current + max_delta;
+        }
+        t.placed = e;
+        push_back(slot(level, (e >> (SLOT_BITS * level)) & (N_SLOTS - 1)), t);
+    }
+
+    // Move the timers of the next higher-level slot(s) down the
+    // hierarchy whenever a lower level wraps around.
+    void cascade()
+    {
+        for (unsigned int level = 1; level < N_LEVELS; ++level)
+        {
+            if (current & ((tick_t(1) << (SLOT_BITS * level)) - 1))
+                break;
+            Link list;
+            splice(slot(level, (current >> (SLOT_BITS * level)) & (N_SLOTS - 1)), list);
+            while (list.next != &list)
+            {
+                Timer &t = *static_cast<Timer *>(list.next);
+                unlink(t);
+                insert(t);
+            }
+        }
+    }
+
+    void expire()
+    {
+        Link list;
+        splice(slot(0, current & (N_SLOTS - 1)), list);
+        while (list.next != &list)
+        {
+            Timer &t = *static_cast<Timer *>(list.next);
+            unlink(t);
+            if (t.deadline > current)
+                insert(t);
+            else
+            {
+                --n_armed;
+                // may destroy t or arm/cancel other timers
+                t.callback();
+            }
+        }
+    }
+
+    // Schedule the asio timer for the given tick, unless
+    // it is already scheduled to run before then.
+    void schedule(const tick_t tick)
+    {
+        if (!timer || halt)
+            return;
+        if (scheduled && scheduled <= tick)
+            return;
+        scheduled = tick;
+        timer->expires_at(tick_time(tick));
+        timer->async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
+                          {
+                              if (!error)
+                                  self->timer_callback(); });
+    }
+
+    void timer_callback()
+    {
+        if (halt)
+            return;
+        scheduled = 0;
+        advance(Time::now());
+        if (n_armed)
+            schedule(next_wakeup());
+    }
+
+    // The next non-empty level 0 slot, or the next cascade
+    tick_t next_wakeup() const
+    {
+        const tick_t boundary = (current | (N_SLOTS - 1)) + 1;
+        for (tick_t tick = current + 1; tick < boundary; ++tick)
+        {
+            const Link &s = slots[tick & (N_SLOTS - 1)];
+            if (s.next != &s)
+                return tick;
+        }
+        return boundary;
+    }
+
+    void shutdown()
+    {
+        halt = true;
+        timer.reset();
+    }
+
+    Link &slot(const unsigned int level, const tick_t index)
+    {
+        return slots[level * N_SLOTS + index];
+    }
+
+    static void push_back(Link &head, Link &l)
+    {
+        l.prev = head.prev;
+        l.next = &head;
+        head.prev->next = &l;
+        head.prev = &l;
+    }
+
+    static void unlink(Link &l)
+    {
+        l.prev->next = l.next;
+        l.next->prev = l.prev;
+        l.prev = l.next = nullptr;
+    }
+
+    // move all entries of from to the empty list to
+    static void splice(Link &from, Link &to)
+    {
+        if (from.next == &from)
+        {
+            to.prev = to.next = &to;
+            return;
+        }
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.prev = from.next = &from;
+    }
+
+    const unsigned int tick_shift;
+    tick_t current = 0;
+    tick_t scheduled = 0;
+    size_t n_armed = 0;
+    bool halt = false;
+    std::unique_ptr<AsioTimerSafe> timer;
+    std::array<Link, N_SLOTS * N_LEVELS> slots;
+};
+
+} // namespace openvpn
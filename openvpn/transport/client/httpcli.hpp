@@ -35,6 +35,7 @@
 #include <openvpn/transport/tcplink.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/socket_protect.hpp>
+#include <openvpn/transport/socket_protect_async.hpp>
 #include <openvpn/transport/protocol.hpp>
 #include <openvpn/http/reply.hpp>
 #include <openvpn/http/status.hpp>
@@ -213,6 +214,7 @@ class ClientConfig : public TransportClientFactory
     DigestFactory::Ptr digest_factory; // needed by proxy auth methods
 
     SocketProtect *socket_protect;
+    SocketProtectQueue::Ptr socket_protect_queue; // created on demand, shared by all clients of this config
 
     bool skip_html;
 
@@ -909,6 +911,8 @@ class Client : public TransportClient, AsyncResolvableTCP
             if (impl)
                 impl->stop();
 
+            if (config->socket_protect_queue)
+                config->socket_protect_queue->cancel(this);
             socket.close();
             async_resolve_cancel();
         }
@@ -967,17 +971,36 @@ class Client : public TransportClient, AsyncResolvableTCP
         parent->transport_wait_proxy();
         socket.open(server_endpoint.protocol());
 
-        if (config->socket_protect)
+        if (config->socket_protect_queue)
         {
-            if (!config->socket_protect->socket_protect(socket.native_handle(), server_endpoint_addr()))
+            config->socket_protect_queue->protect(this,
+                                                  socket.native_handle(),
+                                                  server_endpoint_addr(),
+                                                  [self = Ptr(this)](const bool protected_ok)
+                                                  { self->socket_protected_(protected_ok); });
+        }
+        else
+            connect_();
+    }
+
+    // called when socket_protect has completed
+    void socket_protected_(const bool protected_ok)
+    {
+        if (!halt)
+        {
+            if (protected_ok)
+                connect_();
+            else
             {
                 config->stats->error(Error::SOCKET_PROTECT_ERROR);
                 stop();
                 parent->transport_error(Error::UNDEF, "socket_protect error (HTTP Proxy)");
-                return;
             }
         }
+    }
 
+    void connect_()
+    {
         socket.set_option(openvpn_io::ip::tcp::no_delay(true));
         socket.async_connect(server_endpoint, [self = Ptr(this)](const openvpn_io::error_code &error)
                              {
@@ -1089,6 +1112,8 @@ class Client : public TransportClient, AsyncResolvableTCP
 
 inline TransportClient::Ptr ClientConfig::new_transport_client_obj(openvpn_io::io_context &io_context, TransportClientParent *parent)
 {
+    if (socket_protect && !socket_protect_queue)
+        socket_protect_queue.reset(new SocketProtectQueue(io_context, socket_protect));
     return TransportClient::Ptr(new Client(io_context, this, parent));
 }
 } // namespace openvpn::HTTPProxyTransport
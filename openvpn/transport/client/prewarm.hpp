@@ -0,0 +1,169 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Open a transport connection ahead of the session that will use it.
+// The client uses this to connect to the next TCP remote entry while
+// a UDP entry is being tried, so that if it has to fall back to TCP,
+// the new session starts on an already-connected socket.  The
+// connection is handed over with a TransportRelayFactory, the same way
+// a transport is kept across sessions after a RELAY message.
+
+#ifndef OPENVPN_TRANSPORT_CLIENT_PREWARM_H
+#define OPENVPN_TRANSPORT_CLIENT_PREWARM_H
+
+#include <string>
+#include <utility>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/transport/client/transbase.hpp>
+#include <openvpn/transport/client/relay.hpp>
+
+namespace openvpn {
+class TransportPrewarm : public RC<thread_unsafe_refcount>,
+                         private TransportClientParent
+{
+  public:
+    typedef RCPtr<TransportPrewarm> Ptr;
+
+    enum State
+    {
+        CONNECTING,
+        READY,
+        FAILED,
+    };
+
+    TransportPrewarm(openvpn_io::io_context &io_context_arg,
+                     TransportClientFactory::Ptr factory_arg)
+        : io_context(io_context_arg),
+          factory(std::move(factory_arg))
+    {
+    }
+
+    void start()
+    {
+        if (!transport && state == CONNECTING)
+        {
+            transport = factory->new_transport_client_obj(io_context, this);
+            transport->transport_start();
+        }
+    }
+
+    void stop()
+    {
+        if (transport)
+        {
+            transport->stop();
+            transport.reset();
+        }
+        state = FAILED;
+    }
+
+    State state_get() const
+    {
+        return state;
+    }
+
+    // Reason for the FAILED state, empty if stopped by stop()
+    const std::string &error() const
+    {
+        return error_text;
+    }
+
+    // Hand the connected transport over to a new session, which must
+    // be started with the returned factory.  Returns an undefined
+    // pointer unless READY.
+    TransportClientFactory::Ptr release()
+    {
+        if (state != READY || !transport)
+            return TransportClientFactory::Ptr();
+        return TransportClientFactory::Ptr(new TransportRelayFactory(io_context, std::move(transport), this));
+    }
+
+    ~TransportPrewarm() override
+    {
+        stop();
+    }
+
+  private:
+    // Called back from the transport, so it is kept until stop()
+    void fail(const std::string &err_text)
+    {
+        if (state == FAILED)
+            return;
+        state = FAILED;
+        error_text = err_text;
+    }
+
+    // TransportClientParent
+
+    // Nothing is sent before the hand-over, so the server has nothing
+    // to say yet.  Anything it does send is not for us.
+    void transport_recv(BufferAllocated &buf) override
+    {
+    }
+
+    void transport_needs_send() override
+    {
+    }
+
+    void transport_error(const Error::Type fatal_err, const std::string &err_text) override
+    {
+        fail(err_text);
+    }
+
+    void proxy_error(const Error::Type fatal_err, const std::string &err_text) override
+    {
+        fail(err_text);
+    }
+
+    bool transport_is_openvpn_protocol() override
+    {
+        return true;
+    }
+
+    void transport_pre_resolve() override
+    {
+    }
+
+    void transport_wait_proxy() override
+    {
+    }
+
+    void transport_wait() override
+    {
+    }
+
+    void transport_connecting() override
+    {
+        if (state == CONNECTING)
+            state = READY;
+    }
+
+    bool is_keepalive_enabled() const override
+    {
+        return false;
+    }
+
+    void disable_keepalive(unsigned int &keepalive_ping, unsigned int &keepalive_timeout) override
+    {
+        keepalive_ping = 0;
+        keepalive_timeout = 0;
+    }
+
+    openvpn_io::io_context &io_context;
+    TransportClientFactory::Ptr factory;
+    TransportClient::Ptr transport;
+    State state = CONNECTING;
+    std::string error_text;
+};
+} // namespace openvpn
+
+#endif
@@ -24,6 +24,7 @@
 #endif
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/socket_protect.hpp>
+#include <openvpn/transport/socket_protect_async.hpp>
 #include <openvpn/client/remotelist.hpp>
 
 namespace openvpn::TCPTransport {
@@ -39,6 +40,7 @@ class ClientConfig : public TransportClientFactory
     SessionStats::Ptr stats;
 
     SocketProtect *socket_protect;
+    SocketProtectQueue::Ptr socket_protect_queue; // created on demand, shared by all clients of this config
 
 #ifdef OPENVPN_TLS_LINK
     bool use_tls = false;
@@ -256,6 +258,8 @@ class Client : public TransportClient, AsyncResolvableTCP
             if (impl)
                 impl->stop();
 
+            if (config->socket_protect_queue)
+                config->socket_protect_queue->cancel(this);
             socket.close();
             resolver.cancel();
             async_resolve_cancel();
@@ -294,17 +298,36 @@ class Client : public TransportClient, AsyncResolvableTCP
         parent->transport_wait();
         socket.open(server_endpoint.protocol());
 
-        if (config->socket_protect)
+        if (config->socket_protect_queue)
         {
-            if (!config->socket_protect->socket_protect(socket.native_handle(), server_endpoint_addr()))
+            config->socket_protect_queue->protect(this,
+                                                  socket.native_handle(),
+                                                  server_endpoint_addr(),
+                                                  [self = Ptr(this)](const bool protected_ok)
+                                                  { self->socket_protected_(protected_ok); });
+        }
+        else
+            connect_();
+    }
+
+    // called when socket_protect has completed
+    void socket_protected_(const bool protected_ok)
+    {
+        if (!halt)
+        {
+            if (protected_ok)
+                connect_();
+            else
             {
                 config->stats->error(Error::SOCKET_PROTECT_ERROR);
                 stop();
                 parent->transport_error(Error::UNDEF, "socket_protect error (" + std::string(server_protocol.str()) + ")");
-                return;
             }
         }
+    }
 
+    void connect_()
+    {
         socket.set_option(openvpn_io::ip::tcp::no_delay(true));
         socket.async_connect(server_endpoint, [self = Ptr(this)](const openvpn_io::error_code &error)
                              {
@@ -401,6 +424,8 @@ class Client : public TransportClient, AsyncResolvableTCP
 inline TransportClient::Ptr ClientConfig::new_transport_client_obj(openvpn_io::io_context &io_context,
                                                                    TransportClientParent *parent)
 {
+    if (socket_protect && !socket_protect_queue)
+        socket_protect_queue.reset(new SocketProtectQueue(io_context, socket_protect));
     return TransportClient::Ptr(new Client(io_context, this, parent));
 }
 } // namespace openvpn::TCPTransport
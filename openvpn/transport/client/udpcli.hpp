@@ -24,6 +24,7 @@
 #include <openvpn/transport/udplink.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/socket_protect.hpp>
+#include <openvpn/transport/socket_protect_async.hpp>
 #include <openvpn/client/remotelist.hpp>
 
 namespace openvpn::UDPTransport {
@@ -41,6 +42,12 @@ class ClientConfig : public TransportClientFactory
     SessionStats::Ptr stats;
 
     SocketProtect *socket_protect;
+    SocketProtectQueue::Ptr socket_protect_queue; // created on demand, shared by all clients of this config
+
+    bool io_uring = false; // use io_uring for socket I/O where available (Linux)
+
+    bool monitor_drops = false;   // count kernel receive drops in SessionStats where supported
+    int sockbuf_autotune_max = 0; // grow socket buffers up to this size on drops, 0 to disable, implies monitor_drops
 
 #ifdef OPENVPN_GREMLIN
     Gremlin::Config::Ptr gremlin_config;
@@ -184,6 +191,7 @@ class Client : public TransportClient, AsyncResolvableUDP
            ClientConfig *config_arg,
            TransportClientParent *parent_arg)
         : AsyncResolvableUDP(io_context_arg),
+          io_context(io_context_arg),
           socket(io_context_arg),
           config(config_arg),
           parent(parent_arg),
@@ -237,6 +245,8 @@ class Client : public TransportClient, AsyncResolvableUDP
             halt = true;
             if (impl)
                 impl->stop();
+            if (config->socket_protect_queue)
+                config->socket_protect_queue->cancel(this);
             socket.close();
             resolver.cancel();
             async_resolve_cancel();
@@ -274,17 +284,36 @@ class Client : public TransportClient, AsyncResolvableUDP
         parent->transport_wait();
         socket.open(server_endpoint.protocol());
 
-        if (config->socket_protect)
+        if (config->socket_protect_queue)
         {
-            if (!config->socket_protect->socket_protect(socket.native_handle(), server_endpoint_addr()))
+            config->socket_protect_queue->protect(this,
+                                                  socket.native_handle(),
+                                                  server_endpoint_addr(),
+                                                  [self = Ptr(this)](const bool protected_ok)
+                                                  { self->socket_protected_(protected_ok); });
+        }
+        else
+            connect_();
+    }
+
+    // called when socket_protect has completed
+    void socket_protected_(const bool protected_ok)
+    {
+        if (!halt)
+        {
+            if (protected_ok)
+                connect_();
+            else
             {
                 config->stats->error(Error::SOCKET_PROTECT_ERROR);
                 stop();
                 parent->transport_error(Error::UNDEF, "socket_protect error (UDP)");
-                return;
             }
         }
+    }
 
+    void connect_()
+    {
         socket.async_connect(server_endpoint, [self = Ptr(this)](const openvpn_io::error_code &error)
                              {
                                                 OPENVPN_ASYNC_HANDLER;
@@ -304,6 +333,16 @@ class Client : public TransportClient, AsyncResolvableUDP
                                         config->stats));
 #ifdef OPENVPN_GREMLIN
                 impl->gremlin_config(config->gremlin_config);
+#endif
+                if (config->monitor_drops || config->sockbuf_autotune_max)
+                    impl->monitor_drops();
+                impl->set_sockbuf_autotune(config->sockbuf_autotune_max);
+#ifdef OPENVPN_IO_URING
+                if (config->io_uring)
+                {
+                    if (IOUring::Ptr ring = IOUring::get(io_context))
+                        impl->use_io_uring(std::move(ring));
+                }
 #endif
                 impl->start(config->n_parallel);
                 parent->transport_connecting();
@@ -324,6 +363,7 @@ class Client : public TransportClient, AsyncResolvableUDP
 
     Protocol server_protocol;
 
+    openvpn_io::io_context &io_context;
     openvpn_io::ip::udp::socket socket;
     ClientConfig::Ptr config;
     TransportClientParent *parent;
@@ -336,6 +376,8 @@ class Client : public TransportClient, AsyncResolvableUDP
 inline TransportClient::Ptr ClientConfig::new_transport_client_obj(openvpn_io::io_context &io_context,
                                                                    TransportClientParent *parent)
 {
+    if (socket_protect && !socket_protect_queue)
+        socket_protect_queue.reset(new SocketProtectQueue(io_context, socket_protect));
     return TransportClient::Ptr(new Client(io_context, this, parent));
 }
 } // namespace openvpn::UDPTransport
@@ -0,0 +1,383 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// FQ-CoDel packet scheduler (RFC 8290) for tunnel packets waiting to be
+// sent over a stream transport.
+//
+// Packets are hashed on their inner IP 5-tuple into flow queues that are
+// served by deficit round robin.  Flows that were idle get one quantum
+// of priority over the bulk flows, so sparse interactive traffic such
+// as DNS, ssh keystrokes or TCP ACKs overtakes a saturating upload.
+// Each flow is managed by CoDel (RFC 8289): once the time packets spend
+// in the queue stays above the target for a full interval, packets are
+// dropped at an increasing rate from the head of the flow until the
+// standing queue is gone.
+//
+// The scheduler does not read the clock itself; callers pass the
+// current time to enqueue() and dequeue().
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/common/count.hpp>
+#include <openvpn/common/socktypes.hpp>
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+
+class FQCoDel
+{
+  public:
+    struct Config
+    {
+        Time::Duration target = Time::Duration::milliseconds(5);    // acceptable standing queue delay
+        Time::Duration interval = Time::Duration::milliseconds(100); // expected worst-case RTT
+        size_t n_flows = 1024;                                       // number of flow queues
+        size_t limit = 1024;                                         // max packets queued over all flows
+        size_t quantum = 1514;                                       // bytes per flow per round
+        std::uint64_t perturbation = 0;                              // flow hash seed
+    };
+
+    struct Stats
+    {
+        count_t enqueued = 0;
+        count_t dequeued = 0;
+        count_t codel_drops = 0;     // dropped by CoDel for standing queue delay
+        count_t overlimit_drops = 0; // dropped because the queue was full
+        Time::Duration sojourn_total;
+        Time::Duration sojourn_max;
+
+        count_t drops() const
+        {
+            return codel_drops + overlimit_drops;
+        }
+
+        // average time a sent packet spent in the queue
+        Time::Duration sojourn_avg() const
+        {
+            if (!dequeued)
+                return Time::Duration();
+            return Time::Duration::binary_ms(sojourn_total.raw() / dequeued);
+        }
+    };
+
+    explicit FQCoDel(const Config &config_arg)
+        : config(config_arg),
+          flows(config.n_flows ? config.n_flows : 1)
+    {
+    }
+
+    // Queue buf, leaving buf empty.  Returns false if the queue was full
+    // and a packet (not necessarily this one) had to be dropped.
+    bool enqueue(BufferAllocated &buf, const Time &now)
+    {
+        std::unique_ptr<Flow> &fp = flows[flow_hash(buf, config.perturbation) % flows.size()];
+        if (!fp)
+            fp.reset(new Flow());
+        Flow &flow = *fp;
+
+        flow.q.emplace_back();
+        Packet &pkt = flow.q.back();
+        pkt.buf.swap(buf);
+        pkt.time = now;
+        flow.backlog += pkt.buf.size();
+        ++size_;
+        ++stats_.enqueued;
+
+        if (!flow.active)
+        {
+            flow.active = true;
+            flow.deficit = long(config.quantum);
+            new_flows.push_back(&flow);
+        }
+
+        if (size_ > config.limit)
+        {
+            drop_from_fattest_flow();
+            return false;
+        }
+        return true;
+    }
+
+    // Move the next packet to send into buf.  Returns false if the queue
+    // is empty.
+    bool dequeue(BufferAllocated &buf, const Time &now)
+    {
+        while (true)
+        {
+            std::deque<Flow *> *list;
+            if (!new_flows.empty())
+                list = &new_flows;
+            else if (!old_flows.empty())
+                list = &old_flows;
+            else
+                return false;
+
+            Flow *flow = list->front();
+            if (flow->deficit <= 0)
+            {
+                flow->deficit += long(config.quantum);
+                list->pop_front();
+                old_flows.push_back(flow);
+                continue;
+            }
+
+            if (!codel_dequeue(*flow, buf, now))
+            {
+                list->pop_front();
+                // an emptied new flow goes to the back of the old list
+                // so that it cannot regain priority by sending one packet
+                // at a time
+                if (list == &new_flows && !old_flows.empty())
+                    old_flows.push_back(flow);
+                else
+                    flow->active = false;
+                continue;
+            }
+
+            flow->deficit -= long(buf.size());
+            ++stats_.dequeued;
+            return true;
+        }
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    // Hash of the inner IP 5-tuple.  Port numbers are only used for
+    // unfragmented TCP and UDP packets; non-IP packets all hash alike.
+    static std::uint64_t flow_hash(const Buffer &buf, const std::uint64_t seed)
+    {
+        std::uint64_t h = seed;
+        if (buf.empty())
+            return mix(h);
+
+        const unsigned char *data = buf.c_data();
+        const size_t size = buf.size();
+        unsigned int proto = 0;
+        size_t l4_offset = 0;
+
+        switch (IPCommon::version(data[0]))
+        {
+        case IPCommon::IPv4:
+            {
+                if (size < sizeof(IPv4Header))
+                    return mix(h);
+                const IPv4Header *ip = reinterpret_cast<const IPv4Header *>(data);
+                proto = ip->protocol;
+                h = mix(h ^ ip->saddr);
+                h = mix(h ^ ip->daddr);
+                if (!(ntohs(ip->frag_off) & IPv4Header::OFFMASK))
+                    l4_offset = IPv4Header::length(ip->version_len);
+                break;
+            }
+        case IPCommon::IPv6:
+            {
+                if (size < sizeof(IPv6Header))
+                    return mix(h);
+                const IPv6Header *ip = reinterpret_cast<const IPv6Header *>(data);
+                proto = ip->nexthdr;
+                h = mix(h ^ read_u64(ip->saddr.s6_addr));
+                h = mix(h ^ read_u64(ip->saddr.s6_addr + 8));
+                h = mix(h ^ read_u64(ip->daddr.s6_addr));
+                h = mix(h ^ read_u64(ip->daddr.s6_addr + 8));
+                l4_offset = sizeof(IPv6Header);
+                break;
+            }
+        default:
+            return mix(h);
+        }
+
+        h = mix(h ^ proto);
+        if ((proto == IPCommon::TCP || proto == IPCommon::UDP)
+            && l4_offset && l4_offset + 4 <= size)
+        {
+            std::uint32_t ports;
+            std::memcpy(&ports, data + l4_offset, sizeof(ports));
+            h = mix(h ^ ports);
+        }
+        return h;
+    }
+
+  private:
+    struct Packet
+    {
+        BufferAllocated buf;
+        Time time; // when the packet was queued
+    };
+
+    struct Flow
+    {
+        std::deque<Packet> q;
+        size_t backlog = 0; // bytes queued
+        long deficit = 0;
+        bool active = false; // on new_flows or old_flows
+
+        // CoDel state
+        Time first_above_time;
+        Time drop_next;
+        unsigned int count = 0;
+        unsigned int last_count = 0;
+        bool dropping = false;
+    };
+
+    // RFC 8289 dodequeue(): pop the head of the flow and decide whether
+    // the flow has been above target for long enough to drop from it.
+    bool do_dequeue(Flow &flow, BufferAllocated &buf, const Time &now, bool &ok_to_drop)
+    {
+        ok_to_drop = false;
+        if (flow.q.empty())
+        {
+            flow.first_above_time = Time();
+            return false;
+        }
+
+        Packet &pkt = flow.q.front();
+        const Time::Duration sojourn = now - pkt.time;
+        buf.swap(pkt.buf);
+        flow.q.pop_front();
+        flow.backlog -= buf.size();
+        --size_;
+
+        stats_.sojourn_total += sojourn;
+        if (sojourn > stats_.sojourn_max)
+            stats_.sojourn_max = sojourn;
+
+        if (sojourn < config.target || flow.backlog <= config.quantum)
+            flow.first_above_time = Time();
+        else if (!flow.first_above_time.defined())
+            flow.first_above_time = now + config.interval;
+        else if (now >= flow.first_above_time)
+            ok_to_drop = true;
+        return true;
+    }
+
+    bool codel_dequeue(Flow &flow, BufferAllocated &buf, const Time &now)
+    {
+        bool ok_to_drop;
+        if (!do_dequeue(flow, buf, now, ok_to_drop))
+        {
+            flow.dropping = false;
+            return false;
+        }
+
+        if (flow.dropping)
+        {
+            if (!ok_to_drop)
+                flow.dropping = false;
+            while (flow.dropping && now >= flow.drop_next)
+            {
+                codel_drop();
+                ++flow.count;
+                if (!do_dequeue(flow, buf, now, ok_to_drop))
+                {
+                    flow.dropping = false;
+                    return false;
+                }
+                if (!ok_to_drop)
+                    flow.dropping = false;
+                else
+                    flow.drop_next = control_law(flow.drop_next, flow.count);
+            }
+        }
+        else if (ok_to_drop)
+        {
+            codel_drop();
+            const bool more = do_dequeue(flow, buf, now, ok_to_drop);
+            flow.dropping = true;
+
+            // resume near the previous drop rate if we were dropping
+            // recently
+            const unsigned int delta = flow.count - flow.last_count;
+            if (delta > 1 && now < flow.drop_next + config.interval * 16)
+                flow.count = delta;
+            else
+                flow.count = 1;
+            flow.drop_next = control_law(now, flow.count);
+            flow.last_count = flow.count;
+            if (!more)
+                return false;
+        }
+        return true;
+    }
+
+    Time control_law(const Time &t, const unsigned int count) const
+    {
+        return t + Time::Duration::binary_ms(Time::type(double(config.interval.raw()) / std::sqrt(double(count))));
+    }
+
+    void codel_drop()
+    {
+        ++stats_.codel_drops;
+    }
+
+    void drop_from_fattest_flow()
+    {
+        Flow *fattest = nullptr;
+        for (std::deque<Flow *> *list : {&new_flows, &old_flows})
+            for (Flow *flow : *list)
+                if (!fattest || flow->backlog > fattest->backlog)
+                    fattest = flow;
+        if (!fattest || fattest->q.empty())
+            return;
+        fattest->backlog -= fattest->q.front().buf.size();
+        fattest->q.pop_front();
+        --size_;
+        ++stats_.overlimit_drops;
+    }
+
+    static std::uint64_t read_u64(const unsigned char *p)
+    {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // splitmix64 finalizer
+    static std::uint64_t mix(std::uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    const Config config;
+    std::vector<std::unique_ptr<Flow>> flows; // allocated on first use
+    std::deque<Flow *> new_flows;
+    std::deque<Flow *> old_flows;
+    size_t size_ = 0;
+    Stats stats_;
+};
+
+} // namespace openvpn
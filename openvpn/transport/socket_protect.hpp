@@ -12,6 +12,8 @@
 #ifndef OPENVPN_TRANSPORT_SOCKET_PROTECT_H
 #define OPENVPN_TRANSPORT_SOCKET_PROTECT_H
 
+#include <vector>
+
 #include <openvpn/addr/ip.hpp>
 #ifdef OPENVPN_PLATFORM_UWP
 #include <openvpn/transport/uwp_socket_protect.hpp>
@@ -25,9 +27,34 @@ namespace openvpn {
 class BaseSocketProtect
 {
   public:
+    struct Request
+    {
+        openvpn_io::detail::socket_type socket;
+        IP::Addr endpoint;
+        bool result = false; // set by socket_protect_batch()
+    };
+    typedef std::vector<Request> RequestList;
+
     virtual ~BaseSocketProtect() = default;
 
     virtual bool socket_protect(openvpn_io::detail::socket_type socket, IP::Addr endpoint) = 0;
+
+    // Protect several sockets in one call.  Implementations where each
+    // up-call into the host app is expensive (such as crossing JNI on
+    // Android) should override this and hand over the whole list at once.
+    virtual void socket_protect_batch(RequestList &requests)
+    {
+        for (auto &r : requests)
+            r.result = socket_protect(r.socket, r.endpoint);
+    }
+
+    // If true, SocketProtectQueue makes the up-calls above from a worker
+    // thread and transports continue to connect on completion, rather
+    // than blocking the io_context thread.
+    virtual bool socket_protect_async() const
+    {
+        return false;
+    }
 };
 
 #ifdef OPENVPN_PLATFORM_UWP
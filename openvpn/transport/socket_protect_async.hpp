@@ -0,0 +1,211 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Asynchronous, batched front-end to SocketProtect.
+
+#ifndef OPENVPN_TRANSPORT_SOCKET_PROTECT_ASYNC_H
+#define OPENVPN_TRANSPORT_SOCKET_PROTECT_ASYNC_H
+
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/asio/asiowork.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/log/logger.hpp>
+#include <openvpn/transport/socket_protect.hpp>
+
+namespace openvpn {
+
+// Transports hand newly created sockets to protect() and continue
+// (typically with async_connect) from the completion callback.
+//
+// All requests made during one turn of the io_context are coalesced
+// into a single SocketProtect::socket_protect_batch() up-call.  If the
+// SocketProtect implementation returns true from socket_protect_async(),
+// that up-call is made from a worker thread, so a slow host (for
+// example a JNI round trip on Android) does not stall the io_context
+// thread.  Only one batch is with the host at a time; requests made
+// meanwhile go into the next batch.  The worker is never joined: it
+// holds the queue and keeps the io_context running until it has
+// posted the result back, so the client doesn't return from its event
+// loop, and tear down the SocketProtect object, while the host is
+// still processing a batch.  If the up-call throws, every request of
+// the batch completes as not protected.
+//
+// Requests are keyed by their owner, usually the transport.  A
+// transport calls cancel() when it stops, before it closes its socket:
+// its requests not yet sent to the host are dropped, so the host never
+// sees a descriptor that may have been closed or reused, and the
+// callbacks of a batch already with the host are not invoked.
+//
+// Completion callbacks are always invoked on the io_context thread and
+// always asynchronously with respect to protect().
+class SocketProtectQueue : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<SocketProtectQueue> Ptr;
+    typedef std::function<void(bool protected_ok)> Callback;
+
+    SocketProtectQueue(openvpn_io::io_context &io_context_arg,
+                       SocketProtect *socket_protect_arg)
+        : io_context(io_context_arg),
+          socket_protect(socket_protect_arg)
+    {
+    }
+
+    void protect(const void *owner,
+                 openvpn_io::detail::socket_type socket,
+                 const IP::Addr &endpoint,
+                 Callback callback)
+    {
+        if (!pending)
+        {
+            pending.reset(new Batch());
+            openvpn_io::post(io_context, [self = Ptr(this)]()
+                             { self->flush(); });
+        }
+        pending->requests.push_back({socket, endpoint});
+        pending->owners.push_back(owner);
+        pending->callbacks.push_back(std::move(callback));
+    }
+
+    // Forget the requests of owner.  Does not wait for the host.
+    void cancel(const void *owner)
+    {
+        if (pending)
+        {
+            size_t j = 0;
+            for (size_t i = 0; i < pending->owners.size(); ++i)
+            {
+                if (pending->owners[i] == owner)
+                    continue;
+                if (i != j)
+                {
+                    pending->requests[j] = std::move(pending->requests[i]);
+                    pending->owners[j] = pending->owners[i];
+                    pending->callbacks[j] = std::move(pending->callbacks[i]);
+                }
+                ++j;
+            }
+            pending->requests.resize(j);
+            pending->owners.resize(j);
+            pending->callbacks.resize(j);
+        }
+
+        // only the requests are shared with the worker thread
+        if (active)
+        {
+            for (size_t i = 0; i < active->owners.size(); ++i)
+            {
+                if (active->owners[i] == owner)
+                    active->callbacks[i] = nullptr;
+            }
+        }
+    }
+
+    // Number of batches issued so far, mostly of interest to tests
+    unsigned int n_batches() const
+    {
+        return n_batches_;
+    }
+
+  private:
+    struct Batch
+    {
+        SocketProtect::RequestList requests;
+        std::vector<const void *> owners;
+        std::vector<Callback> callbacks;
+        std::string error; // what the up-call threw, if anything
+    };
+
+    void flush()
+    {
+        if (!pending || active)
+            return;
+        std::shared_ptr<Batch> batch(std::move(pending));
+        if (batch->requests.empty())
+            return;
+        ++n_batches_;
+
+        if (!socket_protect->socket_protect_async())
+        {
+            protect_batch(*batch);
+            complete(*batch);
+            return;
+        }
+
+        // The worker holds a reference until it has posted the result,
+        // and keeps the event loop alive while the host processes the
+        // batch.
+        active = batch;
+        auto work = std::make_shared<AsioWork>(io_context);
+        std::thread([self = Ptr(this), batch, work]() mutable
+                    {
+            self->protect_batch(*batch);
+            openvpn_io::io_context &io_context = self->io_context;
+            openvpn_io::post(io_context, [self = std::move(self), batch = std::move(batch), work = std::move(work)]()
+                             { self->worker_done(*batch); }); })
+            .detach();
+    }
+
+    void worker_done(Batch &batch)
+    {
+        active.reset();
+        complete(batch);
+        flush();
+    }
+
+    void protect_batch(Batch &batch) noexcept
+    {
+        try
+        {
+            socket_protect->socket_protect_batch(batch.requests);
+        }
+        catch (const std::exception &e)
+        {
+            batch.error = e.what();
+        }
+        catch (...)
+        {
+            batch.error = "unknown exception";
+        }
+    }
+
+    static void complete(Batch &batch)
+    {
+        if (!batch.error.empty())
+        {
+            OPENVPN_LOG("socket_protect_batch failed: " << batch.error);
+            for (auto &req : batch.requests)
+                req.result = false;
+        }
+        for (size_t i = 0; i < batch.requests.size(); ++i)
+        {
+            if (batch.callbacks[i])
+                batch.callbacks[i](batch.requests[i].result);
+        }
+    }
+
+    openvpn_io::io_context &io_context;
+    SocketProtect *socket_protect;
+    std::shared_ptr<Batch> pending; // not yet sent to the host
+    std::shared_ptr<Batch> active;  // with the worker thread
+    unsigned int n_batches_ = 0;
+};
+
+} // namespace openvpn
+
+#endif
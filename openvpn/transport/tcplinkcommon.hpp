@@ -16,6 +16,7 @@
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/rc.hpp>
 #include <openvpn/common/socktypes.hpp>
+#include <openvpn/asio/asioarena.hpp>
 #include <openvpn/error/excode.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/log/sessionstats.hpp>
@@ -179,6 +180,11 @@ class LinkCommon : public LinkBase
         return true;
     }
 
+    const AsioArena::Stats &handler_arena_stats() const
+    {
+        return arena.stats();
+    }
+
     void queue_recv(PacketFrom *tcpfrom)
     {
         OPENVPN_LOG_TCPLINK_VERBOSE("TLSLink::queue_recv");
@@ -187,34 +193,34 @@ class LinkCommon : public LinkBase
         frame_context.prepare(tcpfrom->buf);
 
         socket.async_receive(frame_context.mutable_buffer_clamp(tcpfrom->buf),
-                             [self = Ptr(this), tcpfrom = PacketFrom::SPtr(tcpfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
-                             {
-                                 OPENVPN_ASYNC_HANDLER;
-                                 try
-                                 {
-                                     self->handle_recv(std::move(tcpfrom), error, bytes_recvd);
-                                 }
-                                 catch (const std::exception &e)
-                                 {
-                                     Error::Type err = Error::TCP_SIZE_ERROR;
-                                     const char *msg = "TCP_SIZE_ERROR";
-                                     // if exception is an ExceptionCode, translate the code
-                                     // to return status string
-                                     {
-                                         const ExceptionCode *ec = dynamic_cast<const ExceptionCode *>(&e);
-                                         if (ec && ec->code_defined())
-                                         {
-                                             err = ec->code();
-                                             msg = ec->what();
-                                         }
-                                     }
-
-                                     OPENVPN_LOG_TCPLINK_ERROR("TCP packet extract exception: " << e.what());
-                                     self->stats->error(err);
-                                     self->read_handler->tcp_error_handler(msg);
-                                     self->stop();
-                                 }
-                             });
+                             arena.bind([self = Ptr(this), tcpfrom = PacketFrom::SPtr(tcpfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
+                                        {
+                                            OPENVPN_ASYNC_HANDLER;
+                                            try
+                                            {
+                                                self->handle_recv(std::move(tcpfrom), error, bytes_recvd);
+                                            }
+                                            catch (const std::exception &e)
+                                            {
+                                                Error::Type err = Error::TCP_SIZE_ERROR;
+                                                const char *msg = "TCP_SIZE_ERROR";
+                                                // if exception is an ExceptionCode, translate the code
+                                                // to return status string
+                                                {
+                                                    const ExceptionCode *ec = dynamic_cast<const ExceptionCode *>(&e);
+                                                    if (ec && ec->code_defined())
+                                                    {
+                                                        err = ec->code();
+                                                        msg = ec->what();
+                                                    }
+                                                }
+
+                                                OPENVPN_LOG_TCPLINK_ERROR("TCP packet extract exception: " << e.what());
+                                                self->stats->error(err);
+                                                self->read_handler->tcp_error_handler(msg);
+                                                self->stop();
+                                            }
+                                        }));
     }
 
   protected:
@@ -279,11 +285,11 @@ class LinkCommon : public LinkBase
     {
         BufferAllocated &buf = *queue.front();
         socket.async_send(buf.const_buffer_clamp(),
-                          [self = Ptr(this)](const openvpn_io::error_code &error, const size_t bytes_sent)
-                          {
-                              OPENVPN_ASYNC_HANDLER;
-                              self->handle_send(error, bytes_sent);
-                          });
+                          arena.bind([self = Ptr(this)](const openvpn_io::error_code &error, const size_t bytes_sent)
+                                     {
+                                         OPENVPN_ASYNC_HANDLER;
+                                         self->handle_send(error, bytes_sent);
+                                     }));
     }
 
     void handle_send(const openvpn_io::error_code &error, const size_t bytes_sent)
@@ -457,6 +463,7 @@ class LinkCommon : public LinkBase
     ReadHandler read_handler;
     Frame::Context frame_context;
     SessionStats::Ptr stats;
+    AsioArena arena;
     const size_t send_queue_max_size;
     const size_t free_list_max_size;
     Queue queue;     // send queue
@@ -15,11 +15,18 @@
 #define OPENVPN_TRANSPORT_UDPLINK_H
 
 #include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
 
 #include <openvpn/io/io.hpp>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/rc.hpp>
+#include <openvpn/common/platform.hpp>
+#include <openvpn/common/sockopt.hpp>
+#include <openvpn/asio/asioarena.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/log/sessionstats.hpp>
 
@@ -27,6 +34,10 @@
 #include <openvpn/transport/gremlin.hpp>
 #endif
 
+#ifdef OPENVPN_PLATFORM_LINUX
+#include <openvpn/linux/iouring.hpp>
+#endif
+
 #if defined(OPENVPN_DEBUG_UDPLINK) && OPENVPN_DEBUG_UDPLINK >= 1
 #define OPENVPN_LOG_UDPLINK_ERROR(x) OPENVPN_LOG(x)
 #else
@@ -82,6 +93,15 @@ class UDPLink : public RC<thread_unsafe_refcount>
     }
 #endif
 
+#ifdef OPENVPN_IO_URING
+    // Do socket I/O through ring instead of asio.  Must be called
+    // before start().
+    void use_io_uring(IOUring::Ptr ring_arg)
+    {
+        ring = std::move(ring_arg);
+    }
+#endif
+
     // Returns 0 on success, or a system error code on error.
     // May also return SEND_PARTIAL or SEND_SOCKET_HALTED.
     int send(const Buffer &buf, const AsioEndpoint *endpoint)
@@ -97,10 +117,43 @@ class UDPLink : public RC<thread_unsafe_refcount>
             return do_send(buf, endpoint);
     }
 
+    // Count datagrams the kernel drops because the receive buffer is
+    // full in SessionStats::UDP_RECV_DROPS.  Returns false if the
+    // platform cannot report them.  Must be called before start().
+    bool monitor_drops()
+    {
+#ifdef SO_RXQ_OVFL
+        try
+        {
+            SockOpt::rxq_ovfl(socket.native_handle());
+            drop_monitor = true;
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG_UDPLINK_ERROR("UDP drop monitoring not available: " << e.what());
+        }
+#endif
+        return false;
+    }
+
+    // Double SO_RCVBUF when receive drops are seen (see monitor_drops()),
+    // and SO_SNDBUF when a send fails for lack of buffer space, up to
+    // max_size bytes.
+    void set_sockbuf_autotune(const int max_size)
+    {
+        sockbuf_max = max_size;
+    }
+
     void start(const int n_parallel)
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            uring_n_parallel = n_parallel;
+            if (ring && uring_start_multishot())
+                return;
+#endif
             for (int i = 0; i < n_parallel; i++)
                 queue_read(nullptr);
         }
@@ -108,6 +161,10 @@ class UDPLink : public RC<thread_unsafe_refcount>
 
     void stop()
     {
+#ifdef OPENVPN_IO_URING
+        if (ring && !halt)
+            ring->cancel_fd(socket.native_handle());
+#endif
         halt = true;
 #ifdef OPENVPN_GREMLIN
         if (gremlin)
@@ -120,6 +177,11 @@ class UDPLink : public RC<thread_unsafe_refcount>
         frame_context.reset_align_adjust(align_adjust);
     }
 
+    const AsioArena::Stats &handler_arena_stats() const
+    {
+        return arena.stats();
+    }
+
     ~UDPLink()
     {
         stop();
@@ -132,13 +194,29 @@ class UDPLink : public RC<thread_unsafe_refcount>
         if (!udpfrom)
             udpfrom = new PacketFrom();
         frame_context.prepare(udpfrom->buf);
+#ifdef OPENVPN_IO_URING
+        if (ring && uring_queue_read(udpfrom))
+            return;
+#endif
+#ifdef SO_RXQ_OVFL
+        if (drop_monitor)
+        {
+            socket.async_wait(openvpn_io::socket_base::wait_read,
+                              arena.bind([self = Ptr(this), udpfrom = PacketFrom::SPtr(udpfrom)](const openvpn_io::error_code &error) mutable
+                                         {
+                                             OPENVPN_ASYNC_HANDLER;
+                                             self->handle_wait_read(std::move(udpfrom), error);
+                                         }));
+            return;
+        }
+#endif
         socket.async_receive_from(frame_context.mutable_buffer(udpfrom->buf),
                                   udpfrom->sender_endpoint,
-                                  [self = Ptr(this), udpfrom = PacketFrom::SPtr(udpfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
-                                  {
-                                      OPENVPN_ASYNC_HANDLER;
-                                      self->handle_read(std::move(udpfrom), error, bytes_recvd);
-                                  });
+                                  arena.bind([self = Ptr(this), udpfrom = PacketFrom::SPtr(udpfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
+                                             {
+                                                 OPENVPN_ASYNC_HANDLER;
+                                                 self->handle_read(std::move(udpfrom), error, bytes_recvd);
+                                             }));
     }
 
     void handle_read(PacketFrom::SPtr pfp, const openvpn_io::error_code &error, const size_t bytes_recvd)
@@ -150,16 +228,8 @@ class UDPLink : public RC<thread_unsafe_refcount>
             {
                 if (!error)
                 {
-                    OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << bytes_recvd << "] from " << pfp->sender_endpoint);
                     pfp->buf.set_size(bytes_recvd);
-                    stats->inc_stat(SessionStats::BYTES_IN, bytes_recvd);
-                    stats->inc_stat(SessionStats::PACKETS_IN, 1);
-#ifdef OPENVPN_GREMLIN
-                    if (gremlin)
-                        gremlin_recv(pfp);
-                    else
-#endif
-                        read_handler->udp_read_handler(pfp);
+                    recv_packet(pfp);
                 }
                 else
                 {
@@ -172,10 +242,143 @@ class UDPLink : public RC<thread_unsafe_refcount>
         }
     }
 
+#ifdef SO_RXQ_OVFL
+    // With drop monitoring, datagrams are read with recvmsg() to get at
+    // the SO_RXQ_OVFL control message.  Up to RECV_BATCH datagrams are
+    // read per wakeup.
+    void handle_wait_read(PacketFrom::SPtr pfp, const openvpn_io::error_code &error)
+    {
+        if (halt)
+            return;
+        if (error)
+        {
+            handle_read(std::move(pfp), error, 0);
+            return;
+        }
+
+        for (int i = 0; i < RECV_BATCH && !halt; ++i)
+        {
+            if (!pfp)
+                pfp.reset(new PacketFrom());
+            frame_context.prepare(pfp->buf);
+
+            const openvpn_io::mutable_buffer mb = frame_context.mutable_buffer(pfp->buf);
+            ::iovec iov;
+            iov.iov_base = mb.data();
+            iov.iov_len = mb.size();
+            alignas(::cmsghdr) unsigned char control[CMSG_SPACE(sizeof(std::uint32_t))];
+            ::msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = pfp->sender_endpoint.data();
+            msg.msg_namelen = static_cast<socklen_t>(pfp->sender_endpoint.capacity());
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            const ssize_t n = ::recvmsg(socket.native_handle(), &msg, MSG_DONTWAIT);
+            if (n < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: " << openvpn_io::error_code(errno, openvpn_io::system_category()).message());
+                    stats->error(Error::NETWORK_RECV_ERROR);
+                }
+                break;
+            }
+            pfp->sender_endpoint.resize(msg.msg_namelen);
+            recv_control(msg);
+            if (n > 0)
+            {
+                pfp->buf.set_size(n);
+                recv_packet(pfp);
+            }
+        }
+        if (!halt)
+            queue_read(pfp.release()); // reuse PacketFrom object if still available
+    }
+#endif
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+    // Process control messages of a received datagram
+    void recv_control(::msghdr &msg)
+    {
+#ifdef SO_RXQ_OVFL
+        for (::cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                // the kernel reports the total dropped on the socket so far
+                std::uint32_t count;
+                std::memcpy(&count, CMSG_DATA(cmsg), sizeof(count));
+                const std::uint32_t dropped = count - rxq_ovfl_count;
+                rxq_ovfl_count = count;
+                if (dropped)
+                {
+                    stats->inc_stat(SessionStats::UDP_RECV_DROPS, dropped);
+                    grow_sockbuf(SO_RCVBUF, rcvbuf_capped);
+                }
+            }
+        }
+#endif
+    }
+#endif
+
+    // Double the SO_RCVBUF or SO_SNDBUF size, if autotuning is enabled and
+    // the size is not yet at its limit.  Only the final size is logged,
+    // once the limit is reached.
+    void grow_sockbuf(const int optname, bool &capped)
+    {
+#if !defined(OPENVPN_PLATFORM_WIN)
+        if (!sockbuf_max || capped)
+            return;
+        int size = 0;
+        try
+        {
+            const int fd = socket.native_handle();
+            size = SockOpt::sockbuf(fd, optname);
+            if (size < sockbuf_max)
+            {
+                SockOpt::set_sockbuf(fd, optname, int(std::min(long(size) * 2, long(sockbuf_max))));
+                const int new_size = SockOpt::sockbuf(fd, optname);
+                OPENVPN_LOG_UDPLINK_VERBOSE("UDP " << (optname == SO_RCVBUF ? "receive" : "send") << " buffer grown from " << size << " to " << new_size << " bytes");
+                if (new_size > size && new_size < sockbuf_max)
+                    return;
+                size = new_size;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG_UDPLINK_ERROR("UDP socket buffer tuning error: " << e.what());
+        }
+        // at the configured or system limit
+        capped = true;
+        if (size)
+            OPENVPN_LOG("UDP " << (optname == SO_RCVBUF ? "receive" : "send") << " buffer at its limit of " << size << " bytes");
+#endif
+    }
+
+    void recv_packet(PacketFrom::SPtr &pfp)
+    {
+        OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << pfp->buf.size() << "] from " << pfp->sender_endpoint);
+        stats->inc_stat(SessionStats::BYTES_IN, pfp->buf.size());
+        stats->inc_stat(SessionStats::PACKETS_IN, 1);
+#ifdef OPENVPN_GREMLIN
+        if (gremlin)
+            gremlin_recv(pfp);
+        else
+#endif
+            read_handler->udp_read_handler(pfp);
+    }
+
     int do_send(const Buffer &buf, const AsioEndpoint *endpoint)
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            if (ring && uring_send(buf, endpoint))
+                return 0;
+#endif
             try
             {
                 const size_t wrote = endpoint
@@ -196,6 +399,10 @@ class UDPLink : public RC<thread_unsafe_refcount>
             {
                 OPENVPN_LOG_UDPLINK_ERROR("UDP send exception: " << e.what());
                 stats->error(Error::NETWORK_SEND_ERROR);
+#if !defined(OPENVPN_PLATFORM_WIN)
+                if (e.code() == openvpn_io::error::no_buffer_space || e.code() == openvpn_io::error::would_block)
+                    grow_sockbuf(SO_SNDBUF, sndbuf_capped);
+#endif
                 return e.code().value();
             }
         }
@@ -224,15 +431,278 @@ class UDPLink : public RC<thread_unsafe_refcount>
     }
 #endif
 
+#ifdef OPENVPN_IO_URING
+    // Receives any number of datagrams into the buffers of a provided
+    // buffer ring, re-armed whenever the kernel terminates it.
+    class RecvMultishotOp : public IOUring::Op
+    {
+      public:
+        RecvMultishotOp(UDPLink *link_arg, IOUring::BufferGroup::Ptr group_arg)
+            : link(link_arg),
+              group(std::move(group_arg))
+        {
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_namelen = sizeof(sockaddr_in6);
+        }
+
+        void complete(const int res, const unsigned int flags) override
+        {
+            link->uring_recv_multishot(*this, res, flags);
+        }
+
+        UDPLink::Ptr link;
+        IOUring::BufferGroup::Ptr group;
+        ::msghdr msg;
+        size_t n_packets = 0;
+    };
+
+    // Single-shot receive, for kernels without multishot recvmsg
+    class RecvOp : public IOUring::Op
+    {
+      public:
+        typedef RCPtr<RecvOp> Ptr;
+
+        void complete(const int res, const unsigned int flags) override
+        {
+            UDPLink::Ptr l(std::move(link));
+            PacketFrom::SPtr udpfrom(std::move(pfp));
+            if (res >= 0)
+            {
+                udpfrom->sender_endpoint.resize(msg.msg_namelen);
+                l->recv_control(msg);
+            }
+            l->free_recv_ops.emplace_back(this);
+            l->handle_read(std::move(udpfrom),
+                           res < 0 ? openvpn_io::error_code(-res, openvpn_io::system_category()) : openvpn_io::error_code(),
+                           res > 0 ? res : 0);
+        }
+
+        UDPLink::Ptr link; // only set while pending
+        PacketFrom::SPtr pfp;
+        ::iovec iov;
+        ::msghdr msg;
+        alignas(::cmsghdr) unsigned char control[CMSG_SPACE(sizeof(std::uint32_t))];
+    };
+
+    class SendOp : public IOUring::Op
+    {
+      public:
+        typedef RCPtr<SendOp> Ptr;
+
+        void complete(const int res, const unsigned int flags) override
+        {
+            UDPLink::Ptr l(std::move(link));
+            l->ring->free_slot(slot);
+            if (res < 0 && !l->halt)
+            {
+                OPENVPN_LOG_UDPLINK_ERROR("UDP send error: " << openvpn_io::error_code(-res, openvpn_io::system_category()).message());
+                l->stats->error(Error::NETWORK_SEND_ERROR);
+                if (res == -ENOBUFS || res == -EAGAIN)
+                    l->grow_sockbuf(SO_SNDBUF, l->sndbuf_capped);
+            }
+            l->free_send_ops.emplace_back(this);
+        }
+
+        UDPLink::Ptr link; // only set while pending
+        int slot = -1;
+        AsioEndpoint endpoint;
+        ::iovec iov;
+        ::msghdr msg;
+    };
+
+    bool uring_start_multishot()
+    {
+        IOUring::BufferGroup::Ptr group;
+        const size_t controllen = drop_monitor ? CMSG_SPACE(sizeof(std::uint32_t)) : 0;
+        try
+        {
+            group.reset(new IOUring::BufferGroup(ring, 128, sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in6) + controllen + frame_context.payload()));
+        }
+        catch (const IOUring::io_uring_error &e)
+        {
+            OPENVPN_LOG_UDPLINK_ERROR("UDP io_uring multishot receive not available: " << e.what());
+            return false;
+        }
+        IOUring::Op::Ptr op_ref(new RecvMultishotOp(this, std::move(group)));
+        RecvMultishotOp *op = static_cast<RecvMultishotOp *>(op_ref.get());
+        op->msg.msg_controllen = controllen;
+        return ring->recvmsg_multishot(op, socket.native_handle(), &op->msg, *op->group) != nullptr;
+    }
+
+    void uring_recv_multishot(RecvMultishotOp &op, const int res, const unsigned int flags)
+    {
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            const unsigned int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            if (res > 0 && !halt)
+            {
+                ++op.n_packets;
+                uring_recv_buffer(op, op.group->buffer(bid), res);
+            }
+            op.group->recycle(bid);
+        }
+        if (flags & IORING_CQE_F_MORE || halt)
+            return;
+
+        if (res == -EINVAL && !op.n_packets)
+        {
+            // multishot recvmsg not supported by kernel
+            for (int i = 0; i < uring_n_parallel; i++)
+                queue_read(nullptr);
+            return;
+        }
+        if (res < 0 && res != -ENOBUFS)
+        {
+            OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: " << openvpn_io::error_code(-res, openvpn_io::system_category()).message());
+            stats->error(Error::NETWORK_RECV_ERROR);
+        }
+        if (!ring->recvmsg_multishot(&op, socket.native_handle(), &op.msg, *op.group))
+        {
+            // no room in the ring, continue with single reads
+            for (int i = 0; i < uring_n_parallel; i++)
+                queue_read(nullptr);
+        }
+    }
+
+    void uring_recv_buffer(const RecvMultishotOp &op, const unsigned char *data, const size_t size)
+    {
+        const size_t hdr_size = sizeof(io_uring_recvmsg_out) + op.msg.msg_namelen + op.msg.msg_controllen;
+        const io_uring_recvmsg_out *out = reinterpret_cast<const io_uring_recvmsg_out *>(data);
+        if (size < hdr_size || out->flags & MSG_TRUNC || size - hdr_size < out->payloadlen)
+        {
+            OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: truncated datagram");
+            stats->error(Error::NETWORK_RECV_ERROR);
+            return;
+        }
+
+        if (!spare_pfp)
+            spare_pfp.reset(new PacketFrom());
+        PacketFrom::SPtr pfp(std::move(spare_pfp));
+        frame_context.prepare(pfp->buf);
+        pfp->buf.write(data + hdr_size, out->payloadlen);
+        const size_t namelen = std::min(size_t(out->namelen), size_t(op.msg.msg_namelen));
+        std::memcpy(pfp->sender_endpoint.data(), data + sizeof(io_uring_recvmsg_out), namelen);
+        pfp->sender_endpoint.resize(namelen);
+        if (out->controllen)
+        {
+            ::msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_control = const_cast<unsigned char *>(data) + sizeof(io_uring_recvmsg_out) + op.msg.msg_namelen;
+            msg.msg_controllen = out->controllen;
+            recv_control(msg);
+        }
+        recv_packet(pfp);
+        spare_pfp = std::move(pfp); // reuse PacketFrom object if still available
+    }
+
+    // Returns false, leaving udpfrom to the caller, if the ring has no
+    // room for the read
+    bool uring_queue_read(PacketFrom *udpfrom)
+    {
+        typename RecvOp::Ptr op;
+        if (free_recv_ops.empty())
+            op.reset(new RecvOp());
+        else
+        {
+            op = std::move(free_recv_ops.back());
+            free_recv_ops.pop_back();
+        }
+        op->pfp.reset(udpfrom);
+        const openvpn_io::mutable_buffer mb = frame_context.mutable_buffer(udpfrom->buf);
+        op->iov.iov_base = mb.data();
+        op->iov.iov_len = mb.size();
+        std::memset(&op->msg, 0, sizeof(op->msg));
+        op->msg.msg_name = udpfrom->sender_endpoint.data();
+        op->msg.msg_namelen = static_cast<socklen_t>(udpfrom->sender_endpoint.capacity());
+        op->msg.msg_iov = &op->iov;
+        op->msg.msg_iovlen = 1;
+        if (drop_monitor)
+        {
+            op->msg.msg_control = op->control;
+            op->msg.msg_controllen = sizeof(op->control);
+        }
+        if (!ring->recvmsg(op.get(), socket.native_handle(), &op->msg))
+        {
+            op->pfp.release();
+            free_recv_ops.push_back(std::move(op));
+            return false;
+        }
+        op->link.reset(this);
+        return true;
+    }
+
+    // Queue buf for sending, or return false to send it synchronously
+    bool uring_send(const Buffer &buf, const AsioEndpoint *endpoint)
+    {
+        if (buf.size() > ring->slot_size())
+            return false;
+        const int slot = ring->alloc_slot();
+        if (slot < 0)
+            return false;
+
+        typename SendOp::Ptr op;
+        if (free_send_ops.empty())
+            op.reset(new SendOp());
+        else
+        {
+            op = std::move(free_send_ops.back());
+            free_send_ops.pop_back();
+        }
+        op->slot = slot;
+        std::memcpy(ring->slot(slot), buf.c_data(), buf.size());
+        op->iov.iov_base = ring->slot(slot);
+        op->iov.iov_len = buf.size();
+        std::memset(&op->msg, 0, sizeof(op->msg));
+        if (endpoint)
+        {
+            op->endpoint = *endpoint;
+            op->msg.msg_name = op->endpoint.data();
+            op->msg.msg_namelen = static_cast<socklen_t>(op->endpoint.size());
+        }
+        op->msg.msg_iov = &op->iov;
+        op->msg.msg_iovlen = 1;
+        if (!ring->sendmsg(op.get(), socket.native_handle(), &op->msg))
+        {
+            ring->free_slot(slot);
+            free_send_ops.push_back(std::move(op));
+            return false;
+        }
+        op->link.reset(this);
+
+        stats->inc_stat(SessionStats::BYTES_OUT, buf.size());
+        stats->inc_stat(SessionStats::PACKETS_OUT, 1);
+        return true;
+    }
+#endif
+
     openvpn_io::ip::udp::socket &socket;
     bool halt;
     ReadHandler read_handler;
     Frame::Context frame_context;
     SessionStats::Ptr stats;
+    AsioArena arena;
+
+    enum
+    {
+        RECV_BATCH = 16,
+    };
+    bool drop_monitor = false;
+    std::uint32_t rxq_ovfl_count = 0;
+    int sockbuf_max = 0; // socket buffer autotuning limit, or 0 if disabled
+    bool rcvbuf_capped = false;
+    bool sndbuf_capped = false;
 
 #ifdef OPENVPN_GREMLIN
     std::unique_ptr<Gremlin::SendRecvQueue> gremlin;
 #endif
+
+#ifdef OPENVPN_IO_URING
+    IOUring::Ptr ring;
+    int uring_n_parallel = 0;
+    PacketFrom::SPtr spare_pfp;
+    std::vector<typename RecvOp::Ptr> free_recv_ops;
+    std::vector<typename SendOp::Ptr> free_send_ops;
+#endif
 };
 } // namespace openvpn::UDPTransport
 
@@ -217,7 +217,8 @@ class TunProp
     {
         try
         {
-	const Option* o = opt.get_ptr("route-metric"); // DIRECTIVE
+	static const OptionName route_metric_name("route-metric");
+	const Option* o = opt.get_ptr(route_metric_name); // DIRECTIVE
 	if (o)
 	  {
 	    const int metric = o->get_num<int>(1);
@@ -237,7 +238,8 @@ class TunProp
     static IP::Addr route_gateway(const OptionList& opt)
     {
       IP::Addr gateway;
-      const Option* o = opt.get_ptr("route-gateway"); // DIRECTIVE
+      static const OptionName route_gateway_name("route-gateway");
+      const Option* o = opt.get_ptr(route_gateway_name); // DIRECTIVE
       if (o)
 	{
 	  gateway = IP::Addr::from_string(o->get(1, 256), "route-gateway");
@@ -296,7 +298,8 @@ class TunProp
         // get topology
         Topology top = NET30;
         {
-            const Option *o = opt.get_ptr("topology"); // DIRECTIVE
+            static const OptionName topology_name("topology");
+            const Option *o = opt.get_ptr(topology_name); // DIRECTIVE
             if (o)
             {
                 const std::string &topstr = o->get(1, 16);
@@ -312,7 +315,8 @@ class TunProp
         // configure tun interface
         {
             const Option *o;
-            o = opt.get_ptr("ifconfig"); // DIRECTIVE
+            static const OptionName ifconfig_name("ifconfig");
+            o = opt.get_ptr(ifconfig_name); // DIRECTIVE
             if (o)
             {
                 if (top == SUBNET)
@@ -360,7 +364,8 @@ class TunProp
                     throw option_error(ERR_INVALID_OPTION_VAL, "internal topology error");
             }
 
-	o = opt.get_ptr("ifconfig-ipv6"); // DIRECTIVE
+	static const OptionName ifconfig_ipv6_name("ifconfig-ipv6");
+	o = opt.get_ptr(ifconfig_ipv6_name); // DIRECTIVE
 	if (o)
 	  {
 	    // We don't check topology setting here since it doesn't really affect IPv6
@@ -442,7 +447,8 @@ class TunProp
       // add IPv4 routes
       if (ipv.v4())
 	{
-	  OptionList::IndexMap::const_iterator dopt = opt.map().find("route"); // DIRECTIVE
+	  static const OptionName route_name("route");
+	  OptionList::IndexMap::const_iterator dopt = opt.map().find(route_name); // DIRECTIVE
 	  if (dopt != opt.map().end())
 	    {
 	      for (OptionList::IndexList::const_iterator i = dopt->second.begin(); i != dopt->second.end(); ++i)
@@ -471,7 +477,8 @@ class TunProp
       // add IPv6 routes
       if (ipv.v6())
 	{
-	  OptionList::IndexMap::const_iterator dopt = opt.map().find("route-ipv6"); // DIRECTIVE
+	  static const OptionName route_ipv6_name("route-ipv6");
+	  OptionList::IndexMap::const_iterator dopt = opt.map().find(route_ipv6_name); // DIRECTIVE
 	  if (dopt != opt.map().end())
 	    {
 	      for (OptionList::IndexList::const_iterator i = dopt->second.begin(); i != dopt->second.end(); ++i)
@@ -576,7 +583,8 @@ class TunProp
         //   [dhcp-option] [PROXY_BYPASS] [server1] [server2] ...
         //   [dhcp-option] [PROXY_AUTO_CONFIG_URL] [http://...]
 
-        OptionList::IndexMap::const_iterator dopt = opt.map().find("dhcp-option"); // DIRECTIVE
+        static const OptionName dhcp_option_name("dhcp-option");
+        OptionList::IndexMap::const_iterator dopt = opt.map().find(dhcp_option_name); // DIRECTIVE
         if (dopt != opt.map().end())
         {
             std::string auto_config_url;
@@ -673,7 +681,8 @@ class TunProp
 
     static bool search_domains_exist(const OptionList& opt, const bool quiet)
     {
-      OptionList::IndexMap::const_iterator dopt = opt.map().find("dhcp-option"); // DIRECTIVE
+      static const OptionName dhcp_option_name("dhcp-option");
+      OptionList::IndexMap::const_iterator dopt = opt.map().find(dhcp_option_name); // DIRECTIVE
       if (dopt != opt.map().end())
 	{
 	  for (OptionList::IndexList::const_iterator i = dopt->second.begin(); i != dopt->second.end(); ++i)
@@ -73,6 +73,7 @@ class ClientConfig : public TunClientFactory
     bool generate_tun_builder_capture_event = false;
 
     int n_parallel = 8;
+    bool io_uring = false; // use io_uring for tun I/O if available
     Frame::Ptr frame;
     SessionStats::Ptr stats;
 
@@ -225,6 +226,13 @@ class Client : public TunClient
                                        config->stats,
                                        sd,
                                        state->iface_name));
+#ifdef OPENVPN_IO_URING
+                if (config->io_uring)
+                {
+                    if (IOUring::Ptr ring = IOUring::get(io_context))
+                        impl->use_io_uring(std::move(ring), sd);
+                }
+#endif
                 impl->start(config->n_parallel);
 
                 // signal that we are connected
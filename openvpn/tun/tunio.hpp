@@ -14,18 +14,28 @@
 #pragma once
 
 #include <utility>
+#include <vector>
+#include <deque>
+#include <iterator>
+#include <cstring>
 
 #include <openvpn/io/io.hpp>
 
+#include <openvpn/common/platform.hpp>
 #include <openvpn/common/bigmutex.hpp>
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/rc.hpp>
+#include <openvpn/asio/asioarena.hpp>
 #include <openvpn/frame/frame.hpp>
 #include <openvpn/ip/ipcommon.hpp>
 #include <openvpn/common/socktypes.hpp>
 #include <openvpn/log/sessionstats.hpp>
 #include <openvpn/tun/tunlog.hpp>
 
+#ifdef OPENVPN_PLATFORM_LINUX
+#include <openvpn/linux/iouring.hpp>
+#endif
+
 namespace openvpn {
 
 template <typename ReadHandler, typename PacketFrom, typename STREAM>
@@ -93,6 +103,21 @@ class TunIO : public RC<thread_unsafe_refcount>
                     }
                 }
 
+#ifdef OPENVPN_IO_URING
+                if (ring)
+                {
+                    if (uring_write(buf))
+                        return true;
+                    if (writes_pending || !write_backlog.empty() || !write_retry.empty())
+                    {
+                        // writing directly would overtake the queued packets
+                        OPENVPN_LOG_TUN_ERROR("TUN write error: io_uring write queue full");
+                        tun_error(Error::TUN_WRITE_ERROR, nullptr);
+                        return false;
+                    }
+                }
+#endif
+
                 // write data to tun device
                 const size_t wrote = stream->write_some(buf.const_buffer());
                 if (stats)
@@ -165,11 +190,37 @@ class TunIO : public RC<thread_unsafe_refcount>
         }
     }
 
+#ifdef OPENVPN_IO_URING
+    // Read and write the tun device through ring instead of asio.
+    // fd is the native handle of stream.  Must be called before start().
+    // fd stays non-blocking, as asio may still write to it directly.
+    void use_io_uring(IOUring::Ptr ring_arg, const int fd)
+    {
+        ring = std::move(ring_arg);
+        uring_fd = fd;
+    }
+#endif
+
     // must be called by derived class destructor
     void stop()
     {
         if (!halt)
         {
+#ifdef OPENVPN_IO_URING
+            if (ring)
+            {
+                ring->cancel_fd(uring_fd);
+                for (auto *q : {&write_backlog, &write_retry})
+                {
+                    for (auto &op : *q)
+                    {
+                        ring->free_slot(op->slot);
+                        op->link.reset();
+                    }
+                    q->clear();
+                }
+            }
+#endif
             halt = true;
             if (stream)
             {
@@ -190,6 +241,11 @@ class TunIO : public RC<thread_unsafe_refcount>
         return name_;
     }
 
+    const AsioArena::Stats &handler_arena_stats() const
+    {
+        return arena.stats();
+    }
+
   private:
     void prepend_pf_inet(Buffer &buf, const std::uint32_t value)
     {
@@ -205,13 +261,18 @@ class TunIO : public RC<thread_unsafe_refcount>
             tunfrom = new PacketFrom();
         frame_context.prepare(tunfrom->buf);
 
+#ifdef OPENVPN_IO_URING
+        if (ring && uring_queue_read(tunfrom))
+            return;
+#endif
+
         // queue read on tun device
         stream->async_read_some(frame_context.mutable_buffer(tunfrom->buf),
-                                [self = Ptr(this), tunfrom = typename PacketFrom::SPtr(tunfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
-                                {
-                                    OPENVPN_ASYNC_HANDLER;
-                                    self->handle_read(std::move(tunfrom), error, bytes_recvd);
-                                });
+                                arena.bind([self = Ptr(this), tunfrom = typename PacketFrom::SPtr(tunfrom)](const openvpn_io::error_code &error, const size_t bytes_recvd) mutable
+                                           {
+                                               OPENVPN_ASYNC_HANDLER;
+                                               self->handle_read(std::move(tunfrom), error, bytes_recvd);
+                                           }));
     }
 
     void handle_read(typename PacketFrom::SPtr pfp, const openvpn_io::error_code &error, const size_t bytes_recvd)
@@ -260,6 +321,258 @@ class TunIO : public RC<thread_unsafe_refcount>
         read_handler->tun_error_handler(errtype, error);
     }
 
+#ifdef OPENVPN_IO_URING
+    class ReadOp : public IOUring::Op
+    {
+      public:
+        typedef RCPtr<ReadOp> Ptr;
+
+        void complete(const int res, const unsigned int flags) override
+        {
+            TunIO::Ptr l(std::move(link));
+            typename PacketFrom::SPtr tunfrom(std::move(pfp));
+            l->free_read_ops.emplace_back(this);
+            if (res == -EAGAIN && !l->halt)
+            {
+                // no packet waiting on the non-blocking fd
+                l->uring_wait_read(std::move(tunfrom));
+                return;
+            }
+            openvpn_io::error_code error;
+            if (res < 0)
+                error.assign(-res, openvpn_io::system_category());
+            else if (res == 0)
+                error = openvpn_io::error::eof;
+            l->handle_read(std::move(tunfrom), error, res > 0 ? res : 0);
+        }
+
+        TunIO::Ptr link; // only set while pending
+        typename PacketFrom::SPtr pfp;
+    };
+
+    class WriteOp : public IOUring::Op
+    {
+      public:
+        typedef RCPtr<WriteOp> Ptr;
+
+        void complete(const int res, const unsigned int flags) override
+        {
+            TunIO::Ptr l(std::move(link));
+            if (!l->halt && (res == -EAGAIN || (res == -ECANCELED && !l->write_retry.empty())))
+            {
+                l->uring_retry_write(this);
+                return;
+            }
+            l->ring->free_slot(slot);
+            l->free_write_ops.emplace_back(this);
+            if (l->halt)
+                return;
+            if (--l->writes_pending == 0 && !l->write_backlog.empty() && l->write_retry.empty())
+                l->uring_flush_backlog();
+            if (res < 0)
+            {
+                // writes linked after a failed one complete with -ECANCELED
+                const openvpn_io::error_code code(-res, openvpn_io::system_category());
+                OPENVPN_LOG_TUN_ERROR("TUN write error: " << code.message());
+                l->tun_error(Error::TUN_WRITE_ERROR, &code);
+            }
+            else if (size_t(res) != size)
+            {
+                OPENVPN_LOG_TUN_ERROR("TUN partial write error");
+                l->tun_error(Error::TUN_WRITE_ERROR, nullptr);
+            }
+        }
+
+        TunIO::Ptr link; // only set while pending
+        int slot = -1;
+        size_t size = 0;
+    };
+
+    // Returns false, leaving tunfrom to the caller, if the ring has no
+    // room for the read
+    bool uring_queue_read(PacketFrom *tunfrom)
+    {
+        typename ReadOp::Ptr op;
+        if (free_read_ops.empty())
+            op.reset(new ReadOp());
+        else
+        {
+            op = std::move(free_read_ops.back());
+            free_read_ops.pop_back();
+        }
+        const openvpn_io::mutable_buffer mb = frame_context.mutable_buffer(tunfrom->buf);
+        if (!ring->read(op.get(), uring_fd, mb.data(), mb.size()))
+        {
+            free_read_ops.push_back(std::move(op));
+            return false;
+        }
+        op->pfp.reset(tunfrom);
+        op->link.reset(this);
+        return true;
+    }
+
+    // Read through the ring again once the device has a packet
+    void uring_wait_read(typename PacketFrom::SPtr tunfrom)
+    {
+        stream->async_wait(STREAM::wait_read,
+                           [self = Ptr(this), tunfrom = std::move(tunfrom)](const openvpn_io::error_code &error) mutable
+                           {
+                               if (self->halt)
+                                   return;
+                               if (error)
+                                   self->handle_read(std::move(tunfrom), error, 0);
+                               else
+                                   self->queue_read(tunfrom.release());
+                           });
+    }
+
+    // Queue buf for writing, or return false if it doesn't fit in a slot.
+    // Writes queued before the next submit are linked, so the tun device
+    // sees the packets in order even if one of them has to wait.  A write
+    // that can no longer be linked behind earlier pending ones is held
+    // back until they complete.
+    bool uring_write(const Buffer &buf)
+    {
+        if (buf.size() > ring->slot_size())
+            return false;
+        const int slot = ring->alloc_slot();
+        if (slot < 0)
+            return false;
+
+        typename WriteOp::Ptr op;
+        if (free_write_ops.empty())
+            op.reset(new WriteOp());
+        else
+        {
+            op = std::move(free_write_ops.back());
+            free_write_ops.pop_back();
+        }
+        op->slot = slot;
+        op->size = buf.size();
+        op->link.reset(this);
+        std::memcpy(ring->slot(slot), buf.c_data(), buf.size());
+
+        if (!write_backlog.empty() || !write_retry.empty() || (writes_pending && !ring->link_last(last_write)))
+            write_backlog.push_back(std::move(op));
+        else if (!uring_prep_write(op.get()))
+        {
+            if (!writes_pending)
+            {
+                // write directly instead
+                ring->free_slot(slot);
+                op->link.reset();
+                free_write_ops.push_back(std::move(op));
+                return false;
+            }
+            // queued once the pending writes complete
+            write_backlog.push_back(std::move(op));
+        }
+
+        if (stats)
+        {
+            stats->inc_stat(SessionStats::TUN_BYTES_OUT, buf.size());
+            stats->inc_stat(SessionStats::TUN_PACKETS_OUT, 1);
+        }
+        return true;
+    }
+
+    bool uring_prep_write(WriteOp *op)
+    {
+        if (!ring->write(op, uring_fd, ring->slot(op->slot), op->size))
+            return false;
+        last_write = ring->prepared();
+        ++writes_pending;
+        return true;
+    }
+
+    // Queue held-back writes as one linked chain.  The chain is cut short
+    // where it would be split by a submit, the rest is queued once it
+    // has completed.  If the ring has no room at all, the backlog is
+    // written directly.
+    void uring_flush_backlog()
+    {
+        size_t n = 0;
+        for (; n < write_backlog.size() && n < FLUSH_MAX; ++n)
+        {
+            if (n && !ring->link_last(last_write))
+                break;
+            if (!uring_prep_write(write_backlog[n].get()))
+                break;
+        }
+        write_backlog.erase(write_backlog.begin(), write_backlog.begin() + n);
+        while (!n && !write_backlog.empty() && !halt)
+        {
+            typename WriteOp::Ptr op(std::move(write_backlog.front()));
+            write_backlog.pop_front();
+            uring_write_direct(*op);
+        }
+    }
+
+    // The fd is non-blocking, so a write fails with EAGAIN if the device
+    // has no room, and the writes linked behind it are cancelled.  They
+    // are all written again, in the same order, once it has.
+    void uring_retry_write(WriteOp *op)
+    {
+        op->link.reset(this);
+        write_retry.emplace_back(op);
+        if (--writes_pending)
+            return;
+        stream->async_wait(STREAM::wait_write,
+                           [self = Ptr(this)](const openvpn_io::error_code &error)
+                           {
+                               if (self->halt)
+                                   return;
+                               if (error)
+                               {
+                                   OPENVPN_LOG_TUN_ERROR("TUN write error: " << error.message());
+                                   self->tun_error(Error::TUN_WRITE_ERROR, &error);
+                                   return;
+                               }
+                               self->write_backlog.insert(self->write_backlog.begin(),
+                                                          std::make_move_iterator(self->write_retry.begin()),
+                                                          std::make_move_iterator(self->write_retry.end()));
+                               self->write_retry.clear();
+                               self->uring_flush_backlog();
+                           });
+    }
+
+    void uring_write_direct(WriteOp &op)
+    {
+        try
+        {
+            const size_t wrote = stream->write_some(openvpn_io::buffer(ring->slot(op.slot), op.size));
+            if (wrote != op.size)
+            {
+                OPENVPN_LOG_TUN_ERROR("TUN partial write error");
+                tun_error(Error::TUN_WRITE_ERROR, nullptr);
+            }
+        }
+        catch (const openvpn_io::system_error &e)
+        {
+            OPENVPN_LOG_TUN_ERROR("TUN write exception: " << e.what());
+            const openvpn_io::error_code code(e.code());
+            tun_error(Error::TUN_WRITE_ERROR, &code);
+        }
+        ring->free_slot(op.slot);
+        op.link.reset();
+        free_write_ops.emplace_back(&op);
+    }
+
+    enum
+    {
+        FLUSH_MAX = 64,
+    };
+
+    IOUring::Ptr ring;
+    int uring_fd = -1;
+    unsigned int last_write = 0;
+    size_t writes_pending = 0;
+    std::deque<typename WriteOp::Ptr> write_backlog;
+    std::deque<typename WriteOp::Ptr> write_retry; // waiting for the device to have room
+    std::vector<typename ReadOp::Ptr> free_read_ops;
+    std::vector<typename WriteOp::Ptr> free_write_ops;
+#endif
+
     // should be set by derived class constructor
     std::string name_;
     STREAM *stream = nullptr;
@@ -269,6 +582,7 @@ class TunIO : public RC<thread_unsafe_refcount>
     ReadHandler read_handler;
     const Frame::Context frame_context;
     SessionStats::Ptr stats;
+    AsioArena arena;
 
     bool halt = false;
 };
@@ -58,7 +58,7 @@
 #include <openvpn/buffer/bufstream.hpp>
 #include <openvpn/http/reply.hpp>
 #include <openvpn/time/asiotimersafe.hpp>
-#include <openvpn/time/coarsetime.hpp>
+#include <openvpn/time/timerwheel.hpp>
 #include <openvpn/transport/tcplink.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/ws/httpcommon.hpp>
@@ -375,9 +375,12 @@ class HTTPCore : public Base, public TransportClientParent
 #ifndef USE_ASYNC_RESOLVE
           resolver(io_context_arg),
 #endif
-          connect_timer(io_context_arg),
-          general_timer(io_context_arg),
-          general_timeout_coarse(Time::Duration::binary_ms(512), Time::Duration::binary_ms(1024))
+          connect_timer(TimerWheel::get(io_context_arg), [this]()
+                        { Ptr(this)->connect_timeout_handler(); }),
+          general_timer(TimerWheel::get(io_context_arg), [this]()
+                        { Ptr(this)->general_timeout_handler(); }),
+          keepalive_timer(TimerWheel::get(io_context_arg), [this]()
+                          { Ptr(this)->keepalive_timeout_handler(); })
     {
     }
 
@@ -647,25 +650,12 @@ class HTTPCore : public Base, public TransportClientParent
 
     void activity(const bool init)
     {
-        const Time now = Time::now();
+        // cheap to call on every activity, the
+        // timer wheel defers moving the timer
         if (general_timeout_duration.defined())
-        {
-            const Time next = now + general_timeout_duration;
-            if (init || !general_timeout_coarse.similar(next))
-            {
-                general_timeout_coarse.reset(next);
-                general_timer.expires_at(next);
-                general_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
-                                         {
-					     if (!error)
-					       self->general_timeout_handler(error); });
-            }
-        }
+            general_timer.expires_at(Time::now() + general_timeout_duration);
         else if (init)
-        {
-            general_timeout_coarse.reset();
             general_timer.cancel();
-        }
     }
 
     void handle_request() // called by Asio
@@ -986,10 +976,6 @@ class HTTPCore : public Base, public TransportClientParent
             connect_timer.expires_after(Time::Duration::seconds(to.connect >= 0
                                                                     ? to.connect
                                                                     : connect_timeout));
-            connect_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
-                                     {
-					 if (!error)
-					   self->connect_timeout_handler(error); });
         }
     }
 
@@ -1025,29 +1011,25 @@ class HTTPCore : public Base, public TransportClientParent
             const Time::Duration dur = Time::Duration::seconds(to.keepalive >= 0
                                                                    ? to.keepalive
                                                                    : config->keepalive_timeout);
-            if (!keepalive_timer)
-                keepalive_timer.reset(new AsioTimerSafe(io_context));
-            keepalive_timer->expires_after(dur);
-            keepalive_timer->async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
-                                        {
-			if (!self->halt && !error && self->ready)
-			  {
-			    self->error_handler(Status::E_KEEPALIVE_TIMEOUT, "Keepalive timeout");
-			  } });
+            keepalive_timer.expires_after(dur);
         }
     }
 
     void cancel_keepalive_timer()
     {
-        if (keepalive_timer)
-            keepalive_timer->cancel();
+        keepalive_timer.cancel();
+    }
+
+    void keepalive_timeout_handler()
+    {
+        if (!halt && ready)
+            error_handler(Status::E_KEEPALIVE_TIMEOUT, "Keepalive timeout");
     }
 
     void reset_general_timeout(const unsigned int seconds,
                                const bool register_activity_on_input_only_arg)
     {
         general_timeout_duration = Time::Duration::seconds(seconds);
-        general_timeout_coarse.reset();
         activity(true);
         register_activity_on_input_only = register_activity_on_input_only_arg;
     }
@@ -1059,15 +1041,15 @@ class HTTPCore : public Base, public TransportClientParent
         register_activity_on_input_only = false;
     }
 
-    void general_timeout_handler(const openvpn_io::error_code &e) // called by Asio
+    void general_timeout_handler() // called by TimerWheel
     {
-        if (!halt && !e)
+        if (!halt)
             error_handler(Status::E_GENERAL_TIMEOUT, "General timeout");
     }
 
-    void connect_timeout_handler(const openvpn_io::error_code &e) // called by Asio
+    void connect_timeout_handler() // called by TimerWheel
     {
-        if (!halt && !e)
+        if (!halt)
             error_handler(Status::E_CONNECT_TIMEOUT, "Connect timeout");
     }
 
@@ -1414,13 +1396,12 @@ class HTTPCore : public Base, public TransportClientParent
 
     TransportClient::Ptr transcli;
 
-    AsioTimerSafe connect_timer;
-    AsioTimerSafe general_timer;
+    TimerWheel::Timer connect_timer;
+    TimerWheel::Timer general_timer;
+    TimerWheel::Timer keepalive_timer;
     std::unique_ptr<AsioTimerSafe> req_timer;
-    std::unique_ptr<AsioTimerSafe> keepalive_timer;
 
     Time::Duration general_timeout_duration;
-    CoarseTime general_timeout_coarse;
     bool register_activity_on_input_only = false;
 
     bool content_out_hold = true;
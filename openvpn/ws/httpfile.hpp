@@ -0,0 +1,148 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// HTTP content sourced from a file descriptor.  On Linux, plaintext
+// TCP listeners transmit it with sendfile(), avoiding the copy through
+// userspace and the link send queue.  Otherwise it is read in large
+// chunks into a buffer recycled by the caller.
+
+#pragma once
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <cstdint>
+
+#include <openvpn/common/platform.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/scoped_fd.hpp>
+#include <openvpn/common/strerror.hpp>
+#include <openvpn/buffer/buffer.hpp>
+
+#ifdef OPENVPN_PLATFORM_LINUX
+#include <sys/sendfile.h>
+#endif
+
+namespace openvpn::WS {
+
+class FileContent : public RC<thread_unsafe_refcount>
+{
+  public:
+    typedef RCPtr<FileContent> Ptr;
+
+    OPENVPN_EXCEPTION(http_file_content_error);
+
+    // Transmit length bytes of fd starting at offset.
+    FileContent(ScopedFD &&fd_arg,
+                const std::uint64_t offset_arg,
+                const std::uint64_t length_arg)
+        : fd(std::move(fd_arg)),
+          offset(offset_arg),
+          remaining_(length_arg)
+    {
+    }
+
+    // Open the file at path for transmission in its entirety.
+    static Ptr open(const std::string &path)
+    {
+        ScopedFD fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd.defined())
+        {
+            const int eno = errno;
+            throw http_file_content_error(path + " : open : " + strerror_str(eno));
+        }
+        struct stat st;
+        if (::fstat(fd(), &st) < 0)
+        {
+            const int eno = errno;
+            throw http_file_content_error(path + " : fstat : " + strerror_str(eno));
+        }
+        return new FileContent(std::move(fd), 0, std::uint64_t(st.st_size));
+    }
+
+    // Bytes not yet transmitted
+    std::uint64_t remaining() const
+    {
+        return remaining_;
+    }
+
+    bool done() const
+    {
+        return remaining_ == 0;
+    }
+
+    // Append up to buf.remaining() bytes of the file to buf.
+    // Returns the number of bytes read.
+    size_t read(Buffer &buf)
+    {
+        size_t want = buf.remaining();
+        if (want > remaining_)
+            want = static_cast<size_t>(remaining_);
+        if (!want)
+            return 0;
+        const ssize_t len = ::pread(fd(), buf.data_end(), want, static_cast<off_t>(offset));
+        if (len < 0)
+        {
+            const int eno = errno;
+            throw http_file_content_error("pread : " + strerror_str(eno));
+        }
+        if (len == 0)
+            throw http_file_content_error("pread : unexpected end of file");
+        buf.inc_size(len);
+        advance(len);
+        return len;
+    }
+
+#ifdef OPENVPN_PLATFORM_LINUX
+    // Transmit up to max_bytes directly from the file to the non-blocking
+    // socket sd.  Returns the number of bytes sent, or 0 if the socket
+    // would block.
+    size_t sendfile(const int sd, const size_t max_bytes)
+    {
+        size_t want = max_bytes;
+        if (want > remaining_)
+            want = static_cast<size_t>(remaining_);
+        if (!want)
+            return 0;
+        off_t off = static_cast<off_t>(offset);
+        const ssize_t len = ::sendfile(sd, fd(), &off, want);
+        if (len < 0)
+        {
+            const int eno = errno;
+            if (eno == EAGAIN || eno == EWOULDBLOCK || eno == EINTR)
+                return 0;
+            throw http_file_content_error("sendfile : " + strerror_str(eno));
+        }
+        if (len == 0)
+            throw http_file_content_error("sendfile : unexpected end of file");
+        advance(len);
+        return len;
+    }
+#endif
+
+  private:
+    void advance(const size_t len)
+    {
+        offset += len;
+        remaining_ -= len;
+    }
+
+    ScopedFD fd;
+    std::uint64_t offset;
+    std::uint64_t remaining_;
+};
+
+} // namespace openvpn::WS
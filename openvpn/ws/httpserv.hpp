@@ -34,7 +34,7 @@
 #include <openvpn/buffer/bufstream.hpp>
 #include <openvpn/time/timestr.hpp>
 #include <openvpn/time/asiotimersafe.hpp>
-#include <openvpn/time/coarsetime.hpp>
+#include <openvpn/time/timerwheel.hpp>
 #include <openvpn/addr/ip.hpp>
 #include <openvpn/log/sessionstats.hpp>
 #include <openvpn/options/merge.hpp>
@@ -47,6 +47,10 @@
 #include <openvpn/ws/websocket.hpp>
 #include <openvpn/server/listenlist.hpp>
 
+#if !defined(OPENVPN_PLATFORM_WIN)
+#include <openvpn/ws/httpfile.hpp>
+#endif
+
 #ifdef VPN_BINDING_PROFILES
 #include <openvpn/ws/httpvpn.hpp>
 #endif
@@ -70,6 +74,11 @@
 #define OPENVPN_HTTP_SERV_RC RC<thread_unsafe_refcount>
 #endif
 
+// transmit file content on plaintext TCP connections with sendfile()
+#if defined(OPENVPN_PLATFORM_LINUX) && !defined(OPENVPN_POLYSOCK_SUPPORTS_ALT_ROUTING)
+#define OPENVPN_HTTP_SERV_SENDFILE
+#endif
+
 namespace openvpn::WS::Server {
 
 OPENVPN_EXCEPTION(http_server_exception);
@@ -148,7 +157,11 @@ struct Config : public RC<thread_unsafe_refcount>
     unsigned int send_queue_max_size = 0;
     unsigned int free_list_max_size = 8;
     unsigned int pipeline_max_size = 64;
-    unsigned int sockopt_flags = 0;
+    unsigned int sockopt_flags = 0;    // Acceptor::TCP flags, e.g. REUSE_PORT, DEFER_ACCEPT, FASTOPEN
+    int tcp_defer_accept_seconds = 10; // used with Acceptor::TCP::DEFER_ACCEPT
+    int tcp_fastopen_qlen = 256;       // used with Acceptor::TCP::FASTOPEN
+    size_t file_chunk_size = 65536;    // read size for file content not sent with sendfile()
+    bool file_sendfile = true;         // use sendfile() for file content where possible
     std::string http_server_id;
     Frame::Ptr frame;
     SessionStats::Ptr stats;
@@ -170,6 +183,9 @@ struct ContentInfo
     bool lean_headers = false;
     std::vector<std::string> extra_headers;
     WebSocket::Server::PerRequest::Ptr websocket;
+#if !defined(OPENVPN_PLATFORM_WIN)
+    FileContent::Ptr file; // if defined, transmit this as content, length is set from it
+#endif
 };
 
 class Listener : public ProxyListener
@@ -285,7 +301,8 @@ class Listener : public ProxyListener
               io_context(ci.io_context),
               sock(std::move(ci.socket)),
               parent(ci.parent),
-              timeout_timer(ci.io_context),
+              timeout_timer(TimerWheel::get(ci.io_context), [this]()
+                            { Ptr(this)->timeout_callback(); }),
               client_id(ci.client_id)
         {
         }
@@ -295,6 +312,10 @@ class Listener : public ProxyListener
             http_out_begin();
 
             content_info = std::move(ci);
+#if !defined(OPENVPN_PLATFORM_WIN)
+            if (content_info.file)
+                file_out_begin();
+#endif
 
             outbuf = BufferAllocatedRc::Create(512, BufAllocFlags::GROW);
             BufferStreamOut os(*outbuf);
@@ -456,7 +477,6 @@ class Listener : public ProxyListener
 
         void start(const Acceptor::Item::SSLMode ssl_mode)
         {
-            timeout_coarse.init(Time::Duration::binary_ms(512), Time::Duration::binary_ms(1024));
             link.reset(new LinkImpl(this,
                                     *sock,
                                     parent->config->send_queue_max_size,
@@ -483,7 +503,6 @@ class Listener : public ProxyListener
         void restart(const bool initial)
         {
             timeout_duration = Time::Duration::seconds(parent->config->general_timeout);
-            timeout_coarse.reset();
             activity();
             rr_reset();
             ready = false;
@@ -517,25 +536,15 @@ class Listener : public ProxyListener
 
         void activity()
         {
+            // cheap to call on every activity, the
+            // timer wheel defers moving the timer
             if (timeout_duration.defined())
-            {
-                const Time now = Time::now();
-                const Time next = now + timeout_duration;
-                if (!timeout_coarse.similar(next))
-                {
-                    timeout_coarse.reset(next);
-                    timeout_timer.expires_at(next);
-                    timeout_timer.async_wait([self = Ptr(this)](const openvpn_io::error_code &error)
-                                             {
-					       if (!error)
-						 self->timeout_callback(error); });
-                }
-            }
+                timeout_timer.expires_at(Time::now() + timeout_duration);
         }
 
-        void timeout_callback(const openvpn_io::error_code &e)
+        void timeout_callback()
         {
-            if (halt || e)
+            if (halt)
                 return;
             error_handler(Status::E_GENERAL_TIMEOUT, "General timeout");
         }
@@ -600,6 +609,13 @@ class Listener : public ProxyListener
 
             try
             {
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+                if (file_direct && is_deferred())
+                {
+                    file_send_direct();
+                    return;
+                }
+#endif
                 http_out();
             }
             catch (const std::exception &e)
@@ -635,14 +651,132 @@ class Listener : public ProxyListener
 
         BufferPtr base_http_content_out()
         {
+#if !defined(OPENVPN_PLATFORM_WIN)
+            if (content_info.file)
+                return file_content_out();
+#endif
             return http_content_out();
         }
 
         void base_http_content_out_needed()
         {
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+            if (file_direct)
+            {
+                file_send_direct();
+                return;
+            }
+#endif
             http_content_out_needed();
         }
 
+#if !defined(OPENVPN_PLATFORM_WIN)
+        // file content
+
+        void file_out_begin()
+        {
+            content_info.length = content_info.file->remaining();
+            file_saved_async_out = async_out;
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+            // Zero-copy path: plaintext TCP only, as TLS must see the cleartext
+            if (!ssl_sess && content_info.length > 0 && parent->config->file_sendfile)
+            {
+                file_tcp = dynamic_cast<AsioPolySock::TCP *>(sock.get());
+                if (file_tcp)
+                {
+                    file_tcp->socket.native_non_blocking(true);
+                    file_direct = true;
+                    set_async_out(true); // content is pushed by file_send_direct()
+                    return;
+                }
+            }
+#endif
+            set_async_out(false); // content is pulled by file_content_out()
+        }
+
+        void file_out_end()
+        {
+            content_info.file.reset();
+            if (file_chunk)
+                parent->file_chunk_release(std::move(file_chunk));
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+            file_direct = false;
+            file_tcp = nullptr;
+#endif
+            set_async_out(file_saved_async_out);
+        }
+
+        // read the next chunk of file content into a pooled buffer
+        BufferPtr file_content_out()
+        {
+            FileContent &file = *content_info.file;
+            if (file.done())
+            {
+                file_out_end();
+                return BufferPtr();
+            }
+            if (!file_chunk)
+                file_chunk = parent->file_chunk_acquire();
+            file_chunk->reset_content();
+            file.read(*file_chunk);
+            return file_chunk;
+        }
+
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+        // push file content to the socket with sendfile() until it would block
+        void file_send_direct()
+        {
+            if (halt || file_wait_pending)
+                return;
+
+            // let queued output such as the reply headers drain first,
+            // tcp_write_queue_needs_send() calls back here when it has
+            if (!link->send_queue_empty())
+                return;
+
+            FileContent &file = *content_info.file;
+            const int sd = file_tcp->socket.native_handle();
+            while (!file.done())
+            {
+                const size_t sent = file.sendfile(sd, parent->config->file_chunk_size * 16);
+                if (!sent)
+                {
+                    file_wait_pending = true;
+                    file_tcp->socket.async_wait(openvpn_io::ip::tcp::socket::wait_write,
+                                                [self = Ptr(this)](const openvpn_io::error_code &error)
+                                                { self->file_send_direct_ready(error); });
+                    return;
+                }
+                stats->inc_stat(SessionStats::BYTES_OUT, sent);
+                activity();
+            }
+
+            file_out_end();
+            http_content_out_finish(BufferPtr());
+        }
+
+        void file_send_direct_ready(const openvpn_io::error_code &error)
+        {
+            file_wait_pending = false;
+            if (halt)
+                return;
+            if (error)
+            {
+                asio_error_handler(Status::E_TCP, "file_send_direct", error);
+                return;
+            }
+            try
+            {
+                file_send_direct();
+            }
+            catch (const std::exception &e)
+            {
+                handle_exception("file_send_direct", e);
+            }
+        }
+#endif
+#endif
+
         void base_http_out_eof()
         {
             if (http_out_eof())
@@ -757,14 +891,23 @@ class Listener : public ProxyListener
         }
 
         Listener *parent;
-        AsioTimerSafe timeout_timer;
-        CoarseTime timeout_coarse;
+        TimerWheel::Timer timeout_timer;
         client_t client_id;
         LinkImpl::Ptr link;
         bool keepalive = false;
         bool handoff = false;
         bool http_stop_called = false;
 
+#if !defined(OPENVPN_PLATFORM_WIN)
+        BufferPtr file_chunk;
+        bool file_saved_async_out = false;
+#endif
+#ifdef OPENVPN_HTTP_SERV_SENDFILE
+        AsioPolySock::TCP *file_tcp = nullptr;
+        bool file_direct = false;
+        bool file_wait_pending = false;
+#endif
+
 #ifdef OPENVPN_POLYSOCK_SUPPORTS_ALT_ROUTING
         bool is_alt_routing_ = false;
 #endif
@@ -786,6 +929,32 @@ class Listener : public ProxyListener
     {
     }
 
+    // Make this listener one of n_shards listeners sharing the same
+    // listen addresses, each running on its own thread/io_context
+    // (such as a RunContext unit).  TCP listen sockets are opened with
+    // SO_REUSEPORT so the kernel balances incoming connections across
+    // shards, and client IDs are allocated so that they stay unique
+    // over all shards.  Must be called before start().
+    void set_shard(const unsigned int unit, const unsigned int n_shards)
+    {
+        if (!n_shards || unit >= n_shards)
+            throw http_server_exception("bad shard unit/count");
+        shard_unit = unit;
+        shard_count = n_shards;
+    }
+
+    // The index-th client ID of shard unit out of n_shards.  IDs are
+    // unit + k * n_shards, so each shard owns its own residue class mod
+    // n_shards and two shards can never hand out the same ID.  k is the
+    // index taken mod client_t(-1) / n_shards, which keeps the largest
+    // ID below client_t(-1): were the product allowed to wrap instead,
+    // the ID would land in another shard's class whenever n_shards is
+    // not a power of two.
+    static client_t shard_client_id(const client_t index, const unsigned int unit, const unsigned int n_shards)
+    {
+        return (index % (client_t(-1) / n_shards)) * n_shards + unit;
+    }
+
     void start() override
     {
         if (halt)
@@ -839,7 +1008,12 @@ class Listener : public ProxyListener
                     a->acceptor.open(a->local_endpoint.protocol());
 
                     // set options
-                    a->set_socket_options(config->sockopt_flags);
+                    unsigned int sockopt_flags = config->sockopt_flags;
+                    if (shard_count > 1)
+                        sockopt_flags |= Acceptor::TCP::REUSE_PORT;
+                    a->set_socket_options(sockopt_flags,
+                                          config->tcp_defer_accept_seconds,
+                                          config->tcp_fastopen_qlen);
 
                     // bind to local address
 #ifdef OPENVPN_DEBUG_ACCEPT
@@ -876,6 +1050,11 @@ class Listener : public ProxyListener
 #ifdef ASIO_HAS_LOCAL_SOCKETS
             case Protocol::UnixStream:
                 {
+                    // a pathname can only be bound once, so only
+                    // the first shard listens on it
+                    if (shard_unit)
+                        break;
+
                     OPENVPN_LOG("HTTP Listen: " << listen_item.to_string());
 
                     Acceptor::Unix::Ptr a(new Acceptor::Unix(io_context));
@@ -941,6 +1120,27 @@ class Listener : public ProxyListener
   private:
     typedef std::unordered_map<client_t, Client::Ptr> ClientMap;
 
+#if !defined(OPENVPN_PLATFORM_WIN)
+    // recycled read buffers for file content
+
+    BufferPtr file_chunk_acquire()
+    {
+        if (!file_chunk_pool.empty())
+        {
+            BufferPtr ret = std::move(file_chunk_pool.back());
+            file_chunk_pool.pop_back();
+            return ret;
+        }
+        return BufferAllocatedRc::Create(config->file_chunk_size, 0);
+    }
+
+    void file_chunk_release(BufferPtr &&buf)
+    {
+        if (file_chunk_pool.size() < config->free_list_max_size)
+            file_chunk_pool.push_back(std::move(buf));
+    }
+#endif
+
     void queue_accept(const size_t acceptor_index)
     {
         acceptors[acceptor_index].acceptor->async_accept(this, acceptor_index, io_context);
@@ -1063,8 +1263,9 @@ class Listener : public ProxyListener
     {
         while (true)
         {
-            // find an ID that's not already in use
-            const client_t id = next_id++;
+            // find an ID that's not already in use, and
+            // that belongs to our shard
+            const client_t id = shard_client_id(next_id++, shard_unit, shard_count);
             if (clients.find(id) == clients.end())
                 return id;
         }
@@ -1115,8 +1316,14 @@ class Listener : public ProxyListener
     int throttle_connections = 0;
     std::deque<size_t> throttle_acceptor_indices;
 
+    unsigned int shard_unit = 0;
+    unsigned int shard_count = 1;
     client_t next_id = 0;
     ClientMap clients;
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+    std::vector<BufferPtr> file_chunk_pool;
+#endif
 };
 
 } // namespace openvpn::WS::Server
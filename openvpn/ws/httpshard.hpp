@@ -0,0 +1,187 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+// Run an HTTP server as several independent shards, one per thread,
+// each with its own io_context, listen sockets and client map.  TCP
+// listen sockets are shared between shards with SO_REUSEPORT, so the
+// kernel spreads incoming connections over the threads and accept and
+// request handling scale across cores.
+//
+// Nothing calls set_shard() automatically: a server that runs its own
+// threads, such as RunContext units, can shard a listener the same way
+// by calling set_shard(unit, n_units) on it before start().
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <exception>
+#include <utility>
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/ws/httpserv.hpp>
+
+namespace openvpn::WS::Server {
+
+class ShardedListener : public RC<thread_safe_refcount>
+{
+  public:
+    typedef RCPtr<ShardedListener> Ptr;
+
+    // Called on the shard thread to construct the listener of each unit.
+    // Listener, Config, SessionStats and client factory are not thread
+    // safe, so each shard should be given its own instances.
+    typedef std::function<Listener::Ptr(openvpn_io::io_context &io_context, const unsigned int unit)> Factory;
+
+    ShardedListener(const unsigned int n_shards, Factory factory_arg)
+        : factory(std::move(factory_arg))
+    {
+        if (!n_shards)
+            throw http_server_exception("sharded listener needs at least one shard");
+        shards.reserve(n_shards);
+        for (unsigned int i = 0; i < n_shards; ++i)
+            shards.emplace_back(new Shard());
+    }
+
+    ~ShardedListener()
+    {
+        stop();
+        join();
+    }
+
+    // Start all shards and wait until each has opened its listen
+    // sockets.  If any shard fails to start, all are stopped and the
+    // first error is rethrown.
+    void start()
+    {
+        const unsigned int n_shards = size();
+        std::vector<std::future<void>> started;
+        started.reserve(n_shards);
+        for (unsigned int unit = 0; unit < n_shards; ++unit)
+        {
+            std::promise<void> promise;
+            started.push_back(promise.get_future());
+            shards[unit]->thread.reset(new std::thread([this, unit, n_shards, promise = std::move(promise)]() mutable
+                                                       { run_shard(unit, n_shards, promise); }));
+        }
+
+        std::exception_ptr err;
+        for (auto &f : started)
+        {
+            try
+            {
+                f.get();
+            }
+            catch (...)
+            {
+                if (!err)
+                    err = std::current_exception();
+            }
+        }
+        if (err)
+        {
+            stop();
+            join();
+            std::rethrow_exception(err);
+        }
+    }
+
+    // Thread safe
+    void stop()
+    {
+        for (auto &s : shards)
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            s->halt = true;
+            // Listener::Ptr is not thread safe, so the listener is only
+            // touched on the shard thread
+            if (s->io_context && s->listener)
+                openvpn_io::post(*s->io_context, [&shard = *s]()
+                                 {
+                    if (shard.listener)
+                        shard.listener->stop(); });
+        }
+    }
+
+    void join()
+    {
+        for (auto &s : shards)
+        {
+            if (s->thread && s->thread->joinable())
+                s->thread->join();
+        }
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(shards.size());
+    }
+
+  private:
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unique_ptr<std::thread> thread;
+        openvpn_io::io_context *io_context = nullptr;
+        Listener::Ptr listener;
+        bool halt = false;
+    };
+
+    void run_shard(const unsigned int unit, const unsigned int n_shards, std::promise<void> &started)
+    {
+        Shard &s = *shards[unit];
+        openvpn_io::io_context io_context(1);
+        try
+        {
+            Listener::Ptr listener = factory(io_context, unit);
+            listener->set_shard(unit, n_shards);
+            listener->start();
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.io_context = &io_context;
+                s.listener = listener;
+                if (s.halt)
+                    listener->stop();
+            }
+            started.set_value();
+        }
+        catch (...)
+        {
+            started.set_exception(std::current_exception());
+            return;
+        }
+
+        try
+        {
+            io_context.run();
+        }
+        catch (const std::exception &e)
+        {
+            OPENVPN_LOG("HTTP shard " << unit << " exception: " << e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.io_context = nullptr;
+        s.listener.reset();
+    }
+
+    Factory factory;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+} // namespace openvpn::WS::Server
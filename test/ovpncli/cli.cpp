@@ -15,6 +15,7 @@
 
 #include <string>
 #include <iostream>
+#include <atomic>
 #include <thread>
 #include <memory>
 #include <mutex>
@@ -1074,6 +1075,16 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
         { "remote-override",required_argument,  nullptr,       5  },
 #endif
         { "tbc",            no_argument,        nullptr,       6  },
+        { "io-uring",       no_argument,        nullptr,       7  },
+        { "tcp-queue-aqm",  no_argument,        nullptr,       8  },
+        { "udp-sockbuf-max", required_argument, nullptr,       9  },
+        { "warm-standby",   no_argument,        nullptr,       10 },
+        { "dns-cache",      no_argument,        nullptr,       11 },
+        { "pcap",           required_argument,  nullptr,       12 },
+        { "pcap-snaplen",   required_argument,  nullptr,       13 },
+        { "async-events",   no_argument,        nullptr,       14 },
+        { "tcp-prewarm",    no_argument,        nullptr,       15 },
+        { "udp-drop-monitor", no_argument,      nullptr,       16 },
         { "app-custom-protocols", required_argument, nullptr, 'K' },
         { "certcheck-cert", required_argument, nullptr, 'o' },
         { "certcheck-pkey", required_argument, nullptr, 'O' },
@@ -1137,6 +1148,16 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
             bool dco = false;
 #endif
             bool generateTunBuilderCaptureEvent = false;
+            bool ioUring = false;
+            bool tcpQueueAqm = false;
+            bool udpDropMonitor = false;
+            int udpSockBufMax = 0;
+            bool warmStandby = false;
+            bool tcpPrewarm = false;
+            bool dnsCache = false;
+            std::string packetCapture;
+            int packetCaptureSnaplen = 0;
+            bool asyncEvents = false;
             std::string epki_cert_fn;
             std::string epki_ca_fn;
             std::string epki_key_fn;
@@ -1173,6 +1194,36 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
                 case 6: // --tbc
                     generateTunBuilderCaptureEvent = true;
                     break;
+                case 7: // --io-uring
+                    ioUring = true;
+                    break;
+                case 8: // --tcp-queue-aqm
+                    tcpQueueAqm = true;
+                    break;
+                case 16: // --udp-drop-monitor
+                    udpDropMonitor = true;
+                    break;
+                case 9: // --udp-sockbuf-max
+                    udpSockBufMax = ::atoi(optarg);
+                    break;
+                case 10: // --warm-standby
+                    warmStandby = true;
+                    break;
+                case 15: // --tcp-prewarm
+                    tcpPrewarm = true;
+                    break;
+                case 11: // --dns-cache
+                    dnsCache = true;
+                    break;
+                case 12: // --pcap
+                    packetCapture = optarg;
+                    break;
+                case 13: // --pcap-snaplen
+                    packetCaptureSnaplen = ::atoi(optarg);
+                    break;
+                case 14: // --async-events
+                    asyncEvents = true;
+                    break;
                 case 'e':
                     eval = true;
                     break;
@@ -1376,6 +1427,16 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
                     config.altProxy = altProxy;
                     config.dco = dco;
                     config.generateTunBuilderCaptureEvent = generateTunBuilderCaptureEvent;
+                    config.ioUring = ioUring;
+                    config.tcpQueueAqm = tcpQueueAqm;
+                    config.udpDropMonitor = udpDropMonitor;
+                    config.udpSockBufMax = udpSockBufMax;
+                    config.warmStandby = warmStandby;
+                    config.tcpPrewarm = tcpPrewarm;
+                    config.dnsCache = dnsCache;
+                    config.packetCapture = packetCapture;
+                    config.packetCaptureSnaplen = packetCaptureSnaplen;
+                    config.asyncEvents = asyncEvents;
                     config.defaultKeyDirection = defaultKeyDirection;
                     config.sslDebugLevel = sslDebugLevel;
                     config.googleDnsFallback = googleDnsFallback;
@@ -1533,9 +1594,29 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
 
                         std::cout << "CONNECTING..." << std::endl;
 
+                        // deliver events from a thread of our own
+                        std::atomic<bool> events_done{false};
+                        std::unique_ptr<std::thread> events_thread;
+                        if (asyncEvents)
+                            events_thread.reset(new std::thread([&client, &events_done]()
+                                                                {
+                                while (!events_done.load())
+                                    client.deliver_events(250);
+                                client.deliver_events(0); }));
+
                         // start the client thread
                         start_thread(client);
 
+                        if (events_thread)
+                        {
+                            events_done.store(true);
+                            events_thread->join();
+                            const ClientAPI::EventQueueStats eqs = client.event_queue_stats();
+                            std::cout << "EVENT QUEUE: delivered=" << eqs.delivered << " coalesced=" << eqs.coalesced
+                                      << " dropped=" << eqs.dropped << " lag mean/max us=" << eqs.meanLagUsec
+                                      << '/' << eqs.maxLagUsec << std::endl;
+                        }
+
                         // Get dynamic challenge response
                         if (client.is_dynamic_challenge())
                         {
@@ -1625,6 +1706,16 @@ int openvpn_client(int argc, char *argv[], const std::string *profile_content)
         std::cout << "--sso-methods              : auth pending methods to announce via IV_SSO" << std::endl;
         std::cout << "--write-url, -Z            : write INFO URL to file" << std::endl;
         std::cout << "--tbc                      : generate INFO_JSON/TUN_BUILDER_CAPTURE event" << std::endl;
+        std::cout << "--io-uring                 : use io_uring for UDP and tun I/O (Linux)" << std::endl;
+        std::cout << "--tcp-queue-aqm            : schedule TCP transport packets with FQ-CoDel" << std::endl;
+        std::cout << "--udp-drop-monitor         : count UDP datagrams dropped by the kernel (Linux)" << std::endl;
+        std::cout << "--udp-sockbuf-max          : grow UDP socket buffers up to this many bytes on drops" << std::endl;
+        std::cout << "--warm-standby             : keep a standby session to the next remote for failover" << std::endl;
+        std::cout << "--tcp-prewarm              : connect to the next TCP remote while UDP is tried" << std::endl;
+        std::cout << "--dns-cache                : answer repeated queries to pushed DNS servers locally" << std::endl;
+        std::cout << "--pcap <file>              : capture packet headers to a pcapng file" << std::endl;
+        std::cout << "--pcap-snaplen <bytes>     : bytes captured per packet (default 128)" << std::endl;
+        std::cout << "--async-events             : deliver events from a separate thread" << std::endl;
         std::cout << "--app-custom-protocols, -K : ACC protocols to advertise" << std::endl;
         std::cout << "--certcheck-cert, -o       : path to certificate PEM for certcheck" << std::endl;
         std::cout << "--certcheck-pkey, -O       : path to decrypted pkey PEM for certcheck" << std::endl;
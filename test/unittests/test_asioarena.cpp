@@ -0,0 +1,216 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <functional>
+
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/asio/asioarena.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/transport/udplink.hpp>
+#include <openvpn/tun/tunio.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+const size_t WARMUP = 100;
+const size_t N_PACKETS = 2000;
+
+// Arena counters sampled once the links have warmed up
+struct Sample
+{
+    AsioArena::Stats begin;
+    AsioArena::Stats end;
+};
+
+class UDPPeer
+{
+  public:
+    typedef UDPTransport::UDPLink<UDPPeer *> Link;
+
+    UDPPeer(openvpn_io::io_context &io_context, const Frame::Ptr &frame)
+        : socket(io_context)
+    {
+        socket.open(openvpn_io::ip::udp::v4());
+        socket.bind(UDPTransport::AsioEndpoint(openvpn_io::ip::address_v4::loopback(), 0));
+        link.reset(new Link(this, socket, (*frame)[Frame::READ_LINK_UDP], SessionStats::Ptr(new SessionStats())));
+    }
+
+    void udp_read_handler(UDPTransport::PacketFrom::SPtr &pfp)
+    {
+        recv();
+    }
+
+    openvpn_io::ip::udp::socket socket;
+    Link::Ptr link;
+    std::function<void()> recv;
+};
+
+struct TunPacketFrom
+{
+    typedef std::unique_ptr<TunPacketFrom> SPtr;
+    BufferAllocated buf;
+};
+
+struct TunPeer;
+
+class TestTun : public TunIO<TunPeer *, TunPacketFrom, openvpn_io::posix::stream_descriptor>
+{
+    typedef TunIO<TunPeer *, TunPacketFrom, openvpn_io::posix::stream_descriptor> Base;
+
+  public:
+    typedef RCPtr<TestTun> Ptr;
+
+    TestTun(openvpn_io::io_context &io_context, TunPeer *handler, const Frame::Ptr &frame, const int fd)
+        : Base(handler, frame, SessionStats::Ptr(new SessionStats()))
+    {
+        Base::name_ = "test";
+        Base::stream = new openvpn_io::posix::stream_descriptor(io_context, fd);
+    }
+
+    ~TestTun()
+    {
+        Base::stop();
+    }
+};
+
+struct TunPeer
+{
+    void tun_read_handler(TunPacketFrom::SPtr &pfp)
+    {
+        recv();
+    }
+
+    void tun_error_handler(const Error::Type errtype, const openvpn_io::error_code *error)
+    {
+    }
+
+    std::function<void()> recv;
+};
+
+} // namespace
+
+TEST(asioarena, recycle)
+{
+    AsioArena arena;
+    AsioArena::Allocator<char> alloc(arena);
+
+    char *a = alloc.allocate(100);
+    char *b = alloc.allocate(AsioArena::BLOCK_BYTES);
+    alloc.deallocate(a, 100);
+    alloc.deallocate(b, AsioArena::BLOCK_BYTES);
+    EXPECT_EQ(arena.stats().heap_allocs, 2u);
+
+    // freed blocks are reused for any request that fits
+    char *c = alloc.allocate(8);
+    char *d = alloc.allocate(200);
+    EXPECT_TRUE((c == a && d == b) || (c == b && d == a));
+    EXPECT_EQ(arena.stats().heap_allocs, 2u);
+
+    // oversized requests always go to the heap
+    char *e = alloc.allocate(AsioArena::BLOCK_BYTES + 1);
+    alloc.deallocate(e, AsioArena::BLOCK_BYTES + 1);
+    EXPECT_EQ(arena.stats().heap_allocs, 3u);
+    EXPECT_EQ(arena.stats().allocs, 5u);
+
+    alloc.deallocate(c, 8);
+    alloc.deallocate(d, 200);
+}
+
+// Each UDP packet received costs one arena allocation for the next
+// read, and no heap allocations once the link has warmed up.
+TEST(asioarena, udp_link)
+{
+    openvpn_io::io_context io_context(1);
+    const Frame::Ptr frame(frame_init_simple(2048));
+    UDPPeer a(io_context, frame);
+    UDPPeer b(io_context, frame);
+    a.socket.connect(b.socket.local_endpoint());
+
+    BufferAllocated buf(64, 0);
+    buf.write(reinterpret_cast<const unsigned char *>("ping"), 4);
+
+    Sample s;
+    size_t received = 0;
+    b.recv = [&]()
+    {
+        ++received;
+        if (received == WARMUP)
+            s.begin = b.link->handler_arena_stats();
+        else if (received == WARMUP + N_PACKETS)
+        {
+            s.end = b.link->handler_arena_stats();
+            a.link->stop();
+            b.link->stop();
+            a.socket.close();
+            b.socket.close();
+            return;
+        }
+        a.link->send(buf, nullptr);
+    };
+
+    a.link->start(4);
+    b.link->start(4);
+    openvpn_io::post(io_context, [&]()
+                     { a.link->send(buf, nullptr); });
+    io_context.run();
+
+    ASSERT_EQ(received, WARMUP + N_PACKETS);
+    EXPECT_EQ(s.end.allocs - s.begin.allocs, N_PACKETS);
+    EXPECT_EQ(s.end.heap_allocs, s.begin.heap_allocs);
+    EXPECT_LE(s.end.heap_allocs, 4u);
+}
+
+// The same for tun reads, with a datagram socket pair in place of the
+// tun device.
+TEST(asioarena, tun)
+{
+    openvpn_io::io_context io_context(1);
+    int sv[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+
+    const Frame::Ptr frame(frame_init_simple(2048));
+    TunPeer peer;
+    TestTun::Ptr tun(new TestTun(io_context, &peer, frame, sv[0]));
+
+    const unsigned char ping[] = {0x45, 0, 0, 4};
+    Sample s;
+    size_t received = 0;
+    peer.recv = [&]()
+    {
+        ++received;
+        if (received == WARMUP)
+            s.begin = tun->handler_arena_stats();
+        else if (received == WARMUP + N_PACKETS)
+        {
+            s.end = tun->handler_arena_stats();
+            tun->stop();
+            return;
+        }
+        ASSERT_EQ(::send(sv[1], ping, sizeof(ping), 0), ssize_t(sizeof(ping)));
+    };
+
+    tun->start(2);
+    ASSERT_EQ(::send(sv[1], ping, sizeof(ping), 0), ssize_t(sizeof(ping)));
+    io_context.run();
+    tun.reset();
+    ::close(sv[1]);
+
+    ASSERT_EQ(received, WARMUP + N_PACKETS);
+    EXPECT_EQ(s.end.allocs - s.begin.allocs, N_PACKETS);
+    EXPECT_EQ(s.end.heap_allocs, s.begin.heap_allocs);
+    EXPECT_LE(s.end.heap_allocs, 2u);
+}
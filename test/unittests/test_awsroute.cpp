@@ -0,0 +1,353 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <openvpn/common/string.hpp>
+#include <openvpn/aws/awsroute.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/ssl/sslchoose.hpp>
+
+using namespace openvpn;
+using namespace openvpn::AWS;
+
+namespace {
+
+// A plain HTTP stand-in for the EC2 query API, keeping route tables and
+// sourceDestCheck flags in memory.  Each reply is delayed to model the
+// round trip to the regional endpoint.
+class MockEC2
+{
+  public:
+    std::map<std::string, std::string> routes; // "table cidr" -> target
+    std::map<std::string, std::string> source_dest_check;
+    unsigned int throttle = 0; // requests answered with RequestLimitExceeded
+    std::chrono::milliseconds delay{30};
+
+    unsigned int requests = 0;
+    unsigned int connections = 0;
+    unsigned int max_in_flight = 0;
+
+    MockEC2()
+        : acceptor(io_context, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0))
+    {
+        accept();
+        thread = std::thread([this]()
+                             { io_context.run(); });
+    }
+
+    ~MockEC2()
+    {
+        io_context.stop();
+        thread.join();
+    }
+
+    std::string port() const
+    {
+        return std::to_string(acceptor.local_endpoint().port());
+    }
+
+    std::mutex mutex; // guards everything above
+
+  private:
+    struct Connection
+    {
+        Connection(openvpn_io::io_context &io_context, openvpn_io::ip::tcp::socket sock_arg)
+            : sock(std::move(sock_arg)),
+              timer(io_context)
+        {
+        }
+
+        openvpn_io::ip::tcp::socket sock;
+        openvpn_io::steady_timer timer;
+        openvpn_io::streambuf in;
+        std::string out;
+    };
+
+    void accept()
+    {
+        acceptor.async_accept([this](const openvpn_io::error_code &error, openvpn_io::ip::tcp::socket sock)
+                              {
+            if (error)
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++connections;
+            }
+            read(std::make_shared<Connection>(io_context, std::move(sock)));
+            accept(); });
+    }
+
+    void read(std::shared_ptr<Connection> conn)
+    {
+        openvpn_io::async_read_until(conn->sock, conn->in, "\r\n\r\n", [this, conn](const openvpn_io::error_code &error, const size_t bytes)
+                                     {
+            if (error)
+                return;
+            std::string head(openvpn_io::buffers_begin(conn->in.data()), openvpn_io::buffers_begin(conn->in.data()) + bytes);
+            conn->in.consume(bytes);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++requests;
+                max_in_flight = std::max(max_in_flight, ++in_flight);
+                conn->out = respond(head.substr(0, head.find("\r\n")));
+            }
+            conn->timer.expires_after(delay);
+            conn->timer.async_wait([this, conn](const openvpn_io::error_code &)
+                                   {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --in_flight;
+                }
+                openvpn_io::async_write(conn->sock, openvpn_io::buffer(conn->out), [this, conn](const openvpn_io::error_code &error, const size_t)
+                                        {
+                    if (!error)
+                        read(conn); }); }); });
+    }
+
+    static std::string decode(const std::string &s)
+    {
+        std::string ret;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '%' && i + 2 < s.size())
+            {
+                ret += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            }
+            else
+                ret += s[i];
+        }
+        return ret;
+    }
+
+    static std::string reply(const int status, const std::string &body)
+    {
+        return "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error")
+               + "\r\nContent-Type: text/xml\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    static std::string error(const int status, const std::string &code)
+    {
+        return reply(status, "<Response><Errors><Error><Code>" + code + "</Code></Error></Errors></Response>");
+    }
+
+    static std::string result(const std::string &action, const std::string &content = "<return>true</return>")
+    {
+        return reply(200, "<" + action + "Response>" + content + "</" + action + "Response>");
+    }
+
+    // request_line is "GET /?Action=...&... HTTP/1.1"
+    std::string respond(const std::string &request_line)
+    {
+        std::map<std::string, std::string> parms;
+        const size_t q = request_line.find('?');
+        const std::string query = request_line.substr(q + 1, request_line.rfind(' ') - q - 1);
+        for (const auto &kv : string::split(query, '&'))
+        {
+            const size_t eq = kv.find('=');
+            parms[decode(kv.substr(0, eq))] = decode(kv.substr(eq + 1));
+        }
+
+        if (throttle)
+        {
+            --throttle;
+            return error(503, "RequestLimitExceeded");
+        }
+
+        const std::string action = parms["Action"];
+        const std::string key = parms["RouteTableId"] + ' ' + parms["DestinationCidrBlock"];
+        if (action == "ReplaceRoute" || action == "CreateRoute")
+        {
+            if ((action == "ReplaceRoute") != (routes.find(key) != routes.end()))
+                return error(400, action == "ReplaceRoute" ? "InvalidRoute.NotFound" : "RouteAlreadyExists");
+            routes[key] = parms["NetworkInterfaceId"];
+            return result(action);
+        }
+        else if (action == "DeleteRoute")
+        {
+            if (!routes.erase(key))
+                return error(400, "InvalidRoute.NotFound");
+            return result(action);
+        }
+        else if (action == "DescribeNetworkInterfaceAttribute")
+        {
+            const std::string &sdc = source_dest_check[parms["NetworkInterfaceId"]];
+            return result(action, "<sourceDestCheck><value>" + (sdc.empty() ? std::string("true") : sdc) + "</value></sourceDestCheck>");
+        }
+        else if (action == "ModifyNetworkInterfaceAttribute")
+        {
+            source_dest_check[parms["NetworkInterfaceId"]] = parms["SourceDestCheck.Value"];
+            return result(action);
+        }
+        return error(400, "InvalidAction");
+    }
+
+    openvpn_io::io_context io_context{1};
+    openvpn_io::ip::tcp::acceptor acceptor;
+    std::thread thread;
+    unsigned int in_flight = 0;
+};
+
+std::unique_ptr<Route::Context> context(const MockEC2 &ec2)
+{
+    PCQuery::Info info;
+    info.instanceId = "i-0123456789abcdef0";
+    info.region = "us-east-1";
+    info.privateIp = "10.0.0.10";
+    std::unique_ptr<Route::Context> ctx(new Route::Context(info, Creds("AKIDEXAMPLE", "secret"), StrongRandomAPI::Ptr(new SSLLib::RandomAPI()), nullptr, 0));
+
+    WS::Client::Config::Ptr hc(new WS::Client::Config());
+    hc->frame = frame_init_simple(2048);
+    hc->connect_timeout = 10;
+    hc->general_timeout = 10;
+    ctx->set_endpoint("127.0.0.1", ec2.port(), hc);
+    return ctx;
+}
+
+std::string cidr(const int table, const int i)
+{
+    return "10." + std::to_string(table) + '.' + std::to_string(i) + ".0/24";
+}
+
+std::string table(const int t)
+{
+    return "rtb-" + std::to_string(t);
+}
+
+} // namespace
+
+// Failover of 48 routes in 4 tables to another interface, one query at a
+// time and as a batch
+TEST(awsroute, failover)
+{
+    MockEC2 ec2;
+    const int tables = 4;
+    const int per_table = 12;
+    for (int t = 0; t < tables; ++t)
+        for (int i = 0; i < per_table; ++i)
+            ec2.routes[table(t) + ' ' + cidr(t, i)] = "eni-a";
+    std::unique_ptr<Route::Context> ctx = context(ec2);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < tables; ++t)
+        for (int i = 0; i < per_table; ++i)
+            Route::replace_create_route(*ctx, table(t), cidr(t, i), Route::RouteTargetType::INTERFACE_ID, "eni-b", false);
+    const auto serial = std::chrono::steady_clock::now() - start;
+
+    // and back, with a few routes that don't exist yet
+    Route::Batch batch;
+    for (int t = 0; t < tables; ++t)
+        for (int i = 0; i < per_table + 2; ++i)
+            batch.replace_create_route(table(t), cidr(t, i), Route::RouteTargetType::INTERFACE_ID, "eni-a", false);
+    batch.set_source_dest_check("eni-a", false);
+    EXPECT_EQ(batch.size(), size_t(tables * (per_table + 2) + 1));
+    {
+        std::lock_guard<std::mutex> lock(ec2.mutex);
+        ec2.connections = 0;
+        ec2.max_in_flight = 0;
+    }
+    start = std::chrono::steady_clock::now();
+    batch.execute(*ctx);
+    const auto parallel = std::chrono::steady_clock::now() - start;
+
+    OPENVPN_LOG("failover of " << tables * per_table << " routes: serial "
+                               << std::chrono::duration_cast<std::chrono::milliseconds>(serial).count()
+                               << " ms, batch " << std::chrono::duration_cast<std::chrono::milliseconds>(parallel).count() << " ms");
+
+    std::lock_guard<std::mutex> lock(ec2.mutex);
+    EXPECT_EQ(ec2.routes.size(), size_t(tables * (per_table + 2)));
+    for (const auto &r : ec2.routes)
+        EXPECT_EQ(r.second, "eni-a") << r.first;
+    EXPECT_EQ(ec2.source_dest_check["eni-a"], "false");
+    EXPECT_LE(ec2.max_in_flight, 8u);
+    EXPECT_GT(ec2.max_in_flight, 1u);
+    EXPECT_LE(ec2.connections, 8u);
+    EXPECT_LT(parallel * 3, serial);
+}
+
+// Throttled queries are retried after a backoff
+TEST(awsroute, throttled)
+{
+    MockEC2 ec2;
+    ec2.delay = std::chrono::milliseconds(5);
+    ec2.throttle = 6;
+    std::unique_ptr<Route::Context> ctx = context(ec2);
+
+    Route::Batch batch;
+    for (int i = 0; i < 4; ++i)
+        batch.replace_create_route(table(0), cidr(0, i), Route::RouteTargetType::INTERFACE_ID, "eni-a", false);
+    Route::Batch::Config config;
+    config.max_in_flight = 4;
+    config.backoff = Time::Duration::milliseconds(20);
+    batch.execute(*ctx, config);
+
+    std::lock_guard<std::mutex> lock(ec2.mutex);
+    EXPECT_EQ(ec2.routes.size(), 4u);
+    EXPECT_EQ(ec2.throttle, 0u);
+    EXPECT_EQ(ec2.requests, 6u + 8u); // ReplaceRoute and CreateRoute for each
+}
+
+// A failed operation doesn't hold up the others, and is reported once
+// the batch is finished
+TEST(awsroute, failure)
+{
+    MockEC2 ec2;
+    ec2.delay = std::chrono::milliseconds(5);
+    ec2.routes[table(0) + ' ' + cidr(0, 0)] = "eni-a";
+    std::unique_ptr<Route::Context> ctx = context(ec2);
+
+    Route::Batch batch;
+    batch.delete_route(table(0), cidr(0, 0), false);
+    batch.delete_route(table(0), cidr(0, 1), false);
+    batch.replace_create_route(table(1), cidr(1, 0), Route::RouteTargetType::INTERFACE_ID, "eni-a", false);
+    try
+    {
+        batch.execute(*ctx);
+        ADD_FAILURE() << "no exception";
+    }
+    catch (const Route::aws_route_error &e)
+    {
+        const std::string what = e.what();
+        EXPECT_NE(what.find("1 of 3 route operations failed"), std::string::npos) << what;
+        EXPECT_NE(what.find("DeleteRoute " + cidr(0, 1)), std::string::npos) << what;
+        EXPECT_NE(what.find("InvalidRoute.NotFound"), std::string::npos) << what;
+    }
+
+    std::lock_guard<std::mutex> lock(ec2.mutex);
+    EXPECT_EQ(ec2.routes.size(), 1u);
+    EXPECT_EQ(ec2.routes[table(1) + ' ' + cidr(1, 0)], "eni-a");
+}
+
+// Throttling that outlasts max_attempts fails the operation
+TEST(awsroute, retries_exhausted)
+{
+    MockEC2 ec2;
+    ec2.delay = std::chrono::milliseconds(1);
+    ec2.throttle = 1000;
+    std::unique_ptr<Route::Context> ctx = context(ec2);
+
+    Route::Batch batch;
+    batch.delete_route(table(0), cidr(0, 0), false);
+    Route::Batch::Config config;
+    config.max_attempts = 3;
+    config.backoff = Time::Duration::milliseconds(5);
+    EXPECT_THROW(batch.execute(*ctx, config), Route::aws_route_error);
+
+    std::lock_guard<std::mutex> lock(ec2.mutex);
+    EXPECT_EQ(ec2.requests, 3u);
+}
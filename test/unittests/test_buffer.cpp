@@ -1,6 +1,7 @@
 #include "test_common.hpp"
 
 #include <openvpn/buffer/bufstr.hpp>
+#include <openvpn/frame/frame_init.hpp>
 
 using namespace openvpn;
 
@@ -552,3 +553,54 @@ TEST(buffer, append_after_move_safe)
     // coverity[USE_AFTER_MOVE]
     EXPECT_EQ(buf, buf3);
 }
+
+TEST(buffer, realloc_count)
+{
+    const size_t start = buffer_realloc_count;
+
+    // first allocation and reuse within capacity are not counted
+    BufferAllocated buf;
+    buf.reset(64, 0);
+    buf.reset(32, 0);
+    EXPECT_EQ(buffer_realloc_count, start);
+
+    buf.reset(128, 0);
+    EXPECT_EQ(buffer_realloc_count, start + 1);
+
+    BufferAllocated grow(4, BufAllocFlags::GROW);
+    buf_append_string(grow, "hello world");
+    EXPECT_EQ(buffer_realloc_count, start + 2);
+
+    buf_append_string(buf, "hello");
+    buf.realign(buf.capacity());
+    EXPECT_EQ(buffer_realloc_count, start + 3);
+}
+
+TEST(buffer, frame_data_path_fits)
+{
+    Frame frame(Frame::Context(16, 1500, 8, 0, 16, 0));
+    EXPECT_TRUE(frame.data_path_fits(16, 8));
+    EXPECT_FALSE(frame.data_path_fits(64, 4));
+    EXPECT_FALSE(frame.data_path_fits(16, 16));
+
+    // only the data path contexts are checked
+    frame[Frame::WRITE_SSL_INIT] = Frame::Context(0, 1500, 0, 0, 16, 0);
+    EXPECT_TRUE(frame.data_path_fits(16, 8));
+    frame[Frame::READ_TUN] = Frame::Context(0, 1500, 0, 0, 16, 0);
+    EXPECT_FALSE(frame.data_path_fits(16, 8));
+}
+
+// frame_init() leaves room for the largest data channel pipeline in
+// the buffers of every data path context
+TEST(buffer, frame_init_data_path)
+{
+    Frame::Ptr frame = frame_init(true, 1500, 1250, false);
+    EXPECT_TRUE(frame->data_path_fits(frame_data_path_headroom, frame_data_path_tailroom));
+
+    BufferAllocated buf;
+    frame->prepare(Frame::READ_TUN, buf);
+    const size_t reallocs = buffer_realloc_count;
+    buf.write_alloc(1500 + frame_data_path_tailroom);
+    buf.prepend_alloc(frame_data_path_headroom);
+    EXPECT_EQ(buffer_realloc_count, reallocs);
+}
@@ -0,0 +1,196 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include <openvpn/client/clieventqueue.hpp>
+
+using namespace openvpn;
+using namespace openvpn::ClientEvent;
+
+namespace {
+
+AsyncQueue::Item item(const Type id, const std::string &info = "")
+{
+    AsyncQueue::Item it;
+    it.id = id;
+    it.name = event_name(id);
+    it.info = info;
+    return it;
+}
+
+std::vector<std::string> drain_all(AsyncQueue &q)
+{
+    std::vector<std::string> out;
+    q.drain([&out](AsyncQueue::Item &it)
+            { out.push_back(it.name + (it.info.empty() ? "" : ":" + it.info)); });
+    return out;
+}
+
+} // namespace
+
+TEST(clieventqueue, order)
+{
+    AsyncQueue q(8);
+    EXPECT_TRUE(q.push(item(RESOLVE)));
+    EXPECT_TRUE(q.push(item(CONNECTING)));
+    EXPECT_TRUE(q.push(item(INFO, "hello")));
+    EXPECT_TRUE(q.push(item(CONNECTED)));
+    EXPECT_EQ(drain_all(q), std::vector<std::string>({"RESOLVE", "CONNECTING", "INFO:hello", "CONNECTED"}));
+    EXPECT_TRUE(drain_all(q).empty());
+
+    const AsyncQueue::Stats s = q.stats();
+    EXPECT_EQ(s.queued, 4u);
+    EXPECT_EQ(s.delivered, 4u);
+    EXPECT_EQ(s.coalesced, 0u);
+    EXPECT_EQ(s.dropped, 0u);
+}
+
+// Only runs of the same transitional event are collapsed, keeping the newest
+TEST(clieventqueue, coalesce)
+{
+    AsyncQueue q(16);
+    q.push(item(RECONNECTING, "1"));
+    q.push(item(RECONNECTING, "2"));
+    q.push(item(RECONNECTING, "3"));
+    q.push(item(RESOLVE));
+    q.push(item(RECONNECTING, "4"));
+    q.push(item(INFO, "a"));
+    q.push(item(INFO, "b"));
+    q.push(item(WARN, "x"));
+    q.push(item(WARN, "x"));
+    EXPECT_EQ(drain_all(q), std::vector<std::string>({"RECONNECTING:3", "RESOLVE", "RECONNECTING:4", "INFO:a", "INFO:b", "WARN:x", "WARN:x"}));
+    EXPECT_EQ(q.stats().coalesced, 2u);
+    EXPECT_EQ(q.stats().delivered, 7u);
+}
+
+TEST(clieventqueue, full)
+{
+    AsyncQueue q(3);
+    ASSERT_EQ(q.capacity(), 4u);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(q.push(item(INFO, std::to_string(i))));
+    EXPECT_FALSE(q.push(item(INFO, "4")));
+    EXPECT_FALSE(q.push(item(WARN)));
+    EXPECT_EQ(q.stats().dropped, 2u);
+
+    // space is reclaimed once drained, across the wrap of the ring
+    EXPECT_EQ(drain_all(q).size(), 4u);
+    for (int n = 0; n < 10; ++n)
+    {
+        EXPECT_TRUE(q.push(item(INFO, std::to_string(n))));
+        EXPECT_TRUE(q.push(item(WARN)));
+        EXPECT_EQ(drain_all(q), std::vector<std::string>({"INFO:" + std::to_string(n), "WARN"}));
+    }
+}
+
+// DISCONNECTED and fatal events are delivered even when the ring is
+// full, after the events ahead of them, and nothing overtakes them.
+TEST(clieventqueue, terminal)
+{
+    AsyncQueue q(4);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(q.push(item(INFO, std::to_string(i))));
+    AsyncQueue::Item fatal = item(AUTH_FAILED);
+    fatal.error = fatal.fatal = true;
+    EXPECT_TRUE(q.push(std::move(fatal)));
+    EXPECT_FALSE(q.push(item(WARN)));
+    EXPECT_TRUE(q.push(item(DISCONNECTED)));
+
+    const AsyncQueue::Stats s = q.stats();
+    EXPECT_EQ(s.queued, 6u);
+    EXPECT_EQ(s.dropped, 1u);
+    EXPECT_EQ(s.overflowed, 2u);
+
+    EXPECT_EQ(drain_all(q), std::vector<std::string>({"INFO:0", "INFO:1", "INFO:2", "INFO:3", "AUTH_FAILED", "DISCONNECTED"}));
+    EXPECT_EQ(q.stats().delivered, 6u);
+
+    // the ring is used again once the overflow list is delivered
+    EXPECT_TRUE(q.push(item(INFO, "4")));
+    EXPECT_EQ(q.stats().overflowed, 2u);
+    EXPECT_EQ(drain_all(q), std::vector<std::string>({"INFO:4"}));
+}
+
+// Several producers, each pushing its own numbered sequence, while the
+// consumer drains concurrently.  Every event arrives once, in the
+// order of its producer.
+TEST(clieventqueue, multi_producer)
+{
+    const int producers = 4;
+    const int per_producer = 20000;
+    AsyncQueue q(64);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+        threads.emplace_back([&q, p]()
+                             {
+            for (int i = 0; i < per_producer; ++i)
+            {
+                AsyncQueue::Item it = item(INFO, std::to_string(p) + ' ' + std::to_string(i));
+                while (!q.push(it))
+                    std::this_thread::yield();
+            } });
+
+    std::vector<int> next(producers, 0);
+    int received = 0;
+    while (received < producers * per_producer)
+    {
+        q.drain([&](AsyncQueue::Item &it)
+                {
+            const size_t sp = it.info.find(' ');
+            const int p = std::stoi(it.info.substr(0, sp));
+            const int i = std::stoi(it.info.substr(sp + 1));
+            EXPECT_EQ(i, next[p]);
+            next[p] = i + 1;
+            ++received; },
+                std::chrono::milliseconds(10));
+    }
+    for (auto &t : threads)
+        t.join();
+
+    for (int p = 0; p < producers; ++p)
+        EXPECT_EQ(next[p], per_producer);
+    const AsyncQueue::Stats s = q.stats();
+    EXPECT_EQ(s.delivered, count_t(producers * per_producer));
+    EXPECT_EQ(s.queued, s.delivered);
+}
+
+// A waiting consumer is woken by a push rather than by its timeout,
+// and the time spent queued is reported as lag
+TEST(clieventqueue, wake_and_lag)
+{
+    AsyncQueue q(8);
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(q.drain([](AsyncQueue::Item &) {}, std::chrono::milliseconds(50)), 0u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+
+    std::thread producer([&q]()
+                         {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.push(item(CONNECTED)); });
+    const auto wait_start = std::chrono::steady_clock::now();
+    EXPECT_EQ(q.drain([](AsyncQueue::Item &) {}, std::chrono::seconds(10)), 1u);
+    EXPECT_LT(std::chrono::steady_clock::now() - wait_start, std::chrono::seconds(5));
+    producer.join();
+
+    // an event left in the queue for a while
+    q.push(item(DISCONNECTED));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(drain_all(q).size(), 1u);
+    const AsyncQueue::Stats s = q.stats();
+    EXPECT_GE(s.last_lag, 30000);
+    EXPECT_GE(s.max_lag, s.last_lag);
+    EXPECT_LE(s.mean_lag, s.max_lag);
+    EXPECT_EQ(s.delivered, 2u);
+}
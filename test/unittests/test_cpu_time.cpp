@@ -35,6 +35,8 @@
 #include <memory>
 #include <mutex>
 #include <openvpn/time/cputime.hpp>
+#include <openvpn/time/cpuacct.hpp>
+#include <openvpn/log/sessionstats.hpp>
 #include <algorithm>
 
 #ifdef DEBUG
@@ -84,6 +86,8 @@ void update_thread_runtime(double val)
 }
 
 
+using namespace openvpn;
+
 namespace unittests {
 static void workload(const uint16_t multiplier)
 {
@@ -231,4 +235,75 @@ TEST(CPUTime, cpu_time_thread_numcores)
     // here.
     ASSERT_LT(parent_diff, 3 + thread_runtime);
 }
+
+
+TEST(CPUTime, cpu_accounting_nested_scopes)
+{
+    CPUAccounting acct(1);
+    {
+        CPUAccounting::Scope io(&acct, CPUAccounting::IO);
+        workload(20);
+        {
+            CPUAccounting::Scope crypto(&acct, CPUAccounting::CRYPTO);
+            workload(100);
+        }
+    }
+
+    // nested time is attributed exclusively to the inner stage
+    EXPECT_GT(acct.stage_ns(CPUAccounting::CRYPTO), acct.stage_ns(CPUAccounting::IO));
+    EXPECT_GT(acct.stage_ns(CPUAccounting::IO), 0u);
+    EXPECT_EQ(acct.stage_ns(CPUAccounting::COMPRESS), 0u);
+    EXPECT_EQ(acct.stage_ns(CPUAccounting::CONTROL), 0u);
+    EXPECT_EQ(acct.total_ns(), acct.stage_ns(CPUAccounting::CRYPTO) + acct.stage_ns(CPUAccounting::IO));
+}
+
+
+TEST(CPUTime, cpu_accounting_sampling)
+{
+    CPUAccounting acct(4);
+    for (int i = 0; i < 3; ++i)
+    {
+        CPUAccounting::Scope control(&acct, CPUAccounting::CONTROL);
+        workload(10);
+    }
+    // no batch sampled yet
+    EXPECT_EQ(acct.total_ns(), 0u);
+
+    {
+        CPUAccounting::Scope control(&acct, CPUAccounting::CONTROL);
+        workload(10);
+    }
+    EXPECT_GT(acct.stage_ns(CPUAccounting::CONTROL), 0u);
+    EXPECT_EQ(acct.stage_ns(CPUAccounting::CONTROL) % 4, 0u);
+}
+
+
+TEST(CPUTime, cpu_accounting_session_stats)
+{
+    SessionStats::Ptr stats(new SessionStats());
+    EXPECT_EQ(stats->cpu_accounting(), nullptr);
+    EXPECT_EQ(stats->cpu_per_gb(), -1.0);
+
+    // a null accounting pointer makes scopes no-ops
+    {
+        CPUAccounting::Scope io(stats->cpu_accounting(), CPUAccounting::IO);
+    }
+
+    stats->cpu_accounting_enable(1);
+    ASSERT_NE(stats->cpu_accounting(), nullptr);
+    EXPECT_EQ(stats->cpu_per_handshake(), -1.0);
+    {
+        CPUAccounting::Scope crypto(stats->cpu_accounting(), CPUAccounting::CRYPTO);
+        workload(20);
+    }
+    {
+        CPUAccounting::Scope control(stats->cpu_accounting(), CPUAccounting::CONTROL);
+        workload(20);
+    }
+    stats->cpu_accounting()->inc_handshake();
+    stats->inc_stat(SessionStats::BYTES_IN, 1000);
+
+    EXPECT_GT(stats->cpu_per_gb(), 0.0);
+    EXPECT_GT(stats->cpu_per_handshake(), 0.0);
+}
 } // namespace unittests
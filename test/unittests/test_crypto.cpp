@@ -19,7 +19,9 @@
 #include <openvpn/crypto/crypto_aead_epoch.hpp>
 #include <openvpn/crypto/data_epoch.hpp>
 #include <openvpn/crypto/cryptodcsel.hpp>
+#include <openvpn/transport/pktstream.hpp>
 #include <cstring>
+#include <chrono>
 
 
 static uint8_t testkey[20] = {0x0b, 0x00};
@@ -90,7 +92,10 @@ static openvpn::Frame::Context frame_ctx()
 }
 
 
-openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch)
+openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch,
+                                                      openvpn::CryptoAlgs::Type cipher = openvpn::CryptoAlgs::AES_256_GCM,
+                                                      openvpn::CryptoAlgs::Type digest = openvpn::CryptoAlgs::NONE,
+                                                      openvpn::StrongRandomAPI::Ptr rng = nullptr)
 {
     openvpn::CryptoDCInstance::Ptr cryptodc;
     auto frameptr = openvpn::Frame::Ptr{new openvpn::Frame{frame_ctx()}};
@@ -98,11 +103,12 @@ openvpn::CryptoDCInstance::Ptr create_dctest_instance(bool use_epoch)
 
 
     openvpn::CryptoDCSettingsData dc;
-    dc.set_cipher(openvpn::CryptoAlgs::AES_256_GCM);
+    dc.set_cipher(cipher);
+    dc.set_digest(digest);
     dc.set_use_epoch_keys(use_epoch);
 
     openvpn::SSLLib::Ctx libctx = nullptr;
-    openvpn::CryptoDCFactory::Ptr dc_factory_sel{new openvpn::CryptoDCSelect<openvpn::SSLLib::CryptoAPI>(libctx, frameptr, statsptr, nullptr)};
+    openvpn::CryptoDCFactory::Ptr dc_factory_sel{new openvpn::CryptoDCSelect<openvpn::SSLLib::CryptoAPI>(libctx, frameptr, statsptr, rng)};
 
     auto dc_factory = dc_factory_sel->new_obj(dc);
 
@@ -684,4 +690,124 @@ TEST_F(EpochTest, key_overflow)
     EXPECT_EQ(dce_.lookup_decrypt_key( UINT16_MAX - 33)->epoch, UINT16_MAX - 33);
     EXPECT_EQ(dce_.lookup_decrypt_key(UINT16_MAX - 32), nullptr);
     EXPECT_EQ(dce_.lookup_decrypt_key(UINT16_MAX), nullptr);
-}
\ No newline at end of file
+}
+static void test_datachannel_cbc(openvpn::CryptoAlgs::Type cipher, openvpn::CryptoAlgs::Type digest)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, true, false);
+
+    openvpn::StrongRandomAPI::Ptr rng(new openvpn::SSLLib::RandomAPI());
+    openvpn::CryptoDCInstance::Ptr cryptodc = create_dctest_instance(false, cipher, digest, rng);
+    const unsigned char op32[]{7, 0, 0, 23};
+
+    for (size_t len = 1; len <= 1500; len += 37)
+    {
+        for (const size_t tailroom : {size_t(64), size_t(0)})
+        {
+            std::string plaintext(len, '\0');
+            for (size_t i = 0; i < len; ++i)
+                plaintext[i] = static_cast<char>(i * 13 + len);
+
+            // a buffer without tailroom for the CBC padding
+            // cannot be encrypted in place
+            openvpn::BufferAllocated work{128 + len + tailroom, 0};
+            work.realign(128);
+            std::memcpy(work.write_alloc(len), plaintext.data(), len);
+
+            cryptodc->encrypt(work, op32);
+            EXPECT_GT(work.size(), len);
+            EXPECT_EQ(cryptodc->decrypt(work, 42, op32), openvpn::Error::SUCCESS);
+            ASSERT_EQ(work.size(), len);
+            EXPECT_EQ(std::memcmp(work.data(), plaintext.data(), len), 0);
+        }
+    }
+
+    // tampered ciphertext fails HMAC verification
+    openvpn::BufferAllocated work{2048, 0};
+    work.realign(128);
+    std::memcpy(work.write_alloc(std::strlen(ipsumlorem)), ipsumlorem, std::strlen(ipsumlorem));
+    cryptodc->encrypt(work, op32);
+    work.data()[work.size() - 1] ^= 1;
+    EXPECT_EQ(cryptodc->decrypt(work, 42, op32), openvpn::Error::HMAC_ERROR);
+}
+
+// Whether encrypted in place or through the work buffer, the packet
+// keeps enough headroom for the op32 and the TCP length prefix
+TEST(crypto, dccbc_headroom)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, true, false);
+
+    openvpn::StrongRandomAPI::Ptr rng(new openvpn::SSLLib::RandomAPI());
+    openvpn::CryptoDCInstance::Ptr cryptodc = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA1, rng);
+    const unsigned char op32[]{7, 0, 0, 23};
+    const std::string plaintext(1400, 'x');
+
+    // packet ID + IV + HMAC only, and the ENCRYPT_WORK headroom after
+    // the packet ID
+    const size_t pid_size = 4;
+    for (const size_t headroom : {pid_size + 16 + 20, pid_size + frame_ctx().headroom()})
+    {
+        openvpn::BufferAllocated work{headroom + plaintext.size() + 64, 0};
+        work.realign(headroom);
+        std::memcpy(work.write_alloc(plaintext.size()), plaintext.data(), plaintext.size());
+        const unsigned char *raw = work.c_data_raw();
+
+        cryptodc->encrypt(work, op32);
+        EXPECT_EQ(work.c_data_raw() == raw, headroom > pid_size + 16 + 20);
+        work.prepend(op32, sizeof(op32));
+        openvpn::PacketStream<std::uint16_t>::prepend_size(work);
+
+        work.advance(2 + sizeof(op32));
+        EXPECT_EQ(cryptodc->decrypt(work, 42, op32), openvpn::Error::SUCCESS);
+        ASSERT_EQ(work.size(), plaintext.size());
+        EXPECT_EQ(std::memcmp(work.data(), plaintext.data(), plaintext.size()), 0);
+    }
+}
+
+TEST(crypto, dccbc_aes128_sha1)
+{
+    test_datachannel_cbc(openvpn::CryptoAlgs::AES_128_CBC, openvpn::CryptoAlgs::SHA1);
+}
+
+TEST(crypto, dccbc_aes256_sha256)
+{
+    test_datachannel_cbc(openvpn::CryptoAlgs::AES_256_CBC, openvpn::CryptoAlgs::SHA256);
+}
+
+// Throughput of the CBC+HMAC data channel on full-sized packets
+TEST(crypto, dccbc_throughput)
+{
+    openvpn::CryptoAlgs::allow_default_dc_algs<openvpn::SSLLib::CryptoAPI>(nullptr, true, false);
+
+    const size_t packet_size = 1400;
+    const int n_packets = 100000;
+    const unsigned char op32[]{7, 0, 0, 23};
+    const std::string plaintext(packet_size, 'x');
+
+    for (const auto digest : {openvpn::CryptoAlgs::SHA1, openvpn::CryptoAlgs::SHA256})
+    {
+        openvpn::StrongRandomAPI::Ptr rng(new openvpn::SSLLib::RandomAPI());
+        openvpn::CryptoDCInstance::Ptr cryptodc = create_dctest_instance(false, openvpn::CryptoAlgs::AES_256_CBC, digest, rng);
+        openvpn::BufferAllocated work{2048, 0};
+
+        double encrypt_secs = 0;
+        double decrypt_secs = 0;
+        for (int i = 0; i < n_packets; ++i)
+        {
+            work.reset(128, 2048, 0);
+            std::memcpy(work.write_alloc(packet_size), plaintext.data(), packet_size);
+
+            const auto t0 = std::chrono::steady_clock::now();
+            cryptodc->encrypt(work, op32);
+            const auto t1 = std::chrono::steady_clock::now();
+            ASSERT_EQ(cryptodc->decrypt(work, 42, op32), openvpn::Error::SUCCESS);
+            const auto t2 = std::chrono::steady_clock::now();
+
+            encrypt_secs += std::chrono::duration<double>(t1 - t0).count();
+            decrypt_secs += std::chrono::duration<double>(t2 - t1).count();
+        }
+        const double mb = double(packet_size) * n_packets / 1e6;
+        std::cout << "AES-256-CBC/" << openvpn::CryptoAlgs::name(digest)
+                  << " encrypt " << mb / encrypt_secs << " MB/s"
+                  << ", decrypt " << mb / decrypt_secs << " MB/s" << std::endl;
+    }
+}
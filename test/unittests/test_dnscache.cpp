@@ -0,0 +1,421 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <openvpn/client/dns.hpp>
+#include <openvpn/client/dnscache.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+typedef std::vector<unsigned char> Bytes;
+
+const std::string CLIENT4 = "10.8.0.2";
+const std::string SERVER4 = "10.8.0.1";
+const std::string CLIENT6 = "fd00::2";
+const std::string SERVER6 = "fd00::1";
+const std::uint16_t CLIENT_PORT = 40000;
+
+DnsOptionsParser pushed_dns()
+{
+    OptionList opt;
+    opt.parse_from_config("dhcp-option DNS " + SERVER4 + "\n"
+                          "dhcp-option DNS6 " + SERVER6 + "\n",
+                          nullptr);
+    opt.update_map();
+    return DnsOptionsParser(opt, false);
+}
+
+void put16(Bytes &b, const unsigned int v)
+{
+    b.push_back(static_cast<unsigned char>(v >> 8));
+    b.push_back(static_cast<unsigned char>(v));
+}
+
+void put32(Bytes &b, const std::uint32_t v)
+{
+    put16(b, v >> 16);
+    put16(b, v & 0xffff);
+}
+
+std::uint16_t get16(const unsigned char *p)
+{
+    return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+std::uint32_t get32(const unsigned char *p)
+{
+    return (std::uint32_t(get16(p)) << 16) | get16(p + 2);
+}
+
+// DNS query for name (as "www.example.com") with the RD bit set
+Bytes dns_query(const std::uint16_t id, const std::string &name, const bool edns_do = false)
+{
+    Bytes b;
+    put16(b, id);
+    put16(b, 0x0100);
+    put16(b, 1);
+    put16(b, 0);
+    put16(b, 0);
+    put16(b, edns_do ? 1 : 0);
+    size_t start = 0;
+    while (start <= name.size())
+    {
+        size_t end = name.find('.', start);
+        if (end == std::string::npos)
+            end = name.size();
+        b.push_back(static_cast<unsigned char>(end - start));
+        b.insert(b.end(), name.begin() + start, name.begin() + end);
+        start = end + 1;
+    }
+    b.push_back(0);
+    put16(b, 1); // A
+    put16(b, 1); // IN
+    if (edns_do)
+    {
+        b.push_back(0);
+        put16(b, 41);
+        put16(b, 1232);
+        put32(b, 0x00008000);
+        put16(b, 0);
+    }
+    return b;
+}
+
+// Response to query with one A record per TTL, followed by the query's
+// OPT record if it has one
+Bytes dns_response(const Bytes &query, const std::vector<std::uint32_t> &ttls, const unsigned int rcode = 0)
+{
+    Bytes b(query.begin(), query.begin() + 12);
+    b[2] = 0x81;
+    b[3] = static_cast<unsigned char>(0x80 | rcode);
+    b[6] = 0;
+    b[7] = static_cast<unsigned char>(ttls.size());
+
+    // question, up to an OPT record
+    size_t pos = 12;
+    while (query[pos])
+        pos += query[pos] + 1;
+    pos += 5;
+    b.insert(b.end(), query.begin() + 12, query.begin() + pos);
+
+    unsigned char n = 1;
+    for (const std::uint32_t ttl : ttls)
+    {
+        put16(b, 0xc00c); // name of the question
+        put16(b, 1);
+        put16(b, 1);
+        put32(b, ttl);
+        put16(b, 4);
+        b.insert(b.end(), {192, 0, 2, n++});
+    }
+    b.insert(b.end(), query.begin() + pos, query.end());
+    return b;
+}
+
+BufferAllocated udp_packet(const std::string &src,
+                           const std::string &dst,
+                           const std::uint16_t sport,
+                           const std::uint16_t dport,
+                           const Bytes &payload)
+{
+    const IP::Addr saddr(src);
+    const IP::Addr daddr(dst);
+    const bool v4 = !saddr.is_ipv6();
+    const size_t ip_size = v4 ? sizeof(IPv4Header) : sizeof(IPv6Header);
+    const size_t udp_size = sizeof(UDPHeader) + payload.size();
+
+    BufferAllocated buf(2048, 0);
+    buf.init_headroom(128);
+    unsigned char *p = buf.write_alloc(ip_size + udp_size);
+    std::memset(p, 0, ip_size + udp_size);
+    if (v4)
+    {
+        IPv4Header *ip = reinterpret_cast<IPv4Header *>(p);
+        ip->version_len = IPv4Header::ver_len(4, sizeof(IPv4Header));
+        ip->tot_len = htons(static_cast<std::uint16_t>(ip_size + udp_size));
+        ip->ttl = 64;
+        ip->protocol = IPCommon::UDP;
+        saddr.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->saddr));
+        daddr.to_byte_string_variable(reinterpret_cast<unsigned char *>(&ip->daddr));
+        ip->check = IPChecksum::checksum(ip, sizeof(IPv4Header));
+    }
+    else
+    {
+        IPv6Header *ip = reinterpret_cast<IPv6Header *>(p);
+        ip->version_prio = 6 << 4;
+        ip->payload_len = htons(static_cast<std::uint16_t>(udp_size));
+        ip->nexthdr = IPCommon::UDP;
+        ip->hop_limit = 64;
+        saddr.to_byte_string_variable(ip->saddr.s6_addr);
+        daddr.to_byte_string_variable(ip->daddr.s6_addr);
+    }
+    UDPHeader *udp = reinterpret_cast<UDPHeader *>(p + ip_size);
+    udp->source = htons(sport);
+    udp->dest = htons(dport);
+    udp->len = htons(static_cast<std::uint16_t>(udp_size));
+    std::memcpy(p + ip_size + sizeof(UDPHeader), payload.data(), payload.size());
+    return buf;
+}
+
+BufferAllocated query_packet(const Bytes &query, const bool v6 = false)
+{
+    return v6 ? udp_packet(CLIENT6, SERVER6, CLIENT_PORT, 53, query)
+              : udp_packet(CLIENT4, SERVER4, CLIENT_PORT, 53, query);
+}
+
+BufferAllocated response_packet(const Bytes &response, const bool v6 = false)
+{
+    return v6 ? udp_packet(SERVER6, CLIENT6, 53, CLIENT_PORT, response)
+              : udp_packet(SERVER4, CLIENT4, 53, CLIENT_PORT, response);
+}
+
+// Check the IP and UDP headers of a response synthesized for a query from
+// CLIENT_PORT, and return its DNS message
+Bytes check_response(const Buffer &buf, const bool v6 = false)
+{
+    const unsigned char *p = buf.c_data();
+    size_t ip_size;
+    std::uint32_t pseudo;
+    if (!v6)
+    {
+        const IPv4Header *ip = reinterpret_cast<const IPv4Header *>(p);
+        EXPECT_EQ(ip->protocol, IPCommon::UDP);
+        EXPECT_EQ(ntohs(ip->tot_len), buf.size());
+        EXPECT_EQ(IPChecksum::checksum(ip, sizeof(IPv4Header)), 0);
+        EXPECT_EQ(IP::Addr::from_ipv4(IPv4::Addr::from_uint32_net(ip->saddr)).to_string(), SERVER4);
+        EXPECT_EQ(IP::Addr::from_ipv4(IPv4::Addr::from_uint32_net(ip->daddr)).to_string(), CLIENT4);
+        ip_size = sizeof(IPv4Header);
+        pseudo = IPChecksum::compute(&ip->saddr, 8);
+    }
+    else
+    {
+        const IPv6Header *ip = reinterpret_cast<const IPv6Header *>(p);
+        EXPECT_EQ(ip->nexthdr, IPCommon::UDP);
+        EXPECT_EQ(sizeof(IPv6Header) + ntohs(ip->payload_len), buf.size());
+        EXPECT_EQ(IP::Addr::from_byte_string(ip->saddr.s6_addr).to_string(), SERVER6);
+        EXPECT_EQ(IP::Addr::from_byte_string(ip->daddr.s6_addr).to_string(), CLIENT6);
+        ip_size = sizeof(IPv6Header);
+        pseudo = IPChecksum::compute(&ip->saddr, 32);
+    }
+
+    const UDPHeader *udp = reinterpret_cast<const UDPHeader *>(p + ip_size);
+    const size_t udp_size = buf.size() - ip_size;
+    EXPECT_EQ(ntohs(udp->source), 53);
+    EXPECT_EQ(ntohs(udp->dest), CLIENT_PORT);
+    EXPECT_EQ(ntohs(udp->len), udp_size);
+
+    // the checksum over pseudo header and datagram folds to zero
+    const std::uint16_t trailer[2] = {htons(IPCommon::UDP), htons(static_cast<std::uint16_t>(udp_size))};
+    const std::uint32_t sum = IPChecksum::partial(udp, udp_size, IPChecksum::partial(trailer, sizeof(trailer), pseudo));
+    EXPECT_EQ(IPChecksum::cfold(sum), 0);
+
+    return Bytes(p + ip_size + sizeof(UDPHeader), p + buf.size());
+}
+
+// TTL of the n-th answer of a response built by dns_response()
+std::uint32_t answer_ttl(const Bytes &response, const size_t n)
+{
+    size_t pos = 12;
+    while (response[pos])
+        pos += response[pos] + 1;
+    pos += 5 + n * 16;
+    return get32(response.data() + pos + 6);
+}
+
+} // namespace
+
+TEST(dnscache, servers)
+{
+    DnsCache cache(pushed_dns(), nullptr, DnsCache::Config());
+    EXPECT_FALSE(cache.empty());
+
+    // servers only reached over DoT or another port are not used
+    OptionList opt;
+    opt.parse_from_config("dns server 1 address 10.8.0.1:5353\n"
+                          "dns server 2 address 10.8.0.2\n"
+                          "dns server 2 transport DoT\n",
+                          nullptr);
+    opt.update_map();
+    EXPECT_TRUE(DnsCache(DnsOptionsParser(opt, false), nullptr, DnsCache::Config()).empty());
+}
+
+TEST(dnscache, hit_after_response)
+{
+    SessionStats::Ptr stats(new SessionStats());
+    DnsCache cache(pushed_dns(), stats, DnsCache::Config());
+    Time now = Time::now();
+
+    const Bytes query = dns_query(0x1234, "www.example.com");
+    BufferAllocated buf = query_packet(query);
+    EXPECT_FALSE(cache.answer(buf, now));
+    EXPECT_EQ(buf.size(), 28 + query.size()); // forwarded unchanged
+
+    const Bytes response = dns_response(query, {300, 60});
+    cache.learn(response_packet(response), now);
+    EXPECT_EQ(cache.size(), 1u);
+
+    // the same question in different case gets the cached response with
+    // its own ID and case, and the TTLs counted down
+    now += Time::Duration::seconds(20);
+    const Bytes query2 = dns_query(0xbeef, "WWW.Example.com");
+    buf = query_packet(query2);
+    ASSERT_TRUE(cache.answer(buf, now));
+    const Bytes answer = check_response(buf);
+    ASSERT_EQ(answer.size(), response.size());
+    EXPECT_EQ(get16(answer.data()), 0xbeef);
+    EXPECT_TRUE(std::equal(query2.begin() + 12, query2.end(), answer.begin() + 12));
+    EXPECT_EQ(answer_ttl(answer, 0), 280u);
+    EXPECT_EQ(answer_ttl(answer, 1), 40u);
+    EXPECT_TRUE(std::equal(response.begin() + 2, response.begin() + 12, answer.begin() + 2));
+    EXPECT_TRUE(std::equal(response.end() - 6, response.end(), answer.end() - 6));
+
+    // the smallest TTL expires the entry
+    now += Time::Duration::seconds(41);
+    buf = query_packet(query2);
+    EXPECT_FALSE(cache.answer(buf, now));
+    EXPECT_EQ(cache.size(), 0u);
+
+    EXPECT_EQ(cache.stats().hits, 1u);
+    EXPECT_EQ(cache.stats().misses, 2u);
+    EXPECT_EQ(cache.stats().hit_rate(), 33u);
+    EXPECT_EQ(stats->get_stat(SessionStats::DNS_CACHE_HITS), 1u);
+    EXPECT_EQ(stats->get_stat(SessionStats::DNS_CACHE_MISSES), 2u);
+}
+
+TEST(dnscache, ipv6)
+{
+    DnsCache cache(pushed_dns(), nullptr, DnsCache::Config());
+    const Time now = Time::now();
+
+    const Bytes query = dns_query(1, "example.org", true);
+    cache.learn(response_packet(dns_response(query, {3600}), true), now);
+
+    BufferAllocated buf = query_packet(dns_query(2, "example.org", true), true);
+    ASSERT_TRUE(cache.answer(buf, now));
+    const Bytes answer = check_response(buf, true);
+    EXPECT_EQ(get16(answer.data()), 2);
+
+    // the DNSSEC OK bit is part of the question
+    buf = query_packet(dns_query(3, "example.org"), true);
+    EXPECT_FALSE(cache.answer(buf, now));
+}
+
+TEST(dnscache, nxdomain)
+{
+    DnsCache cache(pushed_dns(), nullptr, DnsCache::Config());
+    const Time now = Time::now();
+
+    // negative answers are cached for the TTL of their authority records
+    const Bytes query = dns_query(1, "nonexistent.example.com");
+    cache.learn(response_packet(dns_response(query, {900}, 3)), now);
+    BufferAllocated buf = query_packet(query);
+    ASSERT_TRUE(cache.answer(buf, now));
+    EXPECT_EQ(check_response(buf)[3] & 0x0f, 3);
+}
+
+TEST(dnscache, not_cached)
+{
+    DnsCache cache(pushed_dns(), nullptr, DnsCache::Config());
+    const Time now = Time::now();
+    const Bytes query = dns_query(1, "www.example.com");
+
+    // server failure
+    cache.learn(response_packet(dns_response(query, {300}, 2)), now);
+
+    // truncated
+    Bytes truncated = dns_response(query, {300});
+    truncated[2] |= 0x02;
+    cache.learn(response_packet(truncated), now);
+
+    // zero TTL, or no records to take a TTL from
+    cache.learn(response_packet(dns_response(query, {0})), now);
+    cache.learn(response_packet(dns_response(query, {})), now);
+
+    // from a server that was not pushed, or another port
+    cache.learn(udp_packet("192.0.2.1", CLIENT4, 53, CLIENT_PORT, dns_response(query, {300})), now);
+    cache.learn(udp_packet(SERVER4, CLIENT4, 5353, CLIENT_PORT, dns_response(query, {300})), now);
+
+    // malformed
+    Bytes short_response = dns_response(query, {300});
+    short_response.resize(short_response.size() - 3);
+    cache.learn(response_packet(short_response), now);
+
+    EXPECT_EQ(cache.size(), 0u);
+
+    // queries to other servers are not even counted
+    BufferAllocated buf = udp_packet(CLIENT4, "192.0.2.1", CLIENT_PORT, 53, query);
+    EXPECT_FALSE(cache.answer(buf, now));
+    EXPECT_EQ(cache.stats().misses, 0u);
+}
+
+TEST(dnscache, max_entries)
+{
+    DnsCache::Config config;
+    config.max_entries = 4;
+    DnsCache cache(pushed_dns(), nullptr, config);
+    const Time now = Time::now();
+
+    for (std::uint32_t i = 0; i < 8; ++i)
+    {
+        const Bytes query = dns_query(1, "host" + std::to_string(i) + ".example.com");
+        cache.learn(response_packet(dns_response(query, {100 + i})), now);
+    }
+    EXPECT_EQ(cache.size(), 4u);
+
+    // the entries closest to expiry made room for the later ones
+    BufferAllocated buf = query_packet(dns_query(1, "host7.example.com"));
+    EXPECT_TRUE(cache.answer(buf, now));
+    buf = query_packet(dns_query(1, "host0.example.com"));
+    EXPECT_FALSE(cache.answer(buf, now));
+}
+
+// Expired entries make room before live ones, and a relearned question
+// is ordered by its new expiry
+TEST(dnscache, expiry_order)
+{
+    DnsCache::Config config;
+    config.max_entries = 3;
+    DnsCache cache(pushed_dns(), nullptr, config);
+    Time now = Time::now();
+
+    const Bytes q0 = dns_query(1, "host0.example.com");
+    const Bytes q1 = dns_query(1, "host1.example.com");
+    const Bytes q2 = dns_query(1, "host2.example.com");
+    const Bytes q3 = dns_query(1, "host3.example.com");
+    cache.learn(response_packet(dns_response(q0, {100})), now);
+    cache.learn(response_packet(dns_response(q1, {10})), now);
+    cache.learn(response_packet(dns_response(q2, {200})), now);
+
+    // host0 now expires last
+    cache.learn(response_packet(dns_response(q0, {300})), now);
+    EXPECT_EQ(cache.size(), 3u);
+
+    // host1 has expired and goes first
+    now += Time::Duration::seconds(20);
+    cache.learn(response_packet(dns_response(q3, {100})), now);
+    EXPECT_EQ(cache.size(), 3u);
+    BufferAllocated buf = query_packet(q1);
+    EXPECT_FALSE(cache.answer(buf, now));
+
+    // then the live entry closest to expiry, host3, not host0
+    cache.learn(response_packet(dns_response(q1, {400})), now);
+    EXPECT_EQ(cache.size(), 3u);
+    buf = query_packet(q3);
+    EXPECT_FALSE(cache.answer(buf, now));
+    for (const Bytes *q : {&q0, &q1, &q2})
+    {
+        buf = query_packet(*q);
+        EXPECT_TRUE(cache.answer(buf, now));
+    }
+}
@@ -0,0 +1,481 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <set>
+
+#include <openvpn/client/async_resolve.hpp>
+
+using namespace openvpn;
+using namespace openvpn::DnsStub;
+
+namespace {
+
+// A name server on 127.0.0.1, answering over UDP and TCP on the same port
+class TestServer
+{
+  public:
+    std::map<std::string, std::vector<IP::Addr>> records; // names without records get NXDOMAIN
+    std::set<std::string> truncated;                      // names answered with TC over UDP
+    std::uint32_t ttl = 300;
+    bool silent = false; // receive queries but never answer
+
+    unsigned int udp_queries = 0;
+    unsigned int tcp_queries = 0;
+
+    TestServer(openvpn_io::io_context &io_context)
+        : udp(io_context, openvpn_io::ip::udp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0)),
+          acceptor(io_context, openvpn_io::ip::tcp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), udp.local_endpoint().port()))
+    {
+        udp_receive();
+        accept();
+    }
+
+    Config::Server server() const
+    {
+        return {IP::Addr("127.0.0.1"), udp.local_endpoint().port()};
+    }
+
+  private:
+    void udp_receive()
+    {
+        udp.async_receive_from(openvpn_io::buffer(buf, sizeof(buf)), from, [this](const openvpn_io::error_code &error, const size_t bytes)
+                               {
+            if (error)
+                return;
+            ++udp_queries;
+            if (!silent)
+            {
+                const std::vector<unsigned char> reply = respond(buf, bytes, true);
+                openvpn_io::error_code ec;
+                udp.send_to(openvpn_io::buffer(reply), from, 0, ec);
+            }
+            udp_receive(); });
+    }
+
+    void accept()
+    {
+        acceptor.async_accept([this](const openvpn_io::error_code &error, openvpn_io::ip::tcp::socket sock)
+                              {
+            if (error)
+                return;
+            ++tcp_queries;
+            auto conn = std::make_shared<Connection>(std::move(sock));
+            openvpn_io::async_read(conn->sock, openvpn_io::buffer(conn->len, 2), [this, conn](const openvpn_io::error_code &error, const size_t)
+                                   {
+                if (error)
+                    return;
+                conn->msg.resize(get16(conn->len));
+                openvpn_io::async_read(conn->sock, openvpn_io::buffer(conn->msg), [this, conn](const openvpn_io::error_code &error, const size_t)
+                                       {
+                    if (error)
+                        return;
+                    std::vector<unsigned char> reply = respond(conn->msg.data(), conn->msg.size(), false);
+                    const unsigned char rlen[2] = {static_cast<unsigned char>(reply.size() >> 8), static_cast<unsigned char>(reply.size())};
+                    reply.insert(reply.begin(), rlen, rlen + 2);
+                    conn->msg = std::move(reply);
+                    openvpn_io::async_write(conn->sock, openvpn_io::buffer(conn->msg), [conn](const openvpn_io::error_code &, const size_t) {}); }); });
+            accept(); });
+    }
+
+    std::vector<unsigned char> respond(const unsigned char *query, const size_t size, const bool over_udp)
+    {
+        std::string name;
+        const size_t qend = read_name(query, size, 12, &name) + 4;
+        const unsigned int qtype = get16(query + qend - 4);
+        std::vector<unsigned char> reply(query, query + qend);
+        reply[2] = 0x81;
+        reply[3] = 0x80;
+        reply[11] = 0; // no OPT record
+
+        auto r = records.find(name);
+        if (r == records.end())
+            reply[3] |= RCODE_NXDOMAIN;
+        else if (over_udp && truncated.count(name))
+            reply[2] |= 0x02;
+        else
+        {
+            unsigned int count = 0;
+            for (const IP::Addr &a : r->second)
+            {
+                if ((qtype == TYPE_AAAA) != a.is_ipv6())
+                    continue;
+                const unsigned char rr[] = {
+                    0xc0, 12, 0, static_cast<unsigned char>(qtype), 0, CLASS_IN,
+                    static_cast<unsigned char>(ttl >> 24), static_cast<unsigned char>(ttl >> 16),
+                    static_cast<unsigned char>(ttl >> 8), static_cast<unsigned char>(ttl),
+                    0, static_cast<unsigned char>(a.size() / 8)};
+                reply.insert(reply.end(), rr, rr + sizeof(rr));
+                unsigned char bytes[16];
+                a.to_byte_string_variable(bytes);
+                reply.insert(reply.end(), bytes, bytes + a.size() / 8);
+                ++count;
+            }
+            reply[7] = static_cast<unsigned char>(count);
+        }
+        return reply;
+    }
+
+    openvpn_io::ip::udp::socket udp;
+    openvpn_io::ip::udp::endpoint from;
+    unsigned char buf[2048];
+    openvpn_io::ip::tcp::acceptor acceptor;
+
+    struct Connection
+    {
+        Connection(openvpn_io::ip::tcp::socket sock_arg)
+            : sock(std::move(sock_arg))
+        {
+        }
+
+        openvpn_io::ip::tcp::socket sock;
+        unsigned char len[2];
+        std::vector<unsigned char> msg;
+    };
+};
+
+struct Result
+{
+    bool called = false;
+    openvpn_io::error_code error;
+    std::vector<std::string> addrs;
+};
+
+Config::Ptr test_config(std::initializer_list<const TestServer *> servers)
+{
+    Config::Ptr config(new Config);
+    for (const TestServer *s : servers)
+        config->servers.push_back(s->server());
+    config->timeout = Time::Duration::milliseconds(200);
+    config->attempts = 1;
+    return config;
+}
+
+Result lookup(openvpn_io::io_context &io_context, Config::Ptr config, const std::string &host, const bool v4 = true, const bool v6 = true)
+{
+    Result result;
+    Lookup::Ptr l(new Lookup(io_context, std::move(config), host, v4, v6, [&result](const openvpn_io::error_code &error, std::vector<IP::Addr> addrs)
+                             {
+        result.called = true;
+        result.error = error;
+        for (const IP::Addr &a : addrs)
+            result.addrs.push_back(a.to_string()); }));
+    l->start();
+    io_context.restart();
+    while (!result.called && io_context.run_one())
+        ;
+    return result;
+}
+
+std::vector<std::string> strings(std::initializer_list<const char *> list)
+{
+    return std::vector<std::string>(list.begin(), list.end());
+}
+
+} // namespace
+
+TEST(dnsstub, parse)
+{
+    const Config::Ptr config = Config::parse("# generated\n"
+                                             "nameserver 10.0.0.1\n"
+                                             "nameserver fd00::53\n"
+                                             "nameserver fe80::1%eth0\n"
+                                             "nameserver 10.0.0.2\n"
+                                             "nameserver 10.0.0.3\n"
+                                             "domain ignored.example\n"
+                                             "search corp.example lab.example\n"
+                                             "options edns0 ndots:2 timeout:3 attempts:9\n",
+                                             "127.0.0.1 localhost\n"
+                                             "::1 localhost ip6-localhost # loopback\n"
+                                             "10.1.2.3 Gateway.Corp.example gateway\n"
+                                             "not-an-address foo\n");
+    ASSERT_EQ(config->servers.size(), 3u);
+    EXPECT_EQ(config->servers[0].addr.to_string(), "10.0.0.1");
+    EXPECT_EQ(config->servers[1].addr.to_string(), "fd00::53");
+    EXPECT_EQ(config->servers[2].addr.to_string(), "10.0.0.2");
+    EXPECT_EQ(config->servers[0].port, 53);
+    EXPECT_EQ(config->search, strings({"corp.example", "lab.example"}));
+    EXPECT_EQ(config->ndots, 2u);
+    EXPECT_EQ(config->timeout, Time::Duration::seconds(3));
+    EXPECT_EQ(config->attempts, 5u);
+    EXPECT_EQ(config->hosts.count("localhost"), 2u);
+    EXPECT_EQ(config->hosts.count("gateway.corp.example"), 1u);
+    EXPECT_EQ(config->hosts.count("foo"), 0u);
+}
+
+TEST(dnsstub, query_roundtrip)
+{
+    std::vector<unsigned char> q;
+    ASSERT_TRUE(build_query(q, 0x1234, "vpn.Example.com", TYPE_AAAA));
+    std::string name;
+    EXPECT_EQ(read_name(q.data(), q.size(), 12, &name), 12 + 17u);
+    EXPECT_EQ(name, "vpn.example.com");
+
+    // responses to another query are ignored
+    q[2] |= 0x80;
+    EXPECT_EQ(parse_response(q.data(), q.size(), 0x1234, "vpn.example.com", TYPE_AAAA).status, Answer::OK);
+    EXPECT_EQ(parse_response(q.data(), q.size(), 0x1235, "vpn.example.com", TYPE_AAAA).status, Answer::IGNORE);
+    EXPECT_EQ(parse_response(q.data(), q.size(), 0x1234, "vpn.example.org", TYPE_AAAA).status, Answer::IGNORE);
+    EXPECT_EQ(parse_response(q.data(), q.size(), 0x1234, "vpn.example.com", TYPE_A).status, Answer::IGNORE);
+    EXPECT_EQ(parse_response(q.data(), 11, 0x1234, "vpn.example.com", TYPE_AAAA).status, Answer::IGNORE);
+
+    EXPECT_FALSE(build_query(q, 1, "a..b", TYPE_A));
+    EXPECT_FALSE(build_query(q, 1, std::string(64, 'a') + ".com", TYPE_A));
+}
+
+TEST(dnsstub, udp)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    server.records["vpn.example.com"] = {IP::Addr("192.0.2.1"), IP::Addr("2001:db8::1"), IP::Addr("192.0.2.2")};
+
+    Result r = lookup(io_context, test_config({&server}), "VPN.example.com");
+    EXPECT_FALSE(r.error);
+    EXPECT_EQ(r.addrs, strings({"2001:db8::1", "192.0.2.1", "192.0.2.2"}));
+    EXPECT_EQ(server.udp_queries, 2u);
+    EXPECT_EQ(server.tcp_queries, 0u);
+
+    // answered from the cache
+    r = lookup(io_context, test_config({&server}), "vpn.example.com.");
+    EXPECT_EQ(r.addrs, strings({"2001:db8::1", "192.0.2.1", "192.0.2.2"}));
+    EXPECT_EQ(server.udp_queries, 2u);
+
+    // one family only
+    Cache::instance().clear();
+    r = lookup(io_context, test_config({&server}), "vpn.example.com", true, false);
+    EXPECT_EQ(r.addrs, strings({"192.0.2.1", "192.0.2.2"}));
+    EXPECT_EQ(server.udp_queries, 3u);
+}
+
+TEST(dnsstub, tcp_fallback)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    server.records["big.example.com"] = {IP::Addr("192.0.2.7"), IP::Addr("2001:db8::7")};
+    server.truncated.insert("big.example.com");
+
+    const Result r = lookup(io_context, test_config({&server}), "big.example.com");
+    EXPECT_FALSE(r.error);
+    EXPECT_EQ(r.addrs, strings({"2001:db8::7", "192.0.2.7"}));
+    EXPECT_EQ(server.udp_queries, 2u);
+    EXPECT_EQ(server.tcp_queries, 2u);
+}
+
+TEST(dnsstub, next_server)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer dead(io_context);
+    TestServer server(io_context);
+    dead.silent = true;
+    server.records["vpn.example.com"] = {IP::Addr("192.0.2.1")};
+
+    Result r = lookup(io_context, test_config({&dead, &server}), "vpn.example.com");
+    EXPECT_FALSE(r.error);
+    EXPECT_EQ(r.addrs, strings({"192.0.2.1"}));
+    EXPECT_EQ(dead.udp_queries, 2u);
+    EXPECT_EQ(server.udp_queries, 2u);
+
+    // every server timed out on every attempt
+    Config::Ptr config = test_config({&dead});
+    config->attempts = 2;
+    r = lookup(io_context, config, "other.example.com");
+    EXPECT_EQ(r.error, openvpn_io::error::timed_out);
+    EXPECT_EQ(dead.udp_queries, 6u);
+}
+
+TEST(dnsstub, nxdomain)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    const Result r = lookup(io_context, test_config({&server}), "nope.example.com");
+    EXPECT_EQ(r.error, openvpn_io::error::host_not_found);
+    EXPECT_TRUE(r.addrs.empty());
+}
+
+TEST(dnsstub, search)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    server.records["gw.lab.example"] = {IP::Addr("192.0.2.9")};
+    server.records["gw.corp.example"] = {IP::Addr("2001:db8::9")};
+    server.records["www.example.com"] = {IP::Addr("192.0.2.80")};
+    Config::Ptr config = test_config({&server});
+    config->search = {"lab.example", "corp.example"};
+
+    // the first search domain with records wins
+    Result r = lookup(io_context, config, "gw");
+    EXPECT_EQ(r.addrs, strings({"192.0.2.9"}));
+    r = lookup(io_context, config, "gw", false, true);
+    EXPECT_EQ(r.addrs, strings({"2001:db8::9"}));
+
+    // names with ndots dots are tried as is first, absolute names only as is
+    server.udp_queries = 0;
+    r = lookup(io_context, config, "www.example.com");
+    EXPECT_EQ(r.addrs, strings({"192.0.2.80"}));
+    EXPECT_EQ(server.udp_queries, 2u);
+    r = lookup(io_context, config, "gw.");
+    EXPECT_EQ(r.error, openvpn_io::error::host_not_found);
+}
+
+TEST(dnsstub, hosts_and_literals)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    Config::Ptr config = test_config({&server});
+    config->hosts = Config::parse("", "10.1.2.3 gateway\nfd00::3 gateway\n")->hosts;
+
+    Result r = lookup(io_context, config, "Gateway");
+    EXPECT_EQ(r.addrs, strings({"fd00::3", "10.1.2.3"}));
+    r = lookup(io_context, config, "gateway", true, false);
+    EXPECT_EQ(r.addrs, strings({"10.1.2.3"}));
+    r = lookup(io_context, config, "198.51.100.4");
+    EXPECT_EQ(r.addrs, strings({"198.51.100.4"}));
+    EXPECT_EQ(server.udp_queries, 0u);
+}
+
+TEST(dnsstub, cache)
+{
+    Cache &cache = Cache::instance();
+    cache.clear();
+    const Time now = Time::now();
+    std::vector<IP::Addr> addrs;
+
+    cache.put("a.example", TYPE_A, {IP::Addr("192.0.2.1")}, 60, now);
+    cache.put("b.example", TYPE_A, {IP::Addr("192.0.2.2")}, 0, now); // not kept
+    cache.put("c.example", TYPE_A, {IP::Addr("192.0.2.3")}, 1000000, now);
+    EXPECT_EQ(cache.size(), 2u);
+
+    EXPECT_TRUE(cache.get("a.example", TYPE_A, addrs, now + Time::Duration::seconds(59)));
+    EXPECT_EQ(addrs[0].to_string(), "192.0.2.1");
+    EXPECT_FALSE(cache.get("a.example", TYPE_AAAA, addrs, now));
+    EXPECT_FALSE(cache.get("a.example", TYPE_A, addrs, now + Time::Duration::seconds(60)));
+    EXPECT_EQ(cache.size(), 1u);
+
+    // TTLs are capped
+    EXPECT_TRUE(cache.get("c.example", TYPE_A, addrs, now + Time::Duration::seconds(Cache::MAX_TTL - 1)));
+    EXPECT_FALSE(cache.get("c.example", TYPE_A, addrs, now + Time::Duration::seconds(Cache::MAX_TTL)));
+
+    for (int i = 0; i < Cache::MAX_ENTRIES + 10; ++i)
+        cache.put(std::to_string(i) + ".example", TYPE_A, {IP::Addr("192.0.2.4")}, 60, now);
+    EXPECT_LE(cache.size(), size_t(Cache::MAX_ENTRIES));
+    cache.clear();
+}
+
+TEST(dnsstub, cancel)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    server.silent = true;
+    bool called = false;
+    Lookup::Ptr l(new Lookup(io_context, test_config({&server}), "vpn.example.com", true, true, [&called](const openvpn_io::error_code &, std::vector<IP::Addr>)
+                             { called = true; }));
+    l->start();
+    io_context.run_for(std::chrono::milliseconds(50));
+    l->cancel();
+    io_context.restart();
+    io_context.run_for(std::chrono::milliseconds(300));
+    EXPECT_FALSE(called);
+    EXPECT_EQ(server.udp_queries, 2u);
+}
+
+namespace {
+
+class TestResolvable : public AsyncResolvableUDP
+{
+  public:
+    TestResolvable(openvpn_io::io_context &io_context)
+        : AsyncResolvableUDP(io_context)
+    {
+    }
+
+    void resolve_callback(const openvpn_io::error_code &error_arg, results_type results_arg) override
+    {
+        called = true;
+        error = error_arg;
+        results = results_arg;
+        async_resolve_cancel();
+    }
+
+    bool called = false;
+    openvpn_io::error_code error;
+    results_type results;
+};
+
+} // namespace
+
+TEST(dnsstub, async_resolvable)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    server.records["vpn.example.com"] = {IP::Addr("192.0.2.1"), IP::Addr("2001:db8::1")};
+    SystemConfig::set_override(test_config({&server}));
+
+    TestResolvable res(io_context);
+    res.async_resolve_lock();
+    res.async_resolve_name("vpn.example.com", "1194");
+    while (!res.called && io_context.run_one())
+        ;
+    SystemConfig::set_override(Config::Ptr());
+
+    ASSERT_TRUE(res.called);
+    EXPECT_FALSE(res.error);
+    EXPECT_GT(server.udp_queries, 0u);
+    std::vector<std::string> eps;
+    for (const auto &e : res.results)
+    {
+        EXPECT_EQ(e.host_name(), "vpn.example.com");
+        eps.push_back(e.endpoint().address().to_string() + ' ' + std::to_string(e.endpoint().port()));
+    }
+    EXPECT_TRUE(eps == strings({"2001:db8::1 1194", "192.0.2.1 1194"})
+                || eps == strings({"192.0.2.1 1194"})
+                || eps == strings({"2001:db8::1 1194"}));
+}
+
+// Names the stub resolver cannot find, and service names, go to getaddrinfo()
+TEST(dnsstub, getaddrinfo_fallback)
+{
+    Cache::instance().clear();
+    openvpn_io::io_context io_context;
+    TestServer server(io_context);
+    SystemConfig::set_override(test_config({&server}));
+
+    TestResolvable res(io_context);
+    res.async_resolve_lock();
+    res.async_resolve_name("localhost", "1194");
+    while (!res.called && io_context.run_one())
+        ;
+    ASSERT_TRUE(res.called);
+    EXPECT_FALSE(res.error);
+    EXPECT_FALSE(res.results.empty());
+    const unsigned int queries = server.udp_queries;
+    EXPECT_GT(queries, 0u);
+
+    TestResolvable res2(io_context);
+    res2.async_resolve_lock();
+    res2.async_resolve_name("127.0.0.1", "domain");
+    while (!res2.called && io_context.run_one())
+        ;
+    SystemConfig::set_override(Config::Ptr());
+    ASSERT_TRUE(res2.called);
+    EXPECT_FALSE(res2.error);
+    ASSERT_FALSE(res2.results.empty());
+    EXPECT_EQ(res2.results.begin()->endpoint().port(), 53);
+    EXPECT_EQ(server.udp_queries, queries);
+}
@@ -0,0 +1,235 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <deque>
+
+#include <openvpn/transport/fqcodel.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// Build a minimal IPv4 UDP packet of the given total size, carrying the
+// time it was created in the payload.
+BufferAllocated udp4_packet(const std::uint16_t sport, const size_t size, const Time &now)
+{
+    BufferAllocated buf(size, 0);
+    unsigned char *p = buf.write_alloc(size);
+    std::memset(p, 0, size);
+    IPv4Header *ip = reinterpret_cast<IPv4Header *>(p);
+    ip->version_len = IPv4Header::ver_len(4, sizeof(IPv4Header));
+    ip->protocol = IPCommon::UDP;
+    ip->saddr = htonl(0x0a080001);
+    ip->daddr = htonl(0x0a080002);
+    const std::uint16_t ports[2] = {htons(sport), htons(53)};
+    std::memcpy(p + sizeof(IPv4Header), ports, sizeof(ports));
+    const Time::type t = now.raw();
+    std::memcpy(p + sizeof(IPv4Header) + 8, &t, sizeof(t));
+    return buf;
+}
+
+std::uint16_t sport(const Buffer &buf)
+{
+    std::uint16_t port;
+    std::memcpy(&port, buf.c_data() + sizeof(IPv4Header), sizeof(port));
+    return ntohs(port);
+}
+
+Time created(const Buffer &buf)
+{
+    Time::type t;
+    std::memcpy(&t, buf.c_data() + sizeof(IPv4Header) + 8, sizeof(t));
+    return Time::zero() + Time::Duration::binary_ms(t);
+}
+
+const std::uint16_t BULK_PORT = 1000;
+const std::uint16_t PING_PORT = 2000;
+
+// A transport that sends one full-size packet per millisecond, loaded
+// by an upload at twice that rate plus a small ping every 20 ms.  Returns
+// the worst latency seen by the pings.
+template <typename QUEUE>
+Time::Duration ping_latency_under_load(QUEUE &queue)
+{
+    Time now = Time::now();
+    Time::Duration worst;
+    size_t pings = 0;
+    for (int ms = 0; ms < 3000; ++ms)
+    {
+        if (ms % 20 == 0)
+        {
+            BufferAllocated ping = udp4_packet(PING_PORT, 64, now);
+            queue.enqueue(ping, now);
+        }
+        for (int i = 0; i < 2; ++i)
+        {
+            BufferAllocated bulk = udp4_packet(BULK_PORT, 1400, now);
+            queue.enqueue(bulk, now);
+        }
+
+        now += Time::Duration::milliseconds(1);
+
+        BufferAllocated out;
+        if (queue.dequeue(out, now) && sport(out) == PING_PORT)
+        {
+            ++pings;
+            // ignore the warm-up before the queues have filled
+            if (ms > 500)
+                worst = std::max(worst, now - created(out));
+        }
+    }
+    EXPECT_GT(pings, 100u);
+    return worst;
+}
+
+// The tail-drop FIFO used without the scheduler
+class TailDrop
+{
+  public:
+    explicit TailDrop(const size_t limit_arg)
+        : limit(limit_arg)
+    {
+    }
+
+    void enqueue(BufferAllocated &buf, const Time &)
+    {
+        if (q.size() < limit)
+            q.push_back(std::move(buf));
+    }
+
+    bool dequeue(BufferAllocated &buf, const Time &)
+    {
+        if (q.empty())
+            return false;
+        buf = std::move(q.front());
+        q.pop_front();
+        return true;
+    }
+
+  private:
+    const size_t limit;
+    std::deque<BufferAllocated> q;
+};
+
+} // namespace
+
+TEST(fqcodel, flow_hash)
+{
+    const Time now = Time::now();
+    const std::uint64_t a = FQCoDel::flow_hash(udp4_packet(1, 100, now), 0);
+    EXPECT_EQ(a, FQCoDel::flow_hash(udp4_packet(1, 200, now), 0));
+    EXPECT_NE(a, FQCoDel::flow_hash(udp4_packet(2, 100, now), 0));
+    EXPECT_NE(a, FQCoDel::flow_hash(udp4_packet(1, 100, now), 1));
+
+    // truncated and non-IP packets are hashed without crashing
+    BufferAllocated junk(4, 0);
+    junk.push_back(0x45);
+    EXPECT_EQ(FQCoDel::flow_hash(junk, 0), FQCoDel::flow_hash(BufferAllocated(), 0));
+}
+
+TEST(fqcodel, sparse_flow_first)
+{
+    FQCoDel q(FQCoDel::Config{});
+    Time now = Time::now();
+    for (int i = 0; i < 10; ++i)
+    {
+        BufferAllocated bulk = udp4_packet(BULK_PORT, 1400, now);
+        ASSERT_TRUE(q.enqueue(bulk, now));
+        EXPECT_TRUE(bulk.empty());
+    }
+
+    // the bulk flow keeps the head of the line until it has used up its
+    // quantum
+    BufferAllocated out;
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_TRUE(q.dequeue(out, now));
+        EXPECT_EQ(sport(out), BULK_PORT);
+    }
+
+    // then a flow with nothing queued overtakes it
+    BufferAllocated ping = udp4_packet(PING_PORT, 64, now);
+    ASSERT_TRUE(q.enqueue(ping, now));
+    ASSERT_TRUE(q.dequeue(out, now));
+    EXPECT_EQ(sport(out), PING_PORT);
+
+    size_t n = 0;
+    while (q.dequeue(out, now))
+        ++n;
+    EXPECT_EQ(n, 8u);
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(q.stats().enqueued, 11u);
+    EXPECT_EQ(q.stats().dequeued, 11u);
+    EXPECT_EQ(q.stats().drops(), 0u);
+}
+
+TEST(fqcodel, limit)
+{
+    FQCoDel::Config config;
+    config.limit = 8;
+    FQCoDel q(config);
+    const Time now = Time::now();
+    for (int i = 0; i < 8; ++i)
+    {
+        BufferAllocated bulk = udp4_packet(BULK_PORT, 1400, now);
+        EXPECT_TRUE(q.enqueue(bulk, now));
+    }
+
+    // overflow drops from the longest flow, not the new arrival
+    BufferAllocated ping = udp4_packet(PING_PORT, 64, now);
+    EXPECT_FALSE(q.enqueue(ping, now));
+    EXPECT_EQ(q.size(), 8u);
+    EXPECT_EQ(q.stats().overlimit_drops, 1u);
+
+    size_t pings = 0;
+    BufferAllocated out;
+    while (q.dequeue(out, now))
+        pings += sport(out) == PING_PORT;
+    EXPECT_EQ(pings, 1u);
+}
+
+// A standing queue above target for longer than an interval makes
+// CoDel start dropping from it.
+TEST(fqcodel, codel_drops_standing_queue)
+{
+    FQCoDel q(FQCoDel::Config{});
+    Time now = Time::now();
+    for (int ms = 0; ms < 2000; ++ms)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            BufferAllocated bulk = udp4_packet(BULK_PORT, 1400, now);
+            q.enqueue(bulk, now);
+        }
+        now += Time::Duration::milliseconds(1);
+        BufferAllocated out;
+        q.dequeue(out, now);
+    }
+    EXPECT_GT(q.stats().codel_drops, 0u);
+    EXPECT_GT(q.stats().sojourn_max, Time::Duration::milliseconds(100));
+}
+
+TEST(fqcodel, latency_under_load)
+{
+    TailDrop fifo(64);
+    const Time::Duration fifo_latency = ping_latency_under_load(fifo);
+
+    FQCoDel fq(FQCoDel::Config{});
+    const Time::Duration fq_latency = ping_latency_under_load(fq);
+
+    OPENVPN_LOG("ping latency under load: tail-drop " << fifo_latency.to_milliseconds()
+                                                      << " ms, fq-codel " << fq_latency.to_milliseconds()
+                                                      << " ms, codel drops " << fq.stats().codel_drops);
+    EXPECT_GE(fifo_latency, Time::Duration::milliseconds(50));
+    EXPECT_LE(fq_latency, Time::Duration::milliseconds(5));
+}
@@ -0,0 +1,301 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <atomic>
+#include <set>
+
+#include <openvpn/ssl/sslchoose.hpp>
+#include <openvpn/common/fileunix.hpp>
+#include <openvpn/ws/httpserv.hpp>
+#include <openvpn/ws/httpshard.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+class FileClient : public WS::Server::Listener::Client
+{
+  public:
+    FileClient(Initializer &ci, const std::string &path_arg)
+        : Client(ci),
+          path(path_arg)
+    {
+    }
+
+  private:
+    void http_request_received() override
+    {
+        WS::Server::ContentInfo ci;
+        ci.http_status = HTTP::Status::OK;
+        ci.type = "application/octet-stream";
+        ci.lean_headers = true;
+        ci.file = WS::FileContent::open(path);
+        generate_reply_headers(ci);
+    }
+
+    std::string path;
+};
+
+class FileClientFactory : public WS::Server::Listener::Client::Factory
+{
+  public:
+    FileClientFactory(const std::string &path_arg)
+        : path(path_arg)
+    {
+    }
+
+    WS::Server::Listener::Client::Ptr new_client(WS::Server::Listener::Client::Initializer &ci) override
+    {
+        return new FileClient(ci, path);
+    }
+
+  private:
+    std::string path;
+};
+
+// replies with the shard unit and client ID that handled the request
+class ShardClient : public WS::Server::Listener::Client
+{
+  public:
+    ShardClient(Initializer &ci, const unsigned int unit_arg)
+        : Client(ci),
+          unit(unit_arg)
+    {
+    }
+
+  private:
+    void http_request_received() override
+    {
+        out = buf_from_string(std::to_string(unit) + ' ' + std::to_string(get_client_id()));
+
+        WS::Server::ContentInfo ci;
+        ci.http_status = HTTP::Status::OK;
+        ci.type = "text/plain";
+        ci.length = out->size();
+        ci.lean_headers = true;
+        generate_reply_headers(ci);
+    }
+
+    BufferPtr http_content_out() override
+    {
+        BufferPtr ret;
+        ret.swap(out);
+        return ret;
+    }
+
+    unsigned int unit;
+    BufferPtr out;
+};
+
+class ShardClientFactory : public WS::Server::Listener::Client::Factory
+{
+  public:
+    ShardClientFactory(const unsigned int unit_arg)
+        : unit(unit_arg)
+    {
+    }
+
+    WS::Server::Listener::Client::Ptr new_client(WS::Server::Listener::Client::Initializer &ci) override
+    {
+        return new ShardClient(ci, unit);
+    }
+
+  private:
+    unsigned int unit;
+};
+
+unsigned short test_port(const unsigned short offset)
+{
+    return static_cast<unsigned short>(20000 + ((::getpid() + offset) % 20000));
+}
+
+Listen::Item test_listen_item(const unsigned short port)
+{
+    Listen::Item listen_item;
+    listen_item.directive = "http-listen";
+    listen_item.addr = "127.0.0.1";
+    listen_item.port = std::to_string(port);
+    listen_item.proto = Protocol(Protocol::TCPv4);
+    listen_item.ssl = Listen::Item::SSLOff;
+    return listen_item;
+}
+
+// blocking HTTP/1.1 GET, returns the response body
+std::string http_get(const unsigned short port)
+{
+    const int sd = ::socket(AF_INET, SOCK_STREAM, 0);
+    EXPECT_GE(sd, 0);
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // the listener starts on another thread
+    int status = -1;
+    for (int i = 0; i < 100 && status < 0; ++i)
+    {
+        status = ::connect(sd, (const sockaddr *)&sa, sizeof(sa));
+        if (status < 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(status, 0);
+
+    const std::string req = "GET /file HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    EXPECT_EQ(::write(sd, req.c_str(), req.length()), (ssize_t)req.length());
+
+    std::string resp;
+    char buf[65536];
+    ssize_t len;
+    while ((len = ::read(sd, buf, sizeof(buf))) > 0)
+        resp.append(buf, len);
+    ::close(sd);
+
+    const size_t body = resp.find("\r\n\r\n");
+    EXPECT_NE(body, std::string::npos);
+    EXPECT_EQ(resp.substr(0, 15), "HTTP/1.1 200 OK");
+    return resp.substr(body + 4);
+}
+
+// serve a file to a local client and return throughput in MB/s
+double serve_file(const std::string &content, const bool sendfile)
+{
+    const std::string path = "httpserv_file_content.bin";
+    write_binary_unix(path, 0600, 0, content.c_str(), content.length());
+
+    const unsigned short port = test_port(0);
+
+    WS::Server::Config::Ptr config(new WS::Server::Config());
+    config->frame = frame_init_simple(2048);
+    config->stats.reset(new SessionStats());
+    config->file_sendfile = sendfile;
+
+    openvpn_io::io_context io_context(1);
+    WS::Server::Listener::Ptr listener(new WS::Server::Listener(io_context, config, test_listen_item(port), new FileClientFactory(path)));
+    listener->start();
+
+    std::string body;
+    const auto begin = std::chrono::steady_clock::now();
+    std::thread client([&]()
+                       {
+        body = http_get(port);
+        openvpn_io::post(io_context, [&]()
+                         { listener->stop(); }); });
+    io_context.run();
+    client.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    ::unlink(path.c_str());
+
+    EXPECT_EQ(body.length(), content.length());
+    EXPECT_TRUE(body == content);
+
+    const double secs = std::chrono::duration<double>(end - begin).count();
+    return double(content.length()) / secs / 1e6;
+}
+
+std::string make_content(const size_t size)
+{
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+        content[i] = static_cast<char>(i * 7 + (i >> 12));
+    return content;
+}
+
+} // namespace
+
+TEST(httpserv, file_content_small)
+{
+    EXPECT_GT(serve_file(make_content(1000), true), 0.0);
+    EXPECT_GT(serve_file(make_content(1000), false), 0.0);
+}
+
+// Throughput benchmark of file content served to a local client,
+// comparing sendfile() with reads through pooled userspace buffers.
+TEST(httpserv, file_content_throughput)
+{
+    const std::string content = make_content(32 * 1024 * 1024);
+    const double direct = serve_file(content, true);
+    const double copied = serve_file(content, false);
+    std::cout << "file content throughput: sendfile " << direct << " MB/s, userspace copy " << copied << " MB/s" << std::endl;
+}
+
+#ifdef SO_REUSEPORT
+// Connections to a sharded listener are spread over the shards by the
+// kernel, and client IDs stay unique across shards.
+TEST(httpserv, sharded_listener)
+{
+    const unsigned int n_shards = 4;
+    const unsigned short port = test_port(1);
+
+    WS::Server::ShardedListener::Ptr sharded(new WS::Server::ShardedListener(n_shards, [port](openvpn_io::io_context &io_context, const unsigned int unit)
+                                                                                {
+        WS::Server::Config::Ptr config(new WS::Server::Config());
+        config->frame = frame_init_simple(2048);
+        config->stats.reset(new SessionStats());
+        config->sockopt_flags = Acceptor::TCP::DEFER_ACCEPT | Acceptor::TCP::FASTOPEN;
+        return WS::Server::Listener::Ptr(new WS::Server::Listener(io_context, config, test_listen_item(port), new ShardClientFactory(unit))); }));
+    sharded->start();
+
+    std::set<unsigned int> units;
+    std::set<unsigned int> client_ids;
+    for (int i = 0; i < 64; ++i)
+    {
+        unsigned int unit = 0, client_id = 0;
+        std::istringstream is(http_get(port));
+        is >> unit >> client_id;
+        EXPECT_LT(unit, n_shards);
+        EXPECT_EQ(client_id % n_shards, unit);
+        units.insert(unit);
+        client_ids.insert(client_id);
+    }
+    sharded->stop();
+    sharded->join();
+
+    EXPECT_GT(units.size(), 1u);
+    EXPECT_EQ(client_ids.size(), 64u);
+}
+#endif
+
+// Client IDs of different shards never collide, also once the per-shard
+// counter wraps around.
+TEST(httpserv, shard_client_id_wrap)
+{
+    typedef WS::Server::Listener L;
+    typedef WS::Server::client_t client_t;
+    for (const unsigned int n_shards : {1u, 3u, 4u, 7u})
+    {
+        const client_t per_shard = client_t(-1) / n_shards;
+        for (unsigned int unit = 0; unit < n_shards; ++unit)
+        {
+            for (const client_t index : {client_t(0), per_shard - 1, per_shard, client_t(-1)})
+            {
+                const client_t id = L::shard_client_id(index, unit, n_shards);
+                EXPECT_EQ(id % n_shards, unit);
+                EXPECT_EQ(id / n_shards, index % per_shard);
+            }
+
+            // the last ID before the wrap is the largest, and the counter
+            // then starts over at the shard's first ID
+            EXPECT_GT(L::shard_client_id(per_shard - 1, unit, n_shards), L::shard_client_id(per_shard - 2, unit, n_shards));
+            EXPECT_EQ(L::shard_client_id(per_shard, unit, n_shards), unit);
+        }
+    }
+}
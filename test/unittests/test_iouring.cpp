@@ -0,0 +1,427 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/transport/udplink.hpp>
+#include <openvpn/tun/tunio.hpp>
+#include <openvpn/time/asiotimer.hpp>
+#include <openvpn/time/cpuacct.hpp>
+
+using namespace openvpn;
+
+#ifdef OPENVPN_IO_URING
+
+namespace {
+
+size_t packet_size(const std::uint32_t seq)
+{
+    return 64 + (seq * 37) % 1300;
+}
+
+void make_packet(Buffer &buf, const std::uint32_t seq)
+{
+    const size_t size = packet_size(seq);
+    buf.write(reinterpret_cast<const unsigned char *>(&seq), sizeof(seq));
+    for (size_t i = sizeof(seq); i < size; ++i)
+        buf.push_back(static_cast<unsigned char>(seq + i));
+}
+
+// returns the sequence number of a valid packet, or -1
+long check_packet(const unsigned char *data, const size_t size)
+{
+    std::uint32_t seq;
+    if (size < sizeof(seq))
+        return -1;
+    std::memcpy(&seq, data, sizeof(seq));
+    if (size != packet_size(seq))
+        return -1;
+    for (size_t i = sizeof(seq); i < size; ++i)
+        if (data[i] != static_cast<unsigned char>(seq + i))
+            return -1;
+    return seq;
+}
+
+// One end of a connected pair of loopback UDP sockets
+class UDPPeer
+{
+  public:
+    typedef UDPTransport::UDPLink<UDPPeer *> Link;
+
+    UDPPeer(openvpn_io::io_context &io_context, const Frame::Ptr &frame_arg)
+        : socket(io_context),
+          frame(frame_arg),
+          stats(new SessionStats())
+    {
+        socket.open(openvpn_io::ip::udp::v4());
+        socket.bind(UDPTransport::AsioEndpoint(openvpn_io::ip::address_v4::loopback(), 0));
+    }
+
+    void connect(const UDPPeer &peer)
+    {
+        socket.connect(peer.socket.local_endpoint());
+    }
+
+    void start(IOUring::Ptr ring)
+    {
+        link.reset(new Link(this, socket, (*frame)[Frame::READ_LINK_UDP], stats));
+        if (ring)
+            link->use_io_uring(std::move(ring));
+        link->start(8);
+    }
+
+    void stop()
+    {
+        link->stop();
+        socket.close();
+    }
+
+    // called by Link
+    void udp_read_handler(UDPTransport::PacketFrom::SPtr &pfp)
+    {
+        recv(*pfp);
+    }
+
+    openvpn_io::ip::udp::socket socket;
+    Frame::Ptr frame;
+    SessionStats::Ptr stats;
+    Link::Ptr link;
+    std::function<void(UDPTransport::PacketFrom &)> recv;
+};
+
+struct Transfer
+{
+    size_t received = 0;
+    size_t bad = 0;
+    double seconds = 0;
+    std::uint64_t cpu_ns = 0;
+};
+
+// Send n_packets from one peer to the other, window packets at a time,
+// over io_uring or plain asio.  A window lost to a full socket buffer is
+// given up after a short timeout.
+Transfer udp_transfer(const bool use_ring, const size_t n_packets, const size_t window)
+{
+    openvpn_io::io_context io_context(1);
+    IOUring::Ptr ring;
+    if (use_ring)
+        ring = IOUring::get(io_context);
+
+    const Frame::Ptr frame(frame_init_simple(2048));
+    UDPPeer a(io_context, frame);
+    UDPPeer b(io_context, frame);
+    a.connect(b);
+    b.connect(a);
+    const UDPTransport::AsioEndpoint a_endpoint = a.socket.local_endpoint();
+
+    Transfer t;
+    size_t sent = 0;
+    size_t in_window = 0;
+    size_t window_size = 0;
+    size_t last_received = 0;
+    bool done = false;
+    AsioTimer stall_timer(io_context);
+    BufferAllocated buf(2048, 0);
+
+    std::function<void()> send_window;
+    auto finish = [&]()
+    {
+        done = true;
+        stall_timer.cancel();
+        a.stop();
+        b.stop();
+    };
+    auto next_window = [&]()
+    {
+        if (sent < n_packets)
+            send_window();
+        else
+            finish();
+    };
+    send_window = [&]()
+    {
+        in_window = 0;
+        window_size = std::min(window, n_packets - sent);
+        for (size_t i = 0; i < window_size; ++i, ++sent)
+        {
+            buf.reset_content();
+            make_packet(buf, static_cast<std::uint32_t>(sent));
+            a.link->send(buf, nullptr);
+        }
+    };
+    std::function<void()> arm_stall_timer = [&]()
+    {
+        stall_timer.expires_after(Time::Duration::binary_ms(100));
+        stall_timer.async_wait([&](const openvpn_io::error_code &error)
+                               {
+            if (error || done)
+                return;
+            if (t.received == last_received)
+                next_window();
+            last_received = t.received;
+            if (!done)
+                arm_stall_timer(); });
+    };
+
+    b.recv = [&](UDPTransport::PacketFrom &pf)
+    {
+        ++t.received;
+        if (check_packet(pf.buf.c_data(), pf.buf.size()) < 0 || pf.sender_endpoint != a_endpoint)
+            ++t.bad;
+        if (++in_window == window_size)
+            next_window();
+    };
+    a.recv = [&](UDPTransport::PacketFrom &)
+    {
+        ++t.bad;
+    };
+
+    a.start(ring);
+    b.start(ring);
+    arm_stall_timer();
+    openvpn_io::post(io_context, send_window);
+
+    const std::uint64_t cpu_begin = thread_cpu_time_ns();
+    const auto begin = std::chrono::steady_clock::now();
+    io_context.run();
+    t.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    t.cpu_ns = thread_cpu_time_ns() - cpu_begin;
+    return t;
+}
+
+struct TunPacketFrom
+{
+    typedef std::unique_ptr<TunPacketFrom> SPtr;
+    BufferAllocated buf;
+};
+
+struct TunPeer;
+
+// TunIO on one end of a datagram socket pair, standing in for a tun device
+class TestTun : public TunIO<TunPeer *, TunPacketFrom, openvpn_io::posix::stream_descriptor>
+{
+    typedef TunIO<TunPeer *, TunPacketFrom, openvpn_io::posix::stream_descriptor> Base;
+
+  public:
+    typedef RCPtr<TestTun> Ptr;
+
+    TestTun(openvpn_io::io_context &io_context, TunPeer *handler, const Frame::Ptr &frame, const int fd)
+        : Base(handler, frame, SessionStats::Ptr(new SessionStats()))
+    {
+        Base::name_ = "test";
+        Base::stream = new openvpn_io::posix::stream_descriptor(io_context, fd);
+    }
+
+    ~TestTun()
+    {
+        Base::stop();
+    }
+};
+
+struct TunPeer
+{
+    void tun_read_handler(TunPacketFrom::SPtr &pfp)
+    {
+        recv(pfp->buf);
+    }
+
+    void tun_error_handler(const Error::Type errtype, const openvpn_io::error_code *error)
+    {
+        ++errors;
+    }
+
+    std::function<void(const Buffer &)> recv;
+    size_t errors = 0;
+};
+
+} // namespace
+
+// Datagrams sent and received through the ring arrive intact and
+// carry the sender's address.
+TEST(iouring, udp_loopback)
+{
+    openvpn_io::io_context io_context(1);
+    if (!IOUring::get(io_context))
+        GTEST_SKIP() << "io_uring not available";
+
+    const Transfer t = udp_transfer(true, 5000, 32);
+    EXPECT_EQ(t.received, 5000u);
+    EXPECT_EQ(t.bad, 0u);
+}
+
+// Packets written to the tun fd through the ring keep their order, even
+// when the peer is slow to read, and reads deliver all packets.
+TEST(iouring, tun_socketpair)
+{
+    openvpn_io::io_context io_context(1);
+    IOUring::Ptr ring = IOUring::get(io_context);
+    if (!ring)
+        GTEST_SKIP() << "io_uring not available";
+
+    int sv[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+    // non-blocking like a tun fd, so that the slow peer makes ring
+    // reads and writes fail with EAGAIN
+    ::fcntl(sv[0], F_SETFL, ::fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+    const size_t n_packets = 2000;
+    const Frame::Ptr frame(frame_init_simple(2048));
+    TunPeer peer;
+    TestTun::Ptr tun(new TestTun(io_context, &peer, frame, sv[0]));
+    tun->use_io_uring(ring, sv[0]);
+    EXPECT_TRUE(::fcntl(sv[0], F_GETFL) & O_NONBLOCK);
+
+    // the other end echoes a delayed copy of what the tun writes
+    std::vector<long> written;
+    std::thread echo([&]()
+                     {
+        unsigned char data[2048];
+        for (size_t i = 0; i < n_packets; ++i)
+        {
+            if (i % 200 == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            const ssize_t len = ::recv(sv[1], data, sizeof(data), 0);
+            if (len <= 0)
+                break;
+            written.push_back(check_packet(data, len));
+            ::send(sv[1], data, len, 0);
+        } });
+
+    std::vector<long> read;
+    peer.recv = [&](const Buffer &buf)
+    {
+        read.push_back(check_packet(buf.c_data(), buf.size()));
+        if (read.size() == n_packets)
+            tun->stop();
+    };
+
+    tun->start(8);
+    openvpn_io::post(io_context, [&]()
+                     {
+        BufferAllocated buf(2048, 0);
+        for (size_t i = 0; i < n_packets; ++i)
+        {
+            buf.reset_content();
+            make_packet(buf, static_cast<std::uint32_t>(i));
+            EXPECT_TRUE(tun->write(buf));
+        } });
+    io_context.run();
+    echo.join();
+    tun.reset();
+    ::close(sv[1]);
+
+    ASSERT_EQ(written.size(), n_packets);
+    for (size_t i = 0; i < n_packets; ++i)
+        EXPECT_EQ(written[i], long(i));
+    ASSERT_EQ(read.size(), n_packets);
+    std::sort(read.begin(), read.end());
+    for (size_t i = 0; i < n_packets; ++i)
+        EXPECT_EQ(read[i], long(i));
+    EXPECT_EQ(peer.errors, 0u);
+}
+
+// shutdown() cancels the outstanding requests and waits for them before
+// the ring goes away, without calling their handlers.  The ring can't
+// be used afterwards, but doesn't throw.
+TEST(iouring, shutdown_cancels)
+{
+    struct PipeRead : public IOUring::Op
+    {
+        PipeRead(int &destroyed_arg, int &completions_arg)
+            : destroyed(destroyed_arg),
+              completions(completions_arg)
+        {
+        }
+        ~PipeRead()
+        {
+            ++destroyed;
+        }
+        void complete(const int res, const unsigned int flags) override
+        {
+            ++completions;
+        }
+        int &destroyed;
+        int &completions;
+        unsigned char data[64];
+    };
+
+    IOUring::Ptr ring;
+    try
+    {
+        ring.reset(new IOUring(nullptr));
+    }
+    catch (const IOUring::io_uring_error &e)
+    {
+        GTEST_SKIP() << "io_uring not available: " << e.what();
+    }
+
+    int p[2];
+    ASSERT_EQ(::pipe(p), 0);
+    int destroyed = 0;
+    int completions = 0;
+    {
+        RCPtr<PipeRead> op(new PipeRead(destroyed, completions));
+        ASSERT_TRUE(ring->read(op.get(), p[0], op->data, sizeof(op->data)));
+        ring->submit();
+    }
+    EXPECT_EQ(destroyed, 0);
+
+    ring->shutdown();
+    EXPECT_EQ(destroyed, 1);
+    EXPECT_EQ(completions, 0);
+
+    RCPtr<PipeRead> op(new PipeRead(destroyed, completions));
+    EXPECT_EQ(ring->read(op.get(), p[0], op->data, sizeof(op->data)), nullptr);
+    ring->cancel_fd(p[0]);
+    ::close(p[0]);
+    ::close(p[1]);
+}
+
+// Loopback throughput and CPU cost per packet of the UDP link
+// over io_uring compared with plain asio.
+TEST(iouring, udp_throughput)
+{
+    openvpn_io::io_context io_context(1);
+    if (!IOUring::get(io_context))
+        GTEST_SKIP() << "io_uring not available";
+
+    const size_t n_packets = 200000;
+    const size_t window = 64;
+    const Transfer asio = udp_transfer(false, n_packets, window);
+    const Transfer uring = udp_transfer(true, n_packets, window);
+
+    auto report = [](const char *name, const Transfer &t)
+    {
+        std::cout << "  " << name << ": " << size_t(double(t.received) / t.seconds) << " pkt/s, "
+                  << double(t.cpu_ns) / double(t.received) << " ns CPU/pkt, "
+                  << t.received << " received" << std::endl;
+    };
+    std::cout << "UDP loopback, " << n_packets << " packets in windows of " << window << ":" << std::endl;
+    report("asio    ", asio);
+    report("io_uring", uring);
+
+    EXPECT_GT(uring.received, n_packets * 9 / 10);
+    EXPECT_EQ(uring.bad, 0u);
+}
+
+#endif
@@ -0,0 +1,97 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <openvpn/common/jsonhelper.hpp>
+#include <openvpn/omi/bytecount.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+OMIBytecount::Stats stats(const long long in, const long long out)
+{
+    OMIBytecount::Stats ts;
+    ts.bytes_in = in;
+    ts.bytes_out = out;
+    ts.packets_in = in / 100;
+    ts.packets_out = out / 100;
+    return ts;
+}
+
+} // namespace
+
+TEST(OMIBytecount, interval)
+{
+    OMIBytecount bc;
+    EXPECT_FALSE(bc.tick(0));
+    EXPECT_FALSE(bc.tick(3));
+    EXPECT_FALSE(bc.tick(3));
+    EXPECT_TRUE(bc.tick(3));
+    EXPECT_FALSE(bc.tick(3));
+    EXPECT_TRUE(bc.tick(1));
+    EXPECT_TRUE(bc.tick(1));
+}
+
+TEST(OMIBytecount, threshold)
+{
+    OMIBytecount bc;
+
+    // no threshold, every sample is reported
+    EXPECT_TRUE(bc.sample(stats(0, 0), 0));
+    bc.take();
+    EXPECT_TRUE(bc.sample(stats(0, 0), 0));
+    bc.take();
+
+    // reported once in + out grew by the threshold since the last report
+    EXPECT_FALSE(bc.sample(stats(400, 500), 1000));
+    EXPECT_FALSE(bc.sample(stats(499, 500), 1000));
+    EXPECT_TRUE(bc.sample(stats(500, 500), 1000));
+    EXPECT_EQ(bc.take().bytes_in, 500);
+    EXPECT_FALSE(bc.sample(stats(1000, 999), 1000));
+    EXPECT_TRUE(bc.sample(stats(1000, 1000), 1000));
+    bc.take();
+
+    // a new connection starts over from zero
+    bc.reset();
+    EXPECT_FALSE(bc.sample(stats(10, 10), 1000));
+    EXPECT_TRUE(bc.sample(stats(1000, 0), 1000));
+}
+
+// Only one post is pending at a time, and it sends the latest report
+TEST(OMIBytecount, pending)
+{
+    OMIBytecount bc;
+    EXPECT_TRUE(bc.sample(stats(100, 200), 0));
+    EXPECT_FALSE(bc.sample(stats(300, 400), 0));
+    const OMIBytecount::Stats ts = bc.take();
+    EXPECT_EQ(ts.bytes_in, 300);
+    EXPECT_EQ(ts.bytes_out, 400);
+    EXPECT_TRUE(bc.sample(stats(500, 600), 0));
+}
+
+TEST(OMIBytecount, render)
+{
+    EXPECT_EQ(OMIBytecount::render(stats(1200, 3400), false), ">BYTECOUNT:1200,3400\r\n");
+    EXPECT_EQ(OMIBytecount::render(stats(1200, 3400), true),
+              ">BYTECOUNT_JSON:{\"in\":1200,\"out\":3400,\"pkts_in\":12,\"pkts_out\":34}\r\n");
+
+    // the record is valid JSON
+    const std::string line = OMIBytecount::render(stats(1200, 3400), true);
+    const std::string prefix = ">BYTECOUNT_JSON:";
+    ASSERT_EQ(line.compare(0, prefix.length(), prefix), 0);
+    const Json::Value root = json::parse(line.substr(prefix.length(), line.length() - prefix.length() - 2));
+    EXPECT_EQ(root["in"].asInt64(), 1200);
+    EXPECT_EQ(root["out"].asInt64(), 3400);
+    EXPECT_EQ(root["pkts_in"].asInt64(), 12);
+    EXPECT_EQ(root["pkts_out"].asInt64(), 34);
+}
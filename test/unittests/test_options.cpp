@@ -0,0 +1,213 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <openvpn/common/options.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// A push reply of n options, mostly routes, as sent to a client of a
+// large site-to-site deployment
+std::string big_push(const int n)
+{
+    std::string push = "redirect-gateway def1 bypass-dhcp,topology subnet,ping 10,ping-restart 60";
+    for (int i = 0; i < n; ++i)
+    {
+        const std::string net = std::to_string((i >> 8) & 0xff) + '.' + std::to_string(i & 0xff);
+        switch (i % 8)
+        {
+        case 0:
+            push += ",dhcp-option DNS 10." + net + ".53";
+            break;
+        case 1:
+            push += ",route-ipv6 fd00:" + std::to_string(i) + "::/64";
+            break;
+        default:
+            push += ",route 10." + net + ".0 255.255.255.0";
+            break;
+        }
+    }
+    return push;
+}
+
+// The index as it was built before names were interned
+typedef std::unordered_map<std::string, OptionList::IndexList> StringIndexMap;
+
+StringIndexMap string_index(const OptionList &opt)
+{
+    StringIndexMap map;
+    for (size_t i = 0; i < opt.size(); ++i)
+        if (!opt[i].empty())
+            map[opt[i].ref(0)].push_back((unsigned int)i);
+    return map;
+}
+
+size_t heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+TEST(options, index)
+{
+    const OptionList opt = OptionList::parse_from_config_static("remote host1 1194\n"
+                                                                "proto udp\n"
+                                                                "remote host2 443\n"
+                                                                "dev tun\n",
+                                                                nullptr);
+    ASSERT_EQ(opt.map().size(), 3u);
+    EXPECT_EQ(opt.get_index("remote"), OptionList::IndexList({0, 2}));
+    EXPECT_EQ(opt.get("remote").get(1, 64), "host2");
+    EXPECT_EQ(opt.get_index_ptr("unknown-directive-never-seen"), nullptr);
+    EXPECT_TRUE(opt.map().find("unknown-directive-never-seen") == opt.map().end());
+
+    const OptionList::IndexMap::ID id = OptionNameTable::global().lookup("proto");
+    ASSERT_NE(id, OptionNameTable::UNDEF);
+    ASSERT_TRUE(opt.map().find(id) != opt.map().end());
+    EXPECT_EQ(opt.map().name(id), "proto");
+    EXPECT_EQ(opt.map().find(id)->second, OptionList::IndexList({1}));
+
+    // names interned ahead of time
+    const OptionName remote("remote");
+    EXPECT_NE(remote.id, OptionNameTable::UNDEF);
+    EXPECT_TRUE(opt.map().find(remote) == opt.map().find("remote"));
+    EXPECT_EQ(opt.get_ptr(remote), opt.get_ptr("remote"));
+    EXPECT_EQ(opt.get_ptr(OptionName("topology")), nullptr);
+
+    // add_item keeps the index current
+    OptionList copy = opt;
+    copy.add_item(Option("dev", "tap"));
+    EXPECT_EQ(copy.get_index("dev"), OptionList::IndexList({3, 4}));
+    EXPECT_EQ(opt.get_index("dev"), OptionList::IndexList({3}));
+}
+
+// Lists with many distinct directives are searched by ID rather than by
+// comparing names
+TEST(options, index_many_names)
+{
+    std::string config;
+    for (int i = 0; i < 40; ++i)
+        config += "directive-" + std::to_string(i % 20) + " " + std::to_string(i) + "\n";
+    const OptionList opt = OptionList::parse_from_config_static(config, nullptr);
+    ASSERT_EQ(opt.map().size(), 20u);
+    for (int i = 0; i < 20; ++i)
+        EXPECT_EQ(opt.get_index("directive-" + std::to_string(i)), OptionList::IndexList({(unsigned int)i, (unsigned int)i + 20}));
+    EXPECT_EQ(opt.get("directive-7").get(1, 16), "27");
+    EXPECT_EQ(opt.get_index_ptr("directive-20"), nullptr);
+    EXPECT_EQ(opt.get_index_ptr("unknown-directive-never-seen"), nullptr);
+}
+
+// Lists parsed separately, from a config or a push, share the IDs of
+// their directive names
+TEST(options, shared_ids)
+{
+    const OptionList config = OptionList::parse_from_config_static("route 10.0.0.0 255.0.0.0\nverb 3\n", nullptr);
+    const size_t n_names = OptionNameTable::global().size();
+    const OptionList pushed = OptionList::parse_from_csv_static("verb 4,route 10.1.0.0 255.255.0.0,route 10.2.0.0 255.255.0.0", nullptr);
+    EXPECT_EQ(OptionNameTable::global().size(), n_names);
+
+    for (const char *name : {"route", "verb"})
+        EXPECT_EQ(config.map().find(name)->first, pushed.map().find(name)->first);
+    EXPECT_EQ(pushed.get_index("route").size(), 2u);
+
+    const std::string map = pushed.render_map();
+    EXPECT_NE(map.find("verb [ 0 ]"), std::string::npos);
+    EXPECT_NE(map.find("route [ 1 2 ]"), std::string::npos);
+}
+
+TEST(options, name_table_bounds)
+{
+    auto table = std::make_unique<OptionNameTable>();
+    EXPECT_EQ(table->lookup("route"), OptionNameTable::UNDEF);
+    const OptionNameTable::ID route = table->intern("route");
+    EXPECT_EQ(table->intern("route"), route);
+    EXPECT_EQ(table->lookup("route"), route);
+    EXPECT_EQ(table->name(route), "route");
+
+    // bounded in bytes
+    EXPECT_EQ(table->intern(std::string(OptionNameTable::max_bytes, 'x')), OptionNameTable::UNDEF);
+
+    // bounded in number of names
+    for (size_t i = table->size(); i < OptionNameTable::max_names; ++i)
+        ASSERT_NE(table->intern("name-" + std::to_string(i)), OptionNameTable::UNDEF);
+    EXPECT_EQ(table->intern("one-too-many"), OptionNameTable::UNDEF);
+    EXPECT_EQ(table->lookup("name-100"), 100u);
+    EXPECT_EQ(table->name(4095), "name-4095");
+}
+
+TEST(options, push_benchmark)
+{
+    const int n = 50000;
+    const std::string push = big_push(n);
+    OptionList opt = OptionList::parse_from_csv_static_nomap(push, nullptr);
+    ASSERT_EQ(opt.size(), size_t(n + 4));
+
+    size_t heap = heap_in_use();
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<StringIndexMap> string_map(new StringIndexMap(string_index(opt)));
+    const std::chrono::duration<double, std::milli> string_build = std::chrono::steady_clock::now() - start;
+    const size_t string_bytes = heap_in_use() - heap;
+
+    heap = heap_in_use();
+    start = std::chrono::steady_clock::now();
+    opt.update_map();
+    const std::chrono::duration<double, std::milli> id_build = std::chrono::steady_clock::now() - start;
+    const size_t id_bytes = heap_in_use() - heap;
+
+    ASSERT_EQ(opt.map().size(), string_map->size());
+    for (const auto &e : *string_map)
+        ASSERT_EQ(opt.map().find(e.first)->second, e.second);
+
+    const char *names[] = {"route", "route-ipv6", "dhcp-option", "redirect-gateway", "ping", "topology", "block-ipv6"};
+    const int lookups = 1000000;
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i)
+        found += string_map->count(names[i % 7]);
+    const size_t n_found = found;
+    const std::chrono::duration<double, std::milli> string_lookup = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i)
+        found -= opt.map().find(names[i % 7]) != opt.map().end();
+    const std::chrono::duration<double, std::milli> id_lookup = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(found, 0u);
+
+    // the way hot paths look directives up, with names interned ahead of time
+    static const OptionName interned[] = {OptionName(names[0]), OptionName(names[1]), OptionName(names[2]), OptionName(names[3]), OptionName(names[4]), OptionName(names[5]), OptionName(names[6])};
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i)
+        found += opt.map().find(interned[i % 7]) != opt.map().end();
+    const std::chrono::duration<double, std::milli> interned_lookup = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(found, n_found);
+
+    OPENVPN_LOG("index of " << opt.size() << " pushed options: "
+                            << "string keys " << string_build.count() << " ms " << string_bytes << " bytes, "
+                            << "interned ids " << id_build.count() << " ms " << id_bytes << " bytes; "
+                            << lookups << " lookups: string keys " << string_lookup.count() << " ms, "
+                            << "interned ids " << id_lookup.count() << " ms, "
+                            << "OptionName " << interned_lookup.count() << " ms");
+}
@@ -0,0 +1,304 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include <openvpn/log/pcapring.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+struct Block
+{
+    std::uint32_t type;
+    std::vector<unsigned char> body; // between the length fields
+};
+
+struct Packet
+{
+    std::uint32_t iface;
+    std::uint32_t caplen;
+    std::uint32_t len;
+    std::uint32_t flags;
+    std::vector<unsigned char> data;
+};
+
+std::uint32_t get32(const unsigned char *p)
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::uint16_t get16(const unsigned char *p)
+{
+    std::uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Split a pcapng file into blocks, checking that both length fields
+// of each block agree
+std::vector<Block> read_blocks(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    const std::vector<unsigned char> file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    std::vector<Block> blocks;
+    size_t pos = 0;
+    while (pos + 12 <= file.size())
+    {
+        const std::uint32_t len = get32(&file[pos + 4]);
+        EXPECT_EQ(len % 4, 0u);
+        if (len < 12 || pos + len > file.size())
+        {
+            ADD_FAILURE() << "truncated block at " << pos;
+            break;
+        }
+        EXPECT_EQ(get32(&file[pos + len - 4]), len);
+        blocks.push_back({get32(&file[pos]), std::vector<unsigned char>(&file[pos + 8], &file[pos + len - 4])});
+        pos += len;
+    }
+    EXPECT_EQ(pos, file.size());
+    return blocks;
+}
+
+Packet parse_packet(const Block &b)
+{
+    EXPECT_EQ(b.type, 6u);
+    Packet p;
+    p.iface = get32(&b.body[0]);
+    p.caplen = get32(&b.body[12]);
+    p.len = get32(&b.body[16]);
+    p.data.assign(&b.body[20], &b.body[20 + p.caplen]);
+    const size_t opt = 20 + ((p.caplen + 3) & ~3u);
+    EXPECT_EQ(get16(&b.body[opt]), 2);
+    EXPECT_EQ(get16(&b.body[opt + 2]), 4);
+    p.flags = get32(&b.body[opt + 4]);
+    return p;
+}
+
+BufferAllocated packet(const size_t size, const unsigned char fill)
+{
+    BufferAllocated buf(size, 0);
+    std::memset(buf.write_alloc(size), fill, size);
+    return buf;
+}
+
+size_t file_size(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    return f ? static_cast<size_t>(f.tellg()) : 0;
+}
+
+} // namespace
+
+TEST(pcapring, write)
+{
+    PcapRing::Config config;
+    config.path = getTempDirPath("pcapring-write.pcapng");
+    config.snaplen = 64;
+    PcapRing::Ptr ring(new PcapRing(config));
+    ring->capture(PcapRing::TUN, true, packet(40, 0x45));
+    ring->capture(PcapRing::LINK, false, packet(1400, 0x48));
+    ring->capture(PcapRing::TUN, false, packet(61, 0x60));
+    ring->stop();
+    ring->join();
+
+    // packets captured after stop() are not written
+    ring->capture(PcapRing::TUN, true, packet(40, 0x45));
+
+    const PcapRing::Stats stats = ring->stats();
+    EXPECT_EQ(stats.captured, 3u);
+    EXPECT_EQ(stats.written, 3u);
+    EXPECT_EQ(stats.dropped, 1u);
+    EXPECT_EQ(stats.files, 1u);
+
+    const std::vector<Block> blocks = read_blocks(config.path);
+    ASSERT_EQ(blocks.size(), 6u);
+
+    // section header
+    EXPECT_EQ(blocks[0].type, 0x0A0D0D0Au);
+    EXPECT_EQ(get32(&blocks[0].body[0]), 0x1A2B3C4Du);
+
+    // interfaces, with their link type, snaplen and name
+    EXPECT_EQ(blocks[1].type, 1u);
+    EXPECT_EQ(get16(&blocks[1].body[0]), 101);
+    EXPECT_EQ(get32(&blocks[1].body[4]), 64u);
+    EXPECT_EQ(std::string(&blocks[1].body[12], &blocks[1].body[15]), "tun");
+    EXPECT_EQ(blocks[2].type, 1u);
+    EXPECT_EQ(get16(&blocks[2].body[0]), 147);
+    EXPECT_EQ(std::string(&blocks[2].body[12], &blocks[2].body[16]), "link");
+
+    const Packet p1 = parse_packet(blocks[3]);
+    EXPECT_EQ(p1.iface, PcapRing::TUN);
+    EXPECT_EQ(p1.caplen, 40u);
+    EXPECT_EQ(p1.len, 40u);
+    EXPECT_EQ(p1.flags, 2u); // outbound
+    EXPECT_EQ(p1.data, std::vector<unsigned char>(40, 0x45));
+
+    // truncated to snaplen
+    const Packet p2 = parse_packet(blocks[4]);
+    EXPECT_EQ(p2.iface, PcapRing::LINK);
+    EXPECT_EQ(p2.caplen, 64u);
+    EXPECT_EQ(p2.len, 1400u);
+    EXPECT_EQ(p2.flags, 1u); // inbound
+    EXPECT_EQ(p2.data, std::vector<unsigned char>(64, 0x48));
+
+    // padded to four bytes
+    const Packet p3 = parse_packet(blocks[5]);
+    EXPECT_EQ(p3.caplen, 61u);
+    EXPECT_EQ(p3.data, std::vector<unsigned char>(61, 0x60));
+
+    std::remove(config.path.c_str());
+}
+
+TEST(pcapring, rotate)
+{
+    PcapRing::Config config;
+    config.path = getTempDirPath("pcapring-rotate.pcapng");
+    config.max_file_size = 1024;
+    config.max_versions = 20;
+    PcapRing::Ptr ring(new PcapRing(config));
+    for (int i = 0; i < 50; ++i)
+        ring->capture(PcapRing::TUN, true, packet(100, static_cast<unsigned char>(i)));
+    ring->stop();
+    ring->join();
+
+    const PcapRing::Stats stats = ring->stats();
+    EXPECT_EQ(stats.written, 50u);
+    ASSERT_GT(stats.files, 1u);
+
+    // every file is a complete section within the limit, and the
+    // oldest packets are in the highest numbered file
+    int next = 0;
+    for (count_t v = stats.files; v-- > 0;)
+    {
+        const std::string fn = v ? config.path + '.' + std::to_string(v) : config.path;
+        EXPECT_LE(file_size(fn), config.max_file_size);
+        const std::vector<Block> blocks = read_blocks(fn);
+        ASSERT_GT(blocks.size(), 3u);
+        EXPECT_EQ(blocks[0].type, 0x0A0D0D0Au);
+        for (size_t i = 3; i < blocks.size(); ++i)
+            EXPECT_EQ(parse_packet(blocks[i]).data[0], next++);
+        std::remove(fn.c_str());
+    }
+    EXPECT_EQ(next, 50);
+}
+
+TEST(pcapring, ring_full)
+{
+    PcapRing::Config config;
+    config.path = getTempDirPath("pcapring-full.pcapng");
+    config.slots = 4;
+    config.poll_interval = std::chrono::milliseconds(200);
+    PcapRing::Ptr ring(new PcapRing(config));
+
+    // the writer is asleep, so the ring overflows instead of blocking
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 10; ++i)
+        ring->capture(PcapRing::TUN, true, packet(100, 0));
+    ring->stop();
+    ring->join();
+
+    const PcapRing::Stats stats = ring->stats();
+    EXPECT_EQ(stats.captured, 4u);
+    EXPECT_EQ(stats.dropped, 6u);
+    EXPECT_EQ(stats.written, 4u);
+    std::remove(config.path.c_str());
+}
+
+// stop() only signals the writer, and reports back once the file is
+// written out and closed
+TEST(pcapring, stop_done)
+{
+    PcapRing::Config config;
+    config.path = getTempDirPath("pcapring-stop.pcapng");
+    config.poll_interval = std::chrono::milliseconds(200);
+    PcapRing::Ptr ring(new PcapRing(config));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ring->capture(PcapRing::TUN, true, packet(100, 0));
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread::id done_thread;
+    count_t written = 0;
+    ring->stop([&]()
+               {
+        std::lock_guard<std::mutex> lock(mutex);
+        done_thread = std::this_thread::get_id();
+        written = ring->stats().written;
+        cond.notify_one(); });
+
+    // the writer is still asleep
+    EXPECT_EQ(ring->stats().written, 0u);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(cond.wait_for(lock, std::chrono::seconds(10), [&]()
+                                  { return done_thread != std::thread::id(); }));
+    }
+    EXPECT_NE(done_thread, std::this_thread::get_id());
+    EXPECT_EQ(written, 1u);
+    ring->join();
+
+    // once finished, done is called right away
+    bool called = false;
+    ring->stop([&]()
+               { called = true; });
+    EXPECT_TRUE(called);
+    std::remove(config.path.c_str());
+}
+
+TEST(pcapring, bad_path)
+{
+    PcapRing::Config config;
+    EXPECT_THROW(PcapRing ring(config), PcapRing::pcap_ring_error);
+    config.path = getTempDirPath("no-such-dir/capture.pcapng");
+    EXPECT_THROW(PcapRing ring(config), PcapRing::pcap_ring_error);
+    config.path = getTempDirPath("pcapring-snaplen.pcapng");
+    config.snaplen = 0;
+    EXPECT_THROW(PcapRing ring(config), PcapRing::pcap_ring_error);
+}
+
+// Cost of capturing on the session thread.  A burst faster than the
+// writer can drain is dropped rather than stalling the caller.
+TEST(pcapring, capture_cost)
+{
+    PcapRing::Config config;
+    config.path = getTempDirPath("pcapring-cost.pcapng");
+    config.slots = 65536;
+    config.max_file_size = 0;
+    PcapRing::Ptr ring(new PcapRing(config));
+    const BufferAllocated buf = packet(1400, 0x45);
+
+    const size_t n = 200000;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+        ring->capture(PcapRing::TUN, true, buf);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ring->stop();
+    ring->join();
+
+    const PcapRing::Stats stats = ring->stats();
+    OPENVPN_LOG("capture: " << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / n
+                            << " ns/packet, written=" << stats.written << " dropped=" << stats.dropped);
+    EXPECT_EQ(stats.captured + stats.dropped, n);
+    EXPECT_EQ(stats.written, stats.captured);
+    std::remove(config.path.c_str());
+}
@@ -0,0 +1,197 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+
+#include <openvpn/buffer/bufstr.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/transport/client/tcpcli.hpp>
+#include <openvpn/transport/client/prewarm.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+// Session side of the handed over transport
+struct TestParent : public TransportClientParent
+{
+    void transport_recv(BufferAllocated &buf) override
+    {
+        received.emplace_back(reinterpret_cast<const char *>(buf.c_data()), buf.size());
+    }
+    void transport_needs_send() override
+    {
+    }
+    void transport_error(const Error::Type fatal_err, const std::string &err_text) override
+    {
+        error = err_text;
+    }
+    void proxy_error(const Error::Type fatal_err, const std::string &err_text) override
+    {
+        error = err_text;
+    }
+    bool transport_is_openvpn_protocol() override
+    {
+        return true;
+    }
+    void transport_pre_resolve() override
+    {
+    }
+    void transport_wait_proxy() override
+    {
+    }
+    void transport_wait() override
+    {
+    }
+    void transport_connecting() override
+    {
+        ++n_connecting;
+    }
+    bool is_keepalive_enabled() const override
+    {
+        return false;
+    }
+    void disable_keepalive(unsigned int &keepalive_ping, unsigned int &keepalive_timeout) override
+    {
+    }
+
+    std::vector<std::string> received;
+    std::string error;
+    int n_connecting = 0;
+};
+
+TCPTransport::ClientConfig::Ptr tcp_config(const unsigned short port)
+{
+    OptionList cfg;
+    cfg.parse_from_config("remote 127.0.0.1 " + std::to_string(port) + " tcp\n", nullptr);
+    cfg.update_map();
+
+    TCPTransport::ClientConfig::Ptr conf = TCPTransport::ClientConfig::new_obj();
+    conf->remote_list.reset(new RemoteList(cfg, "", 0, nullptr, nullptr));
+    conf->frame = frame_init_simple(2048);
+    conf->stats.reset(new SessionStats());
+    return conf;
+}
+
+// Run handlers until pred() is true, or fail after a few seconds
+template <typename PRED>
+bool run_until(openvpn_io::io_context &io_context, PRED pred)
+{
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred() && std::chrono::steady_clock::now() < end)
+    {
+        io_context.restart();
+        io_context.run_for(std::chrono::milliseconds(10));
+    }
+    return pred();
+}
+
+} // namespace
+
+// The connected socket is taken over by the new session, which can use
+// it in both directions without connecting again
+TEST(TransportPrewarm, handover)
+{
+    openvpn_io::io_context io_context(1);
+    openvpn_io::ip::tcp::acceptor acceptor(io_context, {openvpn_io::ip::make_address("127.0.0.1"), 0});
+    openvpn_io::ip::tcp::socket server(io_context);
+    bool accepted = false;
+    acceptor.async_accept(server, [&accepted](const openvpn_io::error_code &error)
+                          { accepted = !error; });
+
+    TransportPrewarm::Ptr prewarm(new TransportPrewarm(io_context, tcp_config(acceptor.local_endpoint().port())));
+    EXPECT_FALSE(prewarm->release());
+    prewarm->start();
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return accepted && prewarm->state_get() != TransportPrewarm::CONNECTING; }));
+    ASSERT_EQ(prewarm->state_get(), TransportPrewarm::READY);
+
+    TransportClientFactory::Ptr factory = prewarm->release();
+    ASSERT_TRUE(factory);
+    EXPECT_TRUE(factory->is_relay());
+    prewarm.reset();
+
+    TestParent parent;
+    TransportClient::Ptr transport = factory->new_transport_client_obj(io_context, &parent);
+    EXPECT_EQ(transport->server_endpoint_port(), acceptor.local_endpoint().port());
+    EXPECT_EQ(parent.n_connecting, 0);
+
+    // client -> server, with the 16-bit length prefix of OpenVPN over TCP
+    const std::string hello = "hello";
+    BufferAllocated buf;
+    frame_init_simple(2048)->prepare(Frame::ENCRYPT_WORK, buf);
+    buf_write_string(buf, hello);
+    ASSERT_TRUE(transport->transport_send(buf));
+    unsigned char in[7] = {};
+    size_t n_in = 0;
+    server.async_read_some(openvpn_io::buffer(in, sizeof(in)), [&n_in](const openvpn_io::error_code &, size_t n)
+                           { n_in = n; });
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return n_in > 0; }));
+    ASSERT_EQ(n_in, 7u);
+    EXPECT_EQ(in[0], 0);
+    EXPECT_EQ(in[1], 5);
+    EXPECT_EQ(std::string(reinterpret_cast<const char *>(in + 2), 5), hello);
+
+    // server -> client reaches the new parent
+    const unsigned char out[] = {0, 3, 'a', 'b', 'c'};
+    openvpn_io::write(server, openvpn_io::buffer(out, sizeof(out)));
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return !parent.received.empty(); }));
+    EXPECT_EQ(parent.received, std::vector<std::string>({"abc"}));
+    EXPECT_TRUE(parent.error.empty());
+
+    transport->stop();
+}
+
+TEST(TransportPrewarm, connect_error)
+{
+    openvpn_io::io_context io_context(1);
+    unsigned short port;
+    {
+        // a port with nothing listening
+        openvpn_io::ip::tcp::acceptor acceptor(io_context, {openvpn_io::ip::make_address("127.0.0.1"), 0});
+        port = acceptor.local_endpoint().port();
+    }
+
+    TransportPrewarm::Ptr prewarm(new TransportPrewarm(io_context, tcp_config(port)));
+    prewarm->start();
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return prewarm->state_get() != TransportPrewarm::CONNECTING; }));
+    EXPECT_EQ(prewarm->state_get(), TransportPrewarm::FAILED);
+    EXPECT_NE(prewarm->error().find("connect error"), std::string::npos);
+    EXPECT_FALSE(prewarm->release());
+    prewarm->stop();
+}
+
+// A spare connection dropped by the server is not handed over
+TEST(TransportPrewarm, server_close)
+{
+    openvpn_io::io_context io_context(1);
+    openvpn_io::ip::tcp::acceptor acceptor(io_context, {openvpn_io::ip::make_address("127.0.0.1"), 0});
+    openvpn_io::ip::tcp::socket server(io_context);
+    bool accepted = false;
+    acceptor.async_accept(server, [&accepted](const openvpn_io::error_code &error)
+                          { accepted = !error; });
+
+    TransportPrewarm::Ptr prewarm(new TransportPrewarm(io_context, tcp_config(acceptor.local_endpoint().port())));
+    prewarm->start();
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return accepted && prewarm->state_get() == TransportPrewarm::READY; }));
+
+    server.close();
+    ASSERT_TRUE(run_until(io_context, [&]()
+                          { return prewarm->state_get() == TransportPrewarm::FAILED; }));
+    EXPECT_FALSE(prewarm->release());
+    prewarm->stop();
+}
@@ -24,11 +24,22 @@
 #include <cstring>
 #include <limits>
 #include <thread>
+#include <memory>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include <gmock/gmock.h>
 #include <openvpn/common/platform.hpp>
 #include <openvpn/ssl/sslchoose.hpp>
 #include <openvpn/client/cliproto.hpp>
+#include <client/ovpncli.hpp>
+#include <openvpn/client/cliconnect.hpp>
+#include <openvpn/frame/frame_init.hpp>
 
 
 #define OPENVPN_DEBUG
@@ -970,6 +981,116 @@ static auto create_client_proto_context(ClientSSLAPI::Config::Ptr cc, Frame::Ptr
     return cp;
 }
 
+static auto create_server_proto_context(Frame::Ptr frame, ServerRandomAPI::Ptr prng_serv, MySessionStats::Ptr serv_stats, Time &time, bool use_tls_ekm, bool tls_version_mismatch, const std::string &tls_crypt_v2_key_fn = "")
+{
+    const std::string ca_crt = read_text(TEST_KEYCERT_DIR "ca.crt");
+    const std::string server_crt = read_text(TEST_KEYCERT_DIR "server.crt");
+    const std::string server_key = read_text(TEST_KEYCERT_DIR "server.key");
+    const std::string dh_pem = read_text(TEST_KEYCERT_DIR "dh.pem");
+    const std::string tls_auth_key = read_text(TEST_KEYCERT_DIR "tls-auth.key");
+    const std::string tls_crypt_v2_server_key = tls_crypt_v2_key_fn.empty()
+                                                    ? read_text(TEST_KEYCERT_DIR "tls-crypt-v2-server.key")
+                                                    : "";
+
+    // server config
+    ServerSSLAPI::Config::Ptr sc(new ClientSSLAPI::Config());
+    sc->set_mode(Mode(Mode::SERVER));
+    sc->set_frame(frame);
+    sc->set_rng(prng_serv);
+    sc->load_ca(ca_crt, true);
+    sc->load_cert(server_crt);
+    sc->load_private_key(server_key);
+    sc->load_dh(dh_pem);
+    sc->set_tls_version_min(tls_version_mismatch ? TLSVersion::Type::V1_3 : TLS_VER_MIN);
+#ifdef VERBOSE
+    sc->set_debug_level(1);
+#endif
+
+    // server ProtoContext config
+    typedef ProtoContext ServerProtoContext;
+    ServerProtoContext::ProtoConfig::Ptr sp(new ServerProtoContext::ProtoConfig);
+    sp->ssl_factory = sc->new_factory();
+    sp->dc.set_factory(new CryptoDCSelect<ServerCryptoAPI>(sp->ssl_factory->libctx(), frame, serv_stats, prng_serv));
+    sp->tlsprf_factory.reset(new CryptoTLSPRFFactory<ServerCryptoAPI>());
+    sp->frame = frame;
+    sp->now = &time;
+    sp->rng = prng_serv;
+    sp->prng = prng_serv;
+    sp->protocol = Protocol(Protocol::UDPv4);
+    sp->layer = Layer(Layer::OSI_LAYER_3);
+#ifdef PROTOv2
+    sp->enable_op32 = true;
+    sp->remote_peer_id = 101;
+#endif
+    sp->comp_ctx = CompressContext(COMP_METH, false);
+    sp->dc.set_cipher(CryptoAlgs::lookup(PROTO_CIPHER));
+    sp->dc.set_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+    if (use_tls_ekm)
+        sp->dc.set_key_derivation(CryptoAlgs::KeyDerivation::TLS_EKM);
+#ifdef USE_TLS_AUTH
+    sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
+    sp->tls_key.parse(tls_auth_key);
+    sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
+    sp->key_direction = 1;
+#endif
+#if defined(USE_TLS_CRYPT)
+    sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
+    sp->tls_key.parse(tls_auth_key);
+    sp->set_tls_crypt_algs();
+#endif
+#ifdef USE_TLS_CRYPT_V2
+    sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
+
+    if (tls_crypt_v2_key_fn.empty())
+    {
+        TLSCryptV2ServerKey tls_crypt_v2_key;
+        tls_crypt_v2_key.parse(tls_crypt_v2_server_key);
+        tls_crypt_v2_key.extract_key(sp->tls_key);
+    }
+
+    sp->set_tls_crypt_algs();
+    sp->tls_crypt_metadata_factory.reset(new CryptoTLSCryptMetadataFactory());
+    sp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V2;
+    sp->tls_crypt_v2_serverkey_id = !tls_crypt_v2_key_fn.empty();
+    sp->tls_crypt_v2_serverkey_dir = TEST_KEYCERT_DIR;
+#endif
+#if defined(HANDSHAKE_WINDOW)
+    sp->handshake_window = Time::Duration::seconds(HANDSHAKE_WINDOW);
+#elif SITER > 1
+    sp->handshake_window = Time::Duration::seconds(30);
+#else
+    sp->handshake_window = Time::Duration::seconds(17) + Time::Duration::binary_ms(512);
+#endif
+#ifdef BECOME_PRIMARY_SERVER
+    sp->become_primary = Time::Duration::seconds(BECOME_PRIMARY_SERVER);
+#else
+    sp->become_primary = sp->handshake_window;
+#endif
+    sp->tls_timeout = Time::Duration::milliseconds(TLS_TIMEOUT_SERVER);
+#if defined(SERVER_NO_RENEG)
+    sp->renegotiate = Time::Duration::infinite();
+#else
+    // NOTE: if we don't add sp->handshake_window, both client and server reneg-sec (RENEG)
+    // will be equal and will therefore occasionally collide.  Such collisions can sometimes
+    // produce this OpenSSL error:
+    // OpenSSLContext::SSL::read_cleartext: BIO_read failed, cap=400 status=-1: error:140E0197:SSL routines:SSL_shutdown:shutdown while in init
+    // The issue was introduced by this patch in OpenSSL:
+    //   https://github.com/openssl/openssl/commit/64193c8218540499984cd63cda41f3cd491f3f59
+    sp->renegotiate = Time::Duration::seconds(RENEG) + sp->handshake_window;
+#endif
+    sp->expire = sp->renegotiate + sp->renegotiate;
+    sp->keepalive_ping = Time::Duration::seconds(5);
+    sp->keepalive_timeout = Time::Duration::seconds(60);
+    sp->keepalive_timeout_early = Time::Duration::seconds(10);
+
+#ifdef VERBOSE
+    std::cout << "SERVER OPTIONS: " << sp->options_string() << std::endl;
+    std::cout << "SERVER PEER INFO:" << std::endl;
+    std::cout << sp->peer_info_string();
+#endif
+    return sp;
+}
+
 // execute the unit test in one thread
 int test(const int thread_num, bool use_tls_ekm, bool tls_version_mismatch, const std::string &tls_crypt_v2_key_fn = "")
 {
@@ -987,16 +1108,6 @@ int test(const int thread_num, bool use_tls_ekm, bool tls_version_mismatch, cons
         Time time;
         const Time::Duration time_step = Time::Duration::binary_ms(100);
 
-        // config files
-        const std::string ca_crt = read_text(TEST_KEYCERT_DIR "ca.crt");
-        const std::string server_crt = read_text(TEST_KEYCERT_DIR "server.crt");
-        const std::string server_key = read_text(TEST_KEYCERT_DIR "server.key");
-        const std::string dh_pem = read_text(TEST_KEYCERT_DIR "dh.pem");
-        const std::string tls_auth_key = read_text(TEST_KEYCERT_DIR "tls-auth.key");
-        const std::string tls_crypt_v2_server_key = tls_crypt_v2_key_fn.empty()
-                                                        ? read_text(TEST_KEYCERT_DIR "tls-crypt-v2-server.key")
-                                                        : "";
-
         // client config
         ClientSSLAPI::Config::Ptr cc = create_client_ssl_config(frame, prng_cli, tls_version_mismatch);
         MySessionStats::Ptr cli_stats(new MySessionStats);
@@ -1007,103 +1118,10 @@ int test(const int thread_num, bool use_tls_ekm, bool tls_version_mismatch, cons
 
         // server config
         MySessionStats::Ptr serv_stats(new MySessionStats);
-
-        ServerSSLAPI::Config::Ptr sc(new ClientSSLAPI::Config());
-        sc->set_mode(Mode(Mode::SERVER));
-        sc->set_frame(frame);
-        sc->set_rng(prng_serv);
-        sc->load_ca(ca_crt, true);
-        sc->load_cert(server_crt);
-        sc->load_private_key(server_key);
-        sc->load_dh(dh_pem);
-        sc->set_tls_version_min(tls_version_mismatch ? TLSVersion::Type::V1_3 : TLS_VER_MIN);
-#ifdef VERBOSE
-        sc->set_debug_level(1);
-#endif
-
-        // server ProtoContext config
-        typedef ProtoContext ServerProtoContext;
-        ServerProtoContext::ProtoConfig::Ptr sp(new ServerProtoContext::ProtoConfig);
-        sp->ssl_factory = sc->new_factory();
-        sp->dc.set_factory(new CryptoDCSelect<ServerCryptoAPI>(sp->ssl_factory->libctx(), frame, serv_stats, prng_serv));
-        sp->tlsprf_factory.reset(new CryptoTLSPRFFactory<ServerCryptoAPI>());
-        sp->frame = frame;
-        sp->now = &time;
-        sp->rng = prng_serv;
-        sp->prng = prng_serv;
-        sp->protocol = Protocol(Protocol::UDPv4);
-        sp->layer = Layer(Layer::OSI_LAYER_3);
-#ifdef PROTOv2
-        sp->enable_op32 = true;
-        sp->remote_peer_id = 101;
-#endif
-        sp->comp_ctx = CompressContext(COMP_METH, false);
-        sp->dc.set_cipher(CryptoAlgs::lookup(PROTO_CIPHER));
-        sp->dc.set_digest(CryptoAlgs::lookup(PROTO_DIGEST));
-        if (use_tls_ekm)
-            sp->dc.set_key_derivation(CryptoAlgs::KeyDerivation::TLS_EKM);
-#ifdef USE_TLS_AUTH
-        sp->tls_auth_factory.reset(new CryptoOvpnHMACFactory<ServerCryptoAPI>());
-        sp->tls_key.parse(tls_auth_key);
-        sp->set_tls_auth_digest(CryptoAlgs::lookup(PROTO_DIGEST));
-        sp->key_direction = 1;
-#endif
+        auto sp = create_server_proto_context(frame, prng_serv, serv_stats, time, use_tls_ekm, tls_version_mismatch, tls_crypt_v2_key_fn);
 #if defined(USE_TLS_CRYPT)
-        sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
-        sp->tls_key.parse(tls_auth_key);
-        sp->set_tls_crypt_algs();
         cp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V1;
 #endif
-#ifdef USE_TLS_CRYPT_V2
-        sp->tls_crypt_factory.reset(new CryptoTLSCryptFactory<ClientCryptoAPI>());
-
-        if (tls_crypt_v2_key_fn.empty())
-        {
-            TLSCryptV2ServerKey tls_crypt_v2_key;
-            tls_crypt_v2_key.parse(tls_crypt_v2_server_key);
-            tls_crypt_v2_key.extract_key(sp->tls_key);
-        }
-
-        sp->set_tls_crypt_algs();
-        sp->tls_crypt_metadata_factory.reset(new CryptoTLSCryptMetadataFactory());
-        sp->tls_crypt_ = ProtoContext::ProtoConfig::TLSCrypt::V2;
-        sp->tls_crypt_v2_serverkey_id = !tls_crypt_v2_key_fn.empty();
-        sp->tls_crypt_v2_serverkey_dir = TEST_KEYCERT_DIR;
-#endif
-#if defined(HANDSHAKE_WINDOW)
-        sp->handshake_window = Time::Duration::seconds(HANDSHAKE_WINDOW);
-#elif SITER > 1
-        sp->handshake_window = Time::Duration::seconds(30);
-#else
-        sp->handshake_window = Time::Duration::seconds(17) + Time::Duration::binary_ms(512);
-#endif
-#ifdef BECOME_PRIMARY_SERVER
-        sp->become_primary = Time::Duration::seconds(BECOME_PRIMARY_SERVER);
-#else
-        sp->become_primary = sp->handshake_window;
-#endif
-        sp->tls_timeout = Time::Duration::milliseconds(TLS_TIMEOUT_SERVER);
-#if defined(SERVER_NO_RENEG)
-        sp->renegotiate = Time::Duration::infinite();
-#else
-        // NOTE: if we don't add sp->handshake_window, both client and server reneg-sec (RENEG)
-        // will be equal and will therefore occasionally collide.  Such collisions can sometimes
-        // produce this OpenSSL error:
-        // OpenSSLContext::SSL::read_cleartext: BIO_read failed, cap=400 status=-1: error:140E0197:SSL routines:SSL_shutdown:shutdown while in init
-        // The issue was introduced by this patch in OpenSSL:
-        //   https://github.com/openssl/openssl/commit/64193c8218540499984cd63cda41f3cd491f3f59
-        sp->renegotiate = Time::Duration::seconds(RENEG) + sp->handshake_window;
-#endif
-        sp->expire = sp->renegotiate + sp->renegotiate;
-        sp->keepalive_ping = Time::Duration::seconds(5);
-        sp->keepalive_timeout = Time::Duration::seconds(60);
-        sp->keepalive_timeout_early = Time::Duration::seconds(10);
-
-#ifdef VERBOSE
-        std::cout << "SERVER OPTIONS: " << sp->options_string() << std::endl;
-        std::cout << "SERVER PEER INFO:" << std::endl;
-        std::cout << sp->peer_info_string();
-#endif
 
         TestProtoClient cli_proto(cp, cli_stats);
         TestProtoServer serv_proto(sp, serv_stats);
@@ -1166,6 +1184,13 @@ int test(const int thread_num, bool use_tls_ekm, bool tls_version_mismatch, cons
                   << " HE=" << cli_stats->get_error_count(Error::HANDSHAKE_TIMEOUT) << '/' << serv_stats->get_error_count(Error::HANDSHAKE_TIMEOUT)
                   << std::endl;
 
+        // the frame must be large enough for the data channel
+        if (cli_stats->get_error_count(Error::BUFFER_REALLOC) || serv_stats->get_error_count(Error::BUFFER_REALLOC))
+        {
+            std::cerr << "Data channel buffers were reallocated" << std::endl;
+            return 1;
+        }
+
 #ifdef STATS
         std::cerr << "-------- CLIENT STATS --------" << std::endl;
         cli_stats->show_error_counts();
@@ -1304,6 +1329,222 @@ TEST_F(ProtoUnitTest, base_multiple_thread)
     EXPECT_THAT(expected_results, ::testing::ContainerEq(results));
 }
 
+// Heap bytes in use, or 0 where malloc statistics are unavailable
+static size_t heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Deliver the packets a has queued to b, without loss
+static void idle_xfer(TestProto &a, TestProto &b)
+{
+    a.do_housekeeping();
+    while (!a.net_out.empty())
+    {
+        BufferPtr bp = std::move(a.net_out.front());
+        a.net_out.pop_front();
+        const ProtoContext::PacketType pt = b.proto_context.packet_type(*bp);
+        if (pt.is_control())
+            b.proto_context.control_net_recv(pt, std::move(bp));
+        else if (pt.is_data())
+            b.data_decrypt(pt, *bp);
+    }
+    b.proto_context.flush(true);
+}
+
+// Run the handshake between a fresh client and server until both
+// data channels are up
+static bool idle_connect(TestProtoClient &cli, TestProtoServer &serv, Time &time)
+{
+    cli.reset();
+    serv.reset();
+    cli.proto_context.start();
+    serv.start();
+    for (int i = 0; i < 100 && !(cli.proto_context.data_channel_ready() && serv.proto_context.data_channel_ready()); ++i)
+    {
+        idle_xfer(cli, serv);
+        idle_xfer(serv, cli);
+        time += Time::Duration::binary_ms(100);
+    }
+    return cli.proto_context.data_channel_ready() && serv.proto_context.data_channel_ready();
+}
+
+// Memory benchmark of idle server sessions.  Each session completes a
+// handshake and passes a data packet in each direction, then its client
+// goes away.  Set PROTO_IDLE_SESSIONS to run with e.g. 100000 sessions.
+TEST_F(ProtoUnitTest, idle_session_memory)
+{
+    if (!heap_in_use())
+        GTEST_SKIP() << "malloc statistics not available";
+
+    size_t n_sessions = 200;
+    if (const char *env = std::getenv("PROTO_IDLE_SESSIONS"))
+        n_sessions = std::strtoul(env, nullptr, 10);
+
+    Frame::Ptr frame(frame_init_simple(1500));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    Time time;
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(frame, prng_serv, serv_stats, time, false, false);
+
+    std::vector<std::unique_ptr<TestProtoServer>> servers;
+    servers.reserve(n_sessions + 1);
+    size_t n_ready = 0;
+    auto connect = [&]()
+    {
+        auto cli = std::make_unique<TestProtoClient>(cp, cli_stats);
+        auto serv = std::make_unique<TestProtoServer>(sp, serv_stats);
+        if (idle_connect(*cli, *serv, time))
+        {
+            BufferPtr bp = cli->data_encrypt_string("ping");
+            serv->data_decrypt(serv->proto_context.packet_type(*bp), *bp);
+            bp = serv->data_encrypt_string("pong");
+            cli->data_decrypt(cli->proto_context.packet_type(*bp), *bp);
+            ++n_ready;
+        }
+        // let the last ACKs go through
+        for (int i = 0; i < 3; ++i)
+        {
+            idle_xfer(*cli, *serv);
+            idle_xfer(*serv, *cli);
+        }
+        servers.push_back(std::move(serv));
+    };
+
+    // the first session also sets up state shared by all sessions
+    connect();
+    const size_t begin = heap_in_use();
+    for (size_t i = 0; i < n_sessions; ++i)
+        connect();
+    const size_t per_session = (heap_in_use() - begin) / n_sessions;
+
+    std::cout << "idle server sessions: " << n_sessions << ", " << per_session << " bytes/session, "
+              << per_session * 100000 / (1024 * 1024) << " MB per 100k sessions" << std::endl;
+    EXPECT_EQ(n_ready, n_sessions + 1);
+}
+
+// Keepalives are recognized by their exact length and content, and
+// only the first of the data packets received at the same time moves
+// the keepalive expiration.
+TEST_F(ProtoUnitTest, data_channel_keepalive)
+{
+    Frame::Ptr frame(frame_init_simple(1500));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    Time time;
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(frame, prng_serv, serv_stats, time, false, false);
+    // keep the keepalive expiration ahead of any other housekeeping
+    sp->keepalive_ping = Time::Duration::infinite();
+    sp->keepalive_timeout = Time::Duration::seconds(2);
+    TestProtoClient cli(cp, cli_stats);
+    TestProtoServer serv(sp, serv_stats);
+    ASSERT_TRUE(idle_connect(cli, serv, time));
+    for (int i = 0; i < 3; ++i)
+    {
+        idle_xfer(cli, serv);
+        idle_xfer(serv, cli);
+    }
+
+    auto send = [&](const unsigned char *data, const size_t size)
+    {
+        BufferAllocated buf;
+        frame->prepare(Frame::READ_LINK_UDP, buf);
+        buf.write(data, size);
+        cli.data_encrypt(buf);
+        EXPECT_TRUE(serv.proto_context.data_decrypt(serv.proto_context.packet_type(buf), buf));
+        return buf.size();
+    };
+
+    unsigned char msg[sizeof(proto_context_private::keepalive_message) + 1];
+    std::memcpy(msg, proto_context_private::keepalive_message, sizeof(proto_context_private::keepalive_message));
+    msg[sizeof(msg) - 1] = 0;
+    EXPECT_EQ(send(msg, sizeof(msg) - 1), 0u);
+    EXPECT_EQ(send(msg, sizeof(msg)), sizeof(msg));
+    msg[1] ^= 1;
+    EXPECT_EQ(send(msg, sizeof(msg) - 1), sizeof(msg) - 1);
+
+    time += Time::Duration::seconds(1);
+    send(msg, sizeof(msg));
+    const Time expire = serv.proto_context.next_housekeeping();
+    EXPECT_EQ(expire, time + sp->keepalive_timeout);
+
+    // another packet at the same time leaves the expiration alone,
+    // the first one at a later time moves it
+    sp->keepalive_timeout = Time::Duration::seconds(3);
+    send(msg, sizeof(msg));
+    EXPECT_EQ(serv.proto_context.next_housekeeping(), expire);
+    time += Time::Duration::binary_ms(1);
+    send(msg, sizeof(msg));
+    EXPECT_EQ(serv.proto_context.next_housekeeping(), time + Time::Duration::seconds(3));
+
+    // nothing for the lightweight flush to do on the data path
+    EXPECT_FALSE(serv.proto_context.flush(false));
+}
+
+// Receive side data channel benchmark: decrypt, keepalive check and
+// lightweight flush for each packet, as done by the client for every
+// data packet it receives.  Set PROTO_DATA_PACKETS to change the number
+// of packets decrypted for each packet size.
+TEST_F(ProtoUnitTest, data_channel_benchmark)
+{
+    size_t n_packets = 20000;
+    if (const char *env = std::getenv("PROTO_DATA_PACKETS"))
+        n_packets = std::strtoul(env, nullptr, 10);
+
+    Frame::Ptr frame(frame_init_simple(1500));
+    ClientRandomAPI::Ptr prng_cli(new ClientRandomAPI());
+    ServerRandomAPI::Ptr prng_serv(new ServerRandomAPI());
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    MySessionStats::Ptr serv_stats(new MySessionStats);
+    Time time;
+    auto cp = create_client_proto_context(create_client_ssl_config(frame, prng_cli), frame, prng_cli, cli_stats, time);
+    auto sp = create_server_proto_context(frame, prng_serv, serv_stats, time, false, false);
+    TestProtoClient cli(cp, cli_stats);
+    TestProtoServer serv(sp, serv_stats);
+    ASSERT_TRUE(idle_connect(cli, serv, time));
+
+    for (const size_t size : {64, 1400})
+    {
+        std::vector<BufferAllocated> packets(n_packets);
+        const std::vector<unsigned char> payload(size, 0x45);
+        for (auto &buf : packets)
+        {
+            frame->prepare(Frame::READ_LINK_UDP, buf);
+            buf.write(payload.data(), payload.size());
+            serv.data_encrypt(buf);
+        }
+
+        size_t received = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            // packets arrive in batches of 32 read at the same time
+            if (i % 32 == 0)
+                time += Time::Duration::binary_ms(1);
+            BufferAllocated &buf = packets[i];
+            cli.proto_context.data_decrypt(cli.proto_context.packet_type(buf), buf);
+            received += buf.size();
+            cli.proto_context.flush(false);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        EXPECT_EQ(received, n_packets * size);
+        std::cout << "data channel receive, " << size << " byte packets: "
+                  << static_cast<size_t>(n_packets / elapsed.count()) << " packets/s, "
+                  << static_cast<size_t>(received / elapsed.count() / (1024 * 1024)) << " MB/s" << std::endl;
+    }
+}
+
 TEST(proto, iv_ciphers_aead)
 {
     CryptoAlgs::allow_default_dc_algs<SSLLib::CryptoAPI>(nullptr, true, false);
@@ -1485,3 +1726,707 @@ TEST(proto, client_proto_check_cc_msg)
     EXPECT_EQ(uf->name, "Invalid chars in control message");
     EXPECT_EQ(uf->reason, "Control channel message with invalid characters not allowed to be send with post_cc_msg");
 }
+
+// Server end of an in-memory link to a ClientProto::Session.  Accepts any
+// credentials and answers push requests.
+class LoopbackServer : public TestProto
+{
+  public:
+    LoopbackServer(const ProtoContext::ProtoConfig::Ptr &config,
+                   const SessionStats::Ptr &stats)
+        : TestProto(config, stats)
+    {
+    }
+
+  private:
+    void server_auth(const std::string &username,
+                     const SafeString &password,
+                     const std::string &peer_info,
+                     const AuthCert::Ptr &auth_cert) override
+    {
+    }
+
+    void control_recv(BufferPtr &&app_bp) override
+    {
+        if (ProtoContext::read_control_string<std::string>(*app_bp) == "PUSH_REQUEST")
+        {
+            proto_context.write_control_string(push_reply);
+            proto_context.flush(true);
+            ++n_push_replies;
+        }
+    }
+
+  public:
+    std::string push_reply = "PUSH_REPLY,ping 10,ping-restart 60";
+    int n_push_replies = 0;
+};
+
+class LoopbackTransport : public TransportClient
+{
+  public:
+    typedef RCPtr<LoopbackTransport> Ptr;
+
+    LoopbackTransport(TransportClientParent *parent_arg, LoopbackServer &server_arg)
+        : parent(parent_arg),
+          server(server_arg)
+    {
+    }
+
+    // Deliver the packets queued in both directions, and return how
+    // many there were.
+    size_t round_trip()
+    {
+        size_t n = 0;
+        while (!to_server.empty())
+        {
+            BufferPtr bp = std::move(to_server.front());
+            to_server.pop_front();
+            const ProtoContext::PacketType pt = server.proto_context.packet_type(*bp);
+            if (pt.is_control())
+                server.proto_context.control_net_recv(pt, std::move(bp));
+            else if (pt.is_data())
+                server.data_decrypt(pt, *bp);
+            ++n;
+        }
+        server.proto_context.flush(true);
+        while (!stopped && !server.net_out.empty())
+        {
+            BufferPtr bp = std::move(server.net_out.front());
+            server.net_out.pop_front();
+            parent->transport_recv(*bp);
+            ++n;
+        }
+        return n;
+    }
+
+    void transport_start() override
+    {
+        parent->transport_connecting();
+    }
+
+    void stop() override
+    {
+        stopped = true;
+    }
+
+    bool transport_send_const(const Buffer &buf) override
+    {
+        if (stopped)
+            return false;
+        to_server.push_back(BufferAllocatedRc::Create(buf, 0));
+        return true;
+    }
+
+    bool transport_send(BufferAllocated &buf) override
+    {
+        return transport_send_const(buf);
+    }
+
+    bool transport_send_queue_empty() override
+    {
+        return true;
+    }
+
+    bool transport_has_send_queue() override
+    {
+        return false;
+    }
+
+    void transport_stop_requeueing() override
+    {
+    }
+
+    size_t transport_send_queue_size() override
+    {
+        return 0;
+    }
+
+    void reset_align_adjust(const size_t align_adjust) override
+    {
+    }
+
+    IP::Addr server_endpoint_addr() const override
+    {
+        return IP::Addr("127.0.0.1");
+    }
+
+    void server_endpoint_info(std::string &host,
+                              std::string &port,
+                              std::string &proto,
+                              std::string &ip_addr) const override
+    {
+        host = "loopback";
+        port = "1194";
+        proto = "UDP";
+        ip_addr = "127.0.0.1";
+    }
+
+    Protocol transport_protocol() const override
+    {
+        return Protocol(Protocol::UDPv4);
+    }
+
+    void transport_reparent(TransportClientParent *parent_arg) override
+    {
+        parent = parent_arg;
+    }
+
+  private:
+    TransportClientParent *parent;
+    LoopbackServer &server;
+    std::deque<BufferPtr> to_server;
+    bool stopped = false;
+};
+
+class LoopbackTransportFactory : public TransportClientFactory
+{
+  public:
+    explicit LoopbackTransportFactory(LoopbackServer &server_arg)
+        : server(server_arg)
+    {
+    }
+
+    TransportClient::Ptr new_transport_client_obj(openvpn_io::io_context &io_context,
+                                                  TransportClientParent *parent) override
+    {
+        transport.reset(new LoopbackTransport(parent, server));
+        return transport;
+    }
+
+    LoopbackServer &server;
+    LoopbackTransport::Ptr transport;
+};
+
+// Tun that counts the packets it receives, and lets the test inject
+// packets as if read from the tun device
+class LoopbackTun : public TunClient
+{
+  public:
+    typedef RCPtr<LoopbackTun> Ptr;
+
+    explicit LoopbackTun(TunClientParent &parent_arg)
+        : parent(parent_arg)
+    {
+    }
+
+    void inject(const std::string &packet, const Frame &frame)
+    {
+        BufferAllocated buf;
+        frame.prepare(Frame::READ_TUN, buf);
+        buf_append_string(buf, packet);
+        parent.tun_recv(buf);
+    }
+
+    void tun_start(const OptionList &, TransportClient &, CryptoDCSettings &) override
+    {
+        parent.tun_connected();
+    }
+
+    bool tun_send(BufferAllocated &buf) override
+    {
+        ++received;
+        return true;
+    }
+
+    std::string tun_name() const override
+    {
+        return "loopback";
+    }
+
+    std::string vpn_ip4() const override
+    {
+        return "";
+    }
+
+    std::string vpn_ip6() const override
+    {
+        return "";
+    }
+
+    int vpn_mtu() const override
+    {
+        return 0;
+    }
+
+    void set_disconnect() override
+    {
+    }
+
+    void stop() override
+    {
+    }
+
+    size_t received = 0;
+
+  private:
+    TunClientParent &parent;
+};
+
+class LoopbackTunFactory : public TunClientFactory
+{
+  public:
+    TunClient::Ptr new_tun_client_obj(openvpn_io::io_context &io_context,
+                                      TunClientParent &parent,
+                                      TransportClient *transcli) override
+    {
+        tun.reset(new LoopbackTun(parent));
+        return tun;
+    }
+
+    bool supports_proto_v3() override
+    {
+        return true;
+    }
+
+    LoopbackTun::Ptr tun;
+};
+
+class StandbyCallback : public ClientProto::NotifyCallback
+{
+  public:
+    void client_proto_terminate() override
+    {
+        ++terminated;
+    }
+
+    void client_proto_connected() override
+    {
+        ++connected;
+    }
+
+    void client_proto_standby_ready() override
+    {
+        ++standby_ready;
+    }
+
+    int terminated = 0;
+    int connected = 0;
+    int standby_ready = 0;
+};
+
+// A client session and the server at the other end of its link
+struct LoopbackConnection
+{
+    LoopbackConnection(openvpn_io::io_context &io_context,
+                       Frame::Ptr frame,
+                       Time &time,
+                       ClientProto::NotifyCallback *notify_callback,
+                       ClientEvent::Queue::Ptr events,
+                       const bool standby)
+    {
+        ClientRandomAPI::Ptr rng_cli(new ClientRandomAPI());
+        ServerRandomAPI::Ptr rng_serv(new ServerRandomAPI());
+        MySessionStats::Ptr serv_stats(new MySessionStats);
+        cli_stats.reset(new MySessionStats);
+
+        server.reset(new LoopbackServer(create_server_proto_context(frame, rng_serv, serv_stats, time, false, false), serv_stats));
+        server->reset();
+        server->proto_context.start();
+
+        transport_factory.reset(new LoopbackTransportFactory(*server));
+        tun_factory.reset(new LoopbackTunFactory());
+
+        ClientProto::Session::Config config;
+        config.proto_context_config = create_client_proto_context(create_client_ssl_config(frame, rng_cli), frame, rng_cli, cli_stats, time);
+        config.proto_context_options.reset(new ProtoContextCompressionOptions());
+        config.transport_factory = transport_factory;
+        config.tun_factory = tun_factory;
+        config.cli_stats = cli_stats;
+        config.cli_events = std::move(events);
+        config.standby = standby;
+        session.reset(new ClientProto::Session(io_context, config, notify_callback));
+    }
+
+    // Exchange packets until done() or no more progress can be made,
+    // and return the number of round trips it took.
+    template <typename DONE>
+    size_t run_until(openvpn_io::io_context &io_context, DONE done)
+    {
+        size_t round_trips = 0;
+        while (!done() && round_trips < 100)
+        {
+            io_context.restart();
+            io_context.poll();
+            if (!transport_factory->transport->round_trip() && !done())
+            {
+                io_context.restart();
+                io_context.run_for(std::chrono::milliseconds(10));
+            }
+            ++round_trips;
+        }
+        return round_trips;
+    }
+
+    MySessionStats::Ptr cli_stats;
+    std::unique_ptr<LoopbackServer> server;
+    RCPtr<LoopbackTransportFactory> transport_factory;
+    RCPtr<LoopbackTunFactory> tun_factory;
+    ClientProto::Session::Ptr session;
+};
+
+// Failover to a warm standby session only has to bring up the tun, while
+// a new session has to go through the handshake and push request first.
+// Measured over an in-memory link, in round trips until the first
+// packet from the tun reaches the new server.
+TEST(proto, warm_standby_failover)
+{
+    openvpn_io::io_context io_context;
+    Frame::Ptr frame(frame_init_simple(1500));
+    Time time;
+
+    // active session, and a standby session to another server
+    StandbyCallback active_cb;
+    ClientEvent::Queue::Ptr events(new EventQueueVector());
+    EventQueueVector *eqv = static_cast<EventQueueVector *>(events.get());
+    LoopbackConnection active(io_context, frame, time, &active_cb, events, false);
+    active.session->start();
+    active.run_until(io_context, [&]()
+                     { return active_cb.connected > 0; });
+    ASSERT_EQ(active_cb.connected, 1);
+
+    StandbyCallback standby_cb;
+    LoopbackConnection standby(io_context, frame, time, &standby_cb, ClientEvent::Queue::Ptr(new EventQueueVector()), true);
+    standby.session->start();
+    standby.run_until(io_context, [&]()
+                      { return standby_cb.standby_ready > 0; });
+    ASSERT_TRUE(standby.session->standby_ready());
+    EXPECT_EQ(standby_cb.connected, 0);
+    EXPECT_FALSE(standby.tun_factory->tun); // no tun until promoted
+    EXPECT_TRUE(standby.server->proto_context.data_channel_ready());
+
+    // fail over
+    active.session->stop(false);
+    const size_t events_before = eqv->events.size();
+    const std::chrono::steady_clock::time_point warm_start = std::chrono::steady_clock::now();
+    standby.session->promote(&active_cb, events, active.cli_stats);
+    ASSERT_EQ(active_cb.connected, 2);
+    ASSERT_TRUE(standby.tun_factory->tun);
+    const size_t warm_bytes = standby.server->data_bytes();
+    standby.tun_factory->tun->inject("after failover", *frame);
+    const size_t warm_round_trips = standby.run_until(io_context, [&]()
+                                                      { return standby.server->data_bytes() > warm_bytes; });
+    const auto warm_time = std::chrono::steady_clock::now() - warm_start;
+    EXPECT_GT(standby.server->data_bytes(), warm_bytes);
+
+    // the Connected event of the promoted session is reported
+    bool connected_event = false;
+    for (size_t i = events_before; i < eqv->events.size(); ++i)
+        connected_event |= bool(dynamic_cast<ClientEvent::Connected *>(eqv->events[i].get()));
+    EXPECT_TRUE(connected_event);
+
+    // server to client traffic reaches the tun
+    BufferPtr bp = standby.server->data_encrypt_string("to client");
+    standby.transport_factory->transport->round_trip(); // flush
+    standby.server->net_out.push_back(std::move(bp));
+    standby.transport_factory->transport->round_trip();
+    EXPECT_EQ(standby.tun_factory->tun->received, 1u);
+
+    // the same failover with a new session
+    StandbyCallback cold_cb;
+    const std::chrono::steady_clock::time_point cold_start = std::chrono::steady_clock::now();
+    LoopbackConnection cold(io_context, frame, time, &cold_cb, ClientEvent::Queue::Ptr(new EventQueueVector()), false);
+    cold.session->start();
+    size_t cold_round_trips = cold.run_until(io_context, [&]()
+                                             { return cold_cb.connected > 0; });
+    ASSERT_EQ(cold_cb.connected, 1);
+    cold.tun_factory->tun->inject("after reconnect", *frame);
+    cold_round_trips += cold.run_until(io_context, [&]()
+                                       { return cold.server->data_bytes() > 0; });
+    const auto cold_time = std::chrono::steady_clock::now() - cold_start;
+
+    std::cout << "failover to first packet: new session " << cold_round_trips << " round trips, "
+              << std::chrono::duration_cast<std::chrono::microseconds>(cold_time).count() << " us; "
+              << "warm standby " << warm_round_trips << " round trips, "
+              << std::chrono::duration_cast<std::chrono::microseconds>(warm_time).count() << " us" << std::endl;
+    EXPECT_EQ(warm_round_trips, 1u);
+    EXPECT_GT(cold_round_trips, 3u);
+
+    standby.session->stop(false);
+    cold.session->stop(false);
+}
+
+// The errors of a standby session stay out of the client stats until it
+// is promoted, and its transport counters are merged in from then on.
+TEST(proto, standby_stats)
+{
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    StandbyStats::Ptr standby_stats(new StandbyStats);
+
+    standby_stats->error(Error::KEEPALIVE_TIMEOUT);
+    standby_stats->inc_stat(SessionStats::BYTES_IN, 100);
+    standby_stats->inc_stat(SessionStats::PACKETS_IN, 1);
+    EXPECT_EQ(cli_stats->get_error_count(Error::KEEPALIVE_TIMEOUT), 0u);
+    EXPECT_EQ(standby_stats->error_count(Error::KEEPALIVE_TIMEOUT), 1u);
+    EXPECT_FALSE(cli_stats->dco_update());
+
+    standby_stats->promote(cli_stats);
+    EXPECT_EQ(cli_stats->get_error_count(Error::KEEPALIVE_TIMEOUT), 1u);
+    EXPECT_EQ(standby_stats->error_count(Error::KEEPALIVE_TIMEOUT), 0u);
+    standby_stats->error(Error::DECRYPT_ERROR);
+    EXPECT_EQ(cli_stats->get_error_count(Error::DECRYPT_ERROR), 1u);
+
+    cli_stats->inc_stat(SessionStats::BYTES_IN, 10);
+    EXPECT_TRUE(cli_stats->dco_update());
+    EXPECT_EQ(cli_stats->get_stat(SessionStats::BYTES_IN), 110u);
+    standby_stats->inc_stat(SessionStats::BYTES_IN, 50);
+    standby_stats->inc_stat(SessionStats::PACKETS_IN, 1);
+    EXPECT_TRUE(cli_stats->dco_update());
+    EXPECT_EQ(cli_stats->get_stat(SessionStats::BYTES_IN), 160u);
+    EXPECT_EQ(cli_stats->get_stat(SessionStats::PACKETS_IN), 2u);
+
+    // the last counts are pulled in when the session goes away
+    standby_stats->inc_stat(SessionStats::BYTES_OUT, 20);
+    standby_stats->detach();
+    EXPECT_EQ(cli_stats->get_stat(SessionStats::BYTES_OUT), 20u);
+    EXPECT_FALSE(cli_stats->dco_update());
+    standby_stats->error(Error::DECRYPT_ERROR);
+    EXPECT_EQ(cli_stats->get_error_count(Error::DECRYPT_ERROR), 1u);
+}
+
+// Server end of a UDP connection from a ClientConnect, for tests that
+// go through the client's own transports.  Each client hard reset gets
+// a new server session, and the server can be made to go silent.
+class UDPLoopbackServer
+{
+  public:
+    UDPLoopbackServer(openvpn_io::io_context &io_context, Frame::Ptr frame_arg, std::string push_reply_arg)
+        : socket(io_context, openvpn_io::ip::udp::endpoint(openvpn_io::ip::make_address("127.0.0.1"), 0)),
+          timer(io_context),
+          frame(std::move(frame_arg)),
+          push_reply(std::move(push_reply_arg))
+    {
+        receive();
+        housekeeping();
+    }
+
+    unsigned short port() const
+    {
+        return socket.local_endpoint().port();
+    }
+
+    void stop()
+    {
+        socket.close();
+        timer.cancel();
+    }
+
+    bool silent = false;
+    int sessions = 0;
+    size_t sent = 0; // packets sent to the client
+
+    int push_replies() const
+    {
+        return server ? server->n_push_replies : 0;
+    }
+
+  private:
+    void receive()
+    {
+        socket.async_receive_from(openvpn_io::buffer(rx),
+                                  peer,
+                                  [this](const openvpn_io::error_code &error, const size_t n)
+                                  {
+                                      if (error == openvpn_io::error::operation_aborted || !socket.is_open())
+                                          return;
+                                      if (!error && !silent && n)
+                                          recv(n);
+                                      receive();
+                                  });
+    }
+
+    void recv(const size_t n)
+    {
+        time = Time::now();
+
+        // CONTROL_HARD_RESET_CLIENT_V2/V3 start a new session
+        const unsigned int opcode = rx[0] >> 3;
+        if (opcode == 7 || opcode == 10)
+            new_session();
+        if (!server)
+            return;
+
+        BufferAllocated buf;
+        frame->prepare(Frame::READ_LINK_UDP, buf);
+        buf.write(rx.data(), n);
+        const ProtoContext::PacketType pt = server->proto_context.packet_type(buf);
+        if (pt.is_control())
+            server->proto_context.control_net_recv(pt, BufferAllocatedRc::Create(buf, 0));
+        else if (pt.is_data())
+            server->data_decrypt(pt, buf);
+        send();
+    }
+
+    void new_session()
+    {
+        ServerRandomAPI::Ptr rng(new ServerRandomAPI());
+        MySessionStats::Ptr stats(new MySessionStats);
+        ProtoContext::ProtoConfig::Ptr sp = create_server_proto_context(frame, rng, stats, time, false, false);
+        sp->dc.set_cipher(CryptoAlgs::lookup("AES-256-GCM"));
+        sp->comp_ctx = CompressContext(CompressContext::NONE, false);
+        sp->enable_op32 = false;
+        sp->keepalive_ping = Time::Duration::seconds(1);
+        server.reset(new LoopbackServer(sp, stats));
+        server->push_reply = push_reply;
+        server->reset();
+        server->proto_context.start();
+        ++sessions;
+    }
+
+    void housekeeping()
+    {
+        timer.expires_after(Time::Duration::milliseconds(100));
+        timer.async_wait([this](const openvpn_io::error_code &error)
+                         {
+                             if (error)
+                                 return;
+                             time = Time::now();
+                             if (server && !silent)
+                             {
+                                 server->do_housekeeping();
+                                 send();
+                             }
+                             housekeeping(); });
+    }
+
+    void send()
+    {
+        server->proto_context.flush(true);
+        while (!server->net_out.empty())
+        {
+            if (!silent)
+            {
+                const Buffer &buf = *server->net_out.front();
+                socket.send_to(openvpn_io::buffer(buf.c_data(), buf.size()), peer);
+                ++sent;
+            }
+            server->net_out.pop_front();
+        }
+    }
+
+    openvpn_io::ip::udp::socket socket;
+    openvpn_io::ip::udp::endpoint peer;
+    std::array<unsigned char, 2048> rx;
+    AsioTimer timer;
+    Frame::Ptr frame;
+    std::string push_reply;
+    Time time;
+    std::unique_ptr<LoopbackServer> server;
+};
+
+// Warm standby through ClientConnect: the standby session is restarted
+// when it fails, takes over when the active session is lost, and is
+// stopped with the client.
+TEST(proto, warm_standby_client_connect)
+{
+    openvpn_io::io_context io_context;
+    Frame::Ptr frame(frame_init_simple(1500));
+    const std::string push_reply = "PUSH_REPLY,cipher AES-256-GCM,ping 1,ping-restart 3";
+    UDPLoopbackServer server_a(io_context, frame, push_reply);
+    UDPLoopbackServer server_b(io_context, frame, push_reply);
+
+    const std::string profile = "client\n"
+                                "dev tun\n"
+                                "remote 127.0.0.1 "
+                                + std::to_string(server_a.port()) + " udp\n"
+                                + "remote 127.0.0.1 " + std::to_string(server_b.port()) + " udp\n"
+                                + "<ca>\n" + read_text(TEST_KEYCERT_DIR "ca.crt") + "</ca>\n"
+                                + "<cert>\n" + read_text(TEST_KEYCERT_DIR "client.crt") + "</cert>\n"
+                                + "<key>\n" + read_text(TEST_KEYCERT_DIR "client.key") + "</key>\n"
+#if defined(USE_TLS_CRYPT_V2)
+                                + "<tls-crypt-v2>\n" + read_text(TEST_KEYCERT_DIR "tls-crypt-v2-client.key") + "</tls-crypt-v2>\n";
+#elif defined(USE_TLS_CRYPT)
+                                + "<tls-crypt>\n" + read_text(TEST_KEYCERT_DIR "tls-auth.key") + "</tls-crypt>\n";
+#else
+                                + "key-direction 0\n<tls-auth>\n" + read_text(TEST_KEYCERT_DIR "tls-auth.key") + "</tls-auth>\n";
+#endif
+
+    OptionList options;
+    ParseClientConfig::parse(profile, nullptr, options);
+    MySessionStats::Ptr cli_stats(new MySessionStats);
+    ClientEvent::Queue::Ptr events(new EventQueueVector());
+    EventQueueVector *eqv = static_cast<EventQueueVector *>(events.get());
+    ClientOptions::Config config;
+    config.clientconf.warmStandby = true;
+    config.proto_context_options.reset(new ProtoContextCompressionOptions());
+    config.cli_stats = cli_stats;
+    config.cli_events = events;
+    ClientOptions::Ptr client_options(new ClientOptions(options, config));
+
+    auto n_events = [eqv](const ClientEvent::Type type)
+    {
+        int n = 0;
+        for (const auto &ev : eqv->events)
+            n += ev->id() == type;
+        return n;
+    };
+    auto run_until = [&io_context](auto done, const int seconds)
+    {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (!done() && std::chrono::steady_clock::now() < end)
+        {
+            io_context.restart();
+            io_context.run_for(std::chrono::milliseconds(10));
+        }
+        return done();
+    };
+
+    ClientConnect::Ptr client(new ClientConnect(io_context, client_options));
+    client->start();
+
+    // connected to A, with a standby session on B
+    ASSERT_TRUE(run_until([&]()
+                          { return n_events(ClientEvent::CONNECTED) == 1 && server_b.push_replies() == 1; },
+                          10));
+    run_until([]()
+              { return false; },
+              1);
+    EXPECT_EQ(server_a.sessions, 1);
+    EXPECT_EQ(server_b.sessions, 1);
+    // packets from B go to the stats of the standby session
+    EXPECT_FALSE(cli_stats->dco_update());
+    EXPECT_LE(cli_stats->get_stat(SessionStats::PACKETS_IN), count_t(server_a.sent));
+
+    // B stops answering: the standby session times out, and a new one is
+    // started after a while, without affecting the active session
+    server_b.silent = true;
+    run_until([]()
+              { return false; },
+              5);
+    server_b.silent = false;
+    ASSERT_TRUE(run_until([&]()
+                          { return server_b.push_replies() == 1 && server_b.sessions == 2; },
+                          15));
+    run_until([]()
+              { return false; },
+              1);
+    EXPECT_EQ(n_events(ClientEvent::CONNECTED), 1);
+    EXPECT_EQ(n_events(ClientEvent::RECONNECTING), 0);
+    EXPECT_EQ(cli_stats->get_error_count(Error::KEEPALIVE_TIMEOUT), 0u);
+
+    // A stops answering: the client fails over to the standby session on
+    // B without a new handshake
+    server_a.silent = true;
+    ASSERT_TRUE(run_until([&]()
+                          { return n_events(ClientEvent::CONNECTED) == 2; },
+                          10));
+    EXPECT_EQ(n_events(ClientEvent::RECONNECTING), 1);
+    EXPECT_EQ(server_b.sessions, 2);
+    EXPECT_EQ(cli_stats->get_error_count(Error::KEEPALIVE_TIMEOUT), 1u);
+    EXPECT_EQ(cli_stats->get_error_count(Error::N_RECONNECT), 1u);
+
+    // the packets of the promoted session are merged into the client stats
+    run_until([]()
+              { return false; },
+              2);
+    EXPECT_TRUE(cli_stats->dco_update());
+    EXPECT_GT(cli_stats->get_stat(SessionStats::PACKETS_IN), count_t(server_a.sent));
+
+    // stop with a standby session (to A, which is silent) in progress
+    client->stop();
+    EXPECT_EQ(n_events(ClientEvent::DISCONNECTED), 1);
+    server_a.stop();
+    server_b.stop();
+    io_context.restart();
+    io_context.run_for(std::chrono::seconds(5));
+    EXPECT_TRUE(io_context.stopped());
+}
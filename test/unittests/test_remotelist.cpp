@@ -598,3 +598,39 @@ TEST(RemoteList, OverrideFunctions)
     ASSERT_EQ(rl.size(), 1UL);
     ASSERT_EQ(rl.current_server_host(), "override.host.invalid");
 }
+
+TEST(RemoteList, CloneNextRemote)
+{
+    OptionList cfg;
+    cfg.parse_from_config(
+        "remote 1.domain.tld 1111 udp\n"
+        "remote 2.domain.tld 2222 udp\n"
+        "remote 3.domain.tld 3333 tcp\n",
+        nullptr);
+    cfg.update_map();
+
+    RemoteList::Ptr rl(new RemoteList(cfg, "", 0, nullptr, nullptr));
+    RemoteList::Ptr next = rl->clone_next_remote();
+    ASSERT_TRUE(next);
+    EXPECT_EQ(next->current_server_host(), "2.domain.tld");
+    EXPECT_FALSE(rl->same_current_item(*next));
+
+    // next TCP entry, skipping the UDP ones
+    RemoteList::Ptr tcp = rl->clone_next_remote(Protocol(Protocol::TCP));
+    ASSERT_TRUE(tcp);
+    EXPECT_EQ(tcp->current_server_host(), "3.domain.tld");
+    EXPECT_TRUE(tcp->current_transport_protocol().is_tcp());
+    EXPECT_EQ(rl->current_server_host(), "1.domain.tld");
+
+    rl->next(RemoteList::Advance::Remote);
+    EXPECT_TRUE(rl->same_current_item(*next));
+    rl->next(RemoteList::Advance::Remote);
+    EXPECT_TRUE(rl->same_current_item(*tcp));
+
+    // the current entry is not a candidate, so from the only TCP entry
+    // there is none, and wrapping around finds the first UDP entry
+    EXPECT_FALSE(rl->clone_next_remote(Protocol(Protocol::TCP)));
+    next = rl->clone_next_remote(Protocol(Protocol::UDP));
+    ASSERT_TRUE(next);
+    EXPECT_EQ(next->current_server_host(), "1.domain.tld");
+}
@@ -0,0 +1,228 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <openvpn/transport/socket_protect_async.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+class TestSocketProtect : public SocketProtect
+{
+  public:
+    TestSocketProtect(bool async_arg)
+        : async(async_arg)
+    {
+    }
+
+    bool socket_protect(openvpn_io::detail::socket_type socket, IP::Addr endpoint) override
+    {
+        // reject odd descriptors
+        return (socket & 1) == 0;
+    }
+
+    void socket_protect_batch(RequestList &requests) override
+    {
+        ++n_upcalls;
+        last_batch_size = requests.size();
+        caller = std::this_thread::get_id();
+        std::this_thread::sleep_for(delay);
+        if (fail)
+            throw Exception("host error");
+        SocketProtect::socket_protect_batch(requests);
+        returned = true;
+    }
+
+    bool socket_protect_async() const override
+    {
+        return async;
+    }
+
+    bool async;
+    bool fail = false;
+    std::chrono::milliseconds delay{0};
+    std::atomic<bool> returned{false};
+    std::atomic<unsigned int> n_upcalls{0};
+    size_t last_batch_size = 0;
+    std::thread::id caller;
+};
+
+void run_batch(TestSocketProtect &sp)
+{
+    openvpn_io::io_context io_context(1);
+    SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+    std::vector<int> results(4, -1);
+    for (int i = 0; i < 4; ++i)
+        queue->protect(&sp, i, IP::Addr::from_string("10.0.0.1"), [&results, i](const bool ok)
+                       { results[i] = ok; });
+
+    // completion is always asynchronous
+    EXPECT_EQ(sp.n_upcalls, 0u);
+    EXPECT_EQ(results[0], -1);
+
+    io_context.run();
+
+    EXPECT_EQ(queue->n_batches(), 1u);
+    EXPECT_EQ(sp.n_upcalls, 1u);
+    EXPECT_EQ(sp.last_batch_size, 4u);
+    EXPECT_EQ(results, std::vector<int>({1, 0, 1, 0}));
+}
+
+} // namespace
+
+TEST(SocketProtect, batch_sync)
+{
+    TestSocketProtect sp(false);
+    run_batch(sp);
+    EXPECT_EQ(sp.caller, std::this_thread::get_id());
+}
+
+TEST(SocketProtect, batch_async)
+{
+    TestSocketProtect sp(true);
+    run_batch(sp);
+    EXPECT_NE(sp.caller, std::this_thread::get_id());
+}
+
+TEST(SocketProtect, separate_turns)
+{
+    TestSocketProtect sp(false);
+    openvpn_io::io_context io_context(1);
+    SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+    int n_done = 0;
+    queue->protect(&sp, 2, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                   {
+        ++n_done;
+        // a request made from a completion callback goes into a new batch
+        queue->protect(&sp, 4, IP::Addr::from_string("10.0.0.2"), [&](const bool ok)
+                       { ++n_done; }); });
+    io_context.run();
+
+    EXPECT_EQ(n_done, 2);
+    EXPECT_EQ(queue->n_batches(), 2u);
+}
+
+// An exception from the host completes the batch as not protected
+TEST(SocketProtect, batch_throw)
+{
+    for (const bool async : {false, true})
+    {
+        TestSocketProtect sp(async);
+        sp.fail = true;
+        openvpn_io::io_context io_context(1);
+        SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+        std::vector<int> results(2, -1);
+        for (int i = 0; i < 2; ++i)
+            queue->protect(&sp, i * 2, IP::Addr::from_string("10.0.0.1"), [&results, i](const bool ok)
+                           { results[i] = ok; });
+        io_context.run();
+        EXPECT_EQ(results, std::vector<int>({0, 0}));
+    }
+}
+
+// Requests made while a batch is with the host go into the next batch.
+// The event loop keeps running meanwhile, and doesn't return before
+// the host has returned.
+TEST(SocketProtect, worker_not_joined)
+{
+    TestSocketProtect sp(true);
+    sp.delay = std::chrono::milliseconds(200);
+    openvpn_io::io_context io_context(1);
+    SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+    int n_done = 0;
+    queue->protect(&sp, 2, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                   { ++n_done; });
+    const auto start = std::chrono::steady_clock::now();
+    io_context.poll();
+    queue->protect(&sp, 4, IP::Addr::from_string("10.0.0.2"), [&](const bool ok)
+                   { ++n_done; });
+    io_context.poll();
+    queue->cancel(nullptr);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, sp.delay);
+    EXPECT_EQ(n_done, 0);
+
+    io_context.run();
+    EXPECT_TRUE(sp.returned);
+    EXPECT_EQ(n_done, 2);
+    EXPECT_EQ(sp.n_upcalls, 2u);
+    EXPECT_EQ(queue->n_batches(), 2u);
+}
+
+// A stopped owner's descriptors are not sent to the host, and its
+// callbacks are not invoked, while the other owners are unaffected
+TEST(SocketProtect, cancel)
+{
+    for (const bool async : {false, true})
+    {
+        TestSocketProtect sp(async);
+        openvpn_io::io_context io_context(1);
+        SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+        int a = 0, b = 0;
+        std::vector<int> owners(2);
+        queue->protect(&owners[0], 2, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                       { ++a; });
+        queue->protect(&owners[1], 4, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                       { ++b; });
+        queue->protect(&owners[0], 6, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                       { ++a; });
+        queue->cancel(&owners[0]);
+        io_context.run();
+        EXPECT_EQ(sp.n_upcalls, 1u);
+        EXPECT_EQ(sp.last_batch_size, 1u);
+        EXPECT_EQ(a, 0);
+        EXPECT_EQ(b, 1);
+
+        // no up-call at all once every request is cancelled
+        queue->protect(&owners[1], 8, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                       { ++b; });
+        queue->cancel(&owners[1]);
+        io_context.restart();
+        io_context.run();
+        EXPECT_EQ(sp.n_upcalls, 1u);
+        EXPECT_EQ(b, 1);
+    }
+}
+
+// Cancelled while its batch is with the host: the host still returns,
+// but the callback is not invoked
+TEST(SocketProtect, cancel_in_flight)
+{
+    TestSocketProtect sp(true);
+    sp.delay = std::chrono::milliseconds(100);
+    openvpn_io::io_context io_context(1);
+    SocketProtectQueue::Ptr queue(new SocketProtectQueue(io_context, &sp));
+
+    int a = 0, b = 0;
+    std::vector<int> owners(2);
+    queue->protect(&owners[0], 2, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                   { ++a; });
+    queue->protect(&owners[1], 4, IP::Addr::from_string("10.0.0.1"), [&](const bool ok)
+                   { ++b; });
+    io_context.poll();
+    EXPECT_EQ(queue->n_batches(), 1u);
+    queue->cancel(&owners[0]);
+    io_context.run();
+    EXPECT_TRUE(sp.returned);
+    EXPECT_EQ(sp.last_batch_size, 2u);
+    EXPECT_EQ(a, 0);
+    EXPECT_EQ(b, 1);
+}
@@ -12,6 +12,11 @@
 
 #include "test_common.hpp"
 
+#include <chrono>
+
+#include <openvpn/common/file.hpp>
+#include <openvpn/common/options.hpp>
+#include <openvpn/error/excode.hpp>
 #include <openvpn/ssl/sslchoose.hpp>
 
 
@@ -516,4 +521,154 @@ TEST(sslctx_ut, clienthello)
     EXPECT_TRUE(server->read_ciphertext_ready());
     auto buf = server->read_ciphertext();
     ASSERT_TRUE(buf->length() > 1);
-}
\ No newline at end of file
+}
+
+#define SSL_KEYCERT_DIR UNITTEST_SOURCE_DIR "../ssl/"
+
+// well-formed PEM that doesn't contain a certificate
+static const std::string bad_ca_txt = "-----BEGIN CERTIFICATE-----\nAAAAAAAAAAAA\n-----END CERTIFICATE-----\n";
+
+// Grow a CA bundle past the size that is parsed at load time
+static std::string large_ca(const std::string &ca)
+{
+    std::string ret;
+    while (ret.size() < 256 * 1024)
+        ret += cert_txt + '\n';
+    return ret + ca;
+}
+
+// A bundle with broken PEM framing fails when the options are loaded,
+// whatever its size
+TEST(sslctx_ut, deferred_ca_framing)
+{
+    const std::string truncated = cert_txt.substr(0, cert_txt.find("-----END"));
+    const std::string bad_char = "-----BEGIN CERTIFICATE-----\nAAAA*AAA\n-----END CERTIFICATE-----\n";
+    for (const auto &ca : {truncated, large_ca(truncated), bad_char, large_ca(bad_char)})
+    {
+        OptionList opt;
+        opt.emplace_back("client");
+        opt.emplace_back("ca", ca);
+        opt.emplace_back("cert", cert_txt);
+        opt.emplace_back("key", pvt_key_txt);
+        opt.update_map();
+
+        SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+        config->set_rng(StrongRandomAPI::Ptr(new SSLLib::RandomAPI()));
+        EXPECT_THROW(config->load(opt, SSLConfigAPI::LF_PARSE_MODE), std::exception);
+    }
+}
+
+// A small CA bundle is parsed when it is loaded
+TEST(sslctx_ut, deferred_ca_small)
+{
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    EXPECT_THROW(config->load_ca(bad_ca_txt, false), std::exception);
+}
+
+#ifdef USE_OPENSSL
+// A large CA bundle is only parsed when the first SSL object needs it,
+// and a parse error is reported then as a fatal CERT_VERIFY_FAIL
+TEST(sslctx_ut, deferred_ca_client)
+{
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    config->set_rng(StrongRandomAPI::Ptr(new SSLLib::RandomAPI()));
+    config->set_debug_level(0);
+    config->set_mode(Mode(Mode::CLIENT));
+    config->load_cert(cert_txt);
+    config->load_private_key(pvt_key_txt);
+    config->load_ca(large_ca(bad_ca_txt), false);
+
+    auto factory = config->new_factory();
+    ASSERT_TRUE(factory);
+    for (int i = 0; i < 2; ++i)
+    {
+        try
+        {
+            factory->ssl();
+            FAIL() << "bad CA accepted";
+        }
+        catch (const ExceptionCode &e)
+        {
+            EXPECT_EQ(e.code(), Error::CERT_VERIFY_FAIL);
+            EXPECT_TRUE(e.fatal());
+        }
+    }
+}
+
+// A server reports a bad CA bundle when its factory is created
+TEST(sslctx_ut, deferred_ca_server)
+{
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    config->set_rng(StrongRandomAPI::Ptr(new SSLLib::RandomAPI()));
+    config->set_debug_level(0);
+    config->set_mode(Mode(Mode::SERVER));
+    config->load_cert(cert_txt);
+    config->load_private_key(pvt_key_txt);
+    config->load_ca(large_ca(bad_ca_txt), false);
+    EXPECT_THROW(config->new_factory(), ExceptionCode);
+}
+
+TEST(sslctx_ut, deferred_ca_extract)
+{
+    const std::string ca = read_text(SSL_KEYCERT_DIR "ca.crt");
+    const std::string crl = read_text(SSL_KEYCERT_DIR "ca.crl");
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    config->load_ca(ca, true);
+    config->load_ca(large_ca(ca), true);
+    config->load_crl(crl);
+    config->load_cert(cert_txt, ca);
+
+    const std::string cas = config->extract_ca();
+    EXPECT_EQ(cas.find(OpenSSLPKI::X509(ca, "ca").render_pem()), 0u);
+    EXPECT_NE(cas.find(OpenSSLPKI::X509(cert_txt, "cert").render_pem()), std::string::npos);
+    EXPECT_EQ(config->extract_crl(), OpenSSLPKI::CRL(crl).render_pem());
+    ASSERT_EQ(config->extract_extra_certs().size(), 1u);
+    EXPECT_EQ(config->extract_extra_certs()[0], OpenSSLPKI::X509(ca, "ca").render_pem());
+}
+#endif
+
+// Startup of a client profile with a 5 MB CA/CRL bundle: loading the
+// options and creating the factory only checks the PEM framing of the
+// bundle, and parsing it moves to the first SSL object
+TEST(sslctx_ut, deferred_ca_startup)
+{
+    const std::string ca = read_text(SSL_KEYCERT_DIR "ca.crt");
+    const std::string crl = read_text(SSL_KEYCERT_DIR "ca.crl");
+    std::string ca_bundle = ca;
+    std::string crl_bundle;
+    while (ca_bundle.size() + crl_bundle.size() < 5 * 1024 * 1024)
+    {
+        ca_bundle += cert_txt + '\n';
+        crl_bundle += crl;
+    }
+
+    OptionList opt;
+    opt.emplace_back("client");
+    opt.emplace_back("ca", ca_bundle);
+    opt.emplace_back("crl-verify", crl_bundle);
+    opt.emplace_back("cert", read_text(SSL_KEYCERT_DIR "client.crt"));
+    opt.emplace_back("key", read_text(SSL_KEYCERT_DIR "client.key"));
+    opt.update_map();
+
+    auto start = std::chrono::steady_clock::now();
+    SSLLib::SSLAPI::Config::Ptr config = new SSLLib::SSLAPI::Config;
+    config->set_rng(StrongRandomAPI::Ptr(new SSLLib::RandomAPI()));
+    config->set_debug_level(0);
+    config->load(opt, SSLConfigAPI::LF_PARSE_MODE);
+    auto factory = config->new_factory();
+    const std::chrono::duration<double, std::milli> startup = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    auto ssl = factory->ssl();
+    const std::chrono::duration<double, std::milli> first_ssl = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(ssl);
+
+    start = std::chrono::steady_clock::now();
+    factory->ssl();
+    const std::chrono::duration<double, std::milli> next_ssl = std::chrono::steady_clock::now() - start;
+
+    OPENVPN_LOG((ca_bundle.size() + crl_bundle.size()) / 1024 << " KB CA/CRL bundle: load and factory "
+                                                               << startup.count() << " ms, first SSL object "
+                                                               << first_ssl.count() << " ms, next "
+                                                               << next_ssl.count() << " ms");
+}
@@ -0,0 +1,241 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include <openvpn/time/timerwheel.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+struct Fired
+{
+    std::vector<int> ids;
+    std::vector<Time> when;
+};
+
+std::unique_ptr<TimerWheel::Timer> make_timer(TimerWheel::Ptr wheel, Fired &fired, const int id, const Time &now)
+{
+    return std::make_unique<TimerWheel::Timer>(wheel, [&fired, id, &now]()
+                                               {
+        fired.ids.push_back(id);
+        fired.when.push_back(now); });
+}
+
+// drive the wheel in steps of one tick up to end
+void run_until(TimerWheel &wheel, Time &now, const Time &end)
+{
+    while (now < end)
+    {
+        now += wheel.tick_duration();
+        wheel.advance(now);
+    }
+}
+
+} // namespace
+
+TEST(timerwheel, fire_in_order)
+{
+    TimerWheel::Ptr wheel(new TimerWheel(nullptr));
+    Fired fired;
+    Time now = Time::now();
+    wheel->advance(now);
+
+    // delays spanning the first three levels of the wheel
+    const int secs[] = {5, 1, 3600, 30, 600, 2};
+    std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+    for (int i = 0; i < 6; ++i)
+    {
+        timers.push_back(make_timer(wheel, fired, secs[i], now));
+        timers.back()->expires_at(now + Time::Duration::seconds(secs[i]));
+    }
+    EXPECT_EQ(wheel->size(), 6u);
+
+    const Time start = now;
+    run_until(*wheel, now, start + Time::Duration::seconds(3700));
+    EXPECT_EQ(wheel->size(), 0u);
+    ASSERT_EQ(fired.ids, std::vector<int>({1, 2, 5, 30, 600, 3600}));
+
+    // never early, at most one tick late
+    for (size_t i = 0; i < fired.ids.size(); ++i)
+    {
+        const Time due = start + Time::Duration::seconds(fired.ids[i]);
+        EXPECT_GE(fired.when[i], due);
+        EXPECT_LE(fired.when[i], due + wheel->tick_duration() * 2);
+    }
+}
+
+TEST(timerwheel, cancel_and_destroy)
+{
+    TimerWheel::Ptr wheel(new TimerWheel(nullptr));
+    Fired fired;
+    Time now = Time::now();
+    wheel->advance(now);
+
+    auto t1 = make_timer(wheel, fired, 1, now);
+    auto t2 = make_timer(wheel, fired, 2, now);
+    auto t3 = make_timer(wheel, fired, 3, now);
+    t1->expires_after(Time::Duration::seconds(1));
+    t2->expires_after(Time::Duration::seconds(100));
+    t3->expires_after(Time::Duration::seconds(2));
+    t1->cancel();
+    t2.reset();
+    EXPECT_EQ(wheel->size(), 1u);
+    EXPECT_FALSE(t1->armed());
+    EXPECT_TRUE(t3->armed());
+
+    run_until(*wheel, now, now + Time::Duration::seconds(200));
+    EXPECT_EQ(fired.ids, std::vector<int>({3}));
+    EXPECT_FALSE(t3->armed());
+}
+
+// A timeout pushed out on every activity only fires once activity stops
+TEST(timerwheel, lazy_rearm)
+{
+    TimerWheel::Ptr wheel(new TimerWheel(nullptr));
+    Fired fired;
+    Time now = Time::now();
+    wheel->advance(now);
+
+    auto t = make_timer(wheel, fired, 1, now);
+    const Time start = now;
+    while (now < start + Time::Duration::seconds(120))
+    {
+        t->expires_at(now + Time::Duration::seconds(10));
+        now += Time::Duration::binary_ms(100);
+        wheel->advance(now);
+    }
+    EXPECT_TRUE(fired.ids.empty());
+    const Time last = now;
+    run_until(*wheel, now, now + Time::Duration::seconds(20));
+    ASSERT_EQ(fired.ids.size(), 1u);
+    EXPECT_GE(fired.when[0] + Time::Duration::binary_ms(100), last + Time::Duration::seconds(10));
+
+    // moving an armed timer earlier takes effect immediately
+    t->expires_at(now + Time::Duration::seconds(60));
+    t->expires_at(now + Time::Duration::seconds(1));
+    run_until(*wheel, now, now + Time::Duration::seconds(2));
+    EXPECT_EQ(fired.ids.size(), 2u);
+}
+
+// A callback may re-arm its own timer and destroy others
+TEST(timerwheel, callback_reentrancy)
+{
+    TimerWheel::Ptr wheel(new TimerWheel(nullptr));
+    Time now = Time::now();
+    wheel->advance(now);
+
+    int count = 0;
+    std::unique_ptr<TimerWheel::Timer> other;
+    std::unique_ptr<TimerWheel::Timer> self;
+    self = std::make_unique<TimerWheel::Timer>(wheel, [&]()
+                                               {
+        if (++count < 3)
+            self->expires_after(Time::Duration::seconds(1));
+        other.reset(); });
+    other = std::make_unique<TimerWheel::Timer>(wheel, []()
+                                                { FAIL(); });
+    self->expires_at(now + Time::Duration::seconds(1));
+    other->expires_at(now + Time::Duration::seconds(1));
+
+    run_until(*wheel, now, now + Time::Duration::seconds(10));
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(wheel->size(), 0u);
+}
+
+TEST(timerwheel, io_context)
+{
+    openvpn_io::io_context io_context(1);
+    TimerWheel::Ptr wheel = TimerWheel::get(io_context);
+    EXPECT_EQ(wheel.get(), TimerWheel::get(io_context).get());
+
+    int fired = 0;
+    TimerWheel::Timer t1(wheel, [&]()
+                         { ++fired; });
+    TimerWheel::Timer t2(wheel, [&]()
+                         { ++fired; });
+    t1.expires_after(Time::Duration::binary_ms(300));
+    t2.expires_after(Time::Duration::binary_ms(600));
+    io_context.run();
+    EXPECT_EQ(fired, 2);
+}
+
+// Cancelling the last armed timer lets io_context.run() return
+TEST(timerwheel, io_context_cancel)
+{
+    openvpn_io::io_context io_context(1);
+    TimerWheel::Timer t(TimerWheel::get(io_context), []() {});
+    t.expires_after(Time::Duration::seconds(10));
+    openvpn_io::post(io_context, [&t]()
+                     { t.cancel(); });
+
+    const auto start = std::chrono::steady_clock::now();
+    io_context.run();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_FALSE(t.armed());
+}
+
+// Benchmark of re-arming many idle-connection timeouts, comparing
+// the timer wheel with one asio timer per connection.
+TEST(timerwheel, rearm_benchmark)
+{
+    const size_t n_timers = 50000;
+    const int n_rounds = 20;
+    const Time::Duration timeout = Time::Duration::seconds(60);
+
+    openvpn_io::io_context io_context(1);
+    const Time now = Time::now();
+
+    double wheel_ns;
+    {
+        TimerWheel::Ptr wheel = TimerWheel::get(io_context);
+        std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+        timers.reserve(n_timers);
+        for (size_t i = 0; i < n_timers; ++i)
+            timers.push_back(std::make_unique<TimerWheel::Timer>(wheel, []() {}));
+
+        const auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < n_rounds; ++r)
+            for (auto &t : timers)
+                t->expires_at(now + timeout + Time::Duration::seconds(r));
+        const auto end = std::chrono::steady_clock::now();
+        wheel_ns = std::chrono::duration<double, std::nano>(end - begin).count() / double(n_timers * n_rounds);
+        EXPECT_EQ(wheel->size(), n_timers);
+    }
+
+    double asio_ns;
+    {
+        std::vector<std::unique_ptr<AsioTimerSafe>> timers;
+        timers.reserve(n_timers);
+        for (size_t i = 0; i < n_timers; ++i)
+            timers.push_back(std::make_unique<AsioTimerSafe>(io_context));
+
+        const auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < n_rounds; ++r)
+            for (auto &t : timers)
+            {
+                t->expires_at(now + timeout + Time::Duration::seconds(r));
+                t->async_wait([](const openvpn_io::error_code &error) {});
+            }
+        const auto end = std::chrono::steady_clock::now();
+        asio_ns = std::chrono::duration<double, std::nano>(end - begin).count() / double(n_timers * n_rounds);
+        for (auto &t : timers)
+            t->cancel();
+    }
+    io_context.poll();
+
+    std::cout << "timer re-arm, " << n_timers << " timers: wheel " << wheel_ns << " ns, asio timer " << asio_ns << " ns" << std::endl;
+}
@@ -0,0 +1,155 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/common/sockopt.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/transport/udplink.hpp>
+
+using namespace openvpn;
+
+namespace {
+
+const size_t BURST = 200;        // datagrams sent while the receiver is not reading
+const size_t DATAGRAM_SIZE = 500;
+const int INITIAL_RCVBUF = 4096; // holds only a few datagrams
+const size_t MAX_ROUNDS = 12;
+
+class Receiver
+{
+  public:
+    typedef UDPTransport::UDPLink<Receiver *> Link;
+
+    Receiver(openvpn_io::io_context &io_context)
+        : socket(io_context),
+          stats(new SessionStats())
+    {
+        socket.open(openvpn_io::ip::udp::v4());
+        socket.bind(UDPTransport::AsioEndpoint(openvpn_io::ip::address_v4::loopback(), 0));
+        SockOpt::set_sockbuf(socket.native_handle(), SO_RCVBUF, INITIAL_RCVBUF);
+        link.reset(new Link(this, socket, (*frame_init_simple(2048))[Frame::READ_LINK_UDP], stats));
+    }
+
+    void udp_read_handler(UDPTransport::PacketFrom::SPtr &pfp)
+    {
+        ++received;
+    }
+
+    openvpn_io::ip::udp::socket socket;
+    SessionStats::Ptr stats;
+    Link::Ptr link;
+    size_t received = 0;
+};
+
+// Overrun the receiver with bursts until a burst gets through without
+// drops.  Each burst is followed by a probe datagram, as the kernel
+// reports drops with the first datagram queued after them.  Returns
+// the number of rounds with drops.
+size_t overrun(openvpn_io::io_context &io_context, Receiver &recv)
+{
+    openvpn_io::ip::udp::socket sender(io_context);
+    sender.open(openvpn_io::ip::udp::v4());
+    sender.connect(recv.socket.local_endpoint());
+    const std::vector<unsigned char> payload(DATAGRAM_SIZE, 'x');
+
+    recv.link->start(4);
+    size_t sent = 0;
+    size_t rounds_with_drops = 0;
+    for (size_t round = 0; round < MAX_ROUNDS; ++round)
+    {
+        const count_t drops_before = recv.stats->get_stat(SessionStats::UDP_RECV_DROPS);
+        for (size_t i = 0; i < BURST + 1; ++i)
+        {
+            if (i == BURST)
+            {
+                io_context.restart();
+                io_context.run_for(std::chrono::milliseconds(50));
+            }
+            sender.send(openvpn_io::buffer(payload));
+            ++sent;
+        }
+        io_context.restart();
+        io_context.run_for(std::chrono::milliseconds(50));
+
+        const count_t drops = recv.stats->get_stat(SessionStats::UDP_RECV_DROPS) - drops_before;
+        OPENVPN_LOG("round " << round << ": rcvbuf=" << SockOpt::sockbuf(recv.socket.native_handle(), SO_RCVBUF)
+                             << " drops=" << drops);
+        EXPECT_EQ(recv.received + recv.stats->get_stat(SessionStats::UDP_RECV_DROPS), sent);
+        if (!drops)
+            break;
+        ++rounds_with_drops;
+    }
+    recv.link->stop();
+    return rounds_with_drops;
+}
+
+} // namespace
+
+TEST(udpdrops, counted)
+{
+    openvpn_io::io_context io_context(1);
+    Receiver recv(io_context);
+    ASSERT_TRUE(recv.link->monitor_drops());
+
+    // without autotuning every burst overruns the receive buffer
+    EXPECT_EQ(overrun(io_context, recv), MAX_ROUNDS);
+    EXPECT_GT(recv.stats->get_stat(SessionStats::UDP_RECV_DROPS), 0u);
+    EXPECT_LT(SockOpt::sockbuf(recv.socket.native_handle(), SO_RCVBUF), 2 * INITIAL_RCVBUF + 1);
+}
+
+TEST(udpdrops, autotune_recovers)
+{
+    openvpn_io::io_context io_context(1);
+    Receiver recv(io_context);
+    ASSERT_TRUE(recv.link->monitor_drops());
+    recv.link->set_sockbuf_autotune(1024 * 1024);
+
+    // the receive buffer doubles on each round with drops, until a
+    // whole burst fits
+    const size_t rounds = overrun(io_context, recv);
+    EXPECT_GT(rounds, 0u);
+    EXPECT_LT(rounds, MAX_ROUNDS);
+    EXPECT_GT(SockOpt::sockbuf(recv.socket.native_handle(), SO_RCVBUF), 8 * INITIAL_RCVBUF);
+}
+
+TEST(udpdrops, autotune_limit)
+{
+    openvpn_io::io_context io_context(1);
+    Receiver recv(io_context);
+    ASSERT_TRUE(recv.link->monitor_drops());
+    recv.link->set_sockbuf_autotune(4 * INITIAL_RCVBUF);
+
+    EXPECT_EQ(overrun(io_context, recv), MAX_ROUNDS);
+    EXPECT_LE(SockOpt::sockbuf(recv.socket.native_handle(), SO_RCVBUF), 4 * INITIAL_RCVBUF);
+}
+
+#ifdef OPENVPN_IO_URING
+// The same with receives through io_uring, where the drop counter comes
+// from the multishot recvmsg buffers.
+TEST(udpdrops, io_uring)
+{
+    openvpn_io::io_context io_context(1);
+    IOUring::Ptr ring = IOUring::get(io_context);
+    if (!ring)
+        GTEST_SKIP() << "io_uring not available";
+
+    Receiver recv(io_context);
+    ASSERT_TRUE(recv.link->monitor_drops());
+    recv.link->use_io_uring(std::move(ring));
+    recv.link->set_sockbuf_autotune(1024 * 1024);
+
+    const size_t rounds = overrun(io_context, recv);
+    EXPECT_GT(rounds, 0u);
+    EXPECT_LT(rounds, MAX_ROUNDS);
+}
+#endif
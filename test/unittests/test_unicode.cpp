@@ -0,0 +1,267 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012- OpenVPN Inc.
+//
+//    SPDX-License-Identifier: MPL-2.0 OR AGPL-3.0-only WITH openvpn3-openssl-exception
+//
+
+#include "test_common.hpp"
+
+#include <chrono>
+#include <random>
+
+#include <openvpn/common/hexstr.hpp>
+#include <openvpn/common/unicode.hpp>
+
+using namespace openvpn;
+using namespace openvpn::Unicode;
+
+namespace {
+
+// The byte at a time implementations, without the ASCII fast path
+
+bool ref_is_valid_utf8(const std::string &str, const size_t max_len_flags)
+{
+    const unsigned char *source = (const unsigned char *)str.c_str();
+    size_t size = str.length();
+    const size_t max_len = max_len_flags & ((size_t)UTF8_NO_CTRL - 1);
+    size_t unicode_len = 0;
+    while (size)
+    {
+        const unsigned char c = *source;
+        if (c == '\0')
+            return false;
+        const int length = trailingBytesForUTF8[c] + 1;
+        if ((size_t)length > size)
+            return false;
+        if (!isLegalUTF8(source, length))
+            return false;
+        if (length == 1)
+        {
+            if ((max_len_flags & UTF8_NO_CTRL) && std::iscntrl(c))
+                return false;
+            if ((max_len_flags & UTF8_NO_SPACE) && std::isspace(c))
+                return false;
+        }
+        source += length;
+        size -= length;
+        ++unicode_len;
+        if (max_len && unicode_len > max_len)
+            return false;
+    }
+    return true;
+}
+
+std::string ref_utf8_printable(const std::string &str, size_t max_len_flags)
+{
+    std::string ret;
+    const size_t size = str.length();
+    const size_t max_len = max_len_flags & ((size_t)UTF8_FILTER - 1);
+    size_t upos = 0;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        if (!max_len || upos < max_len)
+        {
+            unsigned char c = str[pos];
+            int len = trailingBytesForUTF8[c] + 1;
+            if (pos + len <= size
+                && c >= 0x20 && c != 0x7F
+                && isLegalUTF8((const unsigned char *)&str[pos], len))
+            {
+                ret.append(str, pos, len);
+            }
+            else
+            {
+                if (c == '\r' || c == '\n' || c == '\t')
+                {
+                    if (!(max_len_flags & UTF8_PASS_FMT))
+                        c = ' ';
+                }
+                else if (max_len_flags & UTF8_FILTER)
+                    c = 0;
+                else
+                    c = '?';
+                if (c)
+                    ret += c;
+                len = 1;
+            }
+            pos += len;
+            ++upos;
+        }
+        else
+        {
+            ret.append("...");
+            break;
+        }
+    }
+    return ret;
+}
+
+const int valid_flags[] = {
+    0,
+    UTF8_NO_CTRL,
+    UTF8_NO_SPACE,
+    UTF8_NO_CTRL | UTF8_NO_SPACE,
+    1,
+    17 | UTF8_NO_CTRL,
+    40 | UTF8_NO_SPACE,
+};
+
+const int printable_flags[] = {
+    0,
+    UTF8_FILTER,
+    UTF8_PASS_FMT,
+    UTF8_FILTER | UTF8_PASS_FMT,
+    1,
+    17 | UTF8_FILTER,
+    40 | UTF8_PASS_FMT,
+};
+
+void check(const std::string &str)
+{
+    for (const int flags : valid_flags)
+        ASSERT_EQ(is_valid_utf8(str, flags), ref_is_valid_utf8(str, flags))
+            << "flags=" << std::hex << flags << " str=" << render_hex_generic(str);
+    for (const int flags : printable_flags)
+        ASSERT_EQ(utf8_printable(str, flags), ref_utf8_printable(str, flags))
+            << "flags=" << std::hex << flags << " str=" << render_hex_generic(str);
+}
+
+} // namespace
+
+TEST(unicode, ascii_run)
+{
+    std::string str(100, 'a');
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        std::string s = str;
+        s[i] = '\x80';
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), 0), i);
+        s[i] = '\0';
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), 0), s.size());
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), ASCII_STOP_NUL), i);
+        s[i] = '\x7f';
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), ASCII_STOP_NUL), s.size());
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), ASCII_STOP_CTRL), i);
+        s[i] = '\v';
+        EXPECT_EQ(ascii_run((const unsigned char *)s.c_str(), s.size(), ASCII_STOP_SPACE), i);
+    }
+}
+
+// Every string of one and two bytes
+TEST(unicode, exhaustive_short)
+{
+    for (unsigned int a = 0; a < 256; ++a)
+    {
+        check(std::string(1, char(a)));
+        for (unsigned int b = 0; b < 256; ++b)
+        {
+            const char s[2] = {char(a), char(b)};
+            check(std::string(s, 2));
+        }
+    }
+}
+
+// Every byte value, and every prefix of a few multi-byte sequences, at
+// every position of an ASCII string spanning several vector blocks
+TEST(unicode, exhaustive_position)
+{
+    const std::string ascii = "The quick brown fox jumps over the lazy dog 0123456789 THE QUICK BROWN FOX!";
+    std::vector<std::string> inserts;
+    for (unsigned int c = 0; c < 256; ++c)
+        inserts.emplace_back(1, char(c));
+    for (const std::string seq : {"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\xa0\x80", "\xc0\xaf", "\xf4\x90\x80\x80"})
+        for (size_t len = 1; len <= seq.size(); ++len)
+            inserts.push_back(seq.substr(0, len));
+
+    for (const std::string &ins : inserts)
+    {
+        for (size_t pos = 0; pos <= ascii.size(); ++pos)
+        {
+            std::string s = ascii;
+            s.insert(pos, ins);
+            check(s);
+            check(s.substr(0, pos + ins.size())); // at the end
+        }
+    }
+}
+
+TEST(unicode, random)
+{
+    std::mt19937 gen(0x5eed);
+    std::uniform_int_distribution<int> len_dist(0, 200);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+    std::uniform_int_distribution<int> ascii_dist(0x20, 0x7e);
+    std::uniform_int_distribution<int> pct(0, 99);
+    const std::vector<std::string> seqs = {"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\t", "\r\n", " "};
+
+    for (int n = 0; n < 50000; ++n)
+    {
+        const int len = len_dist(gen);
+        const int odd = pct(gen) / 10; // percent of bytes that are not printable ASCII
+        std::string s;
+        while (s.size() < size_t(len))
+        {
+            const int p = pct(gen);
+            if (p >= odd)
+                s += char(ascii_dist(gen));
+            else if (p % 2)
+                s += seqs[byte_dist(gen) % seqs.size()];
+            else
+                s += char(byte_dist(gen));
+        }
+        check(s);
+    }
+}
+
+TEST(unicode, benchmark)
+{
+    // a typical control channel message, and text with some non-ASCII
+    const std::string ascii = "PUSH_REPLY,route-gateway 10.8.0.1,topology subnet,ping 10,ping-restart 60,"
+                              "ifconfig 10.8.0.2 255.255.255.0,peer-id 0,cipher AES-256-GCM,"
+                              "dhcp-option DNS 10.8.0.1,redirect-gateway def1 bypass-dhcp,block-outside-dns";
+    std::string control;
+    while (control.size() < 4096)
+        control += ascii + ',';
+    std::string text;
+    while (text.size() < 4096)
+        text += "Grüße aus München, ça va? Prix: 10€. ";
+
+    for (const std::string *s : {&control, &text})
+    {
+        const int iterations = 2000;
+        size_t sink = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink += ref_is_valid_utf8(*s, UTF8_NO_CTRL);
+        const double ref_valid = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink += is_valid_utf8(*s, UTF8_NO_CTRL);
+        const double valid = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink += ref_utf8_printable(*s, UTF8_FILTER).size();
+        const double ref_printable = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            sink += utf8_printable(*s, UTF8_FILTER).size();
+        const double printable = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        const double bytes = double(s->size()) * iterations;
+        OPENVPN_LOG((s == &control ? "ascii" : "mixed")
+                    << ": is_valid_utf8 " << ref_valid / bytes << " -> " << valid / bytes
+                    << " ns/byte, utf8_printable " << ref_printable / bytes << " -> " << printable / bytes
+                    << " ns/byte");
+        EXPECT_GT(sink, 0u);
+    }
+}